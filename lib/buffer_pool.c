@@ -0,0 +1,126 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+#include "config.h"
+#include "common.h"
+#include "libtrace.h"
+#include "buffer_pool.h"
+#include "hugepage_arena.h"
+#include "data-struct/object_cache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/param.h>
+
+/* Classes go up in powers of two from BUFFER_POOL_MIN_SIZE to
+ * LIBTRACE_PACKET_BUFSIZE, anything larger is malloc'd on its own */
+#define BUFFER_POOL_CLASSES 9
+ct_assert((BUFFER_POOL_MIN_SIZE << (BUFFER_POOL_CLASSES - 1)) ==
+                LIBTRACE_PACKET_BUFSIZE);
+
+/* Roughly how much memory each class may keep in its shared ring, on top
+ * of what the threads have cached */
+#define BUFFER_POOL_CLASS_BYTES (1024 * 1024)
+#define BUFFER_POOL_THREAD_CACHE 16
+
+/* The ocache alloc callback takes no arguments, hence one per class */
+#define POOL_ALLOC(n) \
+        static void *pool_alloc_##n(void) { \
+                return libtrace_arena_alloc(BUFFER_POOL_MIN_SIZE << n); \
+        }
+POOL_ALLOC(0) POOL_ALLOC(1) POOL_ALLOC(2) POOL_ALLOC(3) POOL_ALLOC(4)
+POOL_ALLOC(5) POOL_ALLOC(6) POOL_ALLOC(7) POOL_ALLOC(8)
+#undef POOL_ALLOC
+
+static void *(*const pool_allocs[BUFFER_POOL_CLASSES])(void) = {
+        pool_alloc_0, pool_alloc_1, pool_alloc_2, pool_alloc_3, pool_alloc_4,
+        pool_alloc_5, pool_alloc_6, pool_alloc_7, pool_alloc_8
+};
+
+static libtrace_ocache_t pools[BUFFER_POOL_CLASSES];
+static pthread_once_t pools_once = PTHREAD_ONCE_INIT;
+static bool pools_ready = false;
+
+static void init_pools(void) {
+        size_t ring;
+        int i;
+
+        for (i = 0; i < BUFFER_POOL_CLASSES; i++) {
+                ring = BUFFER_POOL_CLASS_BYTES / (BUFFER_POOL_MIN_SIZE << i);
+                if (ring < BUFFER_POOL_THREAD_CACHE)
+                        ring = BUFFER_POOL_THREAD_CACHE;
+                /* The pool is never limited, when it is full buffers
+                 * are simply freed */
+                if (libtrace_ocache_init(&pools[i], pool_allocs[i],
+                                libtrace_arena_free,
+                                BUFFER_POOL_THREAD_CACHE, ring, false) != 0) {
+                        while (--i >= 0)
+                                libtrace_ocache_destroy(&pools[i]);
+                        return;
+                }
+        }
+        pools_ready = true;
+}
+
+/* Returns the smallest class that fits size, or -1 if none do */
+static inline int pool_class(size_t size) {
+        int i;
+
+        for (i = 0; i < BUFFER_POOL_CLASSES; i++) {
+                if (size <= ((size_t)BUFFER_POOL_MIN_SIZE << i))
+                        return i;
+        }
+        return -1;
+}
+
+void *libtrace_buffer_pool_alloc(size_t size, uint32_t *capacity) {
+        void *buffer;
+        int class;
+
+        pthread_once(&pools_once, init_pools);
+        class = pool_class(size);
+        if (!pools_ready || class < 0) {
+                /* Not pooled, so it must be usable as a full packet buffer
+                 * like any other buffer libtrace owns */
+                *capacity = 0;
+                return malloc(MAX(size, LIBTRACE_PACKET_BUFSIZE));
+        }
+
+        if (libtrace_ocache_alloc(&pools[class], &buffer, 1, 1) != 1)
+                return NULL;
+        *capacity = BUFFER_POOL_MIN_SIZE << class;
+        return buffer;
+}
+
+void libtrace_buffer_pool_free(void *buffer, uint32_t capacity) {
+        int class = pool_class(capacity);
+
+        if (!pools_ready || capacity == 0 || class < 0 ||
+                        ((uint32_t)BUFFER_POOL_MIN_SIZE << class) != capacity) {
+                libtrace_arena_free(buffer);
+                return;
+        }
+        libtrace_ocache_free(&pools[class], &buffer, 1, 1);
+}
@@ -0,0 +1,62 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Pool of packet buffers used when libtrace has to copy a packet
+ *
+ * Buffers are grouped into size classes, so a copy only takes as much
+ * memory as the packet needs, and each class is an object cache with a
+ * small per-thread cache in front of it. Buffers come from the huge page
+ * arena once it is enabled, so they must only be released through
+ * libtrace_buffer_pool_free().
+ */
+
+/** The smallest buffer handed out by the pool */
+#define BUFFER_POOL_MIN_SIZE 256
+
+/** Takes a buffer of at least 'size' bytes from the pool
+ *
+ * @param size		The number of bytes needed
+ * @param[out] capacity	Set to the size of the buffer returned, which must
+ * 			be passed back to libtrace_buffer_pool_free()
+ * @return the buffer, or NULL if no memory could be allocated
+ */
+void *libtrace_buffer_pool_alloc(size_t size, uint32_t *capacity);
+
+/** Returns a buffer to the pool
+ *
+ * @param buffer	A buffer from libtrace_buffer_pool_alloc()
+ * @param capacity	The capacity it was allocated with
+ */
+void libtrace_buffer_pool_free(void *buffer, uint32_t capacity);
+
+#endif
@@ -26,24 +26,26 @@
 #ifndef LIBTRACE_BUCKET_H_
 #define LIBTRACE_BUCKET_H_
 
-#include <pthread.h>
-#include "linked_list.h"
+#include <stdint.h>
+#include "libtrace.h"
 
+/* A bucket tracks which buffers still have packets pointing into them, so
+ * each buffer can be freed as soon as the last of its packets is released.
+ *
+ * Packets are pushed into the bucket only by the thread reading the trace,
+ * but may be released from any thread. Neither needs a lock: every buffer
+ * has an atomic count of the references held on it, one for each packet
+ * plus one while it is still the buffer being read into, and whoever drops
+ * the last reference frees it.
+ */
 typedef struct bucket_node {
-        uint64_t startindex;
-        uint8_t *released;
-        uint16_t activemembers;
-        uint16_t slots;
+        uint32_t refs;
         void *buffer;
 } libtrace_bucket_node_t;
 
 typedef struct buckets {
-        uint64_t nextid;
+        /* The buffer currently being read into */
         libtrace_bucket_node_t *node;
-        libtrace_bucket_node_t **packets;
-        libtrace_list_t *nodelist;
-        pthread_mutex_t lock;
-        pthread_cond_t cond;
 } libtrace_bucket_t;
 
 libtrace_bucket_t *libtrace_bucket_init(void);
@@ -25,6 +25,8 @@
  */
 #include "config.h"
 #include "object_cache.h"
+#include "numa_topology.h"
+#include "hugepage_arena.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,6 +39,7 @@
 // been zeroed by the time the pthread destructor is called.
 struct local_cache {
 	libtrace_ocache_t *oc;
+	libtrace_ringbuffer_t *rb;
 	size_t total;
 	size_t used;
 	void **cache;
@@ -62,6 +65,19 @@ struct local_caches {
 	struct local_cache *t_mem_caches;
 };
 
+/* Returns the ring that objects are recycled through on a NUMA node */
+static inline libtrace_ringbuffer_t *node_ring(libtrace_ocache_t *oc, int node) {
+	if (node <= 0 || (size_t) node >= oc->nb_nodes)
+		return &oc->rb;
+	return &oc->node_rbs[node - 1];
+}
+
+static inline libtrace_ringbuffer_t *local_ring(libtrace_ocache_t *oc) {
+	if (oc->nb_nodes <= 1)
+		return &oc->rb;
+	return node_ring(oc, libtrace_numa_current_node());
+}
+
 static pthread_key_t memory_destructor_key;
 static pthread_once_t memory_destructor_once = PTHREAD_ONCE_INIT;
 static inline struct local_caches *get_local_caches();
@@ -93,7 +109,7 @@ static inline void unregister_thread(struct local_cache *lc) {
 	lc->invalid = true;
 
 	if (lc->oc->max_allocations) {
-		libtrace_ringbuffer_swrite_bulk(&lc->oc->rb, lc->cache, lc->used, lc->used);
+		libtrace_ringbuffer_swrite_bulk(lc->rb, lc->cache, lc->used, lc->used);
 	} else {
 		size_t i;
 		// We just run the free these
@@ -126,7 +142,7 @@ static void destroy_memory_caches(void *tlsaddr) {
 	for (a = 0; a < lcs->t_mem_caches_used; ++a) {
 		unregister_thread(&lcs->t_mem_caches[a]);
 		// Write these all back to the main buffer, this might have issues we would want to free these
-		free(lcs->t_mem_caches[a].cache);
+		libtrace_arena_free(lcs->t_mem_caches[a].cache);
 	}
 	free(lcs->t_mem_caches);
 	lcs->t_mem_caches = NULL;
@@ -134,6 +150,23 @@ static void destroy_memory_caches(void *tlsaddr) {
 
 }
 
+/**
+ * The ocache keeps a pointer to each thread's local_cache, so when one is
+ * moved within the thread's list the ocache must be told where it went
+ */
+static void move_thread_cache(struct local_cache *from, struct local_cache *to) {
+	size_t i;
+
+	pthread_spin_lock(&to->oc->spin);
+	for (i = 0; i < to->oc->nb_thread_list; ++i) {
+		if (to->oc->thread_list[i] == from) {
+			to->oc->thread_list[i] = to;
+			break;
+		}
+	}
+	pthread_spin_unlock(&to->oc->spin);
+}
+
 static void once_memory_cache_key_init() {
 	ASSERT_RET(pthread_key_create(&memory_destructor_key, &destroy_memory_caches), == 0);
 }
@@ -142,13 +175,27 @@ static void once_memory_cache_key_init() {
  * Adds more space to our mem_caches
  */
 static void resize_memory_caches(struct local_caches *lcs) {
+	struct local_cache *caches;
+	size_t i;
+
 	if (lcs->t_mem_caches_total <= 0) {
 		fprintf(stderr, "Expected lcs->t_mem_caches_total to be greater or equal to 0 in resize_memory_caches()\n");
 		return;
 	}
-	lcs->t_mem_caches += 0x10;
-	lcs->t_mem_caches = realloc(lcs->t_mem_caches,
-	                            lcs->t_mem_caches_total * sizeof(struct local_cache));
+	// Not realloc, the old caches are needed to find them in the ocaches
+	caches = calloc(lcs->t_mem_caches_total + 0x10, sizeof(struct local_cache));
+	if (!caches) {
+		fprintf(stderr, "Unable to allocate memory for lcs->t_mem_caches in resize_memory_caches()\n");
+		return;
+	}
+	memcpy(caches, lcs->t_mem_caches, lcs->t_mem_caches_used * sizeof(struct local_cache));
+	for (i = 0; i < lcs->t_mem_caches_used; ++i) {
+		if (!caches[i].invalid)
+			move_thread_cache(&lcs->t_mem_caches[i], &caches[i]);
+	}
+	free(lcs->t_mem_caches);
+	lcs->t_mem_caches = caches;
+	lcs->t_mem_caches_total += 0x10;
 }
 
 /* Get TLS for the list of local_caches */
@@ -209,10 +256,18 @@ static inline struct local_cache * find_cache(libtrace_ocache_t *oc) {
 	if (!lc) {
 		if (lcs->t_mem_caches_used == lcs->t_mem_caches_total)
 			resize_memory_caches(lcs);
+		if (lcs->t_mem_caches_used == lcs->t_mem_caches_total)
+			return NULL;
 		lcs->t_mem_caches[lcs->t_mem_caches_used].oc = oc;
+		// Stick with the node the thread started on
+		lcs->t_mem_caches[lcs->t_mem_caches_used].rb = local_ring(oc);
 		lcs->t_mem_caches[lcs->t_mem_caches_used].used = 0;
 		lcs->t_mem_caches[lcs->t_mem_caches_used].total = oc->thread_cache_size;
-		lcs->t_mem_caches[lcs->t_mem_caches_used].cache = malloc(sizeof(void*) * oc->thread_cache_size);
+		lcs->t_mem_caches[lcs->t_mem_caches_used].cache = libtrace_arena_alloc(sizeof(void*) * oc->thread_cache_size);
+		if (oc->nb_nodes > 1)
+			libtrace_numa_place(lcs->t_mem_caches[lcs->t_mem_caches_used].cache,
+			                    sizeof(void*) * oc->thread_cache_size,
+			                    libtrace_numa_current_node());
 		lcs->t_mem_caches[lcs->t_mem_caches_used].invalid = false;
 		lc = &lcs->t_mem_caches[lcs->t_mem_caches_used];
 		// Register it with the underlying ring_buffer
@@ -252,6 +307,8 @@ static inline struct local_cache * find_cache(libtrace_ocache_t *oc) {
   * @param limit_size If true no more objects than buffer_size will be allocated,
   *		reads will block (free never should).Otherwise packets can be freely
   *     allocated upon requested and are free'd if there is not enough space for them.
+  *     Unlimited caches get a buffer of buffer_size for every NUMA node, and
+  *     threads only reuse objects that were free'd on their own node.
   * @return If successful returns 0 otherwise -1.
   */
 DLLEXPORT int libtrace_ocache_init(libtrace_ocache_t *oc, void *(*alloc)(void),
@@ -285,6 +342,30 @@ DLLEXPORT int libtrace_ocache_init(libtrace_ocache_t *oc, void *(*alloc)(void),
 		libtrace_ringbuffer_destroy(&oc->rb);
 		return -1;
 	}
+	oc->node_rbs = NULL;
+	oc->nb_nodes = 1;
+	// A limited cache has to share its objects between all nodes
+	if (!limit_size && libtrace_numa_nodes() > 1) {
+		size_t n, nodes = libtrace_numa_nodes();
+
+		oc->node_rbs = calloc(nodes - 1, sizeof(libtrace_ringbuffer_t));
+		for (n = 0; oc->node_rbs && n < nodes - 1; ++n) {
+			if (libtrace_ringbuffer_init(&oc->node_rbs[n], buffer_size,
+			                             LIBTRACE_RINGBUFFER_BLOCKING) != 0)
+				break;
+			libtrace_numa_place((void *) oc->node_rbs[n].elements,
+			                    sizeof(void*) * oc->node_rbs[n].size, n + 1);
+		}
+		if (!oc->node_rbs || n != nodes - 1) {
+			while (oc->node_rbs && n--)
+				libtrace_ringbuffer_destroy(&oc->node_rbs[n]);
+			free(oc->node_rbs);
+			free(oc->thread_list);
+			libtrace_ringbuffer_destroy(&oc->rb);
+			return -1;
+		}
+		oc->nb_nodes = nodes;
+	}
 	pthread_spin_init(&oc->spin, 0);
 	if (limit_size)
 		oc->max_allocations = buffer_size;
@@ -304,21 +385,27 @@ DLLEXPORT int libtrace_ocache_init(libtrace_ocache_t *oc, void *(*alloc)(void),
   */
 DLLEXPORT int libtrace_ocache_destroy(libtrace_ocache_t *oc) {
 	void *ele;
+	size_t n;
 
 	while (oc->nb_thread_list)
 		unregister_thread(oc->thread_list[0]);
 
 	pthread_spin_lock(&oc->spin);
-	while (libtrace_ringbuffer_try_read(&oc->rb, &ele)) {
-		oc->free(ele);
-		if (oc->max_allocations)
-			--oc->current_allocations;
+	for (n = 0; n < MAX(oc->nb_nodes, 1); ++n) {
+		while (libtrace_ringbuffer_try_read(node_ring(oc, n), &ele)) {
+			oc->free(ele);
+			if (oc->max_allocations)
+				--oc->current_allocations;
+		}
 	}
 	pthread_spin_unlock(&oc->spin);
 
 	if (oc->current_allocations)
 		fprintf(stderr, "OCache destroyed, leaking %d packets!!\n", (int) oc->current_allocations);
 
+	for (n = 1; n < oc->nb_nodes; ++n)
+		libtrace_ringbuffer_destroy(&oc->node_rbs[n - 1]);
+	free(oc->node_rbs);
 	libtrace_ringbuffer_destroy(&oc->rb);
 	pthread_spin_destroy(&oc->spin);
 	free(oc->thread_list);
@@ -329,9 +416,9 @@ DLLEXPORT int libtrace_ocache_destroy(libtrace_ocache_t *oc) {
 		return 0;
 }
 
-static inline size_t libtrace_ocache_alloc_cache(libtrace_ocache_t *oc, void *values[], size_t nb_buffers, size_t min_nb_buffers,
+static inline size_t libtrace_ocache_alloc_cache(libtrace_ocache_t *oc UNUSED, void *values[], size_t nb_buffers, size_t min_nb_buffers,
 										 struct local_cache *lc) {
-	libtrace_ringbuffer_t *rb = &oc->rb;
+	libtrace_ringbuffer_t *rb = lc->rb;
 	size_t i;
 
 	// We have enough cached!! Yay
@@ -412,7 +499,7 @@ DLLEXPORT size_t libtrace_ocache_alloc(libtrace_ocache_t *oc, void *values[], si
 	if (lc)
 		i = libtrace_ocache_alloc_cache(oc, values, nb_buffers, min,  lc);
 	else
-		i = libtrace_ringbuffer_sread_bulk(&oc->rb, values, nb_buffers, min);
+		i = libtrace_ringbuffer_sread_bulk(local_ring(oc), values, nb_buffers, min);
 
 	if (try_alloc) {
 		size_t nb;
@@ -445,7 +532,7 @@ DLLEXPORT size_t libtrace_ocache_alloc(libtrace_ocache_t *oc, void *values[], si
 			if (lc)
 				i += libtrace_ocache_alloc_cache(oc, &values[nb], nb_buffers - nb, min_nb_buffers - nb, lc);
 			else
-				i += libtrace_ringbuffer_sread_bulk(&oc->rb, &values[nb], nb_buffers - nb, min_nb_buffers - nb);
+				i += libtrace_ringbuffer_sread_bulk(local_ring(oc), &values[nb], nb_buffers - nb, min_nb_buffers - nb);
 		}
 	}
 	if (i < min_nb_buffers) {
@@ -457,9 +544,9 @@ DLLEXPORT size_t libtrace_ocache_alloc(libtrace_ocache_t *oc, void *values[], si
 }
 
 
-static inline size_t libtrace_ocache_free_cache(libtrace_ocache_t *oc, void *values[], size_t nb_buffers, size_t min_nb_buffers,
+static inline size_t libtrace_ocache_free_cache(libtrace_ocache_t *oc UNUSED, void *values[], size_t nb_buffers, size_t min_nb_buffers,
 											struct local_cache *lc) {
-	libtrace_ringbuffer_t *rb = &oc->rb;
+	libtrace_ringbuffer_t *rb = lc->rb;
 	size_t i;
 
 	// We have enough cached!! Yay
@@ -540,7 +627,7 @@ DLLEXPORT size_t libtrace_ocache_free(libtrace_ocache_t *oc, void *values[], siz
 	if (lc)
 		i = libtrace_ocache_free_cache(oc, values, nb_buffers, min, lc);
 	else
-		i = libtrace_ringbuffer_swrite_bulk(&oc->rb, values, nb_buffers, min);
+		i = libtrace_ringbuffer_swrite_bulk(local_ring(oc), values, nb_buffers, min);
 
 	if (!oc->max_allocations) {
 		// Free these normally
@@ -553,6 +640,8 @@ DLLEXPORT size_t libtrace_ocache_free(libtrace_ocache_t *oc, void *values[], siz
 
 DLLEXPORT void libtrace_zero_ocache(libtrace_ocache_t *oc) {
 	libtrace_zero_ringbuffer(&oc->rb);
+	oc->node_rbs = NULL;
+	oc->nb_nodes = 0;
 	oc->thread_cache_size = 0;
 	oc->alloc = NULL;
 	oc->free = NULL;
@@ -577,11 +666,17 @@ DLLEXPORT void libtrace_ocache_unregister_thread(libtrace_ocache_t *oc) {
 			if (&lcs->t_mem_caches[i] == lc) {
 				// Free the cache against the ocache
 				unregister_thread(&lcs->t_mem_caches[i]);
-				free(lcs->t_mem_caches[i].cache);
+				libtrace_arena_free(lcs->t_mem_caches[i].cache);
 				// And remove it from the thread itself
 				--lcs->t_mem_caches_used;
-				lcs->t_mem_caches[i] = lcs->t_mem_caches[lcs->t_mem_caches_used];
+				if (i != lcs->t_mem_caches_used) {
+					lcs->t_mem_caches[i] = lcs->t_mem_caches[lcs->t_mem_caches_used];
+					if (!lcs->t_mem_caches[i].invalid)
+						move_thread_cache(&lcs->t_mem_caches[lcs->t_mem_caches_used],
+						                  &lcs->t_mem_caches[i]);
+				}
 				memset(&lcs->t_mem_caches[lcs->t_mem_caches_used], 0, sizeof(struct local_cache));
+				break;
 			}
 		}
 	}
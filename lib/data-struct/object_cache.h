@@ -33,6 +33,11 @@
 struct local_cache;
 typedef struct libtrace_ocache {
 	libtrace_ringbuffer_t rb;
+	/* Unlimited caches on NUMA systems keep a ring per node, so objects
+	 * are reused by threads on the node that freed them. rb is the ring
+	 * for node 0 and node_rbs holds the rest. */
+	libtrace_ringbuffer_t *node_rbs;
+	size_t nb_nodes;
 	void *(*alloc)(void);
 	void (*free)(void *);
 	size_t thread_cache_size;
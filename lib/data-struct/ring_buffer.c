@@ -28,6 +28,7 @@
  */
 
 #include "ring_buffer.h"
+#include "hugepage_arena.h"
 
 #include <stdlib.h>
 #include <assert.h>
@@ -80,7 +81,7 @@ DLLEXPORT int libtrace_ringbuffer_init(libtrace_ringbuffer_t * rb, size_t size,
 	rb->size = size;
 	rb->start = 0;
 	rb->end = 0;
-	rb->elements = calloc(rb->size, sizeof(void*));
+	rb->elements = libtrace_arena_calloc(rb->size, sizeof(void*));
 	if (!rb->elements)
 		return -1;
 	rb->mode = mode;
@@ -124,7 +125,7 @@ DLLEXPORT void libtrace_ringbuffer_destroy(libtrace_ringbuffer_t * rb) {
 	rb->size = 0;
 	rb->start = 0;
 	rb->end = 0;
-	free((void *)rb->elements);
+	libtrace_arena_free((void *)rb->elements);
 	rb->elements = NULL;
 }
 
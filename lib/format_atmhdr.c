@@ -95,7 +95,7 @@ static int atmhdr_prepare_packet(libtrace_t *libtrace,
 	 * avoid leaking memory */
 	if (packet->buffer != buffer &&
                         packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
 	/* Set the buffer owner appropriately */
@@ -203,6 +203,7 @@ static struct libtrace_format_t atmhdr = {
 	NULL,                           /* fin_packet */
         NULL,                           /* can_hold_packet */
         NULL,                           /* write_packet */
+        NULL,                           /* write_packets */
         NULL,                           /* flush_output */
         atmhdr_get_link_type,        	/* get_link_type */
         NULL,                           /* get_direction */
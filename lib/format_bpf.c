@@ -384,6 +384,9 @@ static int bpf_config_input(libtrace_t *libtrace,
 		case TRACE_OPTION_XDP_HARDWARE_OFFLOAD:
 		case TRACE_OPTION_XDP_ZERO_COPY_MODE:
 		case TRACE_OPTION_XDP_COPY_MODE:
+		case TRACE_OPTION_RING_BLOCK_MODE:
+		case TRACE_OPTION_SAMPLE_RATE:
+		case TRACE_OPTION_FLOW_SAMPLE_RATE:
 		case TRACE_OPTION_XDP_DRV_MODE:
 		case TRACE_OPTION_XDP_SKB_MODE:
 			break;
@@ -412,7 +415,7 @@ static int bpf_prepare_packet(libtrace_t *libtrace UNUSED,
 	 * old one to avoid memory leaks */
 	if (packet->buffer != buffer &&
                         packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
 	/* Set the buffer owner appropriately */
@@ -521,7 +524,7 @@ static int bpf_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
 	flags |= TRACE_PREP_DO_NOT_OWN_BUFFER;
 
 	if (packet->buffer && packet->buf_control == TRACE_CTRL_PACKET)
-		free(packet->buffer);
+		trace_free_packet_buffer(packet);
 
 	/* Update 'packet' to point to the first packet in our capture
 	 * buffer */
@@ -632,6 +635,7 @@ static struct libtrace_format_t bpf = {
 	NULL,			/* fin_packet */
         NULL,                   /* can_hold_packet */
 	NULL,			/* write_packet */
+	NULL,			/* write_packets */
 	NULL,			/* flush_output */
 	bpf_get_link_type,	/* get_link_type */
 	bpf_get_direction,	/* get_direction */
@@ -685,6 +689,7 @@ static struct libtrace_format_t bpf = {
 	NULL,			/* fin_packet */
         NULL,                   /* can_hold_packet */
 	NULL,			/* write_packet */
+	NULL,			/* write_packets */
 	NULL,			/* flush_output */
 	bpf_get_link_type,	/* get_link_type */
 	bpf_get_direction,	/* get_direction */
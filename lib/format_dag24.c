@@ -242,6 +242,9 @@ static int dag_config_input(libtrace_t *libtrace, trace_option_t option,
 		case TRACE_OPTION_XDP_DRV_MODE:
 		case TRACE_OPTION_XDP_ZERO_COPY_MODE:
 		case TRACE_OPTION_XDP_COPY_MODE:
+		case TRACE_OPTION_RING_BLOCK_MODE:
+		case TRACE_OPTION_SAMPLE_RATE:
+		case TRACE_OPTION_FLOW_SAMPLE_RATE:
 			return -1;
         }
 	return -1;
@@ -359,7 +362,7 @@ static int dag_prepare_packet(libtrace_t *libtrace, libtrace_packet_t *packet,
          * old one to avoid memory leaks */
         if (packet->buffer != buffer &&
                         packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
 	/* Set the buffer owner appropriately */
@@ -425,8 +428,7 @@ static int dag_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet) {
 	 * that we can set the packet to point into the DAG memory hole */
 	if (packet->buf_control == TRACE_CTRL_PACKET) {
                 packet->buf_control = TRACE_CTRL_EXTERNAL;
-                free(packet->buffer);
-                packet->buffer = 0;
+                trace_free_packet_buffer(packet);
         }
 
 	/* Grab a full ERF record */
@@ -543,6 +545,7 @@ static struct libtrace_format_t dag = {
 	NULL,                           /* fin_packet */
         NULL,                           /* can_hold_packet */
         NULL,                           /* write_packet */
+        NULL,                           /* write_packets */
         NULL,                           /* flush_output */
         erf_get_link_type,              /* get_link_type */
         erf_get_direction,              /* get_direction */
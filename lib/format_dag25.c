@@ -650,6 +650,9 @@ static int dag_config_input(libtrace_t *libtrace, trace_option_t option,
         case TRACE_OPTION_XDP_DRV_MODE:
         case TRACE_OPTION_XDP_ZERO_COPY_MODE:
         case TRACE_OPTION_XDP_COPY_MODE:
+        case TRACE_OPTION_RING_BLOCK_MODE:
+        case TRACE_OPTION_SAMPLE_RATE:
+        case TRACE_OPTION_FLOW_SAMPLE_RATE:
             return -1;
 	}
 	return -1;
@@ -1132,7 +1135,7 @@ static int dag_prepare_packet_stream(libtrace_t *libtrace,
 	 * old one to avoid memory leaks */
 	if (packet->buffer != buffer &&
 	    packet->buf_control == TRACE_CTRL_PACKET) {
-		free(packet->buffer);
+		trace_free_packet_buffer(packet);
 	}
 
 	/* Set the buffer owner appropriately */
@@ -1394,8 +1397,7 @@ static int dag_read_packet_stream(libtrace_t *libtrace,
 	/* If the packet buffer is currently owned by libtrace, free it so
 	 * that we can set the packet to point into the DAG memory hole */
 	if (packet->buf_control == TRACE_CTRL_PACKET) {
-		free(packet->buffer);
-		packet->buffer = 0;
+		trace_free_packet_buffer(packet);
 	}
 
 	if (dag_set_stream_poll64(FORMAT_DATA->device->fd, stream_data->dagstream,
@@ -1700,6 +1702,7 @@ static struct libtrace_format_t dag = {
 	NULL,                           /* fin_packet */
         NULL,                           /* can_hold_packet */
 	dag_write_packet,               /* write_packet */
+	NULL,                           /* write_packets */
 	dag_flush_output,               /* flush_output */
 	erf_get_link_type,              /* get_link_type */
 	erf_get_direction,              /* get_direction */
@@ -127,6 +127,14 @@ struct dpdk_format_data_t {
         int burst_offset;          /* The offset we are into the burst */
         enum device_type dev_type; /* The type of DPDK device vdev vs. PCI */
 
+        /* Packets waiting to be sent with a single tx burst - TX only */
+        pthread_mutex_t tx_lock; /* Held while tx_pkts is filled or sent */
+        struct rte_mbuf *tx_pkts[BURST_SIZE];
+        int tx_count;     /* The number of packets waiting */
+        int tx_max_queue; /* Send once this many packets are waiting */
+        /* The next started output in dpdk_tx_outputs */
+        struct dpdk_format_data_t *tx_next;
+
         /* Our parallel streams */
         libtrace_list_t *per_stream;
 };
@@ -913,6 +921,8 @@ static int dpdk_init_input(libtrace_t *libtrace, enum device_type dev_type)
         FORMAT(libtrace)->hasher_type = HASHER_BALANCE;
         FORMAT(libtrace)->rss_key = NULL;
         FORMAT(libtrace)->dev_type = dev_type;
+        FORMAT(libtrace)->tx_count = 0;
+        FORMAT(libtrace)->tx_max_queue = 1;
 
         /* Make our first stream */
         FORMAT(libtrace)->per_stream = libtrace_list_init_aligned(
@@ -939,10 +949,73 @@ int dpdk_init_input_vdev(libtrace_t *libtrace)
         return dpdk_init_input(libtrace, VDEV_DEVICE);
 }
 
+/* Every started dpdk: output, so a reading thread can send the packets it
+ * queued while processing its last burst. Protected by dpdk_tx_outputs_lock */
+static struct dpdk_format_data_t *dpdk_tx_outputs = NULL;
+static pthread_mutex_t dpdk_tx_outputs_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Set once this thread has left packets waiting on an output */
+static __thread bool dpdk_tx_queued = false;
+
+/* Sends every packet waiting on the output, tx_lock must be held */
+static void dpdk_flush_tx(struct dpdk_format_data_t *format_data)
+{
+        int sent = 0;
+
+        while (sent < format_data->tx_count) {
+                sent += rte_eth_tx_burst(format_data->port, 0 /*queue TODO*/,
+                                         &format_data->tx_pkts[sent],
+                                         format_data->tx_count - sent);
+        }
+        format_data->tx_count = 0;
+}
+
+/* Sends the packets this thread queued while processing its last burst,
+ * called before reading the next one */
+static void dpdk_flush_queued_tx(void)
+{
+        struct dpdk_format_data_t *format_data;
+
+        if (!dpdk_tx_queued)
+                return;
+        dpdk_tx_queued = false;
+
+        pthread_mutex_lock(&dpdk_tx_outputs_lock);
+        for (format_data = dpdk_tx_outputs; format_data != NULL;
+             format_data = format_data->tx_next) {
+                pthread_mutex_lock(&format_data->tx_lock);
+                if (format_data->tx_count > 0)
+                        dpdk_flush_tx(format_data);
+                pthread_mutex_unlock(&format_data->tx_lock);
+        }
+        pthread_mutex_unlock(&dpdk_tx_outputs_lock);
+}
+
+static void dpdk_remove_tx_output(struct dpdk_format_data_t *format_data)
+{
+        struct dpdk_format_data_t **prev;
+
+        pthread_mutex_lock(&dpdk_tx_outputs_lock);
+        for (prev = &dpdk_tx_outputs; *prev != NULL;
+             prev = &(*prev)->tx_next) {
+                if (*prev == format_data) {
+                        *prev = format_data->tx_next;
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&dpdk_tx_outputs_lock);
+}
+
 static int dpdk_fin_output(libtrace_out_t *libtrace)
 {
         /* Free our memory structures */
         if (libtrace->format_data != NULL) {
+                /* Stop reading threads from flushing us */
+                dpdk_remove_tx_output(FORMAT(libtrace));
+                /* Send anything still waiting */
+                pthread_mutex_lock(&FORMAT(libtrace)->tx_lock);
+                if (FORMAT(libtrace)->paused == DPDK_RUNNING)
+                        dpdk_flush_tx(FORMAT(libtrace));
+                pthread_mutex_unlock(&FORMAT(libtrace)->tx_lock);
                 /* Close the device completely, device cannot be restarted */
                 if (FORMAT(libtrace)->port != RTE_MAX_ETHPORTS &&
                     FORMAT(libtrace)->paused != DPDK_NEVER_STARTED) {
@@ -950,6 +1023,7 @@ static int dpdk_fin_output(libtrace_out_t *libtrace)
                         dpdk_close_and_detach_device(FORMAT(libtrace)->port);
                 }
                 libtrace_list_deinit(FORMAT(libtrace)->per_stream);
+                pthread_mutex_destroy(&FORMAT(libtrace)->tx_lock);
                 /* filter here if we used it */
                 free(libtrace->format_data);
                 libtrace->format_data = NULL;
@@ -990,6 +1064,9 @@ static int dpdk_init_output(libtrace_out_t *libtrace, enum device_type dev_type)
         FORMAT(libtrace)->burst_size = 0;
         FORMAT(libtrace)->burst_offset = 0;
         FORMAT(libtrace)->dev_type = dev_type;
+        pthread_mutex_init(&FORMAT(libtrace)->tx_lock, NULL);
+        FORMAT(libtrace)->tx_count = 0;
+        FORMAT(libtrace)->tx_max_queue = 1;
 
         FORMAT(libtrace)->per_stream = libtrace_list_init_aligned(
             sizeof(struct dpdk_per_stream_t), CACHE_LINE_SIZE);
@@ -1068,6 +1145,9 @@ int dpdk_config_input(libtrace_t *libtrace, trace_option_t option, void *data)
         case TRACE_OPTION_XDP_DRV_MODE:
         case TRACE_OPTION_XDP_ZERO_COPY_MODE:
         case TRACE_OPTION_XDP_COPY_MODE:
+        case TRACE_OPTION_RING_BLOCK_MODE:
+        case TRACE_OPTION_SAMPLE_RATE:
+        case TRACE_OPTION_FLOW_SAMPLE_RATE:
                 break;
                 /* Avoid default: so that future options will cause a warning
                  * here to remind us to implement it, or flag it as
@@ -2058,6 +2138,11 @@ static int dpdk_start_output(libtrace_out_t *libtrace)
                 dpdk_fin_output(libtrace);
                 return -1;
         }
+
+        pthread_mutex_lock(&dpdk_tx_outputs_lock);
+        FORMAT(libtrace)->tx_next = dpdk_tx_outputs;
+        dpdk_tx_outputs = FORMAT(libtrace);
+        pthread_mutex_unlock(&dpdk_tx_outputs_lock);
         return 0;
 }
 
@@ -2094,16 +2179,63 @@ int dpdk_pause_input(libtrace_t *libtrace)
         return 0;
 }
 
-static int dpdk_write_packet(libtrace_out_t *trace, libtrace_packet_t *packet)
+/* Gets an mbuf to transmit a packet from. Packets read by a DPDK input are
+ * sent from the mbuf they were received into, anything else is copied into
+ * a new mbuf */
+static struct rte_mbuf *dpdk_get_tx_mbuf(libtrace_out_t *trace,
+                                         libtrace_packet_t *packet, int caplen)
 {
-
-        /* Check dpdk can write this type of packet */
-        if (!dpdk_can_write(packet)) {
-                return 0;
+        struct rte_mbuf *m;
+        char *mbuf_dst;
+        long offset;
+
+        if (packet->type == TRACE_RT_DATA_DPDK &&
+            packet->buf_control == TRACE_CTRL_EXTERNAL && packet->trace &&
+            packet->trace->format->type == TRACE_FORMAT_DPDK) {
+                m = MBUF(packet->buffer);
+                offset = (char *)packet->payload - rte_pktmbuf_mtod(m, char *);
+                if (m->nb_segs == 1 && offset >= 0 &&
+                    offset + caplen <= rte_pktmbuf_data_len(m)) {
+                        if (offset == 0 &&
+                            caplen == rte_pktmbuf_data_len(m)) {
+                                /* The driver frees the mbuf once it is
+                                 * sent, our reference stays with the
+                                 * packet */
+                                rte_mbuf_refcnt_update(m, 1);
+                                return m;
+                        }
+                        /* Send just the captured bytes with a clone that
+                         * shares the packet data */
+                        m = rte_pktmbuf_clone(m, FORMAT(trace)->pktmbuf_pool);
+                        if (m != NULL) {
+                                rte_pktmbuf_adj(m, offset);
+                                rte_pktmbuf_trim(m, rte_pktmbuf_data_len(m) -
+                                                        caplen);
+                                return m;
+                        }
+                }
         }
 
-        struct rte_mbuf *m_buff[1];
+        m = rte_pktmbuf_alloc(FORMAT(trace)->pktmbuf_pool);
+        if (m == NULL) {
+                trace_set_err_out(trace, TRACE_ERR_OUT_OF_MEMORY,
+                                  "Cannot get an empty packet buffer");
+                return NULL;
+        }
+        mbuf_dst = rte_pktmbuf_append(m, caplen);
+        if (mbuf_dst == NULL) {
+                rte_pktmbuf_free(m);
+                trace_set_err_out(trace, TRACE_ERR_NO_CONVERSION,
+                                  "Packet too large");
+                return NULL;
+        }
+        memcpy(mbuf_dst, packet->payload, caplen);
+        return m;
+}
 
+/* Returns the number of bytes of a packet to transmit */
+static int dpdk_get_tx_length(libtrace_packet_t *packet)
+{
         int wirelen = trace_get_wire_length(packet);
         int caplen = trace_get_capture_length(packet);
 
@@ -2111,31 +2243,94 @@ static int dpdk_write_packet(libtrace_out_t *trace, libtrace_packet_t *packet)
         if (trace_get_link_type(packet) == TRACE_TYPE_ETH && wirelen == caplen)
                 caplen -= RTE_ETHER_CRC_LEN;
 
-        m_buff[0] = rte_pktmbuf_alloc(FORMAT(trace)->pktmbuf_pool);
-        if (m_buff[0] == NULL) {
-                trace_set_err_out(trace, TRACE_ERR_OUT_OF_MEMORY,
-                                  "Cannot get an empty packet buffer");
+        return caplen;
+}
+
+static int dpdk_write_packet(libtrace_out_t *trace, libtrace_packet_t *packet)
+{
+        struct dpdk_format_data_t *format_data = FORMAT(trace);
+        struct rte_mbuf *m;
+        int caplen;
+
+        /* Check dpdk can write this type of packet */
+        if (!dpdk_can_write(packet)) {
+                return 0;
+        }
+
+        caplen = dpdk_get_tx_length(packet);
+        m = dpdk_get_tx_mbuf(trace, packet, caplen);
+        if (m == NULL) {
                 return -1;
-        } else {
-                int ret;
-                char *mbuf_dst = rte_pktmbuf_append(m_buff[0], caplen);
-                if (mbuf_dst != NULL) {
-                        memcpy(mbuf_dst, packet->payload, caplen);
-                } else {
-                        rte_pktmbuf_free(m_buff[0]);
-                        trace_set_err_out(trace, TRACE_ERR_NO_CONVERSION,
-                                          "Packet too large");
-                        return -1;
+        }
+
+        pthread_mutex_lock(&format_data->tx_lock);
+        format_data->tx_pkts[format_data->tx_count++] = m;
+        if (format_data->tx_count >= format_data->tx_max_queue)
+                dpdk_flush_tx(format_data);
+        else
+                dpdk_tx_queued = true;
+        pthread_mutex_unlock(&format_data->tx_lock);
+
+        return 0;
+}
+
+static int dpdk_write_packets(libtrace_out_t *trace,
+                              libtrace_packet_t *packets[], int nb_packets)
+{
+        struct dpdk_format_data_t *format_data = FORMAT(trace);
+        struct rte_mbuf *m;
+        int i;
+
+        pthread_mutex_lock(&format_data->tx_lock);
+        for (i = 0; i < nb_packets; i++) {
+                if (!dpdk_can_write(packets[i])) {
+                        continue;
+                }
+                m = dpdk_get_tx_mbuf(trace, packets[i],
+                                     dpdk_get_tx_length(packets[i]));
+                if (m == NULL) {
+                        break;
                 }
-                do {
-                        ret = rte_eth_tx_burst(FORMAT(trace)->port,
-                                               0 /*queue TODO*/, m_buff, 1);
-                } while (ret != 1);
+                format_data->tx_pkts[format_data->tx_count++] = m;
+                if (format_data->tx_count == BURST_SIZE)
+                        dpdk_flush_tx(format_data);
         }
 
+        /* The batch is the burst */
+        dpdk_flush_tx(format_data);
+        pthread_mutex_unlock(&format_data->tx_lock);
+
+        if (i < nb_packets && i == 0) {
+                return -1;
+        }
+        return i;
+}
+
+static int dpdk_flush_output(libtrace_out_t *trace)
+{
+        pthread_mutex_lock(&FORMAT(trace)->tx_lock);
+        dpdk_flush_tx(FORMAT(trace));
+        pthread_mutex_unlock(&FORMAT(trace)->tx_lock);
         return 0;
 }
 
+static int dpdk_config_output(libtrace_out_t *libtrace,
+                              trace_option_output_t option, void *data)
+{
+        switch (option) {
+        case TRACE_OPTION_TX_MAX_QUEUE:
+                FORMAT(libtrace)->tx_max_queue =
+                    MAX(1, MIN(*(int *)data, BURST_SIZE));
+                return 0;
+        case TRACE_OPTION_OUTPUT_FILEFLAGS:
+        case TRACE_OPTION_OUTPUT_COMPRESS:
+        case TRACE_OPTION_OUTPUT_COMPRESSTYPE:
+        case TRACE_OPTION_OUTPUT_XDP_SHARED_UMEM:
+                break;
+        }
+        return -1;
+}
+
 int dpdk_fin_input(libtrace_t *libtrace)
 {
         libtrace_list_node_t *n;
@@ -2255,7 +2450,7 @@ int dpdk_prepare_packet(libtrace_t *libtrace UNUSED, libtrace_packet_t *packet,
         }
         if (packet->buffer != buffer &&
             packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
         if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER)
@@ -2594,6 +2789,9 @@ static int dpdk_pread_packets(libtrace_t *libtrace, libtrace_thread_t *t,
         dpdk_per_stream_t *stream = t->format_data;
         struct dpdk_addt_hdr *hdr;
 
+        /* Send the packets written while processing the last burst */
+        dpdk_flush_queued_tx();
+
         nb_rx = dpdk_read_packet_stream(libtrace, stream, &t->messages,
                                         pkts_burst, nb_packets);
 
@@ -2610,7 +2808,7 @@ static int dpdk_pread_packets(libtrace_t *libtrace, libtrace_thread_t *t,
                                                       "dpdk_pread_packets()\n");
                                         return -1;
                                 }
-                                free(packets[i]->buffer);
+                                trace_free_packet_buffer(packets[i]);
                         }
                         packets[i]->buf_control = TRACE_CTRL_EXTERNAL;
                         packets[i]->type = TRACE_RT_DATA_DPDK;
@@ -2643,8 +2841,7 @@ int dpdk_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
                                       "empty in dpdk_read_packet()\n");
                         return -1;
                 }
-                free(packet->buffer);
-                packet->buffer = NULL;
+                trace_free_packet_buffer(packet);
         }
 
         packet->buf_control = TRACE_CTRL_EXTERNAL;
@@ -2662,6 +2859,9 @@ int dpdk_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
                           // useless anyway
         }
 
+        /* Send the packets written while processing the last burst */
+        dpdk_flush_queued_tx();
+
         nb_rx = dpdk_read_packet_stream(
             libtrace, stream, NULL, FORMAT(libtrace)->burst_pkts, BURST_SIZE);
 
@@ -2791,8 +2991,7 @@ libtrace_eventobj_t dpdk_trace_event(libtrace_t *trace,
                                         event.type = TRACE_EVENT_TERMINATE;
                                         return event;
                                 }
-                                free(packet->buffer);
-                                packet->buffer = NULL;
+                                trace_free_packet_buffer(packet);
                         }
 
                         packet->buf_control = TRACE_CTRL_EXTERNAL;
@@ -2881,7 +3080,7 @@ static struct libtrace_format_t dpdk = {
     dpdk_start_input,        /* start_input */
     dpdk_pause_input,        /* pause_input */
     dpdk_init_output_pci,    /* init_output */
-    NULL,                    /* config_output */
+    dpdk_config_output,      /* config_output */
     dpdk_start_output,       /* start_ouput */
     dpdk_fin_input,          /* fin_input */
     dpdk_fin_output,         /* fin_output */
@@ -2890,7 +3089,8 @@ static struct libtrace_format_t dpdk = {
     dpdk_fin_packet,         /* fin_packet */
     NULL,                    /* can_hold_packet */
     dpdk_write_packet,       /* write_packet */
-    NULL,                    /* flush_output */
+    dpdk_write_packets,      /* write_packets */
+    dpdk_flush_output,       /* flush_output */
     dpdk_get_link_type,      /* get_link_type */
     dpdk_get_direction,      /* get_direction */
     dpdk_set_direction,      /* set_direction */
@@ -2935,7 +3135,7 @@ static struct libtrace_format_t dpdk_vdev = {
     dpdk_start_input,        /* start_input */
     dpdk_pause_input,        /* pause_input */
     dpdk_init_output_vdev,   /* init_output */
-    NULL,                    /* config_output */
+    dpdk_config_output,      /* config_output */
     dpdk_start_output,       /* start_ouput */
     dpdk_fin_input,          /* fin_input */
     dpdk_fin_output,         /* fin_output */
@@ -2944,7 +3144,8 @@ static struct libtrace_format_t dpdk_vdev = {
     dpdk_fin_packet,         /* fin_packet */
     NULL,                    /* can_hold_packet */
     dpdk_write_packet,       /* write_packet */
-    NULL,                    /* flush_output */
+    dpdk_write_packets,      /* write_packets */
+    dpdk_flush_output,       /* flush_output */
     dpdk_get_link_type,      /* get_link_type */
     dpdk_get_direction,      /* get_direction */
     dpdk_set_direction,      /* set_direction */
@@ -629,8 +629,7 @@ static int dpdkndag_pread_packets(libtrace_t *libtrace,
                 }
 
                 if (packets[read_packets]->buf_control == TRACE_CTRL_PACKET) {
-                        free(packets[read_packets]->buffer);
-                        packets[read_packets]->buffer = NULL;
+                        trace_free_packet_buffer(packets[read_packets]);
                 }
                 ret = ndagrec_to_libtrace_packet(libtrace, pt,
                                 packets[read_packets]);
@@ -650,8 +649,7 @@ static int dpdkndag_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
 	int ret;
 
 	if (packet->buf_control == TRACE_CTRL_PACKET) {
-		free(packet->buffer);
-		packet->buffer = NULL;
+		trace_free_packet_buffer(packet);
 	}
 
 	while (pt->nextrec == NULL) {
@@ -684,8 +682,7 @@ static libtrace_eventobj_t trace_event_dpdkndag(libtrace_t *libtrace,
         perthread_t *pt = &(FORMAT_DATA->threaddatas[0]);
 
 	if (packet->buf_control == TRACE_CTRL_PACKET) {
-		free(packet->buffer);
-		packet->buffer = NULL;
+		trace_free_packet_buffer(packet);
 	}
 
         while (pt->nextrec == NULL) {
@@ -738,6 +735,7 @@ static struct libtrace_format_t dpdkndag = {
         NULL,                   /* fin_packet */
         NULL,                   /* can_hold_packet */
         NULL,                   /* write_packet */
+        NULL,                   /* write_packets */
         NULL,                   /* flush_output */
         erf_get_link_type,      /* get_link_type */
         erf_get_direction,      /* get_direction */
@@ -159,7 +159,7 @@ static int duck_prepare_packet(libtrace_t *libtrace, libtrace_packet_t *packet,
 
         if (packet->buffer != buffer &&
                         packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
         if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -355,6 +355,7 @@ static struct libtrace_format_t duck = {
 	NULL,                           /* fin_packet */
         NULL,                           /* can_hold_packet */
         duck_write_packet,              /* write_packet */
+        NULL,                           /* write_packets */
         NULL,                           /* flush_output */
         duck_get_link_type,    		/* get_link_type */
         NULL,              		/* get_direction */
@@ -35,6 +35,8 @@
 #include "format_helper.h"
 #include "format_erf.h"
 #include "wandio.h"
+#include "data-struct/buckets.h"
+#include "hugepage_arena.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -64,12 +66,17 @@
 
 #define ERF_META_TYPE 27
 
+/* Size of the blocks that ERF records are read into. Packets point straight
+ * into these blocks, which are freed once none of them are left. */
+#define ERF_BLOCK_SIZE (512 * 1024)
+
 static struct libtrace_format_t erfformat;
 
 #define DATA(x) ((struct erf_format_data_t *)x->format_data)
 #define DATAOUT(x) ((struct erf_format_data_out_t *)x->format_data)
 
 #define IN_OPTIONS DATA(libtrace)->options
+#define BLOCK DATA(libtrace)->block
 #define OUTPUT DATAOUT(libtrace)
 #define OUT_OPTIONS DATAOUT(libtrace)->options
 
@@ -91,6 +98,20 @@ struct erf_format_data_t {
 
 	bool discard_meta;
 
+	/* Records are read from the file a block at a time and packets
+	 * reference the block they were carved from. The bucket frees each
+	 * block once every packet that points into it has been released. */
+	struct {
+		/* The block currently being filled and carved up */
+		char *buffer;
+		/* The start of the next unread record */
+		char *read;
+		/* The end of the data read from the file so far */
+		char *write;
+		/* Tracks the packets still referencing each block */
+		libtrace_bucket_t *bucket;
+	} block;
+
 	/* Config options for the input trace */
 	struct {
 		/* Flag indicating whether the event API should replicate the
@@ -269,6 +290,11 @@ static int erf_init_input(libtrace_t *libtrace) {
 
 	DATA(libtrace)->discard_meta = 0;
 
+	BLOCK.buffer = NULL;
+	BLOCK.read = NULL;
+	BLOCK.write = NULL;
+	BLOCK.bucket = NULL;
+
 	return 0; /* success */
 }
 
@@ -340,6 +366,20 @@ static int rawerf_start_input(libtrace_t *libtrace)
 	return 0; /* success */
 }
 
+/* Throws away any records that have been read into the current block but
+ * not yet returned, e.g. after seeking within the file */
+static void erf_discard_block(libtrace_t *libtrace)
+{
+	BLOCK.read = BLOCK.write;
+}
+
+/* The offset in the file of the next record that will be returned, which
+ * trails the file position by however much has been read ahead */
+static int64_t erf_tell(libtrace_t *libtrace)
+{
+	return wandio_tell(libtrace->io) - (BLOCK.write - BLOCK.read);
+}
+
 /* Binary search through the index to find the closest point before
  * the packet.  Consider in future having a btree index perhaps?
  */
@@ -380,6 +420,7 @@ static int erf_fast_seek_start(libtrace_t *libtrace,uint64_t erfts)
 
 	/* We've found our location in the trace, now use it. */
 	wandio_seek(libtrace->io,(int64_t) record.offset,SEEK_SET);
+	erf_discard_block(libtrace);
 
 	return 0; /* success */
 }
@@ -395,6 +436,7 @@ static int erf_slow_seek_start(libtrace_t *libtrace,uint64_t erfts UNUSED)
 	libtrace->io = trace_open_file(libtrace);
 	if (!libtrace->io)
 		return -1;
+	erf_discard_block(libtrace);
 	return 0;
 }
 
@@ -439,10 +481,11 @@ static int erf_seek_erf(libtrace_t *libtrace,uint64_t erfts)
 		trace_read_packet(libtrace,packet);
 		if (trace_get_erf_timestamp(packet)==erfts)
 			break;
-		off=wandio_tell(libtrace->io);
+		off=erf_tell(libtrace);
 	} while(trace_get_erf_timestamp(packet)<erfts);
 
 	wandio_seek(libtrace->io,off,SEEK_SET);
+	erf_discard_block(libtrace);
 
 	return 0;
 }
@@ -490,6 +533,9 @@ static int erf_config_output(libtrace_out_t *libtrace,
 static int erf_fin_input(libtrace_t *libtrace) {
 	if (libtrace->io)
 		wandio_destroy(libtrace->io);
+	/* This also frees the current block */
+	if (BLOCK.bucket)
+		libtrace_bucket_destroy(BLOCK.bucket);
 	free(libtrace->format_data);
 	return 0;
 }
@@ -508,7 +554,7 @@ static int erf_prepare_packet(libtrace_t *libtrace, libtrace_packet_t *packet,
 
 	if (packet->buffer != buffer && 
 		packet->buf_control == TRACE_CTRL_PACKET) {
-		free(packet->buffer);
+		trace_free_packet_buffer(packet);
 	}
 
 	if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -549,31 +595,77 @@ static int erf_prepare_packet(libtrace_t *libtrace, libtrace_packet_t *packet,
 	return 0;
 }
 
+/* Makes sure that at least 'wanted' bytes of unread records are sitting in
+ * the current block, reading more of the file as required.
+ *
+ * Once the current block is more than half full, the unread tail of it is
+ * moved into a fresh block. The old block stays alive for as long as
+ * packets still point into it. Records are never split across blocks.
+ *
+ * @return the number of unread bytes available, which is less than wanted
+ * only at the end of the file, or -1 if an error occurred
+ */
+static int erf_fill_block(libtrace_t *libtrace, size_t wanted)
+{
+	int numbytes;
+
+	if (!BLOCK.bucket)
+		BLOCK.bucket = libtrace_bucket_init();
+
+	while ((size_t)(BLOCK.write - BLOCK.read) < wanted) {
+		if (!BLOCK.buffer ||
+				BLOCK.write - BLOCK.buffer > ERF_BLOCK_SIZE / 2) {
+			char *newblock = (char *)libtrace_arena_alloc(
+					(size_t)ERF_BLOCK_SIZE);
+			size_t left = BLOCK.write - BLOCK.read;
+
+			if (!newblock) {
+				trace_set_err(libtrace, errno,
+					"Cannot allocate memory");
+				return -1;
+			}
+			if (left > 0)
+				memcpy(newblock, BLOCK.read, left);
+			BLOCK.buffer = newblock;
+			BLOCK.read = newblock;
+			BLOCK.write = newblock + left;
+			libtrace_create_new_bucket(BLOCK.bucket, newblock);
+		}
+
+		numbytes = wandio_read(libtrace->io, BLOCK.write,
+			ERF_BLOCK_SIZE - (BLOCK.write - BLOCK.buffer));
+		if (numbytes == -1) {
+			trace_set_err(libtrace, errno, "reading ERF file");
+			return -1;
+		}
+
+		/* EOF */
+		if (numbytes == 0)
+			break;
+		BLOCK.write += numbytes;
+	}
+
+	return BLOCK.write - BLOCK.read;
+}
+
 static int erf_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet) {
 	int numbytes;
 	unsigned int size;
-	void *buffer2 = packet->buffer;
 	unsigned int rlen;
-	uint32_t flags = 0;
+	dag_record_t *erfptr;
 	libtrace_rt_types_t linktype;
 	int gotpacket = 0;
 
-	if (!packet->buffer || packet->buf_control == TRACE_CTRL_EXTERNAL) {
-		packet->buffer = malloc((size_t)LIBTRACE_PACKET_BUFSIZE);
-		if (!packet->buffer) {
-			trace_set_err(libtrace, errno, "Cannot allocate memory");
-			return -1;
-		}
+	/* Packets point into our blocks, so there is no use for any buffer
+	 * the packet already owns */
+	if (packet->buffer && packet->buf_control == TRACE_CTRL_PACKET) {
+		trace_free_packet_buffer(packet);
 	}
 
-	flags |= TRACE_PREP_OWN_BUFFER;
-
 	while (!gotpacket) {
 
-		if ((numbytes=wandio_read(libtrace->io, packet->buffer,
-			(size_t)dag_record_size)) == -1) {
-
-			trace_set_err(libtrace,errno,"reading ERF file");
+		if ((numbytes = erf_fill_block(libtrace,
+				(size_t)dag_record_size)) == -1) {
 			return -1;
 		}
 
@@ -587,8 +679,8 @@ static int erf_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet) {
                 	return -1;
         	}
 
-		rlen = ntohs(((dag_record_t *)packet->buffer)->rlen);
-		buffer2 = (char*)packet->buffer + dag_record_size;
+		erfptr = (dag_record_t *)BLOCK.read;
+		rlen = ntohs(erfptr->rlen);
 		size = rlen - dag_record_size;
 
 		if (size >= LIBTRACE_PACKET_BUFSIZE) {
@@ -599,37 +691,32 @@ static int erf_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet) {
 		}
 
 		/* Unknown/corrupt */
-		if ((((dag_record_t *)packet->buffer)->type & 0x7f) > ERF_TYPE_MAX) {
+		if ((erfptr->type & 0x7f) > ERF_TYPE_MAX) {
 			trace_set_err(libtrace, TRACE_ERR_BAD_PACKET, 
 				"Corrupt or Unknown ERF type");
 			return -1;
 		}
 
-		/* read in the rest of the packet */
-		if ((numbytes=wandio_read(libtrace->io, buffer2,
-			(size_t)size)) != (int)size) {
-
-			if (numbytes==-1) {
-				trace_set_err(libtrace,errno, "read(%s)", 
-					libtrace->uridata);
-				return -1;
-			}
+		/* make sure the rest of the record is in the block */
+		if ((numbytes = erf_fill_block(libtrace, (size_t)rlen)) == -1) {
+			return -1;
+		}
 
+		if (numbytes < (int)rlen) {
 			trace_set_err(libtrace,EIO,
-				"Truncated packet (wanted %d, got %d)", size, numbytes);
+				"Truncated packet (wanted %d, got %d)", size,
+				numbytes - (int)dag_record_size);
 
 			/* Failed to read the full packet?  must be EOF */
 			return -1;
 		}
 
-        	if (numbytes < (int)size) {
-                	trace_set_err(libtrace, TRACE_ERR_BAD_PACKET, "Incomplete ERF record");
-                	return -1;
-        	}
+		/* The record may have moved into a new block */
+		erfptr = (dag_record_t *)BLOCK.read;
 
 		/* If a provenance packet make sure correct rt linktype is set.
 	 	 * Only bits 0-6 are used for the type */
-		if ((((dag_record_t *)packet->buffer)->type & 127) == ERF_META_TYPE) {
+		if ((erfptr->type & 127) == ERF_META_TYPE) {
 			linktype = TRACE_RT_ERF_META;
 		} else { linktype = TRACE_RT_DATA_ERF; }
 
@@ -639,10 +726,19 @@ static int erf_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet) {
 			linktype == TRACE_RT_DATA_ERF) {
 			gotpacket = 1;
 
-			if (erf_prepare_packet(libtrace, packet, packet->buffer, linktype, flags)) {
+			if (erf_prepare_packet(libtrace, packet, erfptr, linktype, 0)) {
+				return -1;
+			}
+
+			packet->internalid = libtrace_push_into_bucket(BLOCK.bucket);
+			if (!packet->internalid) {
+				trace_set_err(libtrace, TRACE_ERR_BAD_STATE,
+					"packet->internalid is 0 in erf_read_packet()");
 				return -1;
 			}
+			packet->srcbucket = BLOCK.bucket;
 		}
+		BLOCK.read += rlen;
 	}
 
 	return rlen;
@@ -1280,6 +1376,7 @@ static struct libtrace_format_t erfformat = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	erf_write_packet,		/* write_packet */
+	NULL,				/* write_packets */
 	erf_flush_output,		/* flush_output */
 	erf_get_link_type,		/* get_link_type */
 	erf_get_direction,		/* get_direction */
@@ -1327,6 +1424,7 @@ static struct libtrace_format_t rawerfformat = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	erf_write_packet,		/* write_packet */
+	NULL,				/* write_packets */
 	erf_flush_output,		/* flush_output */
 	erf_get_link_type,		/* get_link_type */
 	erf_get_direction,		/* get_direction */
@@ -575,7 +575,7 @@ static int etsilive_prepare_received(libtrace_t *libtrace,
         uint32_t available = 0;
 
         if (packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
         packet->trace = libtrace;
@@ -738,6 +738,7 @@ static struct libtrace_format_t etsilive = {
     NULL,                        /* fin_packet */
     etsilive_can_hold_packet,    /* can_hold_packet */
     NULL,                        /* write_packet */
+    NULL,                        /* write_packets */
     NULL,                        /* flush_output */
     etsilive_get_link_type,      /* get_link_type */
     NULL,                        /* get_direction */
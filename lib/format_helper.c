@@ -172,6 +172,7 @@ struct libtrace_eventobj_t trace_event_trace(struct libtrace_t *trace, struct li
 			trace_destroy_packet(trace->event.packet);
 			trace->event.packet = NULL;
 			packet->buffer = NULL;
+			packet->pool_capacity = 0;
 			packet->header = NULL;
 			packet->payload = NULL;
 			packet->buf_control = TRACE_CTRL_EXTERNAL;
@@ -229,6 +230,7 @@ struct libtrace_eventobj_t trace_event_trace(struct libtrace_t *trace, struct li
 	packet->payload = trace->event.packet->payload;
 	
 	packet->buffer = trace->event.packet->buffer;
+	packet->pool_capacity = trace->event.packet->pool_capacity;
 	packet->buf_control = trace->event.packet->buf_control;
 
         packet->which_trace_start = trace->event.packet->which_trace_start;
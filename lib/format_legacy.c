@@ -214,7 +214,7 @@ static int legacy_prepare_packet(libtrace_t *libtrace,
 
 	if (packet->buffer != buffer &&
                         packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
         if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -530,6 +530,7 @@ static struct libtrace_format_t legacyatm = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	NULL,				/* write_packet */
+	NULL,				/* write_packets */
 	NULL,				/* flush_output */
 	legacyatm_get_link_type,	/* get_link_type */
 	NULL,				/* get_direction */
@@ -577,6 +578,7 @@ static struct libtrace_format_t legacyeth = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	NULL,				/* write_packet */
+	NULL,				/* write_packets */
 	NULL,				/* flush_output */
 	legacyeth_get_link_type,	/* get_link_type */
 	NULL,				/* get_direction */
@@ -624,6 +626,7 @@ static struct libtrace_format_t legacypos = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	NULL,				/* write_packet */
+	NULL,				/* write_packets */
 	NULL,				/* flush_output */
 	legacypos_get_link_type,	/* get_link_type */
 	NULL,				/* get_direction */
@@ -671,6 +674,7 @@ static struct libtrace_format_t legacynzix = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	NULL,				/* write_packet */
+	NULL,				/* write_packets */
 	NULL,				/* flush_output */
 	legacynzix_get_link_type,	/* get_link_type */
 	NULL,				/* get_direction */
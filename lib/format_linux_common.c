@@ -179,7 +179,14 @@ int linuxcommon_config_input(libtrace_t *libtrace,
 		case TRACE_OPTION_XDP_DRV_MODE:
 		case TRACE_OPTION_XDP_ZERO_COPY_MODE:
 		case TRACE_OPTION_XDP_COPY_MODE:
+		case TRACE_OPTION_SAMPLE_RATE:
+		case TRACE_OPTION_FLOW_SAMPLE_RATE:
 			break;
+		case TRACE_OPTION_RING_BLOCK_MODE:
+			/* Only used by ring: when it creates its rings */
+			FORMAT_DATA->ring_version =
+				*(int *)data ? TPACKET_V3 : TPACKET_V2;
+			return 0;
 		/* Avoid default: so that future options will cause a warning
 		 * here to remind us to implement it, or flag it as
 		 * unimplementable
@@ -199,6 +206,7 @@ int linuxcommon_config_output(libtrace_out_t *libtrace,
                 case TRACE_OPTION_OUTPUT_FILEFLAGS:
                 case TRACE_OPTION_OUTPUT_COMPRESS:
                 case TRACE_OPTION_OUTPUT_COMPRESSTYPE:
+                case TRACE_OPTION_OUTPUT_XDP_SHARED_UMEM:
                     break;
                 case TRACE_OPTION_TX_MAX_QUEUE:
                         FORMAT_DATA_OUT->tx_max_queue = *(int *)data;
@@ -243,6 +251,7 @@ int linuxcommon_init_input(libtrace_t *libtrace)
 	FORMAT_DATA->stats.tp_drops = 0;
 	FORMAT_DATA->stats.tp_packets = 0;
 	FORMAT_DATA->max_order = MAX_ORDER;
+	FORMAT_DATA->ring_version = TPACKET_V2;
 	FORMAT_DATA->fanout_flags = PACKET_FANOUT_LB;
 	/* Some examples use pid for the group however that would limit a single
 	 * application to use only int/ring format, instead using rand */
@@ -65,6 +65,10 @@
  */
 #define CONF_RING_FRAMES        0x100
 
+/* Minimum number of blocks to split a TPACKET_V3 ring into, so that the
+ * kernel can keep filling one block while we are still reading another */
+#define CONF_RING_BLOCKS        8
+
 #else	/* HAVE_NETPACKET_PACKET_H */
 
 /* Need to know what a sockaddr_ll looks like */
@@ -115,6 +119,7 @@ typedef enum { TS_NONE, TS_TIMEVAL, TS_TIMESPEC } timestamptype_t;
 #define PACKET_FANOUT 18
 
 /* Packet mmap RX flags */
+#define TP_STATUS_KERNEL 0x0
 #define TP_STATUS_USER 0x1
 
 /* Packet mmap TX flags */
@@ -125,6 +130,7 @@ typedef enum { TS_NONE, TS_TIMEVAL, TS_TIMESPEC } timestamptype_t;
 
 #define TO_TP_HDR2(x)	((struct tpacket2_hdr *) (x))
 #define TO_TP_HDR3(x)	((struct tpacket3_hdr *) (x))
+#define TO_TP_BLOCK(x)	((struct tpacket_block_desc *) (x))
 #define TPACKET_ALIGNMENT       16
 #define TPACKET_ALIGN(x)        (((x)+TPACKET_ALIGNMENT-1)&~(TPACKET_ALIGNMENT-1))
 #define TPACKET2_HDRLEN		(TPACKET_ALIGN(sizeof(struct tpacket2_hdr)) + sizeof(struct sockaddr_ll))
@@ -193,6 +199,47 @@ struct tpacket3_hdr {
 	union {
 		struct tpacket_hdr_variant1 hv1;
 	};
+	uint8_t			tp_padding[8];
+};
+
+struct tpacket_bd_ts {
+	uint32_t		ts_sec;
+	uint32_t		ts_usec_or_nsec;
+};
+
+struct tpacket_hdr_v1 {
+	/* Block status - owned by the kernel or handed to userspace */
+	uint32_t		block_status;
+	/* Number of frames held in the block */
+	uint32_t		num_pkts;
+	/* Offset in bytes from the block start to the first frame */
+	uint32_t		offset_to_first_pkt;
+	/* Number of valid bytes in the block, including this header */
+	uint32_t		blk_len;
+	uint64_t		seq_num __attribute__((aligned(8)));
+	struct tpacket_bd_ts	ts_first_pkt;
+	struct tpacket_bd_ts	ts_last_pkt;
+};
+
+/* Header found at the start of every block of a TPACKET_V3 ring */
+struct tpacket_block_desc {
+	uint32_t		version;
+	uint32_t		offset_to_priv;
+	union {
+		struct tpacket_hdr_v1 bh1;
+	} hdr;
+};
+
+/* The TPACKET_V3 ring request. TPACKET_V2 rings only use the first four
+ * fields, and are configured with sizeof(struct tpacket_req) */
+struct tpacket_req3 {
+	unsigned int tp_block_size;  /* Minimal size of contiguous block */
+	unsigned int tp_block_nr;    /* Number of blocks */
+	unsigned int tp_frame_size;  /* Size of frame */
+	unsigned int tp_frame_nr;    /* Total number of frames */
+	unsigned int tp_retire_blk_tov; /* Block timeout in msec, 0 = auto */
+	unsigned int tp_sizeof_priv; /* Per block private area size */
+	unsigned int tp_feature_req_word;
 };
 
 struct tpacket_req {
@@ -237,7 +284,9 @@ struct linux_format_data_t {
 	 * file descriptors from packet fanout will use, here we assume/hope
 	 * that every ring can get setup the same */
 	libtrace_list_t *per_stream;
-
+	/* The TPACKET version used for ring buffers, TPACKET_V3 when
+	 * block mode has been requested */
+	int ring_version;
 };
 
 struct linux_format_data_out_t {
@@ -248,7 +297,7 @@ struct linux_format_data_out_t {
 	/* The current frame number within the tx ring */
 	int txring_offset;
 	/* The current ring buffer layout */
-	struct tpacket_req req;
+	struct tpacket_req3 req;
 	/* Our sockaddr structure, here so we can cache the interface number */
 	struct sockaddr_ll sock_hdr;
 	/* The (maximum) number of packets that haven't been written */
@@ -269,11 +318,23 @@ struct linux_per_stream_t {
 	/* Offset within the mapped buffer */
 	int rxring_offset;
 	/* The ring buffer layout */
-	struct tpacket_req req;
+	struct tpacket_req3 req;
 	uint64_t last_timestamp;
+	/* The TPACKET version the ring buffer was created with */
+	int version;
+	/* TPACKET_V3 only: the block being read, the next frame within that
+	 * block and the number of frames left in it */
+	unsigned int block_offset;
+	char *next_frame;
+	uint32_t frames_left;
+	/* TPACKET_V3 only: the number of packets still using each block,
+	 * plus one held by the reader while it is walking the block. The
+	 * block is returned to the kernel when this reaches zero */
+	uint32_t *block_refs;
 } ALIGNED(CACHE_LINE_SIZE);
 
-#define ZERO_LINUX_STREAM {-1, MAP_FAILED, 0, {0,0,0,0}, 0}
+#define ZERO_LINUX_STREAM {-1, MAP_FAILED, 0, {0,0,0,0,0,0,0}, 0, \
+	TPACKET_V2, 0, NULL, 0, NULL}
 
 
 /* Format header for encapsulating packets captured using linux native */
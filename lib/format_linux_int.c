@@ -115,7 +115,7 @@ static int linuxnative_prepare_packet(libtrace_t *libtrace UNUSED,
 
 	if (packet->buffer != buffer &&
 	    packet->buf_control == TRACE_CTRL_PACKET) {
-		free(packet->buffer);
+		trace_free_packet_buffer(packet);
 	}
 
 	if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -526,6 +526,7 @@ static struct libtrace_format_t linuxnative = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	linuxnative_write_packet,	/* write_packet */
+	NULL,				/* write_packets */
 	NULL,				/* flush_output */
 	linuxnative_get_link_type,	/* get_link_type */
 	linuxnative_get_direction,	/* get_direction */
@@ -589,6 +590,7 @@ static struct libtrace_format_t linuxnative = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	NULL,				/* write_packet */
+	NULL,				/* write_packets */
 	NULL,				/* flush_output */
 	linuxnative_get_link_type,	/* get_link_type */
 	linuxnative_get_direction,	/* get_direction */
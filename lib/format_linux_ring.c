@@ -66,6 +66,19 @@ static pthread_mutex_t pagesize_mutex;
                 ((void *)stream->rx_ring +                                     \
                  (stream->rxring_offset * stream->req.tp_frame_size))
 
+/* Get the current block in a TPACKET_V3 ring buffer */
+#        define GET_CURRENT_BLOCK(stream)                                      \
+                TO_TP_BLOCK(stream->rx_ring + (stream->block_offset *          \
+                                               stream->req.tp_block_size))
+
+/* Offset from the start of a TPACKET_V3 frame to where we rewrite it as a
+ * TPACKET_V2 header. Both headers are followed by the sockaddr_ll, so this
+ * leaves the sockaddr_ll and the packet itself where they are.
+ */
+#        define V3_TO_V2_OFFSET                                                \
+                (TPACKET_ALIGN(sizeof(struct tpacket3_hdr)) -                  \
+                 TPACKET_ALIGN(sizeof(struct tpacket2_hdr)))
+
 /* Cached page size, the page size shouldn't be changing */
 static int pagesize = 0;
 
@@ -101,12 +114,15 @@ static bool linuxring_can_write(libtrace_packet_t *packet)
  * - Frame_nr = Block_nr * (frames per block)
  * - CONF_RING_FRAMES is used a minimum number of frames to hold
  * - Calculates based on max_order and buf_min
+ * - TPACKET_V3 rings have at least CONF_RING_BLOCKS blocks where possible
  */
-static void calculate_buffers(struct tpacket_req *req, int fd, char *uri,
-                              uint32_t max_order)
+static void calculate_buffers(struct tpacket_req3 *req, int fd, char *uri,
+                              uint32_t max_order, int version)
 {
         struct ifreq ifr;
         unsigned max_frame = LIBTRACE_PACKET_BUFSIZE;
+        unsigned hdrlen = version == TPACKET_V3 ? TPACKET3_HDRLEN
+                                                : TPACKET2_HDRLEN;
         pthread_mutex_lock(&pagesize_mutex);
         if (pagesize == 0) {
                 pagesize = getpagesize();
@@ -120,7 +136,7 @@ static void calculate_buffers(struct tpacket_req *req, int fd, char *uri,
          * Remember, that our frame also has to include a TPACKET header!
          */
         if (ioctl(fd, SIOCGIFMTU, (caddr_t)&ifr) >= 0)
-                max_frame = ifr.ifr_mtu + TPACKET_ALIGN(TPACKET2_HDRLEN);
+                max_frame = ifr.ifr_mtu + TPACKET_ALIGN(hdrlen);
         if (max_frame > LIBTRACE_PACKET_BUFSIZE)
                 max_frame = LIBTRACE_PACKET_BUFSIZE;
 
@@ -137,7 +153,7 @@ static void calculate_buffers(struct tpacket_req *req, int fd, char *uri,
         req->tp_block_size = pagesize << max_order;
         /* If max order is too high this might become 0 */
         if (req->tp_block_size == 0) {
-                calculate_buffers(req, fd, uri, max_order - 1);
+                calculate_buffers(req, fd, uri, max_order - 1, version);
                 return;
         }
         do {
@@ -151,6 +167,27 @@ static void calculate_buffers(struct tpacket_req *req, int fd, char *uri,
         if ((CONF_RING_FRAMES * req->tp_frame_size) % req->tp_block_size != 0)
                 req->tp_block_nr++;
 
+        /* A TPACKET_V3 block only goes back to the kernel once we have
+         * finished with every packet in it, so a ring made of one large
+         * block would stall capture. Split it up instead -- the kernel
+         * fills blocks with as many packets as fit, so this does not
+         * change how many packets the ring can hold.
+         */
+        if (version == TPACKET_V3) {
+                while (req->tp_block_nr < CONF_RING_BLOCKS &&
+                       req->tp_block_size > (unsigned)pagesize &&
+                       req->tp_block_size > req->tp_frame_size) {
+                        req->tp_block_size >>= 1;
+                        req->tp_block_nr <<= 1;
+                }
+        }
+
+        /* Let the kernel choose the block timeout, we don't use per block
+         * private data or any optional features */
+        req->tp_retire_blk_tov = 0;
+        req->tp_sizeof_priv = 0;
+        req->tp_feature_req_word = 0;
+
         /* Calculate packets such that we use all the space we have to
          * allocated */
         req->tp_frame_nr =
@@ -190,18 +227,15 @@ static void calculate_buffers(struct tpacket_req *req, int fd, char *uri,
 }
 
 static inline int socket_to_packetmmap(char *uridata, int ring_type, int fd,
-                                       struct tpacket_req *req,
+                                       int version, struct tpacket_req3 *req,
                                        char **ring_location,
                                        uint32_t *max_order, char *error)
 {
-        int val;
-
-        /* Switch to TPACKET header version 2, we only try support v2 because
-         * v1 had problems with data type consistency */
-        val = TPACKET_V2;
-        if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &val, sizeof(val)) ==
-            -1) {
-                strncpy(error, "TPACKET2 not supported", 2048);
+        /* Switch to TPACKET header version 2 or 3, we don't support v1
+         * because it had problems with data type consistency */
+        if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version,
+                       sizeof(version)) == -1) {
+                snprintf(error, 2048, "TPACKET%d not supported", version + 1);
                 return -1;
         }
 
@@ -216,9 +250,11 @@ static inline int socket_to_packetmmap(char *uridata, int ring_type, int fd,
                                 2048);
                         return -1;
                 }
-                calculate_buffers(req, fd, uridata, *max_order);
+                calculate_buffers(req, fd, uridata, *max_order, version);
                 if (setsockopt(fd, SOL_PACKET, ring_type, req,
-                               sizeof(struct tpacket_req)) == -1) {
+                               version == TPACKET_V3
+                                   ? sizeof(struct tpacket_req3)
+                                   : sizeof(struct tpacket_req)) == -1) {
                         if (errno == ENOMEM) {
                                 (*max_order)--;
                         } else {
@@ -243,21 +279,75 @@ static inline int socket_to_packetmmap(char *uridata, int ring_type, int fd,
         return 0;
 }
 
+/* Drop a reference to a block in a TPACKET_V3 ring, handing the block back
+ * to the kernel once nothing is using it any more.
+ */
+static inline void ring_release_block(struct linux_per_stream_t *stream,
+                                      unsigned int block)
+{
+        if (__atomic_sub_fetch(&stream->block_refs[block], 1,
+                               __ATOMIC_ACQ_REL) == 0) {
+                struct tpacket_block_desc *desc = TO_TP_BLOCK(
+                    stream->rx_ring + block * stream->req.tp_block_size);
+                __atomic_store_n(&desc->hdr.bh1.block_status,
+                                 TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        }
+}
+
+/* We have read every frame in the current block of a TPACKET_V3 ring, give
+ * up the reader's reference to it and move on to the next block.
+ */
+static inline void ring_finish_block(struct linux_per_stream_t *stream)
+{
+        ring_release_block(stream, stream->block_offset);
+        stream->block_offset++;
+        stream->block_offset %= stream->req.tp_block_nr;
+        stream->next_frame = NULL;
+        stream->frames_left = 0;
+}
+
 /* Release a frame back to the kernel or free() if it's a malloc'd buffer
  */
 inline static void ring_release_frame(libtrace_t *libtrace UNUSED,
                                       libtrace_packet_t *packet)
 {
+        struct linux_per_stream_t *stream = packet->fmtdata;
+
         /* Free the old packet */
         if (packet->buffer == NULL)
                 return;
 
         if (packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
+        }
+
+        if (packet->buf_control == TRACE_CTRL_EXTERNAL && stream &&
+            stream->version == TPACKET_V3) {
+                /* Frames in a block based ring are released a block at a
+                 * time. If the ring has been replaced since the packet was
+                 * read there is nothing to do. The new ring may be mapped
+                 * at the same address, so check the packet was read by
+                 * the current start of the trace (which remapped the
+                 * ring) as well as that it lies within the ring */
+                char *frame = packet->buffer;
+                size_t ring_size = (size_t)stream->req.tp_block_size *
+                                   stream->req.tp_block_nr;
+
+                if (packet->trace &&
+                    packet->which_trace_start == packet->trace->startcount &&
+                    stream->rx_ring != MAP_FAILED &&
+                    frame >= stream->rx_ring &&
+                    frame < stream->rx_ring + ring_size) {
+                        ring_release_block(stream,
+                                           (frame - stream->rx_ring) /
+                                               stream->req.tp_block_size);
+                }
+                packet->fmtdata = NULL;
                 packet->buffer = NULL;
         }
 
-        if (packet->buf_control == TRACE_CTRL_EXTERNAL) {
+        if (packet->buf_control == TRACE_CTRL_EXTERNAL &&
+            packet->buffer != NULL) {
                 // struct linux_format_data_t *ftd = FORMAT_DATA;
                 /* Check it's within our buffer first - consider the pause
                  * resume case it might have already been free'd lets hope we
@@ -287,6 +377,12 @@ linuxring_start_input_stream(libtrace_t *libtrace,
                 stream->rx_ring = MAP_FAILED;
                 stream->rxring_offset = 0;
         }
+        free(stream->block_refs);
+        stream->block_refs = NULL;
+        stream->block_offset = 0;
+        stream->next_frame = NULL;
+        stream->frames_left = 0;
+        stream->version = FORMAT_DATA->ring_version;
 
         /* We set the socket up the same and then convert it to PACKET_MMAP */
         if (linuxcommon_start_input_stream(libtrace, stream) < 0)
@@ -296,8 +392,9 @@ linuxring_start_input_stream(libtrace_t *libtrace,
 
         /* Make it a packetmmap */
         if (socket_to_packetmmap(libtrace->uridata, PACKET_RX_RING, stream->fd,
-                                 &stream->req, &stream->rx_ring,
-                                 &FORMAT_DATA->max_order, error) != 0) {
+                                 stream->version, &stream->req,
+                                 &stream->rx_ring, &FORMAT_DATA->max_order,
+                                 error) != 0) {
                 trace_set_err(libtrace, TRACE_ERR_INIT_FAILED,
                               "Initialisation of packet MMAP failed: %s",
                               error);
@@ -305,6 +402,18 @@ linuxring_start_input_stream(libtrace_t *libtrace,
                 return -1;
         }
 
+        if (stream->version == TPACKET_V3) {
+                stream->block_refs =
+                    calloc(stream->req.tp_block_nr, sizeof(uint32_t));
+                if (!stream->block_refs) {
+                        trace_set_err(libtrace, TRACE_ERR_OUT_OF_MEMORY,
+                                      "Unable to allocate block reference "
+                                      "counts for the ring buffer");
+                        linuxcommon_close_input_stream(libtrace, stream);
+                        return -1;
+                }
+        }
+
         return 0;
 }
 
@@ -324,6 +433,7 @@ static int linuxring_fin_input(libtrace_t *libtrace)
                                        stream->req.tp_block_size *
                                            stream->req.tp_block_nr);
                         }
+                        free(stream->block_refs);
                 }
 
                 if (FORMAT_DATA->filter != NULL)
@@ -364,7 +474,8 @@ static int linuxring_start_output(libtrace_out_t *libtrace)
 
         /* Make it a packetmmap */
         if (socket_to_packetmmap(libtrace->uridata, PACKET_TX_RING,
-                                 FORMAT_DATA_OUT->fd, &FORMAT_DATA_OUT->req,
+                                 FORMAT_DATA_OUT->fd, TPACKET_V2,
+                                 &FORMAT_DATA_OUT->req,
                                  &FORMAT_DATA_OUT->tx_ring,
                                  &FORMAT_DATA_OUT->max_order, error) != 0) {
                 trace_set_err_out(libtrace, TRACE_ERR_INIT_FAILED,
@@ -522,7 +633,7 @@ static int linuxring_prepare_packet(libtrace_t *libtrace UNUSED,
 {
         if (packet->buffer != buffer &&
             packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
         if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER)
@@ -546,6 +657,200 @@ static int linuxring_prepare_packet(libtrace_t *libtrace UNUSED,
  * and read the same packet twice if an old packet has not yet been freed */
 #        define TP_STATUS_LIBTRACE 0xFFFFFFFF
 
+/* Wait for the kernel to fill more of the ring, or for a message to arrive.
+ *
+ * Returns 1 if the ring should be checked again, otherwise the value that
+ * should be returned by the read function.
+ */
+static int linuxring_wait_for_data(libtrace_t *libtrace,
+                                   struct linux_per_stream_t *stream,
+                                   libtrace_message_queue_t *queue)
+{
+        int ret;
+        struct pollfd pollset[2];
+
+        if ((ret = is_halted(libtrace)) != -1)
+                return ret;
+
+        pollset[0].fd = stream->fd;
+        pollset[0].events = POLLIN;
+        pollset[0].revents = 0;
+        if (queue) {
+                pollset[1].fd = libtrace_message_queue_get_fd(queue);
+                pollset[1].events = POLLIN;
+                pollset[1].revents = 0;
+        }
+        /* Wait for more data or a message */
+        ret = poll(pollset, (queue ? 2 : 1), 500);
+        if (ret > 0) {
+                if (pollset[0].revents == POLLIN)
+                        return 1;
+                else if (queue && pollset[1].revents == POLLIN)
+                        return READ_MESSAGE;
+                else if (queue && pollset[1].revents) {
+                        /* Internal error */
+                        trace_set_err(libtrace, TRACE_ERR_BAD_STATE,
+                                      "Message queue error %d poll()",
+                                      pollset[1].revents);
+                        return READ_ERROR;
+                } else {
+                        /* Try get the error from the socket */
+                        int err = ENETDOWN;
+                        socklen_t len = sizeof(err);
+                        getsockopt(stream->fd, SOL_SOCKET, SO_ERROR, &err,
+                                   &len);
+                        trace_set_err(libtrace, err,
+                                      "Socket error revents=%d poll()",
+                                      pollset[0].revents);
+                        return READ_ERROR;
+                }
+        } else if (ret < 0) {
+                if (errno != EINTR) {
+                        trace_set_err(libtrace, errno, "poll()");
+                        return -1;
+                }
+        } else {
+                /* Poll timed out. If we do not have access to the
+                 * message queue return and let libtrace check it,
+                 * otherwise loop.
+                 */
+                if (!queue) {
+                        return READ_MESSAGE;
+                }
+        }
+        return 1;
+}
+
+/* Finish reading a frame that packet->buffer now points at, this works for
+ * both TPACKET_V2 frames and TPACKET_V3 frames rewritten as TPACKET_V2.
+ */
+static inline int linuxring_finish_read(libtrace_t *libtrace,
+                                        libtrace_packet_t *packet,
+                                        struct linux_per_stream_t *stream)
+{
+        unsigned int snaplen;
+
+        packet->trace = libtrace;
+        packet->fmtdata = stream;
+
+        /* If a snaplen was configured, automatically truncate the packet to
+         * the desired length.
+         */
+        snaplen = LIBTRACE_MIN((int)LIBTRACE_PACKET_BUFSIZE -
+                                   (int)sizeof(struct tpacket2_hdr),
+                               (int)FORMAT_DATA->snaplen);
+
+        TO_TP_HDR2(packet->buffer)->tp_snaplen = LIBTRACE_MIN(
+            (unsigned int)snaplen, TO_TP_HDR2(packet->buffer)->tp_len);
+
+        packet->order =
+            (((uint64_t)TO_TP_HDR2(packet->buffer)->tp_sec) << 32) +
+            ((((uint64_t)TO_TP_HDR2(packet->buffer)->tp_nsec) << 32) /
+             1000000000);
+
+        if (packet->order <= stream->last_timestamp) {
+                packet->order = stream->last_timestamp + 1;
+        }
+
+        stream->last_timestamp = packet->order;
+
+        /* We just need to get prepare_packet to set all our packet pointers
+         * appropriately */
+        if (linuxring_prepare_packet(libtrace, packet, packet->buffer,
+                                     packet->type, 0))
+                return -1;
+        return linuxring_get_framing_length(packet) +
+               linuxring_get_capture_length(packet);
+}
+
+inline static int linuxring_read_stream_v3(libtrace_t *libtrace,
+                                           libtrace_packet_t *packet,
+                                           struct linux_per_stream_t *stream,
+                                           libtrace_message_queue_t *queue,
+                                           uint8_t block)
+{
+        struct tpacket_block_desc *desc;
+        struct tpacket3_hdr *frame;
+        struct tpacket2_hdr *header;
+        uint32_t next_offset, sec, nsec, len, caplen, vlan_tci;
+        uint16_t mac, net;
+        int ret;
+
+        packet->buf_control = TRACE_CTRL_EXTERNAL;
+        packet->type = TRACE_RT_DATA_LINUX_RING;
+
+        /* Claim the next block once the kernel has retired it to us. We
+         * hold a reference to the block until we have read every frame in
+         * it, so it can't go back to the kernel under us.
+         */
+        while (stream->frames_left == 0) {
+                uint32_t status;
+
+                desc = GET_CURRENT_BLOCK(stream);
+                status = __atomic_load_n(&desc->hdr.bh1.block_status,
+                                         __ATOMIC_ACQUIRE);
+                if (!(status & TP_STATUS_USER) ||
+                    status == TP_STATUS_LIBTRACE) {
+                        if (!block) {
+                                return 0;
+                        }
+                        ret = linuxring_wait_for_data(libtrace, stream, queue);
+                        if (ret != 1)
+                                return ret;
+                        continue;
+                }
+
+                desc->hdr.bh1.block_status = TP_STATUS_LIBTRACE;
+                __atomic_store_n(&stream->block_refs[stream->block_offset], 1,
+                                 __ATOMIC_RELAXED);
+                stream->next_frame =
+                    (char *)desc + desc->hdr.bh1.offset_to_first_pkt;
+                stream->frames_left = desc->hdr.bh1.num_pkts;
+                if (stream->frames_left == 0)
+                        ring_finish_block(stream);
+        }
+
+        /* Rewrite the frame header in place as a TPACKET_V2 header, so the
+         * packet looks exactly like a frame from a TPACKET_V2 ring to the
+         * rest of this format, to RT and to anyone copying it. The two
+         * headers overlap so read everything we need first.
+         */
+        frame = TO_TP_HDR3(stream->next_frame);
+        next_offset = frame->tp_next_offset;
+        sec = frame->tp_sec;
+        nsec = frame->tp_nsec;
+        len = frame->tp_len;
+        caplen = frame->tp_snaplen;
+        mac = frame->tp_mac;
+        net = frame->tp_net;
+        vlan_tci = frame->hv1.tp_vlan_tci;
+
+        header = TO_TP_HDR2(stream->next_frame + V3_TO_V2_OFFSET);
+        header->tp_status = TP_STATUS_LIBTRACE;
+        header->tp_len = len;
+        header->tp_snaplen = caplen;
+        header->tp_mac = mac - V3_TO_V2_OFFSET;
+        header->tp_net = net - V3_TO_V2_OFFSET;
+        header->tp_sec = sec;
+        header->tp_nsec = nsec;
+        header->tp_vlan_tci = vlan_tci;
+        header->tp_padding = 0;
+
+        /* The packet holds its own reference to the block */
+        __atomic_add_fetch(&stream->block_refs[stream->block_offset], 1,
+                           __ATOMIC_RELAXED);
+        packet->buffer = header;
+
+        /* Move to the next frame, or on to the next block */
+        stream->frames_left--;
+        if (stream->frames_left == 0)
+                ring_finish_block(stream);
+        else
+                stream->next_frame += next_offset;
+
+        return linuxring_finish_read(libtrace, packet, stream);
+}
+
 inline static int linuxring_read_stream(libtrace_t *libtrace,
                                         libtrace_packet_t *packet,
                                         struct linux_per_stream_t *stream,
@@ -555,8 +860,10 @@ inline static int linuxring_read_stream(libtrace_t *libtrace,
 
         struct tpacket2_hdr *header;
         int ret;
-        unsigned int snaplen;
-        struct pollfd pollset[2];
+
+        if (stream->version == TPACKET_V3)
+                return linuxring_read_stream_v3(libtrace, packet, stream,
+                                                queue, block);
 
         packet->buf_control = TRACE_CTRL_EXTERNAL;
         packet->type = TRACE_RT_DATA_LINUX_RING;
@@ -580,95 +887,19 @@ inline static int linuxring_read_stream(libtrace_t *libtrace,
                 if (!block) {
                         return 0;
                 }
-                if ((ret = is_halted(libtrace)) != -1)
+                ret = linuxring_wait_for_data(libtrace, stream, queue);
+                if (ret != 1)
                         return ret;
-
-                pollset[0].fd = stream->fd;
-                pollset[0].events = POLLIN;
-                pollset[0].revents = 0;
-                if (queue) {
-                        pollset[1].fd = libtrace_message_queue_get_fd(queue);
-                        pollset[1].events = POLLIN;
-                        pollset[1].revents = 0;
-                }
-                /* Wait for more data or a message */
-                ret = poll(pollset, (queue ? 2 : 1), 500);
-                if (ret > 0) {
-                        if (pollset[0].revents == POLLIN)
-                                continue;
-                        else if (queue && pollset[1].revents == POLLIN)
-                                return READ_MESSAGE;
-                        else if (queue && pollset[1].revents) {
-                                /* Internal error */
-                                trace_set_err(libtrace, TRACE_ERR_BAD_STATE,
-                                              "Message queue error %d poll()",
-                                              pollset[1].revents);
-                                return READ_ERROR;
-                        } else {
-                                /* Try get the error from the socket */
-                                int err = ENETDOWN;
-                                socklen_t len = sizeof(err);
-                                getsockopt(stream->fd, SOL_SOCKET, SO_ERROR,
-                                           &err, &len);
-                                trace_set_err(libtrace, err,
-                                              "Socket error revents=%d poll()",
-                                              pollset[0].revents);
-                                return READ_ERROR;
-                        }
-                } else if (ret < 0) {
-                        if (errno != EINTR) {
-                                trace_set_err(libtrace, errno, "poll()");
-                                return -1;
-                        }
-                } else {
-                        /* Poll timed out. If we do not have access to the
-                         * message queue return and let libtrace check it,
-                         * otherwise loop.
-                         */
-                        if (!queue) {
-                                return READ_MESSAGE;
-                        }
-
-                        continue;
-                }
         }
         packet->buffer = header;
-        packet->trace = libtrace;
 
         header->tp_status = TP_STATUS_LIBTRACE;
 
-        /* If a snaplen was configured, automatically truncate the packet to
-         * the desired length.
-         */
-        snaplen =
-            LIBTRACE_MIN((int)LIBTRACE_PACKET_BUFSIZE - (int)sizeof(*header),
-                         (int)FORMAT_DATA->snaplen);
-
-        TO_TP_HDR2(packet->buffer)->tp_snaplen = LIBTRACE_MIN(
-            (unsigned int)snaplen, TO_TP_HDR2(packet->buffer)->tp_len);
-
         /* Move to next buffer */
         stream->rxring_offset++;
         stream->rxring_offset %= stream->req.tp_frame_nr;
 
-        packet->order =
-            (((uint64_t)TO_TP_HDR2(packet->buffer)->tp_sec) << 32) +
-            ((((uint64_t)TO_TP_HDR2(packet->buffer)->tp_nsec) << 32) /
-             1000000000);
-
-        if (packet->order <= stream->last_timestamp) {
-                packet->order = stream->last_timestamp + 1;
-        }
-
-        stream->last_timestamp = packet->order;
-
-        /* We just need to get prepare_packet to set all our packet pointers
-         * appropriately */
-        if (linuxring_prepare_packet(libtrace, packet, packet->buffer,
-                                     packet->type, 0))
-                return -1;
-        return linuxring_get_framing_length(packet) +
-               linuxring_get_capture_length(packet);
+        return linuxring_finish_read(libtrace, packet, stream);
 }
 
 static int linuxring_read_packet(libtrace_t *libtrace,
@@ -711,16 +942,24 @@ static int linuxring_pread_packets(libtrace_t *libtrace, libtrace_thread_t *t,
 static libtrace_eventobj_t linuxring_event(libtrace_t *libtrace,
                                            libtrace_packet_t *packet)
 {
-        struct tpacket2_hdr *header;
+        struct linux_per_stream_t *stream = FORMAT_DATA_FIRST;
         libtrace_eventobj_t event = {0, 0, 0.0, 0};
+        uint32_t tp_status;
 
         /* We must free the old packet, otherwise select() will instantly
          * return */
         ring_release_frame(libtrace, packet);
 
-        /* Fetch the current frame */
-        header = GET_CURRENT_BUFFER(FORMAT_DATA_FIRST);
-        uint32_t tp_status = (volatile uint32_t)header->tp_status;
+        /* Fetch the current frame, or block if we are between frames */
+        if (stream->version == TPACKET_V3 && stream->frames_left > 0)
+                tp_status = TP_STATUS_USER;
+        else if (stream->version == TPACKET_V3)
+                tp_status = __atomic_load_n(
+                    &GET_CURRENT_BLOCK(stream)->hdr.bh1.block_status,
+                    __ATOMIC_ACQUIRE);
+        else
+                tp_status = (volatile uint32_t)TO_TP_HDR2(
+                                GET_CURRENT_BUFFER(stream))->tp_status;
         if (tp_status & TP_STATUS_USER && tp_status != TP_STATUS_LIBTRACE) {
                 /* We have a frame waiting */
                 event.size = trace_read_packet(libtrace, packet);
@@ -755,7 +994,11 @@ static void linuxring_fin_packet(libtrace_packet_t *packet)
         /* If we own the packet (i.e. it's not a copy), we need to free it */
         if (packet->buf_control == TRACE_CTRL_EXTERNAL) {
                 /* If we don't have a ring its already been destroyed */
-                if (FORMAT_DATA_FIRST->rx_ring != MAP_FAILED)
+                struct linux_per_stream_t *stream = packet->fmtdata;
+
+                if (stream && stream->version == TPACKET_V3)
+                        ring_release_frame(packet->trace, packet);
+                else if (FORMAT_DATA_FIRST->rx_ring != MAP_FAILED)
                         ring_release_frame(packet->trace, packet);
                 else
                         packet->buffer = NULL;
@@ -772,17 +1015,17 @@ static inline bool tx_frame_available(uint32_t tp_status)
         return !(tp_status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING));
 }
 
-static int linuxring_write_packet(libtrace_out_t *libtrace,
-                                  libtrace_packet_t *packet)
+/* Copy a packet into the next free frame of the TX ring, waiting for the
+ * kernel to free a frame if the ring is full. The frame is marked as ready
+ * to send but the kernel is not told about it, that is up to the caller.
+ *
+ * Returns the number of bytes placed in the frame, or -1 on error.
+ */
+static int linuxring_fill_tx_frame(libtrace_out_t *libtrace,
+                                   libtrace_packet_t *packet)
 {
-        /* Check linuxring can write this type of packet */
-        if (!linuxring_can_write(packet)) {
-                return 0;
-        }
-
         struct tpacket2_hdr *header;
         struct pollfd pollset;
-        struct socket_addr;
         int ret;
         unsigned max_size;
         void *off;
@@ -795,6 +1038,14 @@ static int linuxring_write_packet(libtrace_out_t *libtrace,
                   FORMAT_DATA_OUT->req.tp_frame_size);
 
         while (!tx_frame_available((uint32_t volatile)header->tp_status)) {
+                /* The ring is full, make sure the kernel knows about the
+                 * frames we have queued so that it can free some up */
+                if (FORMAT_DATA_OUT->queue > 0) {
+                        FORMAT_DATA_OUT->queue = 0;
+                        if (linuxring_flush_output_nonblocking(libtrace) < 0)
+                                return -1;
+                }
+
                 /* if none available: wait on more data */
                 pollset.fd = FORMAT_DATA_OUT->fd;
                 pollset.events = POLLOUT;
@@ -826,7 +1077,11 @@ static int linuxring_write_packet(libtrace_out_t *libtrace,
         if (header->tp_len > max_size)
                 header->tp_len = max_size;
 
-        /* Fill packet - no sockaddr_ll in header when writing to the TX_RING */
+        /* Fill packet - no sockaddr_ll in header when writing to the TX_RING.
+         * A packet read from a ring: input is copied straight from its RX
+         * frame, which is the only copy PACKET_MMAP allows as the kernel
+         * only transmits from its own TX frames.
+         */
         off = ((void *)header) + (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll));
         memcpy(off, (char *)packet->payload, header->tp_len);
 
@@ -834,17 +1089,66 @@ static int linuxring_write_packet(libtrace_out_t *libtrace,
         header->tp_status = TP_STATUS_SEND_REQUEST;
         FORMAT_DATA_OUT->txring_offset = (FORMAT_DATA_OUT->txring_offset + 1) %
                                          FORMAT_DATA_OUT->req.tp_frame_nr;
+        FORMAT_DATA_OUT->queue++;
+
+        return header->tp_len;
+}
+
+static int linuxring_write_packet(libtrace_out_t *libtrace,
+                                  libtrace_packet_t *packet)
+{
+        int ret;
+
+        /* Check linuxring can write this type of packet */
+        if (!linuxring_can_write(packet)) {
+                return 0;
+        }
+
+        ret = linuxring_fill_tx_frame(libtrace, packet);
+        if (ret < 0) {
+                return -1;
+        }
 
         /* Notify kernel there are frames to send */
-        FORMAT_DATA_OUT->queue++;
         FORMAT_DATA_OUT->queue %= FORMAT_DATA_OUT->tx_max_queue;
         if (FORMAT_DATA_OUT->queue == 0) {
-                ret = linuxring_flush_output_nonblocking(libtrace);
-                if (ret < 0) {
+                if (linuxring_flush_output_nonblocking(libtrace) < 0) {
                         return -1;
                 }
         }
-        return header->tp_len;
+        return ret;
+}
+
+/* Write a batch of packets, filling a TX frame for each and only notifying
+ * the kernel once the whole batch is in the ring (or the ring fills up).
+ */
+static int linuxring_write_packets(libtrace_out_t *libtrace,
+                                   libtrace_packet_t *packets[],
+                                   int nb_packets)
+{
+        int i;
+
+        for (i = 0; i < nb_packets; i++) {
+                if (!linuxring_can_write(packets[i])) {
+                        continue;
+                }
+                if (linuxring_fill_tx_frame(libtrace, packets[i]) < 0) {
+                        break;
+                }
+        }
+
+        /* Notify kernel there are frames to send */
+        if (FORMAT_DATA_OUT->queue > 0) {
+                FORMAT_DATA_OUT->queue = 0;
+                if (linuxring_flush_output_nonblocking(libtrace) < 0) {
+                        return -1;
+                }
+        }
+
+        if (i < nb_packets && i == 0) {
+                return -1;
+        }
+        return i;
 }
 
 static void linuxring_help(void)
@@ -853,6 +1157,9 @@ static void linuxring_help(void)
         printf("Supported input URIs:\n");
         printf("\tring:eth0\n");
         printf("\n");
+        printf("Set TRACE_OPTION_RING_BLOCK_MODE to read from a block based "
+               "(TPACKET_V3) ring\n");
+        printf("\n");
         printf("Supported output URIs:\n");
         printf("\tring:eth0\n");
         printf("\n");
@@ -879,6 +1186,7 @@ static struct libtrace_format_t linuxring = {
     linuxring_fin_packet,               /* fin_packet */
     NULL,                               /* can_hold_packet */
     linuxring_write_packet,             /* write_packet */
+    linuxring_write_packets,            /* write_packets */
     linuxring_flush_output_nonblocking, /* flush_output */
     linuxring_get_link_type,            /* get_link_type */
     linuxring_get_direction,            /* get_direction */
@@ -944,6 +1252,7 @@ static struct libtrace_format_t linuxring = {
     NULL,                         /* fin_packet */
     NULL,                         /* can_hold_packet */
     NULL,                         /* write_packet */
+    NULL,                         /* write_packets */
     NULL,                         /* flush_output */
     linuxring_get_link_type,      /* get_link_type */
     linuxring_get_direction,      /* get_direction */
@@ -6,6 +6,7 @@
 #include "libtrace.h"
 #include "libtrace_int.h"
 #include "format_linux_xdp.h"
+#include "format_linux_xdp_filter.h"
 #include "format_linux_helpers.h"
 #include "format_linux_common.h"
 #include "hash_toeplitz.h"
@@ -31,6 +32,14 @@
 #include <linux/sockios.h>
 #include <linux/if_link.h>
 
+/* replace path with autoconf varible?? */
+static char *libtrace_xdp_kern[] = {
+    "../lib/format_linux_xdp_kern.bpf", // this is here for tests to correctly find the bpf program
+    "/usr/local/share/libtrace/format_linux_xdp_kern.bpf",
+    "/usr/share/libtrace/format_linux_xdp_kern.bpf",
+};
+static char libtrace_xdp_prog[] = "socket/libtrace_xdp";
+
 #define XDP_FORMAT_DATA ((xdp_format_data_t *)(libtrace->format_data))
 #define PACKET_META ((libtrace_xdp_meta_t *)(packet->header))
 
@@ -43,6 +52,11 @@
 #define MIN_FREE_FRAMES    64
 #define FRAME_SIZE         XSK_UMEM__DEFAULT_FRAME_SIZE
 #define XDP_BUSY_RETRY     5
+/* Extra frames at the end of an input UMEM, used by an output sharing the
+ * UMEM for packets that have to be copied */
+#define XDP_TX_FRAMES      512
+/* How long fin_output waits for queued packets to be sent, in ms */
+#define XDP_TX_DRAIN_WAIT  1000
 
 int hw_rings = 2048;
 int xdp_rings = 2048;
@@ -83,6 +97,8 @@ struct xsk_config {
 
     struct bpf_map *libtrace_ctrl_map;
     int libtrace_ctrl_map_fd;
+    /* size of the control map in the loaded XDP program */
+    uint32_t libtrace_ctrl_map_size;
 
     /* initial interface statistics */
     struct linux_dev_stats stats;
@@ -93,6 +109,9 @@ struct xsk_umem_info {
     struct xsk_ring_prod fq; // frames the kernel can use to insert received packets
     struct xsk_umem *umem;
     void *buffer;
+    uint64_t size;
+    /* the umem belongs to an input trace's socket */
+    bool shared;
 };
 
 struct xsk_socket_info {
@@ -101,6 +120,18 @@ struct xsk_socket_info {
     struct xsk_umem_info *umem;
     struct xsk_socket *xsk;
     int if_queue;
+    /* the kernel only needs kicking when it sets the need_wakeup flag */
+    bool need_wakeup;
+
+    /* stack of umem frames free to copy outgoing packets into */
+    uint64_t *tx_frames;
+    uint32_t tx_nb_free;
+    /* frames below tx_base belong to the input stream we share the umem
+     * with, they go back to its fill queue once sent */
+    uint64_t tx_base;
+    struct xsk_per_stream *shared;
+    /* descriptors submitted that have not completed yet */
+    uint32_t tx_outstanding;
 };
 
 struct xsk_per_stream {
@@ -118,6 +149,14 @@ typedef struct xdp_format_data {
     enum hasher_types hasher_type;
     xdp_state state;
     int snaplen;
+    /* keep 1 in every sample_rate packets, applied by the XDP program */
+    int sample_rate;
+    /* input trace an output shares its umem with */
+    libtrace_t *shared_input;
+    /* flow hash the XDP program calculates for the hasher thread */
+    enum libtrace_xdp_hash_mode hash_mode;
+    /* hashes packets the XDP program didn't hash for the hasher thread */
+    toeplitz_conf_t sw_hasher;
 } xdp_format_data_t;
 
 static struct bpf_object *load_bpf_and_xdp_attach(struct xsk_config *cfg);
@@ -134,8 +173,15 @@ static int linux_xdp_start_stream(struct xsk_config *cfg,
 static int xsk_populate_fill_ring(struct xsk_umem_info *umem);
 
 static bool linux_xdp_can_write(libtrace_packet_t *packet) {
+    libtrace_linktype_t ltype;
+
+    /* a packet already sent without a copy no longer has a buffer */
+    if (packet->buffer == NULL) {
+        return false;
+    }
+
     /* Get the linktype */
-    libtrace_linktype_t ltype = trace_get_link_type(packet);
+    ltype = trace_get_link_type(packet);
 
     if (ltype == TRACE_TYPE_CONTENT_INVALID) {
         return false;
@@ -192,6 +238,7 @@ static struct xsk_umem_info *configure_xsk_umem(void *buffer, uint64_t size) {
     }
 
     umem->buffer = buffer;
+    umem->size = size;
 
     return umem;
 }
@@ -219,6 +266,13 @@ static struct xsk_socket_info *xsk_configure_socket(struct xsk_config *cfg,
     xsk_cfg.libbpf_flags = cfg->libbpf_flags | XSK_LIBBPF_FLAGS__INHIBIT_PROG_LOAD;
     xsk_cfg.xdp_flags = cfg->xdp_flags;
     xsk_cfg.bind_flags = cfg->xsk_bind_flags;
+#ifdef XDP_USE_NEED_WAKEUP
+    /* only make syscalls to transmit when the kernel asks for them */
+    if (dir == 1) {
+        xsk_cfg.bind_flags |= XDP_USE_NEED_WAKEUP;
+        xsk_info->need_wakeup = true;
+    }
+#endif
 
     for (i = 0; i < XDP_BUSY_RETRY; i++) {
         /* inbound */
@@ -230,6 +284,21 @@ static struct xsk_socket_info *xsk_configure_socket(struct xsk_config *cfg,
                                      &xsk_info->rx,
                                      NULL,
                                      &xsk_cfg);
+        /* outbound, sharing an input's umem */
+        } else if (dir == 1 && umem->shared) {
+#ifdef HAVE_XSK_SOCKET_CREATE_SHARED
+            ret = xsk_socket__create_shared(&xsk_info->xsk,
+                                            cfg->ifname,
+                                            if_queue,
+                                            umem->umem,
+                                            NULL,
+                                            &xsk_info->tx,
+                                            &umem->fq,
+                                            &umem->cq,
+                                            &xsk_cfg);
+#else
+            ret = -EOPNOTSUPP;
+#endif
         /* outbound */
         } else if (dir == 1) {
             ret = xsk_socket__create(&xsk_info->xsk,
@@ -279,21 +348,80 @@ static int xsk_populate_fill_ring(struct xsk_umem_info *umem) {
     return 0;
 }
 
+static int xsk_init_tx_frames(struct xsk_socket_info *xsk, uint64_t base) {
+
+    uint64_t addr;
+
+    xsk->tx_frames = calloc((xsk->umem->size - base) / FRAME_SIZE,
+                            sizeof(uint64_t));
+    if (xsk->tx_frames == NULL) {
+        return -1;
+    }
+
+    for (addr = base; addr + FRAME_SIZE <= xsk->umem->size;
+         addr += FRAME_SIZE) {
+        xsk->tx_frames[xsk->tx_nb_free++] = addr;
+    }
+    xsk->tx_base = base;
+
+    return 0;
+}
+
+static void xsk_destroy_socket(struct xsk_socket_info *xsk) {
+
+    xsk_socket__delete(xsk->xsk);
+    /* a shared umem is deleted by the input that owns it */
+    if (!xsk->umem->shared) {
+        xsk_umem__delete(xsk->umem->umem);
+    }
+    free(xsk->umem);
+    free(xsk->tx_frames);
+    free(xsk);
+}
+
+static void linux_xdp_kick_tx(struct xsk_socket_info *xsk) {
+
+    /* does the socket need a wakeup? */
+    if (!xsk->need_wakeup || xsk_ring_prod__needs_wakeup(&xsk->tx)) {
+        sendto(xsk_socket__fd(xsk->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+    }
+}
+
 static void linux_xdp_complete_tx(struct xsk_socket_info *xsk) {
 
-    unsigned int rcvd;
+    unsigned int rcvd, i;
     uint32_t idx;
+    uint64_t addr;
 
-    /* does the socket need a wakeup? */
-    if (xsk_ring_prod__needs_wakeup(&xsk->tx)) {
+    if (xsk->tx_outstanding == 0) {
+        return;
+    }
+
+    /* the kernel may have stalled waiting on us */
+    if (xsk->need_wakeup && xsk_ring_prod__needs_wakeup(&xsk->tx)) {
         sendto(xsk_socket__fd(xsk->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
     }
 
-    /* free completed TX buffers */
-    rcvd = xsk_ring_cons__peek(&xsk->umem->cq, xdp_rings, &idx);
+    /* free all completed TX frames at once */
+    rcvd = xsk_ring_cons__peek(&xsk->umem->cq, xsk->tx_outstanding, &idx);
+    for (i = 0; i < rcvd; i++) {
+        addr = *xsk_ring_cons__comp_addr(&xsk->umem->cq, idx++);
+        addr = xsk_umem__extract_addr(addr);
+
+        if (addr < xsk->tx_base) {
+            /* a received packet sent without a copy, hand the frame back
+             * to the input to refill */
+            libtrace_ringbuffer_swrite(&xsk->shared->addr_free_ring,
+                                       (void *)addr);
+        } else {
+            xsk->tx_frames[xsk->tx_nb_free++] = addr;
+        }
+    }
+
     if (rcvd > 0) {
         /* release the number of sent frames */
         xsk_ring_cons__release(&xsk->umem->cq, rcvd);
+        xsk->tx_outstanding -= rcvd;
     }
 }
 
@@ -342,15 +470,134 @@ static uint64_t linux_xdp_get_time() {
     return sys_time;
 }
 
+/* Copies the trace's BPF filter into the control map so the XDP program can
+ * drop unwanted packets before they reach the socket. libtrace still runs
+ * the filter over every packet it reads, so a filter that can't be pushed
+ * down only costs performance. */
+static void linux_xdp_push_filter(libtrace_t *libtrace UNUSED,
+                                  libtrace_ctrl_map_t *ctrl_map UNUSED) {
+
+#if defined(HAVE_LIBPCAP) && defined(HAVE_BPF)
+    struct bpf_program prog;
+    struct bpf_program *compiled = NULL;
+    libtrace_xdp_insn_t *insns;
+    pcap_t *pcap = NULL;
+
+    if (libtrace->filter == NULL) {
+        return;
+    }
+
+    if (libtrace->filter->flag) {
+        compiled = &libtrace->filter->filter;
+    } else {
+        pcap = pcap_open_dead(libtrace_to_pcap_dlt(TRACE_TYPE_ETH),
+                              XDP_FORMAT_DATA->snaplen);
+        if (pcap == NULL) {
+            return;
+        }
+        if (pcap_compile(pcap, &prog, libtrace->filter->filterstring,
+                         1, 0) == -1) {
+            pcap_close(pcap);
+            return;
+        }
+        compiled = &prog;
+    }
+
+    /* libbpf claims struct bpf_insn for eBPF, the instructions pcap
+     * produced are classic BPF which libtrace_xdp_insn_t mirrors */
+    insns = (libtrace_xdp_insn_t *)compiled->bf_insns;
+    if (xdp_filter_supported(insns, compiled->bf_len)) {
+        memcpy(ctrl_map->filter, insns,
+               compiled->bf_len * sizeof(libtrace_xdp_insn_t));
+        ctrl_map->filter_len = compiled->bf_len;
+    }
+
+    if (pcap != NULL) {
+        pcap_freecode(&prog);
+        pcap_close(pcap);
+    }
+#endif
+}
+
+/* Fills in the libtrace metadata in front of a received packet. The XDP
+ * program may have left the original length of a truncated packet and its
+ * flow hash just ahead of the packet data */
+static inline void linux_xdp_fill_meta(libtrace_t *libtrace,
+                                       libtrace_packet_t *packet,
+                                       uint8_t *pkt_buffer,
+                                       uint32_t pkt_len,
+                                       uint64_t timestamp) {
+
+    libtrace_xdp_meta_t *meta;
+    libtrace_xdp_kmeta_t kmeta;
+
+    /* read the XDP metadata before the libtrace metadata overwrites it */
+    memcpy(&kmeta, pkt_buffer - sizeof(libtrace_xdp_kmeta_t), sizeof(kmeta));
+    if (kmeta.magic != XDP_KMETA_MAGIC) {
+        kmeta.flags = 0;
+    }
+
+    meta = (libtrace_xdp_meta_t *)(pkt_buffer - FRAME_HEADROOM);
+    meta->timestamp = timestamp;
+    if ((kmeta.flags & XDP_KMETA_TRUNCATED) && kmeta.wire_len > pkt_len) {
+        meta->packet_len = kmeta.wire_len;
+    } else {
+        meta->packet_len = pkt_len;
+    }
+    /* a hash of 0 tells the hasher to fall back to software hashing */
+    if (kmeta.flags & XDP_KMETA_HASHED) {
+        trace_packet_set_hash(packet, kmeta.hash);
+    } else {
+        trace_packet_set_hash(packet, 0);
+    }
+    meta->cap_len = LIBTRACE_MIN((unsigned int)XDP_FORMAT_DATA->snaplen,
+                                 (unsigned int)pkt_len);
+}
+
+/* Fields are only ever appended to libtrace_ctrl_map_t, so the size of the
+ * control map tells us which of them the loaded XDP program knows about. A
+ * program built before filtering, sampling and truncation were offloaded
+ * ignores those fields, which would silently do nothing */
+#define XDP_CTRL_HAS_OFFLOAD(size) \
+    ((size) >= offsetof(libtrace_ctrl_map_t, hash_mode))
+
+static uint32_t linux_xdp_ctrl_map_size(int map_fd) {
+
+    struct bpf_map_info info;
+    __u32 len = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+    if (bpf_obj_get_info_by_fd(map_fd, &info, &len) != 0) {
+        return 0;
+    }
+    return info.value_size;
+}
+
 static int linux_xdp_init_control_map(libtrace_t *libtrace) {
 
     libtrace_ctrl_map_t ctrl_map;
+    uint32_t ctrl_size;
     int key = 0;
 
     if (XDP_FORMAT_DATA->cfg.libtrace_ctrl_map_fd <= 0) {
        return -1;
     }
 
+    ctrl_size = linux_xdp_ctrl_map_size(
+        XDP_FORMAT_DATA->cfg.libtrace_ctrl_map_fd);
+    XDP_FORMAT_DATA->cfg.libtrace_ctrl_map_size = ctrl_size;
+
+    /* libtrace applies the filter and snap length again in userspace, but
+     * it has no way to sample on behalf of an older XDP program */
+    if (XDP_FORMAT_DATA->sample_rate > 1 && !XDP_CTRL_HAS_OFFLOAD(ctrl_size)) {
+        trace_set_err(libtrace, TRACE_ERR_OPTION_UNAVAIL,
+            "The XDP program in %s does not support sampling, rebuild it "
+            "from format_linux_xdp_kern.c", XDP_FORMAT_DATA->cfg.bpf_filename);
+        return -1;
+    }
+
+    memset(&ctrl_map, 0, sizeof(ctrl_map));
+
     /* if the trace has a dedicated hasher there is only a single input queue */
     if (trace_has_dedicated_hasher(libtrace)) {
         ctrl_map.max_queues = 1;
@@ -360,6 +607,22 @@ static int linux_xdp_init_control_map(libtrace_t *libtrace) {
 
     ctrl_map.state = XDP_NOT_STARTED;
 
+    /* let the XDP program do the sampling, truncation and filtering so
+     * unwanted bytes never cross into userspace */
+    if (XDP_CTRL_HAS_OFFLOAD(ctrl_size)) {
+        if (XDP_FORMAT_DATA->sample_rate > 1) {
+            ctrl_map.sample_rate = XDP_FORMAT_DATA->sample_rate;
+        }
+        if (XDP_FORMAT_DATA->snaplen > 0) {
+            ctrl_map.snaplen = XDP_FORMAT_DATA->snaplen;
+        }
+        linux_xdp_push_filter(libtrace, &ctrl_map);
+    }
+    /* an older XDP program can't hash, its packets are hashed in software */
+    if (ctrl_size >= sizeof(libtrace_ctrl_map_t)) {
+        ctrl_map.hash_mode = XDP_FORMAT_DATA->hash_mode;
+    }
+
     if (bpf_map_update_elem(XDP_FORMAT_DATA->cfg.libtrace_ctrl_map_fd,
                             &key,
                             &ctrl_map,
@@ -525,7 +788,9 @@ static int linux_xdp_setup_xdp(libtrace_t *libtrace) {
         return -1;
     } else {
         if (linux_xdp_init_control_map(libtrace) == -1) {
-            trace_set_err(libtrace, TRACE_ERR_INIT_FAILED, "Unable to init libtrace XDP control map");
+            if (!trace_is_err(libtrace)) {
+                trace_set_err(libtrace, TRACE_ERR_INIT_FAILED, "Unable to init libtrace XDP control map");
+            }
             return -1;
         }
     }
@@ -752,10 +1017,63 @@ static int linux_xdp_pause_input(libtrace_t * libtrace) {
     return ret;
 }
 
+/* Starts an output stream on the umem of the first stream of an xdp input,
+ * packets read from that stream can then be sent without a copy */
+static int linux_xdp_start_shared_stream(struct xsk_config *cfg,
+                                         struct xsk_per_stream *stream,
+                                         struct xsk_config *input_cfg,
+                                         struct xsk_per_stream *input) {
+
+    struct xsk_umem_info *umem;
+
+    umem = calloc(1, sizeof(*umem));
+    if (umem == NULL) {
+        return ENOMEM;
+    }
+    umem->umem = input->xsk->umem->umem;
+    umem->buffer = input->xsk->umem->buffer;
+    umem->size = input->xsk->umem->size;
+    umem->shared = true;
+
+    stream->xsk = xsk_configure_socket(cfg, umem, 0, 1);
+    if (stream->xsk == NULL) {
+        free(umem);
+        return errno;
+    }
+    stream->xsk->shared = input;
+
+    /* a socket on the same interface and queue as the input shares its
+     * fill and completion rings, libbpf leaves the ones we passed in
+     * untouched. The input only receives, so the completion ring is ours
+     * to consume */
+    if (strcmp(cfg->ifname, input_cfg->ifname) == 0 &&
+        input->xsk->if_queue == stream->xsk->if_queue) {
+        umem->fq = input->xsk->umem->fq;
+        umem->cq = input->xsk->umem->cq;
+    }
+
+    /* the input reserves the last XDP_TX_FRAMES frames of its UMEM for
+     * copying packets into, and only fills its ring from the ones before */
+    if (umem->size < XDP_TX_FRAMES * FRAME_SIZE ||
+        xsk_init_tx_frames(stream->xsk,
+                           umem->size - XDP_TX_FRAMES * FRAME_SIZE) < 0) {
+        xsk_destroy_socket(stream->xsk);
+        stream->xsk = NULL;
+        return ENOMEM;
+    }
+
+    libtrace_ringbuffer_init(&stream->addr_free_ring, NUM_FRAMES,
+                             LIBTRACE_RINGBUFFER_BLOCKING);
+
+    return 0;
+}
+
 static int linux_xdp_start_output(libtrace_out_t *libtrace) {
 
     struct xsk_per_stream empty_stream = {NULL,0,{0},0};
     struct xsk_per_stream *stream;
+    libtrace_t *input = XDP_FORMAT_DATA->shared_input;
+    libtrace_list_node_t *node;
     int ret;
 
     /* insert empty stream into the list */
@@ -764,6 +1082,26 @@ static int linux_xdp_start_output(libtrace_out_t *libtrace) {
     /* get the stream from the list */
     stream = libtrace_list_get_index(XDP_FORMAT_DATA->per_stream, 0)->data;
 
+    if (input != NULL) {
+        node = libtrace_list_get_index(
+            ((xdp_format_data_t *)input->format_data)->per_stream, 0);
+        if (node == NULL ||
+            ((struct xsk_per_stream *)node->data)->xsk == NULL) {
+            trace_set_err_out(libtrace, TRACE_ERR_INIT_FAILED,
+                "The input trace must be started before an output can "
+                "share its packet buffers");
+            return -1;
+        }
+        if ((ret = linux_xdp_start_shared_stream(&XDP_FORMAT_DATA->cfg,
+                stream, &((xdp_format_data_t *)input->format_data)->cfg,
+                node->data)) != 0) {
+            trace_set_err_out(libtrace, TRACE_ERR_INIT_FAILED,
+                "Unable to start shared output stream: %s", strerror(ret));
+            return -1;
+        }
+        return 0;
+    }
+
     /* start the stream */
     if ((ret = linux_xdp_start_stream(&XDP_FORMAT_DATA->cfg, stream, 0, 1)) != 0) {
         trace_set_err_out(libtrace, TRACE_ERR_INIT_FAILED,
@@ -784,8 +1122,12 @@ static int linux_xdp_start_stream(struct xsk_config *cfg,
     int ret, sock_fd;
     struct xsk_umem_info *umem;
 
-    // Allocate memory for NUM_FRAMES of default XDP frame size
+    // Allocate memory for NUM_FRAMES of default XDP frame size, inputs get
+    // some spare frames for an output that shares the umem
     pkt_buf_size = NUM_FRAMES * FRAME_SIZE;
+    if (dir == 0) {
+        pkt_buf_size += XDP_TX_FRAMES * FRAME_SIZE;
+    }
     pkt_buf = mmap(NULL, pkt_buf_size,
                    PROT_READ | PROT_WRITE,
                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
@@ -809,6 +1151,15 @@ static int linux_xdp_start_stream(struct xsk_config *cfg,
         return errno;
     }
 
+    // every frame is free for transmitting (only Tx)
+    if (dir == 1) {
+        if (xsk_init_tx_frames(stream->xsk, 0) < 0) {
+            xsk_destroy_socket(stream->xsk);
+            stream->xsk = NULL;
+            return ENOMEM;
+        }
+    }
+
     // insert socket into xsks map (only RX)
     if (dir == 0) {
         sock_fd = xsk_socket__fd(stream->xsk->xsk);
@@ -896,7 +1247,6 @@ static int linux_xdp_read_stream(libtrace_t *libtrace,
     uint64_t pkt_addr;
     uint8_t *pkt_buffer;
     unsigned int i;
-    libtrace_xdp_meta_t *meta;
     struct pollfd fds;
     int ret;
     uint64_t sys_time;
@@ -979,12 +1329,8 @@ static int linux_xdp_read_stream(libtrace_t *libtrace,
         packet[i]->error = 1;
         packet[i]->order = sys_time + i;
 
-        meta = (libtrace_xdp_meta_t *)packet[i]->buffer;
-        meta->timestamp = sys_time + i;
-        /* we dont really snap packets but we can pretend to */
-        meta->packet_len = pkt_len;
-        meta->cap_len = LIBTRACE_MIN((unsigned int)XDP_FORMAT_DATA->snaplen,
-                                     (unsigned int)pkt_len);
+        linux_xdp_fill_meta(libtrace, packet[i], pkt_buffer, pkt_len,
+                            sys_time + i);
 
         /* next packet */
         idx_rx++;
@@ -1035,25 +1381,25 @@ static int linux_xdp_pread_packets(libtrace_t *libtrace,
                                  nb_packets);
 }
 
-static int linux_xdp_write_packet(libtrace_out_t *libtrace,
-                                  libtrace_packet_t *packet) {
+/* Can the packet be sent straight out of the umem it was received into */
+static inline bool linux_xdp_is_shared_frame(struct xsk_socket_info *xsk,
+                                             libtrace_packet_t *packet) {
 
-    struct xsk_per_stream *stream;
-    libtrace_list_node_t *node;
-    uint32_t idx;
-    struct xdp_desc *tx_desc;
-    void *offset;
-    uint32_t cap_len;
+    return xsk->shared != NULL &&
+           packet->type == TRACE_RT_DATA_XDP &&
+           packet->buf_control == TRACE_CTRL_EXTERNAL &&
+           packet->fmtdata == xsk->shared;
+}
 
-    /* can xdp write this type of packet? */
-    if (!linux_xdp_can_write(packet)) {
-        return 0;
-    }
+static struct xsk_per_stream *linux_xdp_get_output_stream(
+    libtrace_out_t *libtrace) {
+
+    libtrace_list_node_t *node;
 
     if (libtrace->format_data == NULL) {
         trace_set_err_out(libtrace, TRACE_ERR_BAD_FORMAT, "Trace format data missing, "
             "call trace_create_output() before calling trace_write_packet()");
-        return -1;
+        return NULL;
     }
 
     /* get stream data */
@@ -1061,44 +1407,173 @@ static int linux_xdp_write_packet(libtrace_out_t *libtrace,
     if (node == NULL) {
         trace_set_err_out(libtrace, TRACE_ERR_INIT_FAILED, "Unable to get XDP "
             "output stream in linux_xdp_write_packet()");
-        return -1;
+        return NULL;
     }
-    stream = (struct xsk_per_stream *)node->data;
 
+    return (struct xsk_per_stream *)node->data;
+}
 
-    /* is there a free frame for the packet */
-    while (xsk_ring_prod__reserve(&stream->xsk->tx, 1, &idx) != 1) {
-        /* try free up some frames */
-        linux_xdp_complete_tx(stream->xsk);
-    }
+/* Points a tx descriptor at the packet, copying it into a free frame unless
+ * it already lives in our umem */
+static void linux_xdp_fill_tx_desc(struct xsk_socket_info *xsk,
+                                   libtrace_packet_t *packet,
+                                   uint32_t idx) {
 
-    /* get the tx descriptor */
-    tx_desc = xsk_ring_prod__tx_desc(&stream->xsk->tx, idx);
+    struct xdp_desc *tx_desc;
+    uint32_t cap_len;
+    uint64_t addr;
 
+    tx_desc = xsk_ring_prod__tx_desc(&xsk->tx, idx);
     cap_len = trace_get_capture_length(packet);
 
-    /* get the offset to write packet to within the umem */
-    offset = xsk_umem__get_data(stream->xsk->umem->buffer, tx_desc->addr);
+    if (linux_xdp_is_shared_frame(xsk, packet)) {
+        tx_desc->addr = (uint8_t *)packet->payload -
+                        (uint8_t *)xsk->umem->buffer;
+        /* the output now owns the frame and hands it back to the input
+         * once it has been sent, after which the kernel may receive into
+         * it again. Detach the packet from the frame so the caller can't
+         * read it afterwards and fin_packet doesn't release it as well */
+        packet->fmtdata = NULL;
+        packet->buffer = NULL;
+        packet->header = NULL;
+        packet->payload = NULL;
+        trace_clear_cache(packet);
+    } else {
+        addr = xsk->tx_frames[--xsk->tx_nb_free];
+        memcpy(xsk_umem__get_data(xsk->umem->buffer, addr),
+               (char *)packet->payload, cap_len);
+        tx_desc->addr = addr;
+    }
 
-    /* copy the packet */
-    memcpy(offset, (char *)packet->payload, cap_len);
     /* set packet length */
     tx_desc->len = cap_len;
+}
+
+static int linux_xdp_write_packets(libtrace_out_t *libtrace,
+                                   libtrace_packet_t *packets[],
+                                   int nb_packets) {
+
+    struct xsk_per_stream *stream;
+    struct xsk_socket_info *xsk;
+    uint32_t idx, frames, count;
+    int i = 0, j, k;
+
+    if ((stream = linux_xdp_get_output_stream(libtrace)) == NULL) {
+        return -1;
+    }
+    xsk = stream->xsk;
+
+    while (i < nb_packets) {
+
+        /* reap completed frames in bulk */
+        linux_xdp_complete_tx(xsk);
+
+        /* find the run of packets we have descriptors and frames for */
+        frames = xsk->tx_nb_free;
+        count = 0;
+        for (j = i; j < nb_packets && count < (uint32_t)xdp_rings; j++) {
+            if (!linux_xdp_can_write(packets[j])) {
+                continue;
+            }
+            if (trace_get_capture_length(packets[j]) >
+                FRAME_SIZE - FRAME_HEADROOM) {
+                break;
+            }
+            if (!linux_xdp_is_shared_frame(xsk, packets[j])) {
+                if (frames == 0) {
+                    break;
+                }
+                frames--;
+            }
+            count++;
+        }
+
+        if (count == 0) {
+            if (j < nb_packets && trace_get_capture_length(packets[j]) >
+                FRAME_SIZE - FRAME_HEADROOM) {
+                trace_set_err_out(libtrace, TRACE_ERR_BAD_PACKET,
+                    "Packet is too large for an XDP frame");
+                return j > 0 ? j : -1;
+            }
+            if (j > i) {
+                /* nothing in this run could be written by XDP */
+                i = j;
+            } else {
+                /* out of frames, wait for the kernel to send some */
+                linux_xdp_kick_tx(xsk);
+            }
+            continue;
+        }
+
+        /* is there space in the tx ring for the run */
+        if (xsk_ring_prod__reserve(&xsk->tx, count, &idx) != count) {
+            linux_xdp_kick_tx(xsk);
+            continue;
+        }
+
+        for (k = i; k < j; k++) {
+            if (linux_xdp_can_write(packets[k])) {
+                linux_xdp_fill_tx_desc(xsk, packets[k], idx++);
+            }
+        }
+
+        /* submit the whole run and tell the kernel once */
+        xsk_ring_prod__submit(&xsk->tx, count);
+        xsk->tx_outstanding += count;
+        linux_xdp_kick_tx(xsk);
+
+        i = j;
+    }
 
-    /* submit the frame */
-    xsk_ring_prod__submit(&stream->xsk->tx, 1);
+    return nb_packets;
+}
 
-    /* complete the transaction */
-    linux_xdp_complete_tx(stream->xsk);
+static int linux_xdp_write_packet(libtrace_out_t *libtrace,
+                                  libtrace_packet_t *packet) {
+
+    uint32_t cap_len;
+
+    /* can xdp write this type of packet? */
+    if (!linux_xdp_can_write(packet)) {
+        return 0;
+    }
+
+    cap_len = trace_get_capture_length(packet);
+
+    if (linux_xdp_write_packets(libtrace, &packet, 1) < 1) {
+        return -1;
+    }
 
     return cap_len;
 }
 
+static int linux_xdp_flush_output(libtrace_out_t *libtrace) {
+
+    struct xsk_per_stream *stream;
+    int waited = 0;
+
+    if ((stream = linux_xdp_get_output_stream(libtrace)) == NULL) {
+        return -1;
+    }
+
+    /* wait for everything queued to be sent */
+    while (stream->xsk->tx_outstanding > 0 && waited < XDP_TX_DRAIN_WAIT) {
+        linux_xdp_kick_tx(stream->xsk);
+        linux_xdp_complete_tx(stream->xsk);
+        if (stream->xsk->tx_outstanding > 0) {
+            usleep(1000);
+            waited++;
+        }
+    }
+
+    return 0;
+}
+
 static int linux_xdp_prepare_packet(libtrace_t *libtrace UNUSED, libtrace_packet_t *packet,
     void *buffer, libtrace_rt_types_t rt_type, uint32_t flags) {
 
     if (packet->buffer != buffer && packet->buf_control == TRACE_CTRL_PACKET) {
-        free(packet->buffer);
+        trace_free_packet_buffer(packet);
     }
 
     if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -1125,7 +1600,6 @@ static libtrace_eventobj_t linux_xdp_event(libtrace_t *libtrace,
     uint64_t pkt_addr;
     uint8_t *pkt_buffer;
     uint32_t idx_rx = 0;
-    libtrace_xdp_meta_t *meta;
     struct xsk_per_stream *stream;
     libtrace_list_node_t *node;
     uint64_t sys_time;
@@ -1168,18 +1642,12 @@ static libtrace_eventobj_t linux_xdp_event(libtrace_t *libtrace,
         packet->error = 1;
         packet->fmtdata = stream;
 
-        meta = (libtrace_xdp_meta_t *)packet->buffer;
         sys_time = linux_xdp_get_time();
         if (stream->prev_sys_time >= sys_time) {
             sys_time = stream->prev_sys_time + 1;
         }
         stream->prev_sys_time = sys_time;
-        meta->timestamp = sys_time;
-
-        /* we dont really snap packets but we can pretend to */
-        meta->packet_len = pkt_len;
-        meta->cap_len = LIBTRACE_MIN((unsigned int)XDP_FORMAT_DATA->snaplen,
-                                     (unsigned int)pkt_len);
+        linux_xdp_fill_meta(libtrace, packet, pkt_buffer, pkt_len, sys_time);
 
         event.type = TRACE_EVENT_PACKET;
         event.size = pkt_len;
@@ -1210,10 +1678,7 @@ static int linux_xdp_destroy_streams(libtrace_list_t *streams) {
 
         if (stream) {
             if (stream->xsk != NULL) {
-                xsk_socket__delete(stream->xsk->xsk);
-                xsk_umem__delete(stream->xsk->umem->umem);
-                free(stream->xsk->umem);
-                free(stream->xsk);
+                xsk_destroy_socket(stream->xsk);
             }
             libtrace_ringbuffer_destroy(&stream->addr_free_ring);
         }
@@ -1254,6 +1719,11 @@ static int linux_xdp_fin_input(libtrace_t *libtrace) {
 static int linux_xdp_fin_output(libtrace_out_t *libtrace) {
 
     if (FORMAT_DATA != NULL) {
+        /* don't lose packets still waiting in the tx ring */
+        if (libtrace->started) {
+            linux_xdp_flush_output(libtrace);
+        }
+
         linux_xdp_destroy_streams(XDP_FORMAT_DATA->per_stream);
         libtrace_list_deinit(XDP_FORMAT_DATA->per_stream);
 
@@ -1366,6 +1836,7 @@ static void linux_xdp_get_stats(libtrace_t *libtrace, libtrace_stat_t *stats) {
     stats->missing = 0;
     stats->captured = 0;
     stats->errors = 0;
+    stats->filtered = 0;
 
     for (int i = 0; i < thread_count; i++) {
 
@@ -1397,6 +1868,8 @@ static void linux_xdp_get_stats(libtrace_t *libtrace, libtrace_stat_t *stats) {
             /* add up stats from each cpu */
             stats->received += xdp[j].received_packets;
             stats->received_valid = 1;
+            stats->filtered += xdp[j].filtered_packets;
+            stats->filtered_valid = 1;
         }
     }
 
@@ -1451,6 +1924,7 @@ static void linux_xdp_get_thread_stats(libtrace_t *libtrace,
     /* init stats */
     stats->received = 0;
     stats->captured = 0;
+    stats->filtered = 0;
 
     /* get stats from XDP socket */
     if (getsockopt(xsk_socket__fd(stream_data->xsk->xsk),
@@ -1475,6 +1949,8 @@ static void linux_xdp_get_thread_stats(libtrace_t *libtrace,
         /* populate stats structure */
         stats->received += xdp[i].received_packets;
         stats->received_valid = 1;
+        stats->filtered += xdp[i].filtered_packets;
+        stats->filtered_valid = 1;
     }
 
     stats->captured = stats->received - stats->dropped;
@@ -1484,6 +1960,20 @@ static void linux_xdp_get_thread_stats(libtrace_t *libtrace,
     return;
 }
 
+/* Hasher used with a hasher thread, returns the hash the XDP program
+ * calculated for the packet. Packets without one, either because the XDP
+ * program is too old to hash or it couldn't add the metadata, are hashed in
+ * software instead. A flow the XDP program happens to hash to 0 is always
+ * hashed in software too, so it still lands on a single thread */
+static uint64_t linux_xdp_hash_packet(const libtrace_packet_t *packet,
+                                      void *data) {
+
+    if (packet->hash != 0) {
+        return packet->hash;
+    }
+    return toeplitz_hash_packet(packet, (toeplitz_conf_t *)data);
+}
+
 static int linux_xdp_config_input(libtrace_t *libtrace,
                                   trace_option_t options,
                                   void *data) {
@@ -1506,10 +1996,28 @@ static int linux_xdp_config_input(libtrace_t *libtrace,
                 case HASHER_UNIDIRECTIONAL:
                 case HASHER_BIDIRECTIONAL:
                     XDP_FORMAT_DATA->hasher_type = *(enum hasher_types*)data;
+                    XDP_FORMAT_DATA->hash_mode = XDP_HASH_NONE;
                     // Set RSS hash key on NIC
                     if (linux_set_nic_hasher(XDP_FORMAT_DATA->cfg.ifname, XDP_FORMAT_DATA->hasher_type) != 0) {
-                        fprintf(stderr, "Linux XDP: couldn't configure RSS hashing! falling back to software hashing\n");
-                        return -1;
+                        if (XDP_FORMAT_DATA->hasher_type == HASHER_BALANCE) {
+                            fprintf(stderr, "Linux XDP: couldn't configure RSS hashing! falling back to software hashing\n");
+                            return -1;
+                        }
+                        /* Without RSS all packets arrive on one queue and
+                         * an AF_XDP socket can only receive from the queue
+                         * it is bound to, so a hasher thread has to spread
+                         * them. Have the XDP program hash each flow so the
+                         * hasher thread doesn't need to parse packets */
+                        fprintf(stderr, "Linux XDP: couldn't configure RSS hashing! falling back to hashing in XDP\n");
+                        XDP_FORMAT_DATA->hash_mode =
+                            XDP_FORMAT_DATA->hasher_type == HASHER_BIDIRECTIONAL ?
+                            XDP_HASH_BIDIRECTIONAL : XDP_HASH_UNIDIRECTIONAL;
+                        toeplitz_init_config(&XDP_FORMAT_DATA->sw_hasher,
+                            XDP_FORMAT_DATA->hasher_type == HASHER_BIDIRECTIONAL);
+                        libtrace->hasher = linux_xdp_hash_packet;
+                        libtrace->hasher_data = &XDP_FORMAT_DATA->sw_hasher;
+                        libtrace->hasher_owner = HASH_OWNED_FORMAT;
+                        return 0;
                     }
                     // check for any flow director rules
                     if ((ret = linux_get_nic_flow_rule_count(XDP_FORMAT_DATA->cfg.ifname)) > 0) {
@@ -1551,6 +2059,45 @@ static int linux_xdp_config_input(libtrace_t *libtrace,
             XDP_FORMAT_DATA->cfg.xsk_bind_flags &= XDP_COPY;
             XDP_FORMAT_DATA->cfg.xsk_bind_flags |= XDP_ZEROCOPY;
             return 0;
+        case TRACE_OPTION_SAMPLE_RATE:
+            XDP_FORMAT_DATA->sample_rate = *(int *)data;
+            return 0;
+        case TRACE_OPTION_FLOW_SAMPLE_RATE:
+        case TRACE_OPTION_RING_BLOCK_MODE:
+            break;
+    }
+
+    return -1;
+}
+
+static int linux_xdp_config_output(libtrace_out_t *libtrace,
+                                   trace_option_output_t option,
+                                   void *data) {
+
+    libtrace_t *input;
+
+    switch (option) {
+        case TRACE_OPTION_OUTPUT_XDP_SHARED_UMEM:
+            input = (libtrace_t *)data;
+#ifdef HAVE_XSK_SOCKET_CREATE_SHARED
+            if (input == NULL || input->format == NULL ||
+                strcmp(input->format->name, "xdp") != 0) {
+                trace_set_err_out(libtrace, TRACE_ERR_OPTION_UNAVAIL,
+                    "Packet buffers can only be shared with an xdp: input");
+                return -1;
+            }
+            XDP_FORMAT_DATA->shared_input = input;
+            return 0;
+#else
+            trace_set_err_out(libtrace, TRACE_ERR_OPTION_UNAVAIL,
+                "libbpf is too old to share packet buffers between sockets");
+            return -1;
+#endif
+        case TRACE_OPTION_OUTPUT_FILEFLAGS:
+        case TRACE_OPTION_OUTPUT_COMPRESS:
+        case TRACE_OPTION_OUTPUT_COMPRESSTYPE:
+        case TRACE_OPTION_TX_MAX_QUEUE:
+            break;
     }
 
     return -1;
@@ -1577,7 +2124,7 @@ static struct libtrace_format_t xdp = {
     linux_xdp_start_input,          /* start_input */
     linux_xdp_pause_input,          /* pause */
     linux_xdp_init_output,          /* init_output */
-    NULL,                           /* config_output */
+    linux_xdp_config_output,        /* config_output */
     linux_xdp_start_output,         /* start_output */
     linux_xdp_fin_input,            /* fin_input */
     linux_xdp_fin_output,           /* fin_output */
@@ -1586,7 +2133,8 @@ static struct libtrace_format_t xdp = {
     linux_xdp_fin_packet,           /* fin_packet */
     linux_xdp_can_hold_packet,      /* can_hold_packet */
     linux_xdp_write_packet,         /* write_packet */
-    NULL,                           /* flush_output */
+    linux_xdp_write_packets,        /* write_packets */
+    linux_xdp_flush_output,         /* flush_output */
     linux_xdp_get_link_type,        /* get_link_type */
     NULL,                           /* get_direction */
     NULL,                           /* set_direction */
@@ -8,14 +8,6 @@
 #define EXIT_FAIL_XDP       30
 #define EXIT_FAIL_BPF       40
 
-/* replace path with autoconf varible?? */
-static char *libtrace_xdp_kern[] = {
-    "../lib/format_linux_xdp_kern.bpf", // this is here for tests to correctly find the bpf program
-    "/usr/local/share/libtrace/format_linux_xdp_kern.bpf",
-    "/usr/share/libtrace/format_linux_xdp_kern.bpf",
-};
-static char libtrace_xdp_prog[] = "socket/libtrace_xdp";
-
 typedef struct libtrace_xdp {
     /* BPF filter */
     __u64 received_packets;
@@ -30,9 +22,62 @@ typedef enum {
     XDP_PAUSED = 2,
 } xdp_state;
 
+/* Classic BPF opcodes from linux/filter.h that linux/bpf_common.h lacks */
+#ifndef BPF_RVAL
+#define BPF_RVAL(code)  ((code) & 0x18)
+#define BPF_A           0x10
+#endif
+#ifndef BPF_MISCOP
+#define BPF_MISCOP(code) ((code) & 0xf8)
+#define BPF_TAX         0x00
+#define BPF_TXA         0x80
+#endif
+
+/* Maximum number of classic BPF instructions the XDP program will run */
+#define XDP_FILTER_MAX_INSNS 64
+
+/* A classic BPF instruction, laid out the same as pcap's struct bpf_insn */
+typedef struct libtrace_xdp_insn {
+    __u16 code;
+    __u8 jt;
+    __u8 jf;
+    __u32 k;
+} libtrace_xdp_insn_t;
+
 typedef struct libtrace_ctrl_map {
     int max_queues;
     xdp_state state;
+    /* Redirect one in every sample_rate packets, 0 or 1 redirects them all */
+    __u32 sample_rate;
+    /* Truncate redirected packets to snaplen bytes, 0 to leave them whole */
+    __u32 snaplen;
+    /* Classic BPF filter to run over each packet, ignored if filter_len
+     * is 0. Packets that don't match are passed to the kernel */
+    __u32 filter_len;
+    libtrace_xdp_insn_t filter[XDP_FILTER_MAX_INSNS];
+    /* Flow hash to calculate for each redirected packet, see
+     * libtrace_xdp_hash_mode */
+    __u32 hash_mode;
 } libtrace_ctrl_map_t;
 
+enum libtrace_xdp_hash_mode {
+    XDP_HASH_NONE = 0,
+    /* hash the 5-tuple as it is */
+    XDP_HASH_UNIDIRECTIONAL = 1,
+    /* both directions of a flow get the same hash */
+    XDP_HASH_BIDIRECTIONAL = 2,
+};
+
+/* Placed in the metadata area in front of a packet by the XDP program to
+ * pass on the wire length of a truncated packet and the flow hash */
+#define XDP_KMETA_MAGIC 0x4c545452
+#define XDP_KMETA_TRUNCATED 0x1
+#define XDP_KMETA_HASHED 0x2
+typedef struct libtrace_xdp_kmeta {
+    __u32 magic;
+    __u32 flags;
+    __u32 wire_len;
+    __u32 hash;
+} libtrace_xdp_kmeta_t;
+
 #endif
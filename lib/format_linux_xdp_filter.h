@@ -0,0 +1,233 @@
+#ifndef FORMAT_LINUX_XDP_FILTER
+#define FORMAT_LINUX_XDP_FILTER
+
+/* The classic BPF interpreter run by the XDP program. It lives in a header
+ * so that libtrace can check a filter is supported before pushing it down,
+ * and so that it can be tested in userspace.
+ *
+ * The includer must provide the __u8/__u16/__u32 types, the BPF_* opcode
+ * macros from linux/bpf_common.h and format_linux_xdp.h.
+ */
+
+#include <stdbool.h>
+
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif
+
+/* Largest packet offset the filter may load from */
+#define XDP_FILTER_MAX_OFFSET 0xfff0
+
+/* Checks every instruction in a classic BPF program can be run by
+ * xdp_run_filter() */
+static __always_inline bool xdp_filter_supported(
+        const libtrace_xdp_insn_t *insns, unsigned int len) {
+
+    unsigned int i;
+
+    if (len == 0 || len > XDP_FILTER_MAX_INSNS) {
+        return false;
+    }
+
+    for (i = 0; i < len; i++) {
+        switch (insns[i].code) {
+            case BPF_LD|BPF_W|BPF_ABS:
+            case BPF_LD|BPF_H|BPF_ABS:
+            case BPF_LD|BPF_B|BPF_ABS:
+            case BPF_LD|BPF_W|BPF_IND:
+            case BPF_LD|BPF_H|BPF_IND:
+            case BPF_LD|BPF_B|BPF_IND:
+            case BPF_LD|BPF_IMM:
+            case BPF_LD|BPF_W|BPF_LEN:
+            case BPF_LDX|BPF_B|BPF_MSH:
+            case BPF_LDX|BPF_IMM:
+            case BPF_LDX|BPF_W|BPF_LEN:
+            case BPF_ALU|BPF_ADD|BPF_K:
+            case BPF_ALU|BPF_ADD|BPF_X:
+            case BPF_ALU|BPF_SUB|BPF_K:
+            case BPF_ALU|BPF_SUB|BPF_X:
+            case BPF_ALU|BPF_MUL|BPF_K:
+            case BPF_ALU|BPF_MUL|BPF_X:
+            case BPF_ALU|BPF_OR|BPF_K:
+            case BPF_ALU|BPF_OR|BPF_X:
+            case BPF_ALU|BPF_AND|BPF_K:
+            case BPF_ALU|BPF_AND|BPF_X:
+            case BPF_ALU|BPF_XOR|BPF_K:
+            case BPF_ALU|BPF_XOR|BPF_X:
+            case BPF_ALU|BPF_LSH|BPF_K:
+            case BPF_ALU|BPF_LSH|BPF_X:
+            case BPF_ALU|BPF_RSH|BPF_K:
+            case BPF_ALU|BPF_RSH|BPF_X:
+            case BPF_ALU|BPF_NEG:
+            case BPF_JMP|BPF_JA:
+            case BPF_JMP|BPF_JEQ|BPF_K:
+            case BPF_JMP|BPF_JEQ|BPF_X:
+            case BPF_JMP|BPF_JGT|BPF_K:
+            case BPF_JMP|BPF_JGT|BPF_X:
+            case BPF_JMP|BPF_JGE|BPF_K:
+            case BPF_JMP|BPF_JGE|BPF_X:
+            case BPF_JMP|BPF_JSET|BPF_K:
+            case BPF_JMP|BPF_JSET|BPF_X:
+            case BPF_RET|BPF_K:
+            case BPF_RET|BPF_A:
+            case BPF_MISC|BPF_TAX:
+            case BPF_MISC|BPF_TXA:
+                break;
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/* Load a byte, half word or word from the packet in network byte order,
+ * returns false if it lies outside of the packet */
+static __always_inline bool xdp_filter_load(void *data, void *data_end,
+                                            __u32 off, __u16 size,
+                                            __u32 *val) {
+
+    __u8 *p;
+
+    if (off > XDP_FILTER_MAX_OFFSET)
+        return false;
+    p = (__u8 *)data + off;
+
+    switch (size) {
+        case BPF_B:
+            if ((void *)(p + 1) > data_end)
+                return false;
+            *val = p[0];
+            return true;
+        case BPF_H:
+            if ((void *)(p + 2) > data_end)
+                return false;
+            *val = ((__u32)p[0] << 8) | p[1];
+            return true;
+        default:
+            if ((void *)(p + 4) > data_end)
+                return false;
+            *val = ((__u32)p[0] << 24) | ((__u32)p[1] << 16) |
+                   ((__u32)p[2] << 8) | p[3];
+            return true;
+    }
+}
+
+/* Run the classic BPF filter from the control map over the packet between
+ * data and data_end. Returns true if the packet matches. libtrace only
+ * pushes filters that pass xdp_filter_supported(), anything else is
+ * accepted and left for libtrace to filter in userspace */
+static __always_inline bool xdp_run_filter(void *data, void *data_end,
+                                           const libtrace_ctrl_map_t *ctrl) {
+
+    __u32 len = (__u8 *)data_end - (__u8 *)data;
+    __u32 a = 0, x = 0, pc = 0, val = 0;
+    const libtrace_xdp_insn_t *insn;
+    int i;
+
+    for (i = 0; i < XDP_FILTER_MAX_INSNS; i++) {
+        if (pc >= XDP_FILTER_MAX_INSNS || pc >= ctrl->filter_len)
+            return false;
+        insn = &ctrl->filter[pc];
+        pc++;
+
+        switch (BPF_CLASS(insn->code)) {
+            case BPF_LD:
+                switch (BPF_MODE(insn->code)) {
+                    case BPF_ABS:
+                        if (!xdp_filter_load(data, data_end, insn->k,
+                                             BPF_SIZE(insn->code), &val))
+                            return false;
+                        a = val;
+                        break;
+                    case BPF_IND:
+                        if (!xdp_filter_load(data, data_end, x + insn->k,
+                                             BPF_SIZE(insn->code), &val))
+                            return false;
+                        a = val;
+                        break;
+                    case BPF_IMM:
+                        a = insn->k;
+                        break;
+                    case BPF_LEN:
+                        a = len;
+                        break;
+                    default:
+                        return true;
+                }
+                break;
+            case BPF_LDX:
+                switch (BPF_MODE(insn->code)) {
+                    case BPF_MSH:
+                        if (!xdp_filter_load(data, data_end, insn->k, BPF_B,
+                                             &val))
+                            return false;
+                        x = (val & 0xf) << 2;
+                        break;
+                    case BPF_IMM:
+                        x = insn->k;
+                        break;
+                    case BPF_LEN:
+                        x = len;
+                        break;
+                    default:
+                        return true;
+                }
+                break;
+            case BPF_ALU:
+                val = BPF_SRC(insn->code) == BPF_X ? x : insn->k;
+                switch (BPF_OP(insn->code)) {
+                    case BPF_ADD: a += val; break;
+                    case BPF_SUB: a -= val; break;
+                    case BPF_MUL: a *= val; break;
+                    case BPF_OR: a |= val; break;
+                    case BPF_AND: a &= val; break;
+                    case BPF_XOR: a ^= val; break;
+                    case BPF_LSH: a <<= (val & 31); break;
+                    case BPF_RSH: a >>= (val & 31); break;
+                    case BPF_NEG: a = -a; break;
+                    default:
+                        return true;
+                }
+                break;
+            case BPF_JMP:
+                val = BPF_SRC(insn->code) == BPF_X ? x : insn->k;
+                switch (BPF_OP(insn->code)) {
+                    case BPF_JA:
+                        pc += insn->k;
+                        break;
+                    case BPF_JEQ:
+                        pc += (a == val) ? insn->jt : insn->jf;
+                        break;
+                    case BPF_JGT:
+                        pc += (a > val) ? insn->jt : insn->jf;
+                        break;
+                    case BPF_JGE:
+                        pc += (a >= val) ? insn->jt : insn->jf;
+                        break;
+                    case BPF_JSET:
+                        pc += (a & val) ? insn->jt : insn->jf;
+                        break;
+                    default:
+                        return true;
+                }
+                break;
+            case BPF_RET:
+                if (BPF_RVAL(insn->code) == BPF_A)
+                    return a != 0;
+                return insn->k != 0;
+            case BPF_MISC:
+                if (BPF_MISCOP(insn->code) == BPF_TAX)
+                    x = a;
+                else
+                    a = x;
+                break;
+            default:
+                return true;
+        }
+    }
+
+    return false;
+}
+
+#endif
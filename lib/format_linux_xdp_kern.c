@@ -17,6 +17,7 @@
 #include <linux/udp.h>
 
 #include "format_linux_xdp.h"
+#include "format_linux_xdp_filter.h"
 
 struct bpf_map_def SEC("maps") xsks_map = {
     .type = BPF_MAP_TYPE_XSKMAP,
@@ -41,7 +42,7 @@ struct bpf_map_def SEC("maps") libtrace_ctrl_map = {
 
 int libtrace_xdp_sock(struct xdp_md *ctx);
 
-static __always_inline void increment_stats(__u32 ifindex) {
+static __always_inline libtrace_xdp_t *increment_stats(__u32 ifindex) {
 
     /* get the libtrace structure for the destination queue */
     libtrace_xdp_t *libtrace = bpf_map_lookup_elem(&libtrace_map, &ifindex);
@@ -50,23 +51,147 @@ static __always_inline void increment_stats(__u32 ifindex) {
     if (libtrace)
         libtrace->received_packets += 1;
 
-    return;
+    return libtrace;
 }
 
-static __always_inline int redirect_map(__u32 ifindex) {
+static __always_inline __u32 hash_mix(__u32 h, __u32 k) {
 
-    /* increment our stats */
-    increment_stats(ifindex);
+    k *= 0xcc9e2d51;
+    k = (k << 15) | (k >> 17);
+    k *= 0x1b873593;
+    h ^= k;
+    h = (h << 13) | (h >> 19);
+    return h * 5 + 0xe6546b64;
+}
 
-    /* redirect packet to the socket */
-    return bpf_redirect_map(&xsks_map, ifindex, 0);
+/* Hash the packet's 5-tuple. In bidirectional mode the endpoints are put
+ * in order first so both directions of a flow hash the same */
+static __always_inline __u32 flow_hash(struct xdp_md *ctx, __u32 mode) {
+
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+    struct ethhdr *eth = data;
+    struct iphdr *iph;
+    struct ipv6hdr *ip6h;
+    __u16 *ports;
+    void *l4 = NULL;
+    __u32 saddr = 0, daddr = 0, tmp, h;
+    __u16 sport = 0, dport = 0, proto;
+    __u8 l4proto = 0;
+
+    if ((void *)(eth + 1) > data_end)
+        return 0;
+    proto = eth->h_proto;
+    data = eth + 1;
+
+    /* skip a single vlan tag */
+    if (proto == bpf_htons(ETH_P_8021Q) || proto == bpf_htons(ETH_P_8021AD)) {
+        if (data + 4 > data_end)
+            return 0;
+        proto = *(__u16 *)(data + 2);
+        data += 4;
+    }
+
+    if (proto == bpf_htons(ETH_P_IP)) {
+        iph = data;
+        if ((void *)(iph + 1) > data_end || iph->ihl < 5)
+            return 0;
+        saddr = iph->saddr;
+        daddr = iph->daddr;
+        l4proto = iph->protocol;
+        /* only the first fragment has the ports */
+        if (!(iph->frag_off & bpf_htons(0x1fff)))
+            l4 = data + (iph->ihl & 0xf) * 4;
+    } else if (proto == bpf_htons(ETH_P_IPV6)) {
+        ip6h = data;
+        if ((void *)(ip6h + 1) > data_end)
+            return 0;
+        saddr = ip6h->saddr.s6_addr32[0] ^ ip6h->saddr.s6_addr32[1] ^
+                ip6h->saddr.s6_addr32[2] ^ ip6h->saddr.s6_addr32[3];
+        daddr = ip6h->daddr.s6_addr32[0] ^ ip6h->daddr.s6_addr32[1] ^
+                ip6h->daddr.s6_addr32[2] ^ ip6h->daddr.s6_addr32[3];
+        l4proto = ip6h->nexthdr;
+        l4 = ip6h + 1;
+    } else {
+        return 0;
+    }
+
+    if (l4 && (l4proto == IPPROTO_TCP || l4proto == IPPROTO_UDP ||
+               l4proto == IPPROTO_SCTP)) {
+        ports = l4;
+        if ((void *)(ports + 2) <= data_end) {
+            sport = ports[0];
+            dport = ports[1];
+        }
+    }
+
+    if (mode == XDP_HASH_BIDIRECTIONAL &&
+        (saddr > daddr || (saddr == daddr && sport > dport))) {
+        tmp = saddr;
+        saddr = daddr;
+        daddr = tmp;
+        tmp = sport;
+        sport = dport;
+        dport = tmp;
+    }
+
+    h = hash_mix(l4proto, saddr);
+    h = hash_mix(h, daddr);
+    h = hash_mix(h, ((__u32)sport << 16) | dport);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
 }
 
+/* Pass the flow hash and the original length of a packet truncated to the
+ * snap length to libtrace through the metadata area. If the metadata
+ * can't be added the packet is left as it is */
+static __always_inline void add_kmeta(struct xdp_md *ctx,
+                                      libtrace_ctrl_map_t *ctrl) {
+
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+    __u32 len = data_end - data;
+    __u32 snaplen = ctrl->snaplen;
+    libtrace_xdp_kmeta_t *kmeta;
+    __u32 flags = 0, hash = 0;
+
+    if (ctrl->hash_mode != XDP_HASH_NONE) {
+        hash = flow_hash(ctx, ctrl->hash_mode);
+        flags |= XDP_KMETA_HASHED;
+    }
+    if (snaplen >= ETH_HLEN && len > snaplen)
+        flags |= XDP_KMETA_TRUNCATED;
+
+    if (flags == 0)
+        return;
+
+    if (bpf_xdp_adjust_meta(ctx, -(int)sizeof(libtrace_xdp_kmeta_t)) != 0)
+        return;
+
+    data = (void *)(long)ctx->data;
+    kmeta = (void *)(long)ctx->data_meta;
+    if ((void *)(kmeta + 1) > data)
+        return;
+
+    kmeta->magic = XDP_KMETA_MAGIC;
+    kmeta->flags = flags;
+    kmeta->wire_len = len;
+    kmeta->hash = hash;
+
+    if (flags & XDP_KMETA_TRUNCATED)
+        bpf_xdp_adjust_tail(ctx, -(int)(len - snaplen));
+}
 
 SEC("socket/libtrace_xdp")
 int libtrace_xdp_sock(struct xdp_md *ctx) {
 
     libtrace_ctrl_map_t *queue_ctrl;
+    libtrace_xdp_t *libtrace;
     __u32 ifindex = ctx->rx_queue_index;
     __u32 key = 0;
 
@@ -83,7 +208,31 @@ int libtrace_xdp_sock(struct xdp_md *ctx) {
         return XDP_PASS;
     }
 
-    return redirect_map(ifindex);
+    libtrace = increment_stats(ifindex);
+
+    /* packets that are filtered or sampled out carry on to the kernel as
+     * if we weren't here, without using up a frame on the socket */
+    if (queue_ctrl->filter_len > 0 &&
+        !xdp_run_filter((void *)(long)ctx->data,
+                        (void *)(long)ctx->data_end, queue_ctrl)) {
+        if (libtrace)
+            libtrace->filtered_packets += 1;
+        return XDP_PASS;
+    }
+
+    if (queue_ctrl->sample_rate > 1 && libtrace &&
+        libtrace->received_packets % queue_ctrl->sample_rate != 0) {
+        libtrace->filtered_packets += 1;
+        return XDP_PASS;
+    }
+
+    add_kmeta(ctx, queue_ctrl);
+
+    if (libtrace)
+        libtrace->accepted_packets += 1;
+
+    /* redirect packet to the socket */
+    return bpf_redirect_map(&xsks_map, ifindex, 0);
 }
 
 char _license[] SEC("license") = "GPL";
@@ -0,0 +1,594 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+#include "config.h"
+#include "libtrace.h"
+#include "libtrace_int.h"
+#include "format_helper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/* This format module reads several traces at once and presents their
+ * packets as a single stream, in timestamp order.
+ *
+ * The URI is a comma-separated list of ordinary libtrace URIs, e.g.
+ *   merge:erf:a.erf.gz,pcapfile:b.pcap
+ *
+ * Each source is read by its own thread, so sources are decompressed and
+ * parsed in parallel. Each reader fills packets from a small pool of its
+ * own and passes them to the merge over a ringbuffer, along with their
+ * timestamps. The merge keeps the oldest waiting packet from each source
+ * in a binary heap. Reading a packet moves the buffer of the oldest packet
+ * into the caller's packet and gives the caller's old buffer back to the
+ * reader, so no packet contents are copied.
+ *
+ * A packet read from a merge trace belongs to the source trace that it
+ * came from, in the same way as a packet received over RT belongs to a
+ * dummy trace. So all of the usual accessors behave exactly as they would
+ * for that source.
+ *
+ * There is no parallel reading support of our own. trace_pstart() works
+ * through the generic single reader path.
+ */
+
+#define FORMAT_DATA ((struct merge_format_data_t *)libtrace->format_data)
+
+extern int libtrace_parallel;
+
+/* Number of packets each reader may have read ahead of the merge */
+#define MERGE_READ_AHEAD 64
+
+struct merge_input {
+	/* The trace for this source */
+	libtrace_t *trace;
+
+	/* Packets that the reader fills. The rings carry pool slot numbers
+	 * starting at 1, so that NULL can mark the end of the source (on
+	 * 'full') or tell the reader to stop (on 'empty').
+	 */
+	libtrace_packet_t *pool[MERGE_READ_AHEAD];
+	uint64_t ts[MERGE_READ_AHEAD];
+	libtrace_ringbuffer_t full;
+	libtrace_ringbuffer_t empty;
+
+	pthread_t thread;
+	bool running;
+	volatile bool stopping;
+	bool error;
+
+	/* The slot that is waiting to be merged */
+	uintptr_t slot;
+};
+
+struct merge_format_data_t {
+	int count;
+	struct merge_input *inputs;
+
+	/* Min-heap of the inputs with a packet waiting, ordered by the
+	 * timestamp of that packet and then by position in the URI */
+	int *heap;
+	int heapsize;
+
+	bool started;
+	bool primed;
+
+	/* Input whose head packet was handed out by the last read, and so
+	 * needs its next packet fetched, or -1 */
+	int refill;
+
+	/* Source trace that is currently tracking the caller's packet as its
+	 * last packet */
+	libtrace_t *last_trace;
+};
+
+static int merge_read_source(struct merge_input *in, libtrace_packet_t *packet)
+{
+	libtrace_t *trace = in->trace;
+	int ret;
+
+	/* This is trace_read_packet() without the filter, snapping and
+	 * last_packet tracking. The merge trace does the first two itself,
+	 * and the last packet of the source is only ever set by the merge.
+	 */
+	do {
+		packet->trace = trace;
+		packet->which_trace_start = trace->startcount;
+		ret = trace->format->read_packet(trace, packet);
+	} while (ret == READ_MESSAGE && !in->stopping);
+
+	if (ret == READ_MESSAGE)
+		return 0;
+	return ret;
+}
+
+static void *merge_reader(void *data)
+{
+	struct merge_input *in = (struct merge_input *)data;
+
+	while (1) {
+		uintptr_t slot = (uintptr_t)libtrace_ringbuffer_read(&in->empty);
+		libtrace_packet_t *packet;
+		int ret;
+
+		if (slot == 0)
+			break;
+
+		packet = in->pool[slot - 1];
+		ret = merge_read_source(in, packet);
+		if (ret <= 0) {
+			in->error = (ret < 0);
+			break;
+		}
+
+		/* The format may reuse this buffer on its next read, which
+		 * is too soon when we are reading ahead */
+		if (packet->buf_control == TRACE_CTRL_EXTERNAL) {
+			libtrace_packet_t *copy = trace_copy_packet(packet);
+
+			if (!copy) {
+				trace_set_err(in->trace, TRACE_ERR_OUT_OF_MEMORY,
+						"Unable to copy read-ahead packet");
+				in->error = true;
+				break;
+			}
+			if (in->trace->format->fin_packet)
+				in->trace->format->fin_packet(packet);
+			/* Detach it first so that we don't touch the
+			 * source's last packet from this thread */
+			packet->trace = NULL;
+			trace_destroy_packet(packet);
+			in->pool[slot - 1] = packet = copy;
+		}
+
+		in->ts[slot - 1] = trace_get_erf_timestamp(packet);
+		libtrace_ringbuffer_write(&in->full, (void *)slot);
+	}
+
+	/* The full ring always has room for every slot and this */
+	libtrace_ringbuffer_write(&in->full, NULL);
+	return NULL;
+}
+
+static int merge_start_source(struct merge_input *in)
+{
+	int i;
+
+	if (trace_start(in->trace) == -1)
+		return -1;
+
+	libtrace_ringbuffer_init(&in->full, MERGE_READ_AHEAD + 1,
+			LIBTRACE_RINGBUFFER_BLOCKING);
+	libtrace_ringbuffer_init(&in->empty, MERGE_READ_AHEAD + 1,
+			LIBTRACE_RINGBUFFER_BLOCKING);
+	for (i = 0; i < MERGE_READ_AHEAD; i++) {
+		in->pool[i] = trace_create_packet();
+		libtrace_ringbuffer_write(&in->empty, (void *)(uintptr_t)(i + 1));
+	}
+	in->stopping = false;
+	in->error = false;
+	in->slot = 0;
+
+	if (pthread_create(&in->thread, NULL, merge_reader, in) != 0) {
+		for (i = 0; i < MERGE_READ_AHEAD; i++)
+			trace_destroy_packet(in->pool[i]);
+		libtrace_ringbuffer_destroy(&in->full);
+		libtrace_ringbuffer_destroy(&in->empty);
+		trace_set_err(in->trace, TRACE_ERR_THREAD,
+				"Failed to start reader thread");
+		return -1;
+	}
+	in->running = true;
+	return 0;
+}
+
+/* Stops the reader for a source and frees its packets. 'finished' is true
+ * if the reader has already sent the end of source marker.
+ */
+static void merge_stop_source(struct merge_input *in, bool finished)
+{
+	int i;
+
+	if (!in->running)
+		return;
+
+	if (!finished) {
+		enum trace_state state = in->trace->state;
+
+		/* Live formats return READ_MESSAGE once they see the trace
+		 * pausing, which tells the reader to give up */
+		in->stopping = true;
+		in->trace->state = STATE_PAUSING;
+		libtrace_ringbuffer_write(&in->empty, NULL);
+		while (libtrace_ringbuffer_read(&in->full) != NULL)
+			;
+		pthread_join(in->thread, NULL);
+		in->trace->state = state;
+	} else {
+		pthread_join(in->thread, NULL);
+	}
+	in->running = false;
+
+	for (i = 0; i < MERGE_READ_AHEAD; i++) {
+		trace_destroy_packet(in->pool[i]);
+		in->pool[i] = NULL;
+	}
+	libtrace_ringbuffer_destroy(&in->full);
+	libtrace_ringbuffer_destroy(&in->empty);
+}
+
+static void merge_copy_error(libtrace_t *libtrace, struct merge_input *in)
+{
+	libtrace_err_t err = trace_get_err(in->trace);
+
+	trace_set_err(libtrace, err.err_num, "%s: %s", in->trace->uridata,
+			err.problem);
+}
+
+static inline bool merge_before(struct merge_format_data_t *data, int a, int b)
+{
+	struct merge_input *ia = &data->inputs[a];
+	struct merge_input *ib = &data->inputs[b];
+	uint64_t ta = ia->ts[ia->slot - 1];
+	uint64_t tb = ib->ts[ib->slot - 1];
+
+	if (ta != tb)
+		return ta < tb;
+	return a < b;
+}
+
+static void merge_sift_down(struct merge_format_data_t *data, int pos)
+{
+	int *heap = data->heap;
+	int item = heap[pos];
+
+	while (1) {
+		int child = pos * 2 + 1;
+
+		if (child >= data->heapsize)
+			break;
+		if (child + 1 < data->heapsize &&
+				merge_before(data, heap[child + 1], heap[child]))
+			child++;
+		if (!merge_before(data, heap[child], item))
+			break;
+		heap[pos] = heap[child];
+		pos = child;
+	}
+	heap[pos] = item;
+}
+
+/* Waits for the next packet from an input. Returns 1 if there is one, 0 if
+ * the input has finished and -1 if reading it failed.
+ */
+static int merge_next_slot(libtrace_t *libtrace, int index)
+{
+	struct merge_input *in = &FORMAT_DATA->inputs[index];
+
+	in->slot = (uintptr_t)libtrace_ringbuffer_read(&in->full);
+	if (in->slot != 0)
+		return 1;
+
+	/* The reader has stopped, and it has no packets in flight */
+	merge_stop_source(in, true);
+	if (in->error) {
+		merge_copy_error(libtrace, in);
+		return -1;
+	}
+	return 0;
+}
+
+/* Moves the contents of a pool packet into the caller's packet, leaving the
+ * caller's old buffer (if any) in the pool packet for the reader to use.
+ */
+static void merge_swap_packet(libtrace_packet_t *packet,
+		libtrace_packet_t *src)
+{
+	void *buffer = NULL;
+	uint32_t capacity = 0;
+
+	/* The pool capacity belongs to the buffer and has to follow it */
+	if (packet->buf_control == TRACE_CTRL_PACKET) {
+		buffer = packet->buffer;
+		capacity = packet->pool_capacity;
+	}
+
+	packet->trace = src->trace;
+	packet->which_trace_start = src->which_trace_start;
+	packet->buffer = src->buffer;
+	packet->pool_capacity = src->pool_capacity;
+	packet->buf_control = TRACE_CTRL_PACKET;
+	packet->header = src->header;
+	packet->payload = src->payload;
+	packet->type = src->type;
+	packet->cached = src->cached;
+	packet->order = 0;
+	packet->hash = 0;
+	packet->srcbucket = NULL;
+	packet->internalid = 0;
+	packet->fmtdata = NULL;
+
+	src->trace = NULL;
+	src->buffer = buffer;
+	src->pool_capacity = capacity;
+	src->header = NULL;
+	src->payload = NULL;
+	trace_clear_cache(src);
+}
+
+static int merge_init_input(libtrace_t *libtrace)
+{
+	char *uris, *uri, *saveptr = NULL;
+	int i;
+
+	libtrace->format_data = calloc(1, sizeof(struct merge_format_data_t));
+	if (!libtrace->format_data) {
+		trace_set_err(libtrace, TRACE_ERR_INIT_FAILED, "Unable to "
+			"allocate memory for format data in merge_init_input()");
+		return -1;
+	}
+	FORMAT_DATA->refill = -1;
+
+	uris = strdup(libtrace->uridata);
+	for (uri = strtok_r(uris, ",", &saveptr); uri != NULL;
+			uri = strtok_r(NULL, ",", &saveptr)) {
+		FORMAT_DATA->count++;
+	}
+	free(uris);
+
+	if (FORMAT_DATA->count == 0) {
+		trace_set_err(libtrace, TRACE_ERR_BAD_FORMAT, "No traces given "
+			"to merge, expected merge:uri[,uri...]");
+		return -1;
+	}
+
+	FORMAT_DATA->inputs = calloc(FORMAT_DATA->count,
+			sizeof(struct merge_input));
+	FORMAT_DATA->heap = calloc(FORMAT_DATA->count, sizeof(int));
+	if (!FORMAT_DATA->inputs || !FORMAT_DATA->heap) {
+		trace_set_err(libtrace, TRACE_ERR_INIT_FAILED, "Unable to "
+			"allocate memory for format data in merge_init_input()");
+		return -1;
+	}
+
+	uris = strdup(libtrace->uridata);
+	i = 0;
+	for (uri = strtok_r(uris, ",", &saveptr); uri != NULL;
+			uri = strtok_r(NULL, ",", &saveptr)) {
+		struct merge_input *in = &FORMAT_DATA->inputs[i++];
+
+		in->trace = trace_create(uri);
+		if (trace_is_err(in->trace)) {
+			merge_copy_error(libtrace, in);
+			free(uris);
+			return -1;
+		}
+	}
+	free(uris);
+	return 0;
+}
+
+static int merge_config_input(libtrace_t *libtrace, trace_option_t option,
+		void *value)
+{
+	int i;
+
+	switch (option) {
+	/* These apply to the merged stream, so leave them to libtrace.
+	 * Sampling must also come after the merged filter, rather than
+	 * picking packets out of each source before it */
+	case TRACE_OPTION_SNAPLEN:
+	case TRACE_OPTION_FILTER:
+	case TRACE_OPTION_REPLAY_SPEEDUP:
+	case TRACE_OPTION_HASHER:
+	case TRACE_OPTION_SAMPLE_RATE:
+	case TRACE_OPTION_FLOW_SAMPLE_RATE:
+		return -1;
+	default:
+		break;
+	}
+
+	/* Everything else is passed on to every source */
+	for (i = 0; i < FORMAT_DATA->count; i++) {
+		struct merge_input *in = &FORMAT_DATA->inputs[i];
+
+		if (trace_config(in->trace, option, value) != 0) {
+			merge_copy_error(libtrace, in);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int merge_start_input(libtrace_t *libtrace)
+{
+	int i;
+
+	/* Sources keep running while the merge is paused */
+	if (FORMAT_DATA->started)
+		return 0;
+
+	for (i = 0; i < FORMAT_DATA->count; i++) {
+		struct merge_input *in = &FORMAT_DATA->inputs[i];
+
+		if (merge_start_source(in) == -1) {
+			merge_copy_error(libtrace, in);
+			while (--i >= 0)
+				merge_stop_source(&FORMAT_DATA->inputs[i],
+						false);
+			return -1;
+		}
+	}
+	FORMAT_DATA->started = true;
+	return 0;
+}
+
+static int merge_fin_input(libtrace_t *libtrace)
+{
+	int i;
+
+	if (!libtrace->format_data)
+		return 0;
+
+	if (FORMAT_DATA->inputs) {
+		for (i = 0; i < FORMAT_DATA->count; i++) {
+			struct merge_input *in = &FORMAT_DATA->inputs[i];
+
+			merge_stop_source(in, false);
+			/* This finishes the caller's packet if it came from
+			 * this source */
+			if (in->trace)
+				trace_destroy(in->trace);
+		}
+		free(FORMAT_DATA->inputs);
+	}
+	free(FORMAT_DATA->heap);
+	free(libtrace->format_data);
+	libtrace->format_data = NULL;
+	return 0;
+}
+
+static int merge_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
+{
+	struct merge_format_data_t *data = FORMAT_DATA;
+	struct merge_input *in;
+	int ret, i;
+
+	if (!data->primed) {
+		for (i = 0; i < data->count; i++) {
+			ret = merge_next_slot(libtrace, i);
+			if (ret < 0)
+				return -1;
+			if (ret > 0)
+				data->heap[data->heapsize++] = i;
+		}
+		for (i = data->heapsize / 2 - 1; i >= 0; i--)
+			merge_sift_down(data, i);
+		data->primed = true;
+	}
+
+	/* Now that the caller is done with the last packet, find out where
+	 * the input it came from belongs in the heap */
+	if (data->refill >= 0) {
+		ret = merge_next_slot(libtrace, data->refill);
+		data->refill = -1;
+		if (ret <= 0)
+			data->heap[0] = data->heap[--data->heapsize];
+		if (data->heapsize > 0)
+			merge_sift_down(data, 0);
+		if (ret < 0)
+			return -1;
+	}
+
+	if (data->last_trace) {
+		data->last_trace->last_packet = NULL;
+		data->last_trace = NULL;
+	}
+
+	if (data->heapsize == 0)
+		return 0;
+
+	in = &data->inputs[data->heap[0]];
+	merge_swap_packet(packet, in->pool[in->slot - 1]);
+	libtrace_ringbuffer_write(&in->empty, (void *)in->slot);
+	data->refill = data->heap[0];
+
+	/* Let the source finish this packet if the merge is destroyed before
+	 * the caller is done with it */
+	if (!libtrace_parallel) {
+		in->trace->last_packet = packet;
+		data->last_trace = in->trace;
+	}
+
+	return trace_get_framing_length(packet) +
+		trace_get_capture_length(packet);
+}
+
+static void merge_help(void)
+{
+	printf("merge format module\n");
+	printf("Supported input URIs:\n");
+	printf("\tmerge:uri[,uri...]\n");
+	printf("\n");
+	printf("\te.g.: merge:erf:/tmp/a.erf.gz,pcapfile:/tmp/b.pcap\n");
+	printf("\n");
+	printf("\tPackets from all of the traces are returned in timestamp "
+			"order.\n");
+	printf("\n");
+}
+
+static struct libtrace_format_t merge = {
+	"merge",
+	"$Id$",
+	TRACE_FORMAT_MERGE,
+	NULL,				/* probe filename */
+	NULL,				/* probe magic */
+	merge_init_input,		/* init_input */
+	merge_config_input,		/* config_input */
+	merge_start_input,		/* start_input */
+	NULL,				/* pause_input */
+	NULL,				/* init_output */
+	NULL,				/* config_output */
+	NULL,				/* start_output */
+	merge_fin_input,		/* fin_input */
+	NULL,				/* fin_output */
+	merge_read_packet,		/* read_packet */
+	NULL,				/* prepare_packet */
+	NULL,				/* fin_packet */
+	NULL,				/* can_hold_packet */
+	NULL,				/* write_packet */
+	NULL,				/* write_packets */
+	NULL,				/* flush_output */
+	NULL,				/* get_link_type */
+	NULL,				/* get_direction */
+	NULL,				/* set_direction */
+	NULL,				/* get_erf_timestamp */
+	NULL,				/* get_timeval */
+	NULL,				/* get_timespec */
+	NULL,				/* get_seconds */
+	NULL,				/* get_meta_section */
+	NULL,				/* seek_erf */
+	NULL,				/* seek_timeval */
+	NULL,				/* seek_seconds */
+	NULL,				/* get_capture_length */
+	NULL,				/* get_wire_length */
+	NULL,				/* get_framing_length */
+	NULL,				/* set_capture_length */
+	NULL,				/* get_received_packets */
+	NULL,				/* get_filtered_packets */
+	NULL,				/* get_dropped_packets */
+	NULL,				/* get_statistics */
+	NULL,				/* get_fd */
+	trace_event_trace,		/* trace_event */
+	merge_help,			/* help */
+	NULL,				/* next pointer */
+	NON_PARALLEL(false)
+};
+
+void merge_constructor(void) {
+	register_format(&merge);
+}
@@ -1267,8 +1267,7 @@ static int receive_encap_records_block(libtrace_t *libtrace, recvstream_t *rt,
         int iserr = 0;
 
         if (packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
-                packet->buffer = NULL;
+                trace_free_packet_buffer(packet);
         }
 
         do {
@@ -1325,8 +1324,7 @@ static int receive_encap_records_nonblock(libtrace_t *libtrace, recvstream_t *rt
         int iserr = 0;
 
         if (packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
-                packet->buffer = NULL;
+                trace_free_packet_buffer(packet);
         }
 
         /* Make sure we shouldn't be halting */
@@ -1729,6 +1727,7 @@ static struct libtrace_format_t ndag = {
         NULL,                   /* fin_packet */
         NULL,                   /* can_hold_packet */
         NULL,                   /* write_packet */
+        NULL,                   /* write_packets */
         NULL,                   /* flush_output */
         ndag_get_link_type,     /* get_link_type */
         ndag_get_direction,     /* get_direction */
@@ -433,7 +433,7 @@ static int pcap_prepare_packet(libtrace_t *libtrace, libtrace_packet_t *packet,
 	
 	if (packet->buffer != buffer &&
 			packet->buf_control == TRACE_CTRL_PACKET) {
-			free(packet->buffer);
+			trace_free_packet_buffer(packet);
 	}
 
 	if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -470,8 +470,7 @@ static int pcap_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet) {
 
         /* If the packet buffer is owned by libtrace free it */
         if (packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
-                packet->buffer = NULL;
+                trace_free_packet_buffer(packet);
         }
 
 	linktype = pcap_datalink(DATA(libtrace)->input.pcap);
@@ -854,6 +853,7 @@ static struct libtrace_format_t pcap = {
 	NULL,				/* fin_packet */
     NULL,                   /* can_hold_packet */
 	pcap_write_packet,		/* write_packet */  
+	NULL,				/* write_packets */
         pcap_flush_output,              /* flush_output */
 	pcap_get_link_type,		/* get_link_type */
 	pcapint_get_direction,		/* get_direction */
@@ -901,6 +901,7 @@ static struct libtrace_format_t pcapint = {
 	NULL,				/* fin_packet */
     NULL,               /* can_hold_packet */
 	pcapint_write_packet,		/* write_packet */
+	NULL,				/* write_packets */
 	NULL,		                /* flush_output */
 	pcap_get_link_type,		/* get_link_type */
 	pcapint_get_direction,		/* get_direction */
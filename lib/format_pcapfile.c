@@ -28,6 +28,7 @@
 #include "libtrace.h"
 #include "libtrace_int.h"
 #include "format_helper.h"
+#include "time_index.h"
 
 #include <sys/stat.h>
 #include <stdio.h>
@@ -108,6 +109,8 @@ struct pcapfile_format_data_t {
 	pcapfile_header_t header;
 	/* Indicates whether the input trace is started */
 	bool started;
+	/* Sparse index of packet times, used for seeking */
+	libtrace_time_index_t index;
 };
 
 struct pcapfile_format_data_out_t {
@@ -147,6 +150,7 @@ static int pcapfile_init_input(libtrace_t *libtrace) {
 
 	IN_OPTIONS.real_time = 0;
 	DATA(libtrace)->started = false;
+	memset(&DATA(libtrace)->index, 0, sizeof(libtrace_time_index_t));
 	return 0;
 }
 
@@ -292,6 +296,9 @@ static int pcapfile_config_input(libtrace_t *libtrace,
 		case TRACE_OPTION_XDP_DRV_MODE:
 		case TRACE_OPTION_XDP_ZERO_COPY_MODE:
 		case TRACE_OPTION_XDP_COPY_MODE:
+		case TRACE_OPTION_RING_BLOCK_MODE:
+		case TRACE_OPTION_SAMPLE_RATE:
+		case TRACE_OPTION_FLOW_SAMPLE_RATE:
 	break;
 	}
 	trace_set_err(libtrace,TRACE_ERR_UNKNOWN_OPTION,
@@ -303,6 +310,7 @@ static int pcapfile_fin_input(libtrace_t *libtrace)
 {
 	if (libtrace->io)
 		wandio_destroy(libtrace->io);
+	trace_time_index_clear(&DATA(libtrace)->index);
 	free(libtrace->format_data);
 	return 0; /* success */
 }
@@ -345,7 +353,7 @@ static int pcapfile_prepare_packet(libtrace_t *libtrace,
 
 	if (packet->buffer != buffer && 
 			packet->buf_control == TRACE_CTRL_PACKET) {
-		free(packet->buffer);
+		trace_free_packet_buffer(packet);
 	}
 
 	if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -384,7 +392,7 @@ static int pcapfile_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
 				DATA(libtrace)->header.network));
 
 	if (!packet->buffer || packet->buf_control == TRACE_CTRL_EXTERNAL) {
-		packet->buffer = malloc((size_t)LIBTRACE_PACKET_BUFSIZE);
+		trace_alloc_packet_buffer(packet);
 	}
 
 	flags |= TRACE_PREP_OWN_BUFFER;
@@ -452,6 +460,38 @@ static int pcapfile_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
 	return sizeof(libtrace_pcapfile_pkt_hdr_t) + bytes_to_read;
 }
 
+/* Seek using the saved time index if there is one, otherwise read forward
+ * from wherever the trace is, or from the start if it is already past erfts */
+static int pcapfile_seek_erf(libtrace_t *libtrace, uint64_t erfts)
+{
+	uint64_t off;
+	int ret;
+
+	if (!libtrace->io) {
+		trace_set_err(libtrace, TRACE_ERR_BAD_STATE,
+			"Trace must be started before seeking in "
+			"pcapfile_seek_erf()");
+		return -1;
+	}
+
+	if (trace_time_index_lookup(libtrace, &DATA(libtrace)->index, erfts,
+				&off) == 0) {
+		ret = trace_time_index_walk(libtrace, erfts);
+		if (ret != 0)
+			return ret < 0 ? -1 : 0;
+		off = sizeof(DATA(libtrace)->header);
+	}
+
+	if (wandio_seek(libtrace->io, off, SEEK_SET) < 0) {
+		trace_set_err(libtrace, TRACE_ERR_SEEK_ERF,
+			"Unable to seek within %s", libtrace->uridata);
+		return -1;
+	}
+
+	/* Now read forward to the first packet at or after erfts */
+	return trace_time_index_walk(libtrace, erfts) < 0 ? -1 : 0;
+}
+
 static int pcapfile_write_packet(libtrace_out_t *out,
 		libtrace_packet_t *packet)
 {
@@ -805,6 +845,7 @@ static struct libtrace_format_t pcapfile = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	pcapfile_write_packet,		/* write_packet */
+	NULL,				/* write_packets */
         pcapfile_flush_output,          /* flush_output */
 	pcapfile_get_link_type,		/* get_link_type */
 	pcapfile_get_direction,		/* get_direction */
@@ -814,7 +855,7 @@ static struct libtrace_format_t pcapfile = {
 	pcapfile_get_timespec,		/* get_timespec */
 	NULL,				/* get_seconds */
 	NULL,                           /* get_meta_section */
-	NULL,				/* seek_erf */
+	pcapfile_seek_erf,		/* seek_erf */
 	NULL,				/* seek_timeval */
 	NULL,				/* seek_seconds */
 	pcapfile_get_capture_length,	/* get_capture_length */
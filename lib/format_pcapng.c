@@ -29,6 +29,7 @@
 #include "libtrace_int.h"
 #include "format_helper.h"
 #include "format_pcapng.h"
+#include "time_index.h"
 
 #include <sys/stat.h>
 #include <stdio.h>
@@ -555,6 +556,15 @@ static int pcapng_init_input(libtrace_t *libtrace) {
                         sizeof(pcapng_interface_t));
         DATA(libtrace)->allocatedinterfaces = 10;
         DATA(libtrace)->nextintid = 0;
+        DATA(libtrace)->chunks = NULL;
+        DATA(libtrace)->chunkcount = 0;
+        DATA(libtrace)->nextchunk = 0;
+        DATA(libtrace)->index = NULL;
+        DATA(libtrace)->headers = NULL;
+        DATA(libtrace)->headercount = 0;
+        DATA(libtrace)->allocatedheaders = 0;
+        DATA(libtrace)->headerscan = 0;
+        DATA(libtrace)->headerscanswapped = true;
 
         return 0;
 }
@@ -622,6 +632,9 @@ static int pcapng_config_input(libtrace_t *libtrace, trace_option_t option,
                 case TRACE_OPTION_XDP_DRV_MODE:
                 case TRACE_OPTION_XDP_ZERO_COPY_MODE:
                 case TRACE_OPTION_XDP_COPY_MODE:
+                case TRACE_OPTION_RING_BLOCK_MODE:
+                case TRACE_OPTION_SAMPLE_RATE:
+                case TRACE_OPTION_FLOW_SAMPLE_RATE:
                     break;
         }
 
@@ -656,6 +669,12 @@ static int pcapng_fin_input(libtrace_t *libtrace) {
         }
 
         free(DATA(libtrace)->interfaces);
+        free(DATA(libtrace)->chunks);
+        free(DATA(libtrace)->headers);
+        if (DATA(libtrace)->index) {
+                trace_time_index_clear(DATA(libtrace)->index);
+                free(DATA(libtrace)->index);
+        }
 
         if (libtrace->io) {
                 wandio_destroy(libtrace->io);
@@ -728,12 +747,12 @@ static char *pcapng_parse_next_option(libtrace_t *libtrace, char **pktbuf,
         return optval;
 }
 
-static inline int pcapng_read_body(libtrace_t *libtrace, char *body,
-                uint32_t to_read) {
+static inline int pcapng_read_body(libtrace_t *libtrace, io_t *io,
+                char *body, uint32_t to_read) {
 
         int err;
 
-        err = wandio_read(libtrace->io, body, to_read);
+        err = wandio_read(io, body, to_read);
         if (err < 0) {
                 trace_set_err(libtrace, TRACE_ERR_WANDIO_FAILED,
                         "Failed reading pcapng block");
@@ -794,7 +813,7 @@ static int pcapng_prepare_packet(libtrace_t *libtrace,
 
         if (packet->buffer != buffer &&
                         packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
         if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -1086,7 +1105,7 @@ static int pcapng_read_section(libtrace_t *libtrace,
                 return -1;
         }
 
-        err = pcapng_read_body(libtrace, bodyptr, to_read);
+        err = pcapng_read_body(libtrace, libtrace->io, bodyptr, to_read);
         if (err <= 0) {
                 return err;
         }
@@ -1520,12 +1539,16 @@ static int pcapng_read_enhanced(libtrace_t *libtrace, libtrace_packet_t *packet,
                         return -1;
                 }
 
+                /* Parallel readers share the interface table */
                 if (optcode == PCAPNG_PKTOPT_DROPCOUNT) {
                         uint64_t *drops = (uint64_t *)optval;
                         if (DATA(packet->trace)->byteswapped) {
-                                interface->dropcounter += byteswap64(*drops);
+                                __atomic_add_fetch(&interface->dropcounter,
+                                                byteswap64(*drops),
+                                                __ATOMIC_RELAXED);
                         } else {
-                                interface->dropcounter += *drops;
+                                __atomic_add_fetch(&interface->dropcounter,
+                                                *drops, __ATOMIC_RELAXED);
                         }
                 }
 
@@ -1567,7 +1590,7 @@ static int pcapng_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
 	}
 
         if (!packet->buffer || packet->buf_control == TRACE_CTRL_EXTERNAL) {
-                packet->buffer = malloc((size_t)LIBTRACE_PACKET_BUFSIZE);
+                trace_alloc_packet_buffer(packet);
         }
 
         flags |= TRACE_PREP_OWN_BUFFER;
@@ -1612,7 +1635,8 @@ static int pcapng_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
                 if (btype != PCAPNG_SECTION_TYPE) {
                         // Read the entire block, unless it is a section as our byte ordering has
                         // not been set yet.
-                        err = pcapng_read_body(libtrace, packet->buffer, to_read);
+                        err = pcapng_read_body(libtrace, libtrace->io,
+                                        packet->buffer, to_read);
                         if (err <= 0) {
                                 return err;
                         }
@@ -1702,6 +1726,638 @@ static int pcapng_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
 
 }
 
+/* Starts a new chunk with the block at 'offset' */
+static int pcapng_add_chunk(libtrace_t *libtrace, uint32_t *allocated,
+                uint64_t offset, uint64_t index) {
+
+        struct pcapng_chunk *chunk;
+
+        if (DATA(libtrace)->chunkcount == *allocated) {
+                *allocated = *allocated ? *allocated * 2 : 16;
+                chunk = (struct pcapng_chunk *)realloc(DATA(libtrace)->chunks,
+                                *allocated * sizeof(struct pcapng_chunk));
+                if (!chunk) {
+                        return -1;
+                }
+                DATA(libtrace)->chunks = chunk;
+        }
+
+        chunk = &DATA(libtrace)->chunks[DATA(libtrace)->chunkcount++];
+        chunk->start = offset;
+        chunk->end = offset;
+        chunk->first = index;
+        return 0;
+}
+
+/* Walks the block headers of the trace to split it into chunks that can be
+ * read independently. The interface and statistics blocks are consumed here,
+ * so every reader sees the complete interface table no matter which chunk
+ * it is working on.
+ *
+ * Returns 0 if the trace was indexed, or -1 if it has to be read
+ * sequentially (not a plain file, compressed, or mixed byte orders).
+ */
+static int pcapng_index_chunks(libtrace_t *libtrace) {
+
+        struct pcapng_peeker peeker;
+        libtrace_packet_t *packet;
+        struct pcapng_chunk *chunk = NULL;
+        uint32_t allocated = 0;
+        uint32_t ordering, btype, blocklen;
+        uint64_t offset = 0, index = 0;
+        bool byteswapped = false;
+        io_t *io;
+        int ret = -1;
+        int i, err;
+
+        if (strcmp(libtrace->uridata, "-") == 0) {
+                return -1;
+        }
+        io = wandio_create_uncompressed(libtrace->uridata);
+        if (!io) {
+                return -1;
+        }
+
+        packet = trace_create_packet();
+        packet->trace = libtrace;
+        trace_alloc_packet_buffer(packet);
+        packet->buf_control = TRACE_CTRL_PACKET;
+
+        while (1) {
+                err = wandio_read(io, &peeker, sizeof(peeker));
+                if (err == 0 && index > 0) {
+                        ret = 0;
+                        break;
+                }
+                if (err != (int)sizeof(peeker)) {
+                        break;
+                }
+
+                /* The section header magic reads the same either way
+                 * round, the byte-order magic that follows it does not */
+                if (peeker.blocktype == PCAPNG_SECTION_TYPE) {
+                        if (wandio_read(io, &ordering, sizeof(ordering)) !=
+                                        sizeof(ordering)) {
+                                break;
+                        }
+                        if (ordering == 0x1A2B3C4D) {
+                                byteswapped = false;
+                        } else if (ordering == 0x4D3C2B1A) {
+                                byteswapped = true;
+                        } else {
+                                break;
+                        }
+                        if (index > 0 &&
+                                        byteswapped != DATA(libtrace)->byteswapped) {
+                                break;
+                        }
+                        DATA(libtrace)->byteswapped = byteswapped;
+                } else if (index == 0) {
+                        break;
+                }
+
+                if (byteswapped) {
+                        btype = byteswap32(peeker.blocktype);
+                        blocklen = byteswap32(peeker.blocklen);
+                } else {
+                        btype = peeker.blocktype;
+                        blocklen = peeker.blocklen;
+                }
+                if (blocklen < sizeof(pcapng_hdr_t) + 4 || blocklen % 4 != 0 ||
+                                blocklen > LIBTRACE_PACKET_BUFSIZE) {
+                        break;
+                }
+
+                if (btype == PCAPNG_INTERFACE_TYPE ||
+                                btype == PCAPNG_INTERFACE_STATS_TYPE) {
+                        memcpy(packet->buffer, &peeker, sizeof(peeker));
+                        if (wandio_read(io, (char *)packet->buffer +
+                                        sizeof(peeker), blocklen -
+                                        sizeof(peeker)) !=
+                                        (int64_t)(blocklen - sizeof(peeker))) {
+                                break;
+                        }
+                        if (btype == PCAPNG_INTERFACE_TYPE) {
+                                err = pcapng_read_interface(libtrace, packet,
+                                        blocklen, TRACE_PREP_OWN_BUFFER);
+                        } else {
+                                err = pcapng_read_stats(libtrace, packet,
+                                        blocklen, TRACE_PREP_OWN_BUFFER);
+                        }
+                        if (err < 0) {
+                                break;
+                        }
+                } else if (wandio_seek(io, offset + blocklen, SEEK_SET) < 0) {
+                        break;
+                }
+
+                /* Keep each section to its own chunks */
+                if (!chunk || btype == PCAPNG_SECTION_TYPE ||
+                                offset - chunk->start >= PCAPNG_CHUNK_SIZE) {
+                        if (pcapng_add_chunk(libtrace, &allocated, offset,
+                                        index) < 0) {
+                                break;
+                        }
+                        chunk = &DATA(libtrace)->chunks[
+                                DATA(libtrace)->chunkcount - 1];
+                }
+                offset += blocklen;
+                chunk->end = offset;
+                index++;
+        }
+
+        trace_destroy_packet(packet);
+        wandio_destroy(io);
+
+        if (ret < 0) {
+                /* Leave everything as the sequential reader expects */
+                for (i = 0; i < DATA(libtrace)->nextintid; i++) {
+                        free(DATA(libtrace)->interfaces[i]);
+                        DATA(libtrace)->interfaces[i] = NULL;
+                }
+                DATA(libtrace)->nextintid = 0;
+                DATA(libtrace)->byteswapped = true;
+                free(DATA(libtrace)->chunks);
+                DATA(libtrace)->chunks = NULL;
+                DATA(libtrace)->chunkcount = 0;
+                trace_get_err(libtrace);
+        }
+        return ret;
+}
+
+static int pcapng_pstart_input(libtrace_t *libtrace) {
+
+        /* Resuming a paused trace, the readers carry on where they were */
+        if (DATA(libtrace)->chunks) {
+                return 0;
+        }
+
+        /* Returning -1 without setting an error makes libtrace fall back
+         * to pcapng_start_input() and a single reader */
+        return pcapng_index_chunks(libtrace);
+}
+
+static int pcapng_pregister_thread(libtrace_t *libtrace, libtrace_thread_t *t,
+                bool reader) {
+
+        struct pcapng_stream_t *stream;
+
+        if (!reader || t->type != THREAD_PERPKT) {
+                return 0;
+        }
+
+        stream = (struct pcapng_stream_t *)calloc(1,
+                        sizeof(struct pcapng_stream_t));
+        if (!stream) {
+                trace_set_err(libtrace, TRACE_ERR_INIT_FAILED,
+                        "Unable to allocate memory for pcapng reader stream");
+                return -1;
+        }
+        stream->io = wandio_create_uncompressed(libtrace->uridata);
+        if (!stream->io) {
+                free(stream);
+                trace_set_err(libtrace, TRACE_ERR_INIT_FAILED,
+                        "Unable to open %s for a pcapng reader thread",
+                        libtrace->uridata);
+                return -1;
+        }
+        t->format_data = stream;
+        return 0;
+}
+
+static void pcapng_punregister_thread(libtrace_t *libtrace UNUSED,
+                libtrace_thread_t *t) {
+
+        struct pcapng_stream_t *stream = t->format_data;
+
+        if (t->type != THREAD_PERPKT || !stream) {
+                return;
+        }
+        wandio_destroy(stream->io);
+        free(stream);
+        t->format_data = NULL;
+}
+
+/* Moves a reader on to the next unclaimed chunk.
+ * Returns 1 if it has one, 0 if the trace is finished or -1 on error */
+static int pcapng_claim_chunk(libtrace_t *libtrace,
+                struct pcapng_stream_t *stream) {
+
+        struct pcapng_chunk *chunk;
+        uint32_t next;
+
+        next = __atomic_fetch_add(&DATA(libtrace)->nextchunk, 1,
+                        __ATOMIC_RELAXED);
+        if (next >= DATA(libtrace)->chunkcount) {
+                return 0;
+        }
+        chunk = &DATA(libtrace)->chunks[next];
+
+        if (wandio_seek(stream->io, chunk->start, SEEK_SET) < 0) {
+                trace_set_err(libtrace, TRACE_ERR_WANDIO_FAILED,
+                        "Failed to seek to pcapng chunk at offset %" PRIu64,
+                        chunk->start);
+                return -1;
+        }
+        stream->offset = chunk->start;
+        stream->end = chunk->end;
+        stream->order = chunk->first;
+        return 1;
+}
+
+/* Reads the next block of a reader's chunk into 'packet'. The section,
+ * interface and statistics blocks were already parsed when the trace was
+ * indexed, so they are only handed on as meta packets here.
+ *
+ * Returns the block length if 'packet' was filled, 0 if the block was
+ * skipped or -1 on error.
+ */
+static int pcapng_read_chunk_block(libtrace_t *libtrace,
+                struct pcapng_stream_t *stream, libtrace_packet_t *packet) {
+
+        pcapng_hdr_t *hdr;
+        uint32_t btype, blocklen;
+        uint32_t flags = TRACE_PREP_OWN_BUFFER;
+        int err;
+
+        if (!packet->buffer || packet->buf_control == TRACE_CTRL_EXTERNAL) {
+                if (!trace_alloc_packet_buffer(packet)) {
+                        trace_set_err(libtrace, TRACE_ERR_OUT_OF_MEMORY,
+                                "Unable to allocate memory for pcapng packet");
+                        return -1;
+                }
+        }
+        packet->trace = libtrace;
+
+        err = pcapng_read_body(libtrace, stream->io, packet->buffer,
+                        sizeof(pcapng_hdr_t));
+        if (err <= 0) {
+                if (err == 0) {
+                        trace_set_err(libtrace, TRACE_ERR_BAD_PACKET,
+                                "Truncated pcapng chunk");
+                }
+                return -1;
+        }
+
+        hdr = (pcapng_hdr_t *)packet->buffer;
+        if (DATA(libtrace)->byteswapped) {
+                btype = byteswap32(hdr->blocktype);
+                blocklen = byteswap32(hdr->blocklen);
+        } else {
+                btype = hdr->blocktype;
+                blocklen = hdr->blocklen;
+        }
+        if (blocklen < sizeof(pcapng_hdr_t) + 4 ||
+                        blocklen > stream->end - stream->offset) {
+                trace_set_err(libtrace, TRACE_ERR_BAD_PACKET,
+                        "Invalid pcapng block length %u", blocklen);
+                return -1;
+        }
+
+        err = pcapng_read_body(libtrace, stream->io,
+                        (char *)packet->buffer + sizeof(pcapng_hdr_t),
+                        blocklen - sizeof(pcapng_hdr_t));
+        if (err <= 0) {
+                if (err == 0) {
+                        trace_set_err(libtrace, TRACE_ERR_BAD_PACKET,
+                                "Truncated pcapng chunk");
+                }
+                return -1;
+        }
+        if (*((uint32_t *)((char *)packet->buffer + blocklen - 4)) !=
+                        hdr->blocklen) {
+                trace_set_err(libtrace, TRACE_ERR_BAD_PACKET,
+                        "Mismatched pcapng block sizes found, trace is invalid.");
+                return -1;
+        }
+        stream->offset += blocklen;
+        packet->order = stream->order++;
+
+        switch (btype) {
+                case PCAPNG_SECTION_TYPE:
+                case PCAPNG_INTERFACE_TYPE:
+                case PCAPNG_INTERFACE_STATS_TYPE:
+                        if (DATA(libtrace)->discard_meta) {
+                                return 0;
+                        }
+                        err = pcapng_prepare_packet(libtrace, packet,
+                                packet->buffer, TRACE_RT_PCAPNG_META, flags);
+                        break;
+
+                case PCAPNG_ENHANCED_PACKET_TYPE:
+                        err = pcapng_read_enhanced(libtrace, packet, blocklen,
+                                flags);
+                        break;
+
+                case PCAPNG_SIMPLE_PACKET_TYPE:
+                        err = pcapng_read_simple(libtrace, packet, blocklen,
+                                flags);
+                        break;
+
+                case PCAPNG_NAME_RESOLUTION_TYPE:
+                        if (DATA(libtrace)->discard_meta) {
+                                return 0;
+                        }
+                        err = pcapng_read_nrb(libtrace, packet, blocklen,
+                                flags);
+                        break;
+
+                case PCAPNG_CUSTOM_TYPE:
+                case PCAPNG_CUSTOM_NONCOPY_TYPE:
+                        if (DATA(libtrace)->discard_meta) {
+                                return 0;
+                        }
+                        err = pcapng_read_custom(libtrace, packet, blocklen,
+                                flags);
+                        break;
+
+                /* Everything else -- don't care, skip it */
+                default:
+                        return 0;
+        }
+
+        if (err < 0) {
+                return -1;
+        }
+        return (int) blocklen;
+}
+
+static int pcapng_pread_packets(libtrace_t *libtrace, libtrace_thread_t *t,
+                libtrace_packet_t **packets, size_t nb_packets) {
+
+        struct pcapng_stream_t *stream = t->format_data;
+        size_t read = 0;
+        int err;
+
+        while (read < nb_packets) {
+                if ((err = is_halted(libtrace)) != -1) {
+                        return read > 0 ? (int) read : err;
+                }
+
+                if (stream->offset >= stream->end) {
+                        err = pcapng_claim_chunk(libtrace, stream);
+                        if (err < 0) {
+                                return -1;
+                        }
+                        if (err == 0) {
+                                break;
+                        }
+                        continue;
+                }
+
+                err = pcapng_read_chunk_block(libtrace, stream,
+                                packets[read]);
+                packets[read]->error = err;
+                if (err < 0) {
+                        return -1;
+                }
+                if (err > 0) {
+                        read++;
+                }
+        }
+
+        return read;
+}
+
+/* Records a section header or interface description found by
+ * pcapng_scan_headers() */
+static int pcapng_add_header_ref(libtrace_t *libtrace, uint64_t offset,
+                uint32_t btype, bool byteswapped) {
+
+        struct pcapng_header_ref *ref;
+
+        if (DATA(libtrace)->headercount == DATA(libtrace)->allocatedheaders) {
+                uint32_t allocated = DATA(libtrace)->allocatedheaders ?
+                        DATA(libtrace)->allocatedheaders * 2 : 16;
+
+                ref = (struct pcapng_header_ref *)realloc(
+                                DATA(libtrace)->headers,
+                                allocated * sizeof(struct pcapng_header_ref));
+                if (!ref) {
+                        trace_set_err(libtrace, TRACE_ERR_OUT_OF_MEMORY,
+                                "Unable to allocate memory for pcapng "
+                                "header offsets");
+                        return -1;
+                }
+                DATA(libtrace)->headers = ref;
+                DATA(libtrace)->allocatedheaders = allocated;
+        }
+
+        ref = &DATA(libtrace)->headers[DATA(libtrace)->headercount++];
+        ref->offset = offset;
+        ref->btype = btype;
+        ref->byteswapped = byteswapped;
+        return 0;
+}
+
+/* Finds the section headers and interface descriptions before 'offset',
+ * carrying on from wherever the last seek left off. Only block headers are
+ * read, everything else is seeked over. */
+static int pcapng_scan_headers(libtrace_t *libtrace, uint64_t offset) {
+
+        struct {
+                struct pcapng_peeker peeker;
+                uint32_t ordering;
+        } PACKED hdr;
+        uint32_t btype, blocklen;
+        uint64_t pos = DATA(libtrace)->headerscan;
+        bool byteswapped = DATA(libtrace)->headerscanswapped;
+
+        if (offset <= pos) {
+                return 0;
+        }
+
+        while (pos < offset) {
+                if (wandio_seek(libtrace->io, pos, SEEK_SET) < 0) {
+                        trace_set_err(libtrace, TRACE_ERR_SEEK_ERF,
+                                "Unable to seek within %s", libtrace->uridata);
+                        return -1;
+                }
+                if (wandio_peek(libtrace->io, &hdr, sizeof(hdr)) !=
+                                sizeof(hdr)) {
+                        trace_set_err(libtrace, TRACE_ERR_SEEK_ERF,
+                                "Time index for %s is past the end of the "
+                                "trace", libtrace->uridata);
+                        return -1;
+                }
+
+                /* The section header magic reads the same either way
+                 * round, the byte-order magic that follows it does not */
+                if (hdr.peeker.blocktype == PCAPNG_SECTION_TYPE) {
+                        if (hdr.ordering == 0x1A2B3C4D) {
+                                byteswapped = false;
+                        } else if (hdr.ordering == 0x4D3C2B1A) {
+                                byteswapped = true;
+                        } else {
+                                trace_set_err(libtrace, TRACE_ERR_BAD_PACKET,
+                                        "Parsing pcapng section header block");
+                                return -1;
+                        }
+                }
+
+                if (byteswapped) {
+                        btype = byteswap32(hdr.peeker.blocktype);
+                        blocklen = byteswap32(hdr.peeker.blocklen);
+                } else {
+                        btype = hdr.peeker.blocktype;
+                        blocklen = hdr.peeker.blocklen;
+                }
+                if (blocklen < sizeof(hdr.peeker) ||
+                                blocklen > LIBTRACE_PACKET_BUFSIZE) {
+                        trace_set_err(libtrace, TRACE_ERR_BAD_PACKET,
+                                "Invalid pcapng block length %u", blocklen);
+                        return -1;
+                }
+
+                if (btype == PCAPNG_SECTION_TYPE ||
+                                btype == PCAPNG_INTERFACE_TYPE) {
+                        if (pcapng_add_header_ref(libtrace, pos, btype,
+                                        byteswapped) < 0) {
+                                return -1;
+                        }
+                }
+                pos += blocklen;
+        }
+
+        if (pos != offset) {
+                trace_set_err(libtrace, TRACE_ERR_SEEK_ERF,
+                        "Time index for %s does not match the trace",
+                        libtrace->uridata);
+                return -1;
+        }
+        DATA(libtrace)->headerscan = pos;
+        DATA(libtrace)->headerscanswapped = byteswapped;
+        return 0;
+}
+
+/* Rebuilds the section and interface state for reading from 'offset'.
+ * Interfaces are numbered in the order they appear in the trace, so the
+ * table only needs trimming or extending with the interface descriptions
+ * between the current position and 'offset', rather than rebuilding it
+ * from the start of the trace. */
+static int pcapng_replay_headers(libtrace_t *libtrace, uint64_t offset) {
+
+        struct pcapng_peeker peeker;
+        struct pcapng_header_ref *ref;
+        libtrace_packet_t *packet;
+        uint32_t blocklen;
+        uint32_t i, interfaces = 0, seen = 0;
+        bool swapped = true;
+        int err = 0;
+
+        if (pcapng_scan_headers(libtrace, offset) < 0) {
+                return -1;
+        }
+
+        for (i = 0; i < DATA(libtrace)->headercount &&
+                        DATA(libtrace)->headers[i].offset < offset; i++) {
+                ref = &DATA(libtrace)->headers[i];
+                if (ref->btype == PCAPNG_SECTION_TYPE) {
+                        swapped = ref->byteswapped;
+                } else {
+                        interfaces++;
+                }
+        }
+
+        /* Forget interfaces that are described after 'offset' */
+        while (DATA(libtrace)->nextintid > interfaces) {
+                DATA(libtrace)->nextintid--;
+                free(DATA(libtrace)->interfaces[DATA(libtrace)->nextintid]);
+                DATA(libtrace)->interfaces[DATA(libtrace)->nextintid] = NULL;
+        }
+
+        packet = trace_create_packet();
+        packet->trace = libtrace;
+        trace_alloc_packet_buffer(packet);
+        packet->buf_control = TRACE_CTRL_PACKET;
+
+        /* ... and read the ones that haven't been seen yet */
+        for (i = 0; i < DATA(libtrace)->headercount &&
+                        DATA(libtrace)->nextintid < interfaces; i++) {
+                ref = &DATA(libtrace)->headers[i];
+                if (ref->btype != PCAPNG_INTERFACE_TYPE) {
+                        continue;
+                }
+                if (seen++ < DATA(libtrace)->nextintid) {
+                        continue;
+                }
+
+                if (wandio_seek(libtrace->io, ref->offset, SEEK_SET) < 0 ||
+                                wandio_peek(libtrace->io, &peeker,
+                                sizeof(peeker)) != sizeof(peeker)) {
+                        trace_set_err(libtrace, TRACE_ERR_SEEK_ERF,
+                                "Unable to seek within %s", libtrace->uridata);
+                        err = -1;
+                        break;
+                }
+                blocklen = ref->byteswapped ? byteswap32(peeker.blocklen) :
+                        peeker.blocklen;
+
+                /* The interface is parsed using its own section's byte
+                 * order */
+                DATA(libtrace)->byteswapped = ref->byteswapped;
+                if (pcapng_read_body(libtrace, libtrace->io, packet->buffer,
+                                blocklen) <= 0 ||
+                                pcapng_read_interface(libtrace, packet,
+                                blocklen, TRACE_PREP_OWN_BUFFER) < 0) {
+                        err = -1;
+                        break;
+                }
+        }
+        trace_destroy_packet(packet);
+        DATA(libtrace)->byteswapped = swapped;
+
+        if (err == 0 && wandio_seek(libtrace->io, offset, SEEK_SET) < 0) {
+                trace_set_err(libtrace, TRACE_ERR_SEEK_ERF,
+                        "Unable to seek within %s", libtrace->uridata);
+                err = -1;
+        }
+        return err;
+}
+
+/* Seek using the saved time index if there is one, otherwise read forward
+ * from wherever the trace is, or from the start if it is already past erfts */
+static int pcapng_seek_erf(libtrace_t *libtrace, uint64_t erfts) {
+
+        uint64_t off = 0;
+        int ret;
+
+        if (!libtrace->io) {
+                trace_set_err(libtrace, TRACE_ERR_BAD_STATE,
+                        "Trace must be started before seeking in "
+                        "pcapng_seek_erf()");
+                return -1;
+        }
+
+        if (!DATA(libtrace)->index) {
+                DATA(libtrace)->index = (libtrace_time_index_t *)calloc(1,
+                                sizeof(libtrace_time_index_t));
+                if (!DATA(libtrace)->index) {
+                        trace_set_err(libtrace, TRACE_ERR_OUT_OF_MEMORY,
+                                "Unable to allocate memory for pcapng time "
+                                "index");
+                        return -1;
+                }
+        }
+
+        if (trace_time_index_lookup(libtrace, DATA(libtrace)->index, erfts,
+                                &off) == 0) {
+                /* Any interfaces passed on the way are read as usual */
+                ret = trace_time_index_walk(libtrace, erfts);
+                if (ret != 0) {
+                        return ret < 0 ? -1 : 0;
+                }
+        }
+
+        /* Packets can only be read once the interfaces they refer to are
+         * known, so catch up on those before jumping to the packet */
+        if (pcapng_replay_headers(libtrace, off) < 0) {
+                return -1;
+        }
+
+        return trace_time_index_walk(libtrace, erfts) < 0 ? -1 : 0;
+}
+
 static libtrace_linktype_t pcapng_get_link_type(const libtrace_packet_t *packet) {
 
 	if (packet->type == TRACE_RT_PCAPNG_META) {
@@ -2313,6 +2969,7 @@ static struct libtrace_format_t pcapng = {
         NULL,                           /* fin_packet */
         NULL,                           /* can_hold_packet */
         pcapng_write_packet,            /* write_packet */
+        NULL,                           /* write_packets */
         pcapng_flush_output,            /* flush_output */
         pcapng_get_link_type,           /* get_link_type */
         pcapng_get_direction,           /* get_direction */
@@ -2322,7 +2979,7 @@ static struct libtrace_format_t pcapng = {
         pcapng_get_timespec,            /* get_timespec */
         NULL,                           /* get_seconds */
 	pcapng_get_all_meta,            /* get_all_meta */
-        NULL,                           /* seek_erf */
+        pcapng_seek_erf,                /* seek_erf */
         NULL,                           /* seek_timeval */
         NULL,                           /* seek_seconds */
         pcapng_get_capture_length,      /* get_capture_length */
@@ -2337,7 +2994,14 @@ static struct libtrace_format_t pcapng = {
         pcapng_event,                   /* trace_event */
         pcapng_help,                    /* help */
         NULL,                           /* next pointer */
-        NON_PARALLEL(false)
+        {false, -1},                    /* Not live, no thread limit */
+        pcapng_pstart_input,            /* pstart_input */
+        pcapng_pread_packets,           /* pread_packets */
+        NULL,                           /* ppause */
+        NULL,                           /* p_fin */
+        pcapng_pregister_thread,        /* pregister_thread */
+        pcapng_punregister_thread,      /* punregister_thread */
+        NULL                            /* get thread stats */
 };
 
 void pcapng_constructor(void) {
@@ -98,6 +98,9 @@
 #define PCAPNG_META_OLD_FLAGS 2
 #define PCAPNG_META_OLD_HASH 3
 
+/* Parallel readers are given chunks of roughly this many bytes */
+#define PCAPNG_CHUNK_SIZE (1024 * 1024)
+
 #define DATA(x) ((struct pcapng_format_data_t *)((x)->format_data))
 #define DATAOUT(x) ((struct pcapng_format_data_out_t*)((x)->format_data))
 
@@ -203,6 +206,28 @@ struct pcapng_interface_t {
 
 };
 
+/* A run of whole blocks that a single parallel reader works through */
+struct pcapng_chunk {
+        uint64_t start;         /* file offset of the first block */
+        uint64_t end;           /* file offset just past the last block */
+        uint64_t first;         /* number of blocks preceding the chunk */
+};
+
+/* A section header or interface description found while seeking */
+struct pcapng_header_ref {
+        uint64_t offset;        /* file offset of the block */
+        uint32_t btype;
+        bool byteswapped;       /* byte order of the section it belongs to */
+};
+
+/* Per-thread state for the parallel reader */
+struct pcapng_stream_t {
+        io_t *io;
+        uint64_t offset;
+        uint64_t end;
+        uint64_t order;
+};
+
 struct pcapng_format_data_t {
         bool started;
         bool realtime;
@@ -216,6 +241,22 @@ struct pcapng_format_data_t {
         uint16_t allocatedinterfaces;
         uint16_t nextintid;
 
+        /* Chunks of the trace handed out to parallel readers */
+        struct pcapng_chunk *chunks;
+        uint32_t chunkcount;
+        uint32_t nextchunk;
+
+        /* Sparse index of packet times, allocated on the first seek */
+        struct libtrace_time_index *index;
+
+        /* Header blocks found by seeking, in file order. Everything before
+         * headerscan has been looked through already */
+        struct pcapng_header_ref *headers;
+        uint32_t headercount;
+        uint32_t allocatedheaders;
+        uint64_t headerscan;
+        bool headerscanswapped;
+
 };
 
 struct pcapng_format_data_out_t {
@@ -676,6 +676,9 @@ static int pfringzc_config_input(libtrace_t *libtrace, trace_option_t option,
 		case TRACE_OPTION_XDP_SKB_MODE:
 		case TRACE_OPTION_XDP_ZERO_COPY_MODE:
 		case TRACE_OPTION_XDP_COPY_MODE:
+		case TRACE_OPTION_RING_BLOCK_MODE:
+		case TRACE_OPTION_SAMPLE_RATE:
+		case TRACE_OPTION_FLOW_SAMPLE_RATE:
 			break;
 	}
 	return -1;
@@ -717,6 +720,9 @@ static int pfring_config_input(libtrace_t *libtrace, trace_option_t option,
 		case TRACE_OPTION_XDP_SKB_MODE:
 		case TRACE_OPTION_XDP_ZERO_COPY_MODE:
 		case TRACE_OPTION_XDP_COPY_MODE:
+		case TRACE_OPTION_RING_BLOCK_MODE:
+		case TRACE_OPTION_SAMPLE_RATE:
+		case TRACE_OPTION_FLOW_SAMPLE_RATE:
 			break;
 	}
 	return -1;
@@ -840,7 +846,7 @@ static int pfring_prepare_packet(libtrace_t *libtrace UNUSED,
 
 	if (packet->buffer != buffer && packet->buf_control == 
 			TRACE_CTRL_PACKET) {
-		free(packet->buffer);
+		trace_free_packet_buffer(packet);
 	}
 
 	if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -1482,6 +1488,7 @@ static struct libtrace_format_t pfringoldformat = {
     NULL,                        /* fin_packet */
     NULL,                        /* can_hold_packet */
     NULL,                        /* write_packet */
+    NULL,                        /* write_packets */
     NULL,                        /* flush_output */
     pfring_get_lt_link_type,     /* get_link_type */
     pfring_get_direction,        /* get_direction */
@@ -1537,6 +1544,7 @@ static struct libtrace_format_t pfringformat = {
     NULL,                      /* fin_packet */
     NULL,                      /* can_hold_packet */
     pfringzc_write_packet,     /* write_packet */
+    NULL,                      /* write_packets */
     pfringzc_flush_output,     /* flush_output */
     pfring_get_lt_link_type,   /* get_link_type */
     NULL,                      /* get_direction */
@@ -587,7 +587,7 @@ static int rt_get_next_packet(libtrace_t *libtrace, libtrace_packet_t *packet,
         rt_header_t *rthdr;
 
         if (packet->buffer && packet->buf_control == TRACE_CTRL_PACKET)
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
 
         while (RT_INFO->buf_write - RT_INFO->buf_read <
                                 (uint32_t)sizeof(rt_header_t)) {
@@ -657,7 +657,7 @@ static int rt_prepare_packet(libtrace_t *libtrace, libtrace_packet_t *packet,
 
 	if (packet->buffer != buffer &&
                         packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
         if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -857,6 +857,7 @@ static struct libtrace_format_t rt = {
 	NULL,   			/* fin_packet */
         NULL,                           /* can_hold_packet */
         NULL,                           /* write_packet */
+        NULL,                           /* write_packets */
         NULL,                           /* flush_output */
         rt_get_link_type,	        /* get_link_type */
         NULL,  		            	/* get_direction */
@@ -84,7 +84,7 @@ static int tsh_prepare_packet(libtrace_t *libtrace, libtrace_packet_t *packet,
 		void *buffer, libtrace_rt_types_t rt_type, uint32_t flags) {
 	if (packet->buffer != buffer &&
                         packet->buf_control == TRACE_CTRL_PACKET) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
         if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -244,6 +244,7 @@ static struct libtrace_format_t tshformat = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	NULL,				/* write_packet */
+	NULL,				/* write_packets */
 	NULL,				/* flush_output */
 	tsh_get_link_type,		/* get_link_type */
 	tsh_get_direction,		/* get_direction */
@@ -296,6 +297,7 @@ static struct libtrace_format_t frplusformat = {
 	NULL,				/* fin_packet */
         NULL,                           /* can_hold_packet */
 	NULL,				/* write_packet */
+	NULL,				/* write_packets */
 	NULL,				/* flush_output */
 	tsh_get_link_type,		/* get_link_type */
 	tsh_get_direction,		/* get_direction */
@@ -406,7 +406,7 @@ static int tzsplive_prepare_packet(libtrace_t *libtrace UNUSED, libtrace_packet_
         if (packet->buffer != buffer &&
                 packet->buf_control == TRACE_CTRL_PACKET) {
 
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
 
         if ((flags & TRACE_PREP_OWN_BUFFER) == TRACE_PREP_OWN_BUFFER) {
@@ -701,6 +701,7 @@ static struct libtrace_format_t tzsplive = {
         NULL,                           /* fin_packet */
         NULL,                           /* can_hold_packet */
         tzsplive_write_packet,          /* write_packet */
+        NULL,                           /* write_packets */
         NULL,                           /* flush_output */
         tzsplive_get_link_type,         /* get_link_type */
         NULL,                           /* get_direction */
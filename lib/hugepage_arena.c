@@ -0,0 +1,320 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+#include "config.h"
+#include "common.h"
+#include "libtrace.h"
+#include "hugepage_arena.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#define ARENA_MIN_CHUNK 64
+/* Chunk sizes go up in powers of two from ARENA_MIN_CHUNK to a whole slab,
+ * anything larger gets a mapping of its own */
+#define ARENA_CLASSES 16
+ct_assert((ARENA_MIN_CHUNK << (ARENA_CLASSES - 1)) == ARENA_SLAB_SIZE);
+
+/* Number of slabs mapped at a time when using 2MB pages */
+#define ARENA_REGION_SLABS 8
+
+#define HUGE_2MB (2 * 1024 * 1024)
+#define HUGE_1GB (1024 * 1024 * 1024)
+
+struct arena_region {
+        char *base;
+        size_t len;
+        /* The chunk class of each slab, or -1 if the whole region is a
+         * single large allocation */
+        int8_t *classes;
+};
+
+struct arena_class {
+        /* Freed chunks, linked through their first word */
+        void *free_list;
+        /* The unused part of the slab currently being carved up */
+        char *next;
+        char *end;
+};
+
+static struct {
+        pthread_mutex_t lock;
+        size_t page_size;
+        /* Regions sorted by address */
+        struct arena_region *regions;
+        size_t nb_regions;
+        size_t max_regions;
+        /* Slabs left over in the last region mapped */
+        char *spare;
+        char *spare_end;
+        struct arena_class classes[ARENA_CLASSES];
+} arena = { PTHREAD_MUTEX_INITIALIZER, 0, NULL, 0, 0, NULL, NULL,
+            {{NULL, NULL, NULL}} };
+
+int libtrace_arena_enable(size_t page_size) {
+        if (page_size != HUGE_2MB && page_size != HUGE_1GB)
+                return -1;
+
+        pthread_mutex_lock(&arena.lock);
+        if (!arena.page_size)
+                __atomic_store_n(&arena.page_size, page_size,
+                                 __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&arena.lock);
+        return 0;
+}
+
+bool libtrace_arena_enabled(void) {
+        return __atomic_load_n(&arena.page_size, __ATOMIC_ACQUIRE) != 0;
+}
+
+/* Maps len bytes aligned to ARENA_SLAB_SIZE, preferably from huge pages
+ * of page_size */
+static char *map_region(size_t len, size_t page_size) {
+        char *mem, *start;
+        size_t lead;
+
+#ifdef MAP_HUGETLB
+        int shift = page_size == HUGE_1GB ? 30 : 21;
+
+        mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                   (shift << MAP_HUGE_SHIFT), -1, 0);
+        if (mem != MAP_FAILED)
+                return mem;
+#else
+        (void)page_size;
+#endif
+        /* No huge pages are reserved, so settle for transparent ones,
+         * which need the mapping to be aligned */
+        mem = mmap(NULL, len + ARENA_SLAB_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+                return NULL;
+        start = (char *)(((uintptr_t)mem + ARENA_SLAB_SIZE - 1) &
+                         ~((uintptr_t)ARENA_SLAB_SIZE - 1));
+        lead = start - mem;
+        if (lead)
+                munmap(mem, lead);
+        munmap(start + len, ARENA_SLAB_SIZE - lead);
+#ifdef MADV_HUGEPAGE
+        madvise(start, len, MADV_HUGEPAGE);
+#endif
+        return start;
+}
+
+/* Adds a newly mapped region to the sorted list, assumes the lock is held */
+static struct arena_region *add_region(char *base, size_t len, bool large) {
+        struct arena_region *regions;
+        size_t i, slabs = large ? 1 : len / ARENA_SLAB_SIZE;
+        int8_t *classes;
+
+        classes = malloc(slabs);
+        if (!classes)
+                return NULL;
+        memset(classes, -1, slabs);
+
+        if (arena.nb_regions == arena.max_regions) {
+                regions = realloc(arena.regions, (arena.max_regions + 16) *
+                                  sizeof(struct arena_region));
+                if (!regions) {
+                        free(classes);
+                        return NULL;
+                }
+                arena.regions = regions;
+                arena.max_regions += 16;
+        }
+
+        for (i = arena.nb_regions; i > 0; i--) {
+                if (arena.regions[i - 1].base < base)
+                        break;
+                arena.regions[i] = arena.regions[i - 1];
+        }
+        arena.regions[i].base = base;
+        arena.regions[i].len = len;
+        arena.regions[i].classes = classes;
+        __atomic_add_fetch(&arena.nb_regions, 1, __ATOMIC_RELEASE);
+        return &arena.regions[i];
+}
+
+/* Finds the region holding ptr, assumes the lock is held */
+static struct arena_region *find_region(const char *ptr) {
+        size_t min = 0, max = arena.nb_regions, mid;
+
+        while (min < max) {
+                mid = min + (max - min) / 2;
+                if (ptr < arena.regions[mid].base)
+                        max = mid;
+                else if (ptr >= arena.regions[mid].base +
+                         arena.regions[mid].len)
+                        min = mid + 1;
+                else
+                        return &arena.regions[mid];
+        }
+        return NULL;
+}
+
+/* Gives a class a fresh slab to carve up, assumes the lock is held */
+static int new_slab(int class) {
+        struct arena_region *region;
+        size_t len;
+        char *mem;
+
+        if (arena.spare == arena.spare_end) {
+                len = arena.page_size == HUGE_1GB ? HUGE_1GB :
+                      ARENA_REGION_SLABS * ARENA_SLAB_SIZE;
+                mem = map_region(len, arena.page_size);
+                if (!mem)
+                        return -1;
+                if (!add_region(mem, len, false)) {
+                        munmap(mem, len);
+                        return -1;
+                }
+                arena.spare = mem;
+                arena.spare_end = mem + len;
+        }
+
+        region = find_region(arena.spare);
+        region->classes[(arena.spare - region->base) / ARENA_SLAB_SIZE] =
+            class;
+        arena.classes[class].next = arena.spare;
+        arena.classes[class].end = arena.spare + ARENA_SLAB_SIZE;
+        arena.spare += ARENA_SLAB_SIZE;
+        return 0;
+}
+
+static void *alloc_large(size_t size) {
+        size_t len = (size + ARENA_SLAB_SIZE - 1) &
+                     ~((size_t)ARENA_SLAB_SIZE - 1);
+        char *mem;
+
+        /* 1GB pages would waste most of a page on all but enormous
+         * allocations, so these always use 2MB pages */
+        mem = map_region(len, HUGE_2MB);
+        if (!mem)
+                return NULL;
+        pthread_mutex_lock(&arena.lock);
+        if (!add_region(mem, len, true)) {
+                pthread_mutex_unlock(&arena.lock);
+                munmap(mem, len);
+                return NULL;
+        }
+        pthread_mutex_unlock(&arena.lock);
+        return mem;
+}
+
+void *libtrace_arena_alloc(size_t size) {
+        struct arena_class *c;
+        void *chunk = NULL;
+        int class = 0;
+
+        if (!libtrace_arena_enabled() || size == 0)
+                return malloc(size);
+
+        if (size > ARENA_SLAB_SIZE) {
+                chunk = alloc_large(size);
+        } else {
+                while (((size_t)ARENA_MIN_CHUNK << class) < size)
+                        class++;
+                c = &arena.classes[class];
+
+                pthread_mutex_lock(&arena.lock);
+                if (c->free_list) {
+                        chunk = c->free_list;
+                        c->free_list = *(void **)chunk;
+                } else if (c->next != c->end || new_slab(class) == 0) {
+                        chunk = c->next;
+                        c->next += (size_t)ARENA_MIN_CHUNK << class;
+                }
+                pthread_mutex_unlock(&arena.lock);
+        }
+
+        /* Out of huge pages and address space, the heap may do better */
+        if (!chunk)
+                return malloc(size);
+        return chunk;
+}
+
+void *libtrace_arena_calloc(size_t nmemb, size_t size) {
+        void *mem;
+
+        if (!libtrace_arena_enabled())
+                return calloc(nmemb, size);
+        if (size && nmemb > SIZE_MAX / size)
+                return NULL;
+        mem = libtrace_arena_alloc(nmemb * size);
+        if (mem)
+                memset(mem, 0, nmemb * size);
+        return mem;
+}
+
+void libtrace_arena_free(void *ptr) {
+        struct arena_region *region;
+        char *base;
+        size_t len;
+        int class;
+
+        if (!ptr)
+                return;
+        /* Nothing can have come from the arena if it has never mapped
+         * anything */
+        if (__atomic_load_n(&arena.nb_regions, __ATOMIC_ACQUIRE) == 0) {
+                free(ptr);
+                return;
+        }
+
+        pthread_mutex_lock(&arena.lock);
+        region = find_region(ptr);
+        if (!region) {
+                pthread_mutex_unlock(&arena.lock);
+                free(ptr);
+                return;
+        }
+
+        class = region->classes[((char *)ptr - region->base) /
+                                ARENA_SLAB_SIZE];
+        if (class >= 0) {
+                *(void **)ptr = arena.classes[class].free_list;
+                arena.classes[class].free_list = ptr;
+                pthread_mutex_unlock(&arena.lock);
+                return;
+        }
+
+        /* A large allocation, which goes straight back to the system */
+        base = region->base;
+        len = region->len;
+        free(region->classes);
+        memmove(region, region + 1, (arena.regions + arena.nb_regions -
+                                     region - 1) * sizeof(*region));
+        __atomic_sub_fetch(&arena.nb_regions, 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&arena.lock);
+        munmap(base, len);
+}
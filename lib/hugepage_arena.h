@@ -0,0 +1,74 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+#ifndef LIBTRACE_HUGEPAGE_ARENA_H
+#define LIBTRACE_HUGEPAGE_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** @file
+ *
+ * @brief Arena of memory backed by huge pages
+ *
+ * Memory is carved out of 2MB slabs, each of which only holds chunks of a
+ * single power-of-two size. Slabs come from mappings made with MAP_HUGETLB
+ * when the system has huge pages reserved, otherwise from ordinary
+ * mappings that transparent huge pages are asked for with madvise(). If
+ * neither can be had, allocations quietly fall back to malloc().
+ *
+ * Freed chunks are kept for reuse by the arena rather than returned to the
+ * system. libtrace_arena_free() also accepts memory from malloc(), so
+ * storage that libtrace always releases itself can move into the arena
+ * without the code releasing it knowing which allocator was used.
+ */
+
+/** Size of the slabs that chunks are carved from */
+#define ARENA_SLAB_SIZE (2 * 1024 * 1024)
+
+/** Starts serving allocations from huge pages of the given size
+ *
+ * The arena is shared by the whole process, and once enabled stays enabled.
+ *
+ * @param page_size	The huge page size, either 2MB or 1GB
+ * @return 0 if successful, -1 if the page size isn't supported
+ */
+int libtrace_arena_enable(size_t page_size);
+
+/** Returns true if allocations are being served from huge pages */
+bool libtrace_arena_enabled(void);
+
+/** Allocates memory from the arena, or with malloc() if it isn't enabled */
+void *libtrace_arena_alloc(size_t size);
+
+/** Allocates zeroed memory from the arena, or with calloc() if it isn't
+ * enabled */
+void *libtrace_arena_calloc(size_t nmemb, size_t size);
+
+/** Releases memory from libtrace_arena_alloc(), libtrace_arena_calloc() or
+ * malloc() */
+void libtrace_arena_free(void *ptr);
+
+#endif
@@ -227,6 +227,8 @@ enum thread_states {
 enum hash_owner {
         HASH_OWNED_LIBTRACE,
         HASH_OWNED_EXTERNAL,
+        /* The format module supplied the hasher while being configured */
+        HASH_OWNED_FORMAT,
 };
 
 /**
@@ -235,6 +237,8 @@ enum hash_owner {
 struct libtrace_thread_t {
 	uint64_t accepted_packets; // The number of packets accepted only used if pread
 	uint64_t filtered_packets;
+	// Position of this thread within the packet sampling interval
+	uint32_t sample_count;
 	// is retreving packets
 	// Set to true once the first packet has been stored
 	bool recorded_first;
@@ -321,6 +325,8 @@ struct user_configuration {
 	size_t reporter_thold;
 	bool debug_state;
 	int coremap[MAX_THREADS];
+	bool numa_pinning;
+	size_t hugepage_size;
 };
 #define ZERO_USER_CONFIG(config) {\
 	memset(&config, 0, sizeof(struct user_configuration));\
@@ -359,6 +365,17 @@ struct libtrace_t {
 	/** The snap length to be applied to all packets read by the trace - 
 	 * used only if the capture format does not support snapping natively */
 	size_t snaplen;			
+	/** Only one in every sample_rate packets is kept - used only if the
+	 * capture format does not support sampling natively */
+	uint32_t sample_rate;
+	/** Position of the single threaded reader within the sampling
+	 * interval */
+	uint32_t sample_count;
+	/** Only flows whose hash falls into one in every flow_sample_rate
+	 * buckets are kept */
+	uint32_t flow_sample_rate;
+	/** The toeplitz configuration used to hash flows for flow sampling */
+	void *flow_sample_conf;
         /** Speed up the packet rate when using trace_event() to process trace
          * files by this factor. */
         int replayspeedup;
@@ -366,6 +383,10 @@ struct libtrace_t {
 	uint64_t accepted_packets;
 	/** Count of the number of packets filtered by libtrace */
 	uint64_t filtered_packets;
+	/** Count of the number of packets copied by libtrace, and the bytes
+	 * copied for them. Updated atomically as any thread may copy. */
+	uint64_t copied_packets;
+	uint64_t copied_bytes;
 	/** The sequence is like accepted_packets but we don't reset this after a pause. */
 	uint64_t sequence_number;
 	/** The packet read out by the trace, backwards compatibility to allow us to finalise
@@ -412,6 +433,8 @@ struct libtrace_t {
 	libtrace_thread_t keepalive_thread;
 	int perpkt_thread_count;
 	libtrace_thread_t * perpkt_threads; // All our perpkt threads
+	/** NUMA node the capture device is on, -1 if unknown or not pinning */
+	int numa_node;
 	// Used to keep track of the first packet seen on each thread
 	struct first_packets first_packets;
 	int tracetime;
@@ -435,6 +458,18 @@ struct libtrace_t {
 #define LIBTRACE_STAT_MAGIC 0x41
 
 void trace_fin_packet(libtrace_packet_t *packet);
+/** Frees the buffer a packet owns, returning it to the packet copy pool if
+ * it came from there, and leaves the packet without a buffer */
+void trace_free_packet_buffer(libtrace_packet_t *packet);
+/** Gives a packet a new LIBTRACE_PACKET_BUFSIZE buffer to own, from the
+ * packet copy pool when huge pages are in use. It must be released with
+ * trace_free_packet_buffer() rather than free().
+ *
+ * @return the buffer, which is also stored in packet->buffer
+ */
+void *trace_alloc_packet_buffer(libtrace_packet_t *packet);
+int trace_sample_packet(libtrace_t *libtrace, uint32_t *count,
+                libtrace_packet_t *packet);
 void libtrace_zero_thread(libtrace_thread_t * t);
 void store_first_packet(libtrace_t *libtrace, libtrace_packet_t *packet, libtrace_thread_t *t);
 libtrace_thread_t * get_thread_table(libtrace_t *libtrace);
@@ -707,6 +742,21 @@ struct libtrace_format_t {
 	 */
 	int (*write_packet)(libtrace_out_t *libtrace, libtrace_packet_t *packet);
 
+	/** Write a batch of libtrace packets to an output trace.
+	 *
+	 * Only needed by formats that can do better than writing each
+	 * packet in turn, e.g. by notifying the kernel once per batch.
+	 * Packets the format cannot write should be skipped.
+	 *
+	 * @param libtrace	The output trace to write the packets to
+	 * @param packets	The packets to be written out
+	 * @param nb_packets	The number of packets to write
+	 * @return The number of packets consumed, or -1 if an error occurs
+	 * before any packet is written
+	 */
+	int (*write_packets)(libtrace_out_t *libtrace,
+			libtrace_packet_t *packets[], int nb_packets);
+
         /** Flush any buffered output for an output trace.
          *
          * @param libtrace      The output trace to be flushed
@@ -1378,6 +1428,8 @@ void ndag_constructor(void);
 void etsilive_constructor(void);
 /** Constructor for the live TZSP over UDP format module */
 void tzsplive_constructor(void);
+/** Constructor for the time-ordered merge format module */
+void merge_constructor(void);
 #ifdef HAVE_BPF
 /** Constructor for the BPF format module */
 void bpf_constructor(void);
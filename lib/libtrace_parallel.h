@@ -1002,6 +1002,41 @@ DLLEXPORT int trace_set_debug_state(libtrace_t *trace, bool debug_state);
  */
 DLLEXPORT int trace_set_coremap(libtrace_t *trace, const char *coremap);
 
+/**
+ * Keep per-packet threads on the NUMA node of the capture device
+ *
+ * When enabled, the hasher thread and any per-packet threads that are not
+ * given a core by trace_set_coremap() are bound to the CPUs of the NUMA
+ * node that the capture interface is attached to, and the queues between
+ * them are placed in that node's memory. This only applies to live formats
+ * whose URI names the device, such as an interface name or a DPDK PCI
+ * address, and does nothing on systems with a single node.
+ *
+ * @param trace A parallel input trace
+ * @param pin If true threads are pinned to the device's node. Defaults false.
+ * @return 0 if successful otherwise -1.
+ */
+DLLEXPORT int trace_set_numa_pinning(libtrace_t *trace, bool pin);
+
+/**
+ * Back packet buffers and libtrace's queues with huge pages
+ *
+ * Packet buffers, the ring buffers between threads and the per-thread
+ * packet caches are allocated from an arena of huge pages, which cuts the
+ * TLB misses taken at high packet rates. The arena uses reserved huge pages
+ * (see /proc/sys/vm/nr_hugepages) when there are enough, then transparent
+ * huge pages, and finally normal memory, so it is always safe to enable.
+ *
+ * The arena is shared by the whole process and stays in use once any trace
+ * has been started with it enabled.
+ *
+ * @param trace A parallel input trace
+ * @param size The huge page size, 2MB or 1GB, or 0 for normal pages.
+ * Defaults to 0.
+ * @return 0 if successful otherwise -1.
+ */
+DLLEXPORT int trace_set_hugepage_size(libtrace_t *trace, size_t size);
+
 /** Set the hasher function for a parallel trace.
  *
  * @param[in] trace The parallel trace to apply the hasher to
@@ -1418,6 +1453,9 @@ DLLEXPORT libtrace_info_t *trace_get_information(libtrace_t * libtrace);
  * * \b debug_state,\b ds see trace_set_debug_state() [bool]
  * * \b coremap see trace_set_coremap() [string of comma-separated integers]
  *   e.g. coremap=[1,3,5,7] (square brackets required)
+ * * \b numa_pinning,\b np see trace_set_numa_pinning() [bool]
+ * * \b hugepage_size,\b hps see trace_set_hugepage_size() [size_t, which
+ *   may end in K, M or G e.g. hugepage_size=2M]
  *
  * Booleans can be set as 0/1 or false/true.
  *
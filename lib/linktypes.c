@@ -349,9 +349,10 @@ void promote_packet(libtrace_packet_t *packet)
 				trace_get_capture_length(packet));
 		if (packet->buf_control == TRACE_CTRL_EXTERNAL) {
 			packet->buf_control=TRACE_CTRL_PACKET;
+			packet->pool_capacity = 0;
 		}
 		else {
-			free(packet->buffer);
+			trace_free_packet_buffer(packet);
 		}
 		packet->buffer=tmpbuffer;
 		packet->header=tmpbuffer;
@@ -387,9 +388,10 @@ static void replacement_pcap_header(libtrace_packet_t *packet, char *payload,
 
         if (packet->buf_control == TRACE_CTRL_EXTERNAL) {
                 packet->buf_control=TRACE_CTRL_PACKET;
+                packet->pool_capacity = 0;
         }
         else {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
         packet->buffer=tmp;
         packet->header=tmp;
@@ -0,0 +1,204 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "config.h"
+#include "common.h"
+#include "libtrace.h"
+#include "numa_topology.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+
+#ifdef __linux__
+
+#define NUMA_SYSFS "/sys/devices/system/node"
+
+static int node_count = 1;
+/* The node of each CPU, indexed by CPU number */
+static int cpu_nodes[CPU_SETSIZE];
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+/* Reads the first line of a small sysfs file */
+static int read_sysfs(const char *path, char *buffer, size_t len) {
+        FILE *f = fopen(path, "r");
+        char *nl;
+
+        if (!f)
+                return -1;
+        if (!fgets(buffer, len, f)) {
+                fclose(f);
+                return -1;
+        }
+        fclose(f);
+        if ((nl = strchr(buffer, '\n')) != NULL)
+                *nl = '\0';
+        return 0;
+}
+
+/* Parses a sysfs list of ranges such as "0-3,8-11" into a cpu set, returning
+ * the highest number found or -1 if there were none */
+static int parse_list(const char *list, cpu_set_t *set) {
+        const char *p = list;
+        char *end;
+        long first, last, i;
+        int highest = -1;
+
+        CPU_ZERO(set);
+        while (*p) {
+                first = strtol(p, &end, 10);
+                if (end == p)
+                        break;
+                last = first;
+                if (*end == '-') {
+                        p = end + 1;
+                        last = strtol(p, &end, 10);
+                        if (end == p)
+                                break;
+                }
+                for (i = first; i <= last && i < CPU_SETSIZE; i++) {
+                        CPU_SET(i, set);
+                        if (i > highest)
+                                highest = i;
+                }
+                p = end;
+                if (*p == ',')
+                        p++;
+        }
+        return highest;
+}
+
+static void read_topology(void) {
+        char path[128], buffer[1024];
+        cpu_set_t set;
+        int node, cpu, highest;
+
+        memset(cpu_nodes, 0, sizeof(cpu_nodes));
+        if (read_sysfs(NUMA_SYSFS "/possible", buffer, sizeof(buffer)) < 0)
+                return;
+        highest = parse_list(buffer, &set);
+        if (highest < 1)
+                return;
+        node_count = highest + 1;
+
+        for (node = 0; node < node_count; node++) {
+                snprintf(path, sizeof(path), NUMA_SYSFS "/node%d/cpulist",
+                         node);
+                if (read_sysfs(path, buffer, sizeof(buffer)) < 0)
+                        continue;
+                parse_list(buffer, &set);
+                for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                        if (CPU_ISSET(cpu, &set))
+                                cpu_nodes[cpu] = node;
+                }
+        }
+}
+
+int libtrace_numa_nodes(void) {
+        pthread_once(&topology_once, read_topology);
+        return node_count;
+}
+
+int libtrace_numa_current_node(void) {
+        int cpu;
+
+        pthread_once(&topology_once, read_topology);
+        if (node_count == 1)
+                return 0;
+        cpu = sched_getcpu();
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+                return 0;
+        return cpu_nodes[cpu];
+}
+
+int libtrace_numa_device_node(const char *name) {
+        char path[256], buffer[32];
+
+        if (!name || *name == '\0' || strchr(name, '/'))
+                return -1;
+        snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node",
+                 name);
+        if (read_sysfs(path, buffer, sizeof(buffer)) < 0) {
+                snprintf(path, sizeof(path),
+                         "/sys/bus/pci/devices/%s/numa_node", name);
+                if (read_sysfs(path, buffer, sizeof(buffer)) < 0)
+                        return -1;
+        }
+        /* Devices that aren't attached to any particular node report -1 */
+        return atoi(buffer);
+}
+
+int libtrace_numa_node_cpus(int node, cpu_set_t *cpus) {
+        char path[128], buffer[1024];
+
+        CPU_ZERO(cpus);
+        if (node < 0)
+                return 0;
+        snprintf(path, sizeof(path), NUMA_SYSFS "/node%d/cpulist", node);
+        if (read_sysfs(path, buffer, sizeof(buffer)) < 0)
+                return 0;
+        parse_list(buffer, cpus);
+        return CPU_COUNT(cpus);
+}
+
+#else
+
+int libtrace_numa_nodes(void) {
+        return 1;
+}
+
+int libtrace_numa_current_node(void) {
+        return 0;
+}
+
+int libtrace_numa_device_node(const char *name UNUSED) {
+        return -1;
+}
+
+#endif
+
+void libtrace_numa_place(void *mem UNUSED, size_t len UNUSED,
+                         int node UNUSED) {
+#ifdef HAVE_LIBNUMA
+        uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t start = ((uintptr_t) mem + page - 1) & ~(page - 1);
+        uintptr_t end = ((uintptr_t) mem + len) & ~(page - 1);
+
+        /* Policies apply to whole pages, so leave alone any page that is
+         * shared with other allocations */
+        if (node < 0 || end <= start || numa_available() == -1)
+                return;
+        numa_tonode_memory((void *) start, end - start, node);
+#endif
+}
@@ -0,0 +1,65 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+#ifndef LIBTRACE_NUMA_TOPOLOGY_H
+#define LIBTRACE_NUMA_TOPOLOGY_H
+
+#include <stddef.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/** @file
+ *
+ * @brief Finds out which NUMA node CPUs, threads and capture devices are on
+ *
+ * The topology is read from sysfs, so on systems without it (or outside of
+ * Linux) everything is reported as being on a single node 0.
+ */
+
+/** Returns the number of NUMA nodes, which is always at least one */
+int libtrace_numa_nodes(void);
+
+/** Returns the node of the CPU the calling thread is currently running on */
+int libtrace_numa_current_node(void);
+
+/** Returns the node a network interface (e.g. "eth0") or PCI device (e.g.
+ * "0000:01:00.0") is attached to, or -1 if it is not known */
+int libtrace_numa_device_node(const char *name);
+
+#ifdef __linux__
+/** Fills in the set of CPUs that belong to a node
+ *
+ * @return the number of CPUs in the set, or 0 if the node is not known
+ */
+int libtrace_numa_node_cpus(int node, cpu_set_t *cpus);
+#endif
+
+/** Asks for memory that has not been touched yet to be placed on a node
+ * when it is. Only the pages that lie entirely within the memory are placed,
+ * and nothing is done unless libtrace was built with libnuma. */
+void libtrace_numa_place(void *mem, size_t len, int node);
+
+#endif
@@ -0,0 +1,330 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+#include "config.h"
+#include "common.h"
+#include "libtrace.h"
+#include "libtrace_int.h"
+#include "time_index.h"
+#include "wandio.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+static void time_index_filename(libtrace_t *libtrace, char *buffer,
+                size_t len) {
+        snprintf(buffer, len, "%s%s", libtrace->uridata, TIME_INDEX_SUFFIX);
+}
+
+/* Fills in the size and modification time of the trace file, which are
+ * kept in the index to tell when it has gone stale */
+static int time_index_stat_trace(libtrace_t *libtrace,
+                libtrace_time_index_header_t *header) {
+        struct stat st;
+
+        if (stat(libtrace->uridata, &st) != 0) {
+                trace_set_err(libtrace, TRACE_ERR_SEEK_ERF,
+                        "Unable to index %s, it is not a file",
+                        libtrace->uridata);
+                return -1;
+        }
+        header->tracesize = st.st_size;
+        header->tracemtime = st.st_mtime;
+        return 0;
+}
+
+static int time_index_add(libtrace_time_index_t *index, uint64_t timestamp,
+                uint64_t offset) {
+        libtrace_time_index_entry_t *entries;
+
+        if (index->header.count == index->allocated) {
+                index->allocated = index->allocated ?
+                        index->allocated * 2 : 256;
+                entries = (libtrace_time_index_entry_t *)realloc(
+                        index->entries, index->allocated *
+                        sizeof(libtrace_time_index_entry_t));
+                if (!entries) {
+                        return -1;
+                }
+                index->entries = entries;
+        }
+        index->entries[index->header.count].timestamp = timestamp;
+        index->entries[index->header.count].offset = offset;
+        index->header.count++;
+        return 0;
+}
+
+void trace_time_index_clear(libtrace_time_index_t *index) {
+        free(index->entries);
+        memset(index, 0, sizeof(libtrace_time_index_t));
+}
+
+int trace_time_index_build(libtrace_t *libtrace, libtrace_time_index_t *index,
+                uint32_t stride) {
+        char uri[PATH_MAX];
+        libtrace_t *scan;
+        libtrace_packet_t *packet;
+        libtrace_err_t err;
+        uint64_t count = 0, next = 0, last = 0;
+        uint64_t timestamp;
+        int64_t offset;
+        int ret;
+
+        trace_time_index_clear(index);
+        index->header.magic = TIME_INDEX_MAGIC;
+        index->header.version = TIME_INDEX_VERSION;
+        index->header.stride = stride ? stride : TIME_INDEX_DEFAULT_STRIDE;
+        if (time_index_stat_trace(libtrace, &index->header) < 0) {
+                return -1;
+        }
+
+        /* Read a separate copy of the trace so the caller's position is
+         * left alone */
+        snprintf(uri, sizeof(uri), "%s:%s", libtrace->format->name,
+                libtrace->uridata);
+        scan = trace_create(uri);
+        if (trace_is_err(scan) || trace_start(scan) == -1) {
+                err = trace_get_err(scan);
+                trace_set_err(libtrace, err.err_num, "%s", err.problem);
+                trace_destroy(scan);
+                return -1;
+        }
+
+        packet = trace_create_packet();
+        while (1) {
+                ret = trace_read_packet(scan, packet);
+                if (ret <= 0) {
+                        break;
+                }
+                if (IS_LIBTRACE_META_PACKET(packet)) {
+                        continue;
+                }
+                /* The packet started 'ret' bytes before where we are now,
+                 * which skips over any blocks the format read past */
+                offset = wandio_tell(scan->io);
+                if (offset < 0) {
+                        trace_set_err(libtrace, TRACE_ERR_SEEK_ERF,
+                                "Unable to index %s, the file cannot be "
+                                "seeked within", libtrace->uridata);
+                        ret = -1;
+                        break;
+                }
+                offset -= ret;
+
+                /* Entries are kept in timestamp order, so a packet that is
+                 * out of order is passed over for the one after it */
+                timestamp = trace_get_erf_timestamp(packet);
+                if (count >= next && timestamp >= last) {
+                        if (time_index_add(index, timestamp, offset) < 0) {
+                                trace_set_err(libtrace, TRACE_ERR_OUT_OF_MEMORY,
+                                        "Unable to allocate memory for the "
+                                        "time index of %s", libtrace->uridata);
+                                ret = -1;
+                                break;
+                        }
+                        last = timestamp;
+                        next = count + index->header.stride;
+                }
+                count++;
+        }
+
+        if (ret == 0) {
+                index->header.end = wandio_tell(scan->io);
+        } else if (trace_is_err(scan)) {
+                err = trace_get_err(scan);
+                trace_set_err(libtrace, err.err_num, "%s", err.problem);
+        }
+        trace_destroy_packet(packet);
+        trace_destroy(scan);
+
+        if (ret < 0) {
+                trace_time_index_clear(index);
+                return -1;
+        }
+        index->state = TIME_INDEX_EXISTS;
+        return 0;
+}
+
+int trace_time_index_save(libtrace_t *libtrace, libtrace_time_index_t *index) {
+        char filename[PATH_MAX];
+        iow_t *file;
+        int64_t len;
+        bool ok;
+
+        time_index_filename(libtrace, filename, sizeof(filename));
+        file = wandio_wcreate(filename, WANDIO_COMPRESS_NONE, 0,
+                        O_CREAT | O_WRONLY | O_TRUNC);
+        if (!file) {
+                trace_set_err(libtrace, TRACE_ERR_OUTPUT_FILE,
+                        "Unable to create time index %s", filename);
+                return -1;
+        }
+
+        len = index->header.count * sizeof(libtrace_time_index_entry_t);
+        ok = wandio_wwrite(file, &index->header, sizeof(index->header)) ==
+                        (int64_t)sizeof(index->header);
+        if (ok && len > 0) {
+                ok = wandio_wwrite(file, index->entries, len) == len;
+        }
+        wandio_wdestroy(file);
+
+        if (!ok) {
+                /* Don't leave a truncated index lying around */
+                unlink(filename);
+                trace_set_err(libtrace, TRACE_ERR_OUTPUT_FILE,
+                        "Unable to write time index %s", filename);
+                return -1;
+        }
+        return 0;
+}
+
+/* Loads the index from disk, returning -1 if there isn't a usable one */
+static int time_index_load(libtrace_t *libtrace, libtrace_time_index_t *index) {
+        char filename[PATH_MAX];
+        libtrace_time_index_header_t current;
+        io_t *file;
+        int64_t len;
+
+        if (time_index_stat_trace(libtrace, &current) < 0) {
+                return -1;
+        }
+
+        time_index_filename(libtrace, filename, sizeof(filename));
+        file = wandio_create(filename);
+        if (!file) {
+                return -1;
+        }
+
+        trace_time_index_clear(index);
+        if (wandio_read(file, &index->header, sizeof(index->header)) !=
+                        (int64_t)sizeof(index->header) ||
+                        index->header.magic != TIME_INDEX_MAGIC ||
+                        index->header.version != TIME_INDEX_VERSION ||
+                        index->header.tracesize != current.tracesize ||
+                        index->header.tracemtime != current.tracemtime) {
+                goto stale;
+        }
+
+        len = index->header.count * sizeof(libtrace_time_index_entry_t);
+        if (index->header.count > 0) {
+                index->entries = (libtrace_time_index_entry_t *)malloc(len);
+                index->allocated = index->header.count;
+                if (!index->entries || wandio_read(file, index->entries, len)
+                                != len) {
+                        goto stale;
+                }
+        }
+        wandio_destroy(file);
+        index->state = TIME_INDEX_EXISTS;
+        return 0;
+
+stale:
+        wandio_destroy(file);
+        trace_time_index_clear(index);
+        return -1;
+}
+
+int trace_time_index_lookup(libtrace_t *libtrace,
+                libtrace_time_index_t *index, uint64_t erfts,
+                uint64_t *offset) {
+        uint64_t min = 0, max, mid;
+
+        /* Only an index saved by trace_build_time_index() is used. Building
+         * one here would read the whole trace just to seek within it */
+        if (index->state == TIME_INDEX_UNKNOWN) {
+                if (time_index_load(libtrace, index) < 0) {
+                        index->state = TIME_INDEX_NONE;
+                }
+        }
+
+        if (index->state != TIME_INDEX_EXISTS) {
+                return 0;
+        }
+
+        if (index->header.count == 0) {
+                *offset = index->header.end;
+                return 1;
+        }
+
+        /* Find the last entry at or before erfts, or the first entry if
+         * they are all after it */
+        max = index->header.count;
+        while (max - min > 1) {
+                mid = min + (max - min) / 2;
+                if (index->entries[mid].timestamp <= erfts) {
+                        min = mid;
+                } else {
+                        max = mid;
+                }
+        }
+        *offset = index->entries[min].offset;
+        return 1;
+}
+
+int trace_time_index_walk(libtrace_t *libtrace, uint64_t erfts) {
+        libtrace_packet_t *packet;
+        int64_t offset;
+        int ret, skipped = 0;
+
+        packet = trace_create_packet();
+        packet->trace = libtrace;
+        packet->which_trace_start = libtrace->startcount;
+        while (1) {
+                trace_clear_cache(packet);
+                ret = libtrace->format->read_packet(libtrace, packet);
+                if (ret <= 0) {
+                        break;
+                }
+                if (IS_LIBTRACE_META_PACKET(packet)) {
+                        continue;
+                }
+                if (trace_get_erf_timestamp(packet) < erfts) {
+                        skipped++;
+                        continue;
+                }
+
+                /* Step back so this packet is the next one read */
+                offset = wandio_tell(libtrace->io) - ret;
+                if (wandio_seek(libtrace->io, offset, SEEK_SET) < 0) {
+                        trace_set_err(libtrace, TRACE_ERR_SEEK_ERF,
+                                "Unable to seek within %s", libtrace->uridata);
+                        ret = -1;
+                }
+                break;
+        }
+        trace_destroy_packet(packet);
+
+        return ret < 0 ? -1 : skipped;
+}
@@ -0,0 +1,139 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+#ifndef TIME_INDEX_H
+#define TIME_INDEX_H
+
+#include "libtrace.h"
+#include "libtrace_int.h"
+
+/** @file
+ *
+ * @brief Sparse time index used to seek within trace files
+ *
+ * The index records the timestamp and file offset of every Nth packet in a
+ * trace. trace_build_time_index() and the tracetimeindex tool save it next
+ * to the trace as "<file>.tidx". Seeking jumps to the last indexed packet
+ * before the requested time and reads forward from there, rather than
+ * reading the whole trace from the start. Without a saved index, seeking
+ * reads forward from the current position instead, going back to the start
+ * of the trace only if it is already past the requested time.
+ *
+ * Offsets are positions in the uncompressed stream, so seeking in a
+ * compressed trace only works if the wandio reader for it can seek.
+ */
+
+/** Suffix appended to the trace filename to name its index */
+#define TIME_INDEX_SUFFIX ".tidx"
+
+/** Number of packets between index entries, unless told otherwise */
+#define TIME_INDEX_DEFAULT_STRIDE 1000
+
+/** Identifies a time index file ("LTIX") */
+#define TIME_INDEX_MAGIC 0x5849544c
+#define TIME_INDEX_VERSION 1
+
+/** Header at the start of a time index file, which is followed by 'count'
+ * libtrace_time_index_entry_t records in timestamp order */
+typedef struct libtrace_time_index_header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t stride;
+        uint32_t reserved;
+        /** Size and modification time of the trace when it was indexed,
+         * used to spot an index that no longer matches its trace */
+        uint64_t tracesize;
+        uint64_t tracemtime;
+        /** Offset just past the last packet in the trace */
+        uint64_t end;
+        uint64_t count;
+} PACKED libtrace_time_index_header_t;
+ct_assert(sizeof(libtrace_time_index_header_t) == 48);
+
+typedef struct libtrace_time_index_entry {
+        /** ERF timestamp of the packet */
+        uint64_t timestamp;
+        /** Offset of the packet within the uncompressed trace */
+        uint64_t offset;
+} PACKED libtrace_time_index_entry_t;
+ct_assert(sizeof(libtrace_time_index_entry_t) == 16);
+
+typedef struct libtrace_time_index {
+        /** Whether the index has been loaded (or built) yet */
+        enum { TIME_INDEX_UNKNOWN = 0, TIME_INDEX_NONE, TIME_INDEX_EXISTS }
+                state;
+        libtrace_time_index_header_t header;
+        libtrace_time_index_entry_t *entries;
+        uint64_t allocated;
+} libtrace_time_index_t;
+
+/** Reads the whole of a trace file to build a time index for it
+ *
+ * @param libtrace	The trace to index, which is not read from itself. A
+ * 			separate trace is opened on the same file instead.
+ * @param index		The index to fill in
+ * @param stride	The number of packets between index entries
+ * @return 0 on success, -1 on error (which is set on libtrace)
+ */
+int trace_time_index_build(libtrace_t *libtrace, libtrace_time_index_t *index,
+                uint32_t stride);
+
+/** Writes a time index out next to its trace file
+ *
+ * @return 0 on success, -1 on error (which is set on libtrace)
+ */
+int trace_time_index_save(libtrace_t *libtrace, libtrace_time_index_t *index);
+
+/** Finds the offset to start reading from to reach a given time
+ *
+ * The index is loaded from disk the first time this is called. It is never
+ * built here, a trace without a usable saved index is read forward instead.
+ *
+ * @param libtrace	The trace being seeked within
+ * @param index		The index belonging to the trace
+ * @param erfts		The time being seeked to, as an ERF timestamp
+ * @param[out] offset	Set to the offset of the last indexed packet before
+ * 			erfts
+ * @return 1 if offset was set, 0 if the trace has no saved index
+ */
+int trace_time_index_lookup(libtrace_t *libtrace,
+                libtrace_time_index_t *index, uint64_t erfts,
+                uint64_t *offset);
+
+/** Reads forward from the current position in a trace file until the next
+ * packet is the first at or after a given time, leaving it unread.
+ *
+ * The format must read packets straight from libtrace->io and return the
+ * number of bytes consumed for the packet from read_packet().
+ *
+ * @return the number of packets before erfts that were read past, or -1 on
+ * error. 0 means the trace may already have been past erfts.
+ */
+int trace_time_index_walk(libtrace_t *libtrace, uint64_t erfts);
+
+/** Releases the memory used by a time index, leaving it unloaded */
+void trace_time_index_clear(libtrace_time_index_t *index);
+
+#endif
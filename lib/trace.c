@@ -79,6 +79,10 @@
 #include "libtrace.h"
 #include "libtrace_int.h"
 #include "format_helper.h"
+#include "hash_toeplitz.h"
+#include "time_index.h"
+#include "buffer_pool.h"
+#include "hugepage_arena.h"
 #include "rt_protocol.h"
 
 #include <pthread.h>
@@ -152,6 +156,7 @@ __attribute__((constructor)) static void trace_init(void)
                 pcapfile_constructor();
                 pcapng_constructor();
                 tzsplive_constructor();
+                merge_constructor();
                 rt_constructor();
                 ndag_constructor();
 #ifdef HAVE_WANDDER
@@ -294,6 +299,10 @@ DLLEXPORT libtrace_t *trace_create(const char *uri)
         libtrace->event.waiting = false;
         libtrace->filter = NULL;
         libtrace->snaplen = 0;
+        libtrace->sample_rate = 0;
+        libtrace->sample_count = 0;
+        libtrace->flow_sample_rate = 0;
+        libtrace->flow_sample_conf = NULL;
         libtrace->replayspeedup = 1;
         libtrace->started = false;
         libtrace->startcount = 0;
@@ -301,6 +310,8 @@ DLLEXPORT libtrace_t *trace_create(const char *uri)
         libtrace->io = NULL;
         libtrace->filtered_packets = 0;
         libtrace->accepted_packets = 0;
+        libtrace->copied_packets = 0;
+        libtrace->copied_bytes = 0;
         libtrace->last_packet = NULL;
 
         /* Parallel inits */
@@ -320,6 +331,7 @@ DLLEXPORT libtrace_t *trace_create(const char *uri)
         libtrace->reporter_thread.type = THREAD_EMPTY;
         libtrace->perpkt_thread_count = 0;
         libtrace->perpkt_threads = NULL;
+        libtrace->numa_node = -1;
         libtrace->tracetime = 0;
         libtrace->first_packets.first = 0;
         libtrace->first_packets.count = 0;
@@ -442,12 +454,18 @@ DLLEXPORT libtrace_t *trace_create_dead(const char *uri)
         libtrace->event.first_now = 0;
         libtrace->filter = NULL;
         libtrace->snaplen = 0;
+        libtrace->sample_rate = 0;
+        libtrace->sample_count = 0;
+        libtrace->flow_sample_rate = 0;
+        libtrace->flow_sample_conf = NULL;
         libtrace->started = false;
         libtrace->startcount = 0;
         libtrace->uridata = NULL;
         libtrace->io = NULL;
         libtrace->filtered_packets = 0;
         libtrace->accepted_packets = 0;
+        libtrace->copied_packets = 0;
+        libtrace->copied_bytes = 0;
         libtrace->last_packet = NULL;
 
         /* Parallel inits */
@@ -465,6 +483,7 @@ DLLEXPORT libtrace_t *trace_create_dead(const char *uri)
         libtrace->reporter_thread.type = THREAD_EMPTY;
         libtrace->perpkt_thread_count = 0;
         libtrace->perpkt_threads = NULL;
+        libtrace->numa_node = -1;
         libtrace->tracetime = 0;
         libtrace->stats = NULL;
         libtrace->pread = NULL;
@@ -771,6 +790,62 @@ DLLEXPORT int trace_config(libtrace_t *libtrace, trace_option_t option,
                                       "XDP program in SKB (generic) mode");
                 }
                 return -1;
+        case TRACE_OPTION_RING_BLOCK_MODE:
+                if (!trace_is_err(libtrace)) {
+                        trace_set_err(libtrace, TRACE_ERR_OPTION_UNAVAIL,
+                                      "Block based ring buffers are not "
+                                      "supported by this format module");
+                }
+                return -1;
+        case TRACE_OPTION_SAMPLE_RATE:
+                /* Clear the error if there was one */
+                if (trace_is_err(libtrace)) {
+                        trace_get_err(libtrace);
+                }
+                if (*(int *)value < 0) {
+                        trace_set_err(libtrace, TRACE_ERR_BAD_STATE,
+                                      "Invalid sample rate");
+                        return -1;
+                }
+                libtrace->sample_rate = *(int *)value;
+                return 0;
+        case TRACE_OPTION_FLOW_SAMPLE_RATE:
+                /* Clear the error if there was one */
+                if (trace_is_err(libtrace)) {
+                        trace_get_err(libtrace);
+                }
+                if (*(int *)value < 0) {
+                        trace_set_err(libtrace, TRACE_ERR_BAD_STATE,
+                                      "Invalid flow sample rate");
+                        return -1;
+                }
+                if (*(int *)value > 1 && !libtrace->flow_sample_conf) {
+                        toeplitz_conf_t *conf =
+                            calloc(1, sizeof(toeplitz_conf_t));
+                        int i;
+
+                        if (!conf) {
+                                trace_set_err(libtrace,
+                                              TRACE_ERR_OUT_OF_MEMORY,
+                                              "Unable to allocate memory "
+                                              "for flow sampling in "
+                                              "trace_config()");
+                                return -1;
+                        }
+
+                        /* toeplitz_init_config() picks a random key, but
+                         * the same flows must be chosen on every run, so
+                         * use the well known symmetric RSS key instead */
+                        toeplitz_init_config(conf, 1);
+                        for (i = 0; i < (int)sizeof(conf->key); i += 2) {
+                                conf->key[i] = 0x6d;
+                                conf->key[i + 1] = 0x5a;
+                        }
+                        toeplitz_hash_expand_key(conf);
+                        libtrace->flow_sample_conf = conf;
+                }
+                libtrace->flow_sample_rate = *(int *)value;
+                return 0;
         }
         if (!trace_is_err(libtrace)) {
                 trace_set_err(libtrace, TRACE_ERR_UNKNOWN_OPTION,
@@ -806,6 +881,16 @@ DLLEXPORT int trace_set_event_realtime(libtrace_t *trace, bool realtime)
         return trace_config(trace, TRACE_OPTION_EVENT_REALTIME, &tmp);
 }
 
+DLLEXPORT int trace_set_sample_rate(libtrace_t *trace, int rate)
+{
+        return trace_config(trace, TRACE_OPTION_SAMPLE_RATE, &rate);
+}
+
+DLLEXPORT int trace_set_flow_sample_rate(libtrace_t *trace, int rate)
+{
+        return trace_config(trace, TRACE_OPTION_FLOW_SAMPLE_RATE, &rate);
+}
+
 DLLEXPORT int trace_config_output(libtrace_out_t *libtrace,
                                   trace_option_output_t option, void *value)
 {
@@ -870,6 +955,9 @@ DLLEXPORT void trace_destroy(libtrace_t *libtrace)
         if (libtrace->stats)
                 free(libtrace->stats);
 
+        if (libtrace->flow_sample_conf)
+                free(libtrace->flow_sample_conf);
+
         /* Empty any packet memory */
         if (libtrace->state != STATE_NEW) {
                 // This has all of our packets
@@ -987,7 +1075,6 @@ DLLEXPORT libtrace_packet_t *trace_create_packet(void)
 
         packet->buf_control = TRACE_CTRL_PACKET;
         packet->which_trace_start = 0;
-        pthread_mutex_init(&(packet->ref_lock), NULL);
         trace_clear_cache(packet);
         return packet;
 }
@@ -995,6 +1082,7 @@ DLLEXPORT libtrace_packet_t *trace_create_packet(void)
 DLLEXPORT libtrace_packet_t *trace_copy_packet(const libtrace_packet_t *packet)
 {
         libtrace_packet_t *dest;
+        size_t framing, caplen;
 
         if (packet->which_trace_start != packet->trace->startcount) {
                 return NULL;
@@ -1007,30 +1095,42 @@ DLLEXPORT libtrace_packet_t *trace_copy_packet(const libtrace_packet_t *packet)
                 abort();
         }
         dest->trace = packet->trace;
-        dest->buffer = malloc(65536);
+        /* Only take as much buffer as this packet needs. Full sized pool
+         * buffers are kept for formats to reuse, and a format that doesn't
+         * use the pool would free() one, so large copies are malloc'd */
+        framing = trace_get_framing_length(packet);
+        caplen = trace_get_capture_length(packet);
+        if (framing + caplen > LIBTRACE_PACKET_BUFSIZE / 2) {
+                dest->buffer = malloc((size_t)LIBTRACE_PACKET_BUFSIZE);
+                dest->pool_capacity = 0;
+        } else {
+                dest->buffer = libtrace_buffer_pool_alloc(framing + caplen,
+                                                          &dest->pool_capacity);
+        }
         if (!dest->buffer) {
                 printf("Out of memory allocating buffer memory\n");
                 abort();
         }
         dest->header = dest->buffer;
-        dest->payload =
-            (void *)((char *)dest->buffer + trace_get_framing_length(packet));
+        dest->payload = (void *)((char *)dest->buffer + framing);
         dest->type = packet->type;
         dest->buf_control = TRACE_CTRL_PACKET;
         dest->order = packet->order;
         dest->hash = packet->hash;
         dest->error = packet->error;
         dest->which_trace_start = packet->which_trace_start;
-        pthread_mutex_init(&(dest->ref_lock), NULL);
         /* Reset the cache - better to recalculate than try to convert
          * the values over to the new packet */
         trace_clear_cache(dest);
         /* Ooooh nasty memcpys! This is why we want to avoid copying packets
          * as much as possible */
-        memcpy(dest->header, packet->header, trace_get_framing_length(packet));
-        memcpy(dest->payload, packet->payload,
-               trace_get_capture_length(packet));
+        memcpy(dest->header, packet->header, framing);
+        memcpy(dest->payload, packet->payload, caplen);
 
+        __atomic_add_fetch(&packet->trace->copied_packets, 1,
+                           __ATOMIC_RELAXED);
+        __atomic_add_fetch(&packet->trace->copied_bytes, framing + caplen,
+                           __ATOMIC_RELAXED);
         return dest;
 }
 
@@ -1047,11 +1147,16 @@ DLLEXPORT void trace_destroy_packet(libtrace_packet_t *packet)
             packet->trace->last_packet == packet) {
                 packet->trace->last_packet = NULL;
         }
+        /* Let go of the shared format buffer this packet points into */
+        if (packet->srcbucket && packet->internalid != 0) {
+                libtrace_release_bucket_id(
+                    (libtrace_bucket_t *)packet->srcbucket,
+                    packet->internalid);
+        }
 
         if (packet->buf_control == TRACE_CTRL_PACKET && packet->buffer) {
-                free(packet->buffer);
+                trace_free_packet_buffer(packet);
         }
-        pthread_mutex_destroy(&(packet->ref_lock));
         packet->buf_control = (buf_control_t)'\0';
         /* A "bad" value to force an assert
          * if this packet is ever reused
@@ -1059,6 +1164,38 @@ DLLEXPORT void trace_destroy_packet(libtrace_packet_t *packet)
         free(packet);
 }
 
+void trace_free_packet_buffer(libtrace_packet_t *packet)
+{
+        /* A buffer that has already gone must not reach the pool, which
+         * would hand the NULL out again */
+        if (!packet->buffer) {
+                packet->pool_capacity = 0;
+                return;
+        }
+        if (packet->pool_capacity) {
+                libtrace_buffer_pool_free(packet->buffer,
+                                          packet->pool_capacity);
+        } else {
+                free(packet->buffer);
+        }
+        packet->buffer = NULL;
+        packet->pool_capacity = 0;
+}
+
+void *trace_alloc_packet_buffer(libtrace_packet_t *packet)
+{
+        /* Huge page backed buffers can't be free()d, so they have to come
+         * from the pool which knows how to take them back */
+        if (libtrace_arena_enabled()) {
+                packet->buffer = libtrace_buffer_pool_alloc(
+                    LIBTRACE_PACKET_BUFSIZE, &packet->pool_capacity);
+        } else {
+                packet->buffer = malloc((size_t)LIBTRACE_PACKET_BUFSIZE);
+                packet->pool_capacity = 0;
+        }
+        return packet->buffer;
+}
+
 /**
  * Removes any possible data stored againt the trace and releases any data.
  * This will not destroy a reusable good malloc'd buffer (TRACE_CTRL_PACKET)
@@ -1091,6 +1228,12 @@ void trace_fin_packet(libtrace_packet_t *packet)
 
                 if (packet->buf_control != TRACE_CTRL_PACKET) {
                         packet->buffer = NULL;
+                        packet->pool_capacity = 0;
+                } else if (packet->pool_capacity &&
+                           packet->pool_capacity < LIBTRACE_PACKET_BUFSIZE) {
+                        /* Formats expect a reusable buffer to be a full
+                         * LIBTRACE_PACKET_BUFSIZE, which a copy may not be */
+                        trace_free_packet_buffer(packet);
                 }
 
                 trace_clear_cache(packet);
@@ -1101,6 +1244,49 @@ void trace_fin_packet(libtrace_packet_t *packet)
         }
 }
 
+/* Decides whether a packet survives the flow and packet sampling configured
+ * on the trace. Flow sampling is applied first, so the 1-in-N packet
+ * sampling only counts packets belonging to the chosen flows.
+ *
+ * @param libtrace	the trace the packet was read from
+ * @param count		the reader's position within the sampling interval
+ * @param packet	the packet to check
+ * @returns 1 if the packet should be kept, 0 if it should be discarded
+ */
+int trace_sample_packet(libtrace_t *libtrace, uint32_t *count,
+                        libtrace_packet_t *packet)
+{
+        /* Meta packets describe the capture rather than the traffic */
+        if (IS_LIBTRACE_META_PACKET(packet))
+                return 1;
+
+        if (libtrace->flow_sample_rate > 1) {
+                uint32_t hash = (uint32_t)toeplitz_hash_packet(
+                    packet, libtrace->flow_sample_conf);
+
+                /* The default hasher spreads packets over threads using
+                 * the same toeplitz hash, so mix the bits before choosing
+                 * flows. Otherwise every sampled flow could end up on the
+                 * same thread. */
+                hash ^= hash >> 16;
+                hash *= 0x85ebca6b;
+                hash ^= hash >> 13;
+                hash *= 0xc2b2ae35;
+                hash ^= hash >> 16;
+                if (hash % libtrace->flow_sample_rate != 0)
+                        return 0;
+        }
+
+        if (libtrace->sample_rate > 1) {
+                uint32_t pos = *count;
+
+                *count = (pos + 1 == libtrace->sample_rate) ? 0 : pos + 1;
+                if (pos != 0)
+                        return 0;
+        }
+        return 1;
+}
+
 /* Read one packet from the trace into buffer. Note that this function will
  * block until a packet is read (or EOF is reached).
  *
@@ -1148,6 +1334,9 @@ DLLEXPORT int trace_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
                  */
                 if (packet->trace == libtrace) {
                         trace_fin_packet(packet);
+                } else if (packet->buf_control == TRACE_CTRL_PACKET &&
+                           packet->pool_capacity) {
+                        trace_free_packet_buffer(packet);
                 }
                 do {
                         size_t ret;
@@ -1183,6 +1372,13 @@ DLLEXPORT int trace_read_packet(libtrace_t *libtrace, libtrace_packet_t *packet)
                                         continue;
                                 }
                         }
+                        if (!trace_sample_packet(libtrace,
+                                                 &libtrace->sample_count,
+                                                 packet)) {
+                                ++libtrace->filtered_packets;
+                                trace_fin_packet(packet);
+                                continue;
+                        }
                         if (libtrace->snaplen > 0) {
                                 /* Snap the packet */
                                 trace_set_capture_length(packet,
@@ -1256,11 +1452,19 @@ int trace_prepare_packet(libtrace_t *trace, libtrace_packet_t *packet,
         }
 
         packet->trace = trace;
+        packet->which_trace_start = trace->startcount;
         if (!libtrace_parallel)
                 trace->last_packet = packet;
         /* Clear packet cache */
         trace_clear_cache(packet);
 
+        /* The format would free() a copied packet's buffer behind the
+         * pool's back when replacing it */
+        if (packet->buf_control == TRACE_CTRL_PACKET &&
+            packet->pool_capacity && packet->buffer != buffer) {
+                trace_free_packet_buffer(packet);
+        }
+
         if (trace->format->prepare_packet) {
                 return trace->format->prepare_packet(trace, packet, buffer,
                                                      rt_type, flags);
@@ -1313,6 +1517,90 @@ DLLEXPORT int trace_write_packet(libtrace_out_t *libtrace,
         return -1;
 }
 
+/* Writes a batch of packets to the specified output trace
+ *
+ * @param libtrace	describes the output format, destination, etc.
+ * @param packets	the packets to be written out
+ * @param nb_packets	the number of packets to write
+ * @returns the number of packets written, -1 if an error occurred before
+ * any packets were written
+ */
+DLLEXPORT int trace_write_packets(libtrace_out_t *libtrace,
+                                  libtrace_packet_t *packets[], int nb_packets)
+{
+        int i, start, ret;
+        int skipped = 0;
+
+        if (!libtrace) {
+                fprintf(stderr,
+                        "NULL trace passed into trace_write_packets()\n");
+                return TRACE_ERR_NULL_TRACE;
+        }
+        if (!packets) {
+                trace_set_err_out(
+                    libtrace, TRACE_ERR_NULL_PACKET,
+                    "NULL packet array passed into trace_write_packets()");
+                return -1;
+        }
+
+        /* Formats without batch support write one packet at a time. Packets
+         * the output can't write are skipped rather than counted */
+        if (!libtrace->format->write_packets) {
+                for (i = 0; i < nb_packets; i++) {
+                        ret = trace_write_packet(libtrace, packets[i]);
+                        if (ret < 0) {
+                                return i > skipped ? i - skipped : -1;
+                        }
+                        if (ret == 0) {
+                                skipped++;
+                        }
+                }
+                return nb_packets - skipped;
+        }
+
+        if (!libtrace->started) {
+                trace_set_err_out(libtrace, TRACE_ERR_BAD_STATE,
+                                  "You must call trace_start_output() before "
+                                  "calling trace_write_packets()");
+                return -1;
+        }
+
+        /* Hand the format each run of packets between the meta-packets that
+         * we can't convert across formats */
+        i = 0;
+        while (i < nb_packets) {
+                start = i;
+                while (i < nb_packets && packets[i] &&
+                       (strcmp(libtrace->format->name,
+                               packets[i]->trace->format->name) == 0 ||
+                        !IS_LIBTRACE_META_PACKET(packets[i]))) {
+                        i++;
+                }
+                if (i > start) {
+                        ret = libtrace->format->write_packets(
+                            libtrace, &packets[start], i - start);
+                        if (ret < 0) {
+                                return start > skipped ? start - skipped : -1;
+                        }
+                        if (ret < i - start) {
+                                return start - skipped + ret;
+                        }
+                }
+                if (i < nb_packets && !packets[i]) {
+                        trace_set_err_out(libtrace, TRACE_ERR_NULL_PACKET,
+                                          "NULL packet passed into "
+                                          "trace_write_packets()");
+                        return i > skipped ? i - skipped : -1;
+                }
+                /* Skip the meta-packet */
+                if (i < nb_packets) {
+                        skipped++;
+                }
+                i++;
+        }
+        return nb_packets - skipped;
+}
+
 /* Get a pointer to the first byte of the packet payload */
 DLLEXPORT void *trace_get_packet_buffer(const libtrace_packet_t *packet,
                                         libtrace_linktype_t *linktype,
@@ -2408,6 +2696,33 @@ DLLEXPORT int trace_seek_timeval(libtrace_t *trace, struct timeval tv)
         }
 }
 
+DLLEXPORT int trace_build_time_index(libtrace_t *trace, uint32_t stride)
+{
+        libtrace_time_index_t index;
+        int ret;
+
+        if (!trace) {
+                fprintf(stderr, "NULL trace passed to "
+                                "trace_build_time_index()\n");
+                return TRACE_ERR_NULL_TRACE;
+        }
+        if (trace->format->type != TRACE_FORMAT_PCAPFILE &&
+            trace->format->type != TRACE_FORMAT_PCAPNG) {
+                trace_set_err(trace, TRACE_ERR_UNSUPPORTED,
+                              "Time indexes are only supported for pcapfile "
+                              "and pcapng traces");
+                return -1;
+        }
+
+        memset(&index, 0, sizeof(index));
+        ret = trace_time_index_build(trace, &index, stride);
+        if (ret == 0) {
+                ret = trace_time_index_save(trace, &index);
+        }
+        trace_time_index_clear(&index);
+        return ret;
+}
+
 /* Converts a binary ethernet MAC address into a printable string */
 DLLEXPORT char *trace_ether_ntoa(const uint8_t *addr, char *buf)
 {
@@ -2506,11 +2821,15 @@ void trace_construct_packet(libtrace_packet_t *packet,
         size = len + sizeof(hdr);
         if (size < LIBTRACE_PACKET_BUFSIZE)
                 size = LIBTRACE_PACKET_BUFSIZE;
+        /* Pool buffers can't be realloc()d */
+        if (packet->buf_control == TRACE_CTRL_PACKET && packet->pool_capacity)
+                trace_free_packet_buffer(packet);
         if (packet->buf_control == TRACE_CTRL_PACKET) {
                 packet->buffer = realloc(packet->buffer, size);
         } else {
                 packet->buffer = malloc(size);
         }
+        packet->pool_capacity = 0;
         packet->buf_control = TRACE_CTRL_PACKET;
         packet->header = packet->buffer;
         packet->payload = (void *)((char *)packet->buffer + sizeof(hdr));
@@ -2700,6 +3019,13 @@ libtrace_stat_t *trace_get_statistics(libtrace_t *trace, libtrace_stat_t *stat)
                 stat->filtered += trace->perpkt_threads[i].filtered_packets;
         }
 
+        stat->copied_valid = 1;
+        stat->copied = __atomic_load_n(&trace->copied_packets,
+                                       __ATOMIC_RELAXED);
+        stat->copied_bytes_valid = 1;
+        stat->copied_bytes = __atomic_load_n(&trace->copied_bytes,
+                                             __ATOMIC_RELAXED);
+
         if (trace->format->get_statistics) {
                 trace->format->get_statistics(trace, stat);
         }
@@ -82,6 +82,8 @@
 #include "format_helper.h"
 #include "rt_protocol.h"
 #include "hash_toeplitz.h"
+#include "numa_topology.h"
+#include "hugepage_arena.h"
 
 #include <pthread.h>
 #include <signal.h>
@@ -420,6 +422,7 @@ void libtrace_zero_thread(libtrace_thread_t *t)
 {
         t->accepted_packets = 0;
         t->filtered_packets = 0;
+        t->sample_count = 0;
         t->recorded_first = false;
         t->tracetime_offset_usec = 0;
         t->user_data = 0;
@@ -703,11 +706,16 @@ static int trace_perpkt_thread_pause(libtrace_t *trace, libtrace_thread_t *t,
                                 }
                                 /* Verify no packets are remaining */
                                 /* TODO refactor this sanity check out!! */
+                                /* Read the queue directly, pread() keeps
+                                 * returning an EOF it has stored in
+                                 * format_data without emptying it */
                                 while (!libtrace_ringbuffer_is_empty(
                                     &t->rbuffer)) {
-                                        ASSERT_RET(
-                                            trace->pread(trace, t, &packet, 1),
-                                            <= 0);
+                                        libtrace_ocache_free(
+                                            &trace->packet_freelist,
+                                            (void **)&packet, 1, 1);
+                                        packet = libtrace_ringbuffer_read(
+                                            &t->rbuffer);
                                         // No packets after this should have any
                                         // data in them
                                         if (packet->error > 0) {
@@ -1586,6 +1594,42 @@ static inline size_t filter_packets(libtrace_t *trace,
         return offset;
 }
 
+/* Discards packets that are not chosen by flow or packet sampling.
+ * Discarded packets are emptied and then moved to the end of the packet list.
+ *
+ * @param trace       The trace, containing the sampling configuration
+ * @param t           The thread, which tracks its own sampling interval
+ * @param packets     An array of packets
+ * @param nb_packets  The number of valid items in packets
+ *
+ * @return The number of packets that were sampled, which are moved to
+ *          the start of the packets array
+ */
+static inline size_t sample_packets(libtrace_t *trace, libtrace_thread_t *t,
+                                    libtrace_packet_t **packets,
+                                    size_t nb_packets)
+{
+        size_t offset = 0;
+        size_t i;
+
+        for (i = 0; i < nb_packets; ++i) {
+                // Hashing flows needs the trace attached for the link type
+                packets[i]->trace = trace;
+                packets[i]->which_trace_start = trace->startcount;
+                if (trace_sample_packet(trace, &t->sample_count,
+                                        packets[i])) {
+                        libtrace_packet_t *tmp;
+                        tmp = packets[offset];
+                        packets[offset++] = packets[i];
+                        packets[i] = tmp;
+                } else {
+                        trace_fin_packet(packets[i]);
+                }
+        }
+
+        return offset;
+}
+
 /* Read a batch of packets from the trace into a buffer.
  * Note that this function will block until a packet is read (or EOF is reached)
  *
@@ -1637,6 +1681,14 @@ static int trace_pread_packet_wrapper(libtrace_t *libtrace,
                                 t->filtered_packets += ret - remaining;
                                 ret = remaining;
                         }
+                        if (libtrace->sample_rate > 1 ||
+                            libtrace->flow_sample_rate > 1) {
+                                int remaining;
+                                remaining = sample_packets(libtrace, t,
+                                                           packets, ret);
+                                t->filtered_packets += ret - remaining;
+                                ret = remaining;
+                        }
                         for (i = 0; i < ret; ++i) {
                                 /* We do not mark the packet against the trace,
                                  * before hand or after. After breaks DAG meta
@@ -1718,9 +1770,11 @@ static int trace_prestart(libtrace_t *libtrace, void *global_blob,
         for (i = 0; i < libtrace->perpkt_thread_count; ++i) {
                 libtrace->perpkt_threads[i].accepted_packets = 0;
                 libtrace->perpkt_threads[i].filtered_packets = 0;
+                libtrace->perpkt_threads[i].sample_count = 0;
         }
         libtrace->accepted_packets = 0;
         libtrace->filtered_packets = 0;
+        libtrace->sample_count = 0;
 
         /* Update functions if requested */
         if (global_blob)
@@ -1839,6 +1893,27 @@ static void verify_configuration(libtrace_t *libtrace)
                         libtrace->config.coremap[i] = -1;
                 }
         }
+
+        if (libtrace->config.hugepage_size &&
+            libtrace_arena_enable(libtrace->config.hugepage_size) != 0) {
+                fprintf(stderr,
+                        "Unsupported huge page size %zu, packet buffers will "
+                        "use normal pages\n",
+                        libtrace->config.hugepage_size);
+        }
+
+        /* Find the node of the capture device, which is named by the URI
+         * of live formats (an interface, or a PCI address for DPDK) */
+        libtrace->numa_node = -1;
+        if (libtrace->config.numa_pinning && libtrace_numa_nodes() > 1) {
+                libtrace->numa_node =
+                    libtrace_numa_device_node(libtrace->uridata);
+                if (libtrace->numa_node < 0)
+                        fprintf(stderr,
+                                "Unable to find the NUMA node of %s, threads "
+                                "will not be pinned\n",
+                                libtrace->uridata);
+        }
 }
 
 /**
@@ -1890,6 +1965,9 @@ static int trace_start_thread(libtrace_t *trace, libtrace_thread_t *t,
         // does a coremap entry exist for this perpkt thread
         if (type == THREAD_PERPKT && trace->config.coremap[perpkt_num] != -1) {
                 CPU_SET(trace->config.coremap[perpkt_num], &cpus);
+        } else if ((type == THREAD_PERPKT || type == THREAD_HASHER) &&
+                   libtrace_numa_node_cpus(trace->numa_node, &cpus) > 0) {
+                // keep packet handling on the capture device's node
         } else {
                 for (i = 0; i < get_nb_cores(); i++)
                         CPU_SET(i, &cpus);
@@ -1916,6 +1994,9 @@ static int trace_start_thread(libtrace_t *trace, libtrace_thread_t *t,
                                          trace->config.hasher_polling
                                              ? LIBTRACE_RINGBUFFER_POLLING
                                              : LIBTRACE_RINGBUFFER_BLOCKING);
+                libtrace_numa_place((void *)t->rbuffer.elements,
+                                    sizeof(void *) * t->rbuffer.size,
+                                    trace->numa_node);
         }
 #if defined(HAVE_PTHREAD_SETNAME_NP) && defined(__linux__)
         if (name)
@@ -2640,7 +2721,7 @@ DLLEXPORT int trace_set_hasher(libtrace_t *trace, enum hasher_types type,
                         }
                         return -1;
                 }
-        } else {
+        } else if (trace->hasher_owner != HASH_OWNED_FORMAT) {
                 /* If the hasher is hardware we zero out the hasher and hasher
                  * data fields - only if we need a hasher do we do this */
                 trace->hasher = NULL;
@@ -3030,6 +3111,31 @@ static bool config_bool_parse(char *value)
                 return strtoll(value, NULL, 10) != 0;
 }
 
+/* Parses a size such as 2M or 1G, with "true" picking 2MB huge pages */
+static size_t config_hugepage_parse(char *value)
+{
+        char *end;
+        size_t size;
+
+        if (strcmp(value, "true") == 0)
+                return 2 * 1024 * 1024;
+        size = strtoull(value, &end, 10);
+        switch (*end) {
+        case 'G':
+        case 'g':
+                size *= 1024;
+                /* Fall through */
+        case 'M':
+        case 'm':
+                size *= 1024;
+                /* Fall through */
+        case 'K':
+        case 'k':
+                size *= 1024;
+        }
+        return size;
+}
+
 static int config_coremap_parse(const char *value,
                                 struct user_configuration *uc)
 {
@@ -3071,6 +3177,24 @@ DLLEXPORT int trace_set_coremap(libtrace_t *trace, const char *value)
         return config_coremap_parse(value, &trace->config);
 }
 
+DLLEXPORT int trace_set_hugepage_size(libtrace_t *trace, size_t size)
+{
+        if (!trace_is_configurable(trace))
+                return -1;
+
+        trace->config.hugepage_size = size;
+        return 0;
+}
+
+DLLEXPORT int trace_set_numa_pinning(libtrace_t *trace, bool pin)
+{
+        if (!trace_is_configurable(trace))
+                return -1;
+
+        trace->config.numa_pinning = pin;
+        return 0;
+}
+
 /* Note update documentation on trace_set_configuration */
 static int config_string(struct user_configuration *uc, char *key, char *value)
 {
@@ -3121,6 +3245,12 @@ static int config_string(struct user_configuration *uc, char *key, char *value)
                 uc->debug_state = config_bool_parse(value);
         } else if (strcmp(key, "coremap") == 0) {
                 return config_coremap_parse(value, uc);
+        } else if (strcmp(key, "numa_pinning") == 0 ||
+                   strcmp(key, "np") == 0) {
+                uc->numa_pinning = config_bool_parse(value);
+        } else if (strcmp(key, "hugepage_size") == 0 ||
+                   strcmp(key, "hps") == 0) {
+                uc->hugepage_size = config_hugepage_parse(value);
         } else {
                 fprintf(stderr, "No matching option %s(=%s), ignoring\n", key,
                         value);
@@ -3335,24 +3465,23 @@ DLLEXPORT void trace_free_packet(libtrace_t *libtrace,
 
 DLLEXPORT void trace_increment_packet_refcount(libtrace_packet_t *packet)
 {
-        pthread_mutex_lock(&(packet->ref_lock));
-        if (packet->refcount < 0) {
-                packet->refcount = 1;
-        } else {
-                packet->refcount++;
-        }
-        pthread_mutex_unlock(&(packet->ref_lock));
+        int old = __atomic_load_n(&packet->refcount, __ATOMIC_RELAXED);
+
+        /* A count that has gone negative starts again from one */
+        while (!__atomic_compare_exchange_n(&packet->refcount, &old,
+                                            old < 0 ? 1 : old + 1, true,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_RELAXED))
+                ;
 }
 
 DLLEXPORT void trace_decrement_packet_refcount(libtrace_packet_t *packet)
 {
-        pthread_mutex_lock(&(packet->ref_lock));
-        packet->refcount--;
-
-        if (packet->refcount <= 0) {
+        /* Whoever takes the count to zero releases the packet, and the
+         * acquire makes the other holders' writes to it visible first */
+        if (__atomic_sub_fetch(&packet->refcount, 1, __ATOMIC_ACQ_REL) <= 0) {
                 trace_free_packet(packet->trace, packet);
         }
-        pthread_mutex_unlock(&(packet->ref_lock));
 }
 
 DLLEXPORT libtrace_info_t *trace_get_information(libtrace_t *libtrace)
@@ -33,51 +33,21 @@
 #include <arpa/inet.h>
 #include "libpacketdump.h"
 
-uint16_t bits;
-/* "the largest possible type the compiler supports" */
-bitbuffer_t buffer;
-
-static bitbuffer_t getbit(void **packet, int *packlen, uint64_t numbits)
+/* Reads a field out of the packet. The field must lie within the packet,
+ * which the caller has checked against field->end */
+static bitbuffer_t read_field(const unsigned char *packet,
+		const protocol_field_t *field)
 {
-    bitbuffer_t ret;
-    bitbuffer_t mask;
-    
-    char *pktptr = NULL;
-
-    /* While the buffer is not filled up and there is still
-     * data in the packet to read, read a byte...
-     * 
-     * The buffer gets filled from right to left
-     */
-    while(bits < numbits && *packlen > 0)
-    {
-	uint8_t byte;
-	/* read in one byte from the packet */
-	byte=(*((bitbuffer_t*)*packet))&0xff;
-	buffer |= (bitbuffer_t)byte << (sizeof(bitbuffer_t)*8-(bits+sizeof(byte)*8));
-	/* update the position within the packet */
-	pktptr = (char *)*packet;
-	pktptr += 1;
-	*packet = pktptr;
-
-	//*packet = ((char*)*packet) + 1;
-
-	bits += sizeof(byte)*8;
-	*packlen -= 1;
-    }
-
-    /* our return value is the first <numbits> of the buffer */
-    mask = ~((1ULL<<((sizeof(bitbuffer_t)*8-numbits)))-1);
-    ret = buffer & mask;
-    ret >>=(sizeof(bitbuffer_t)*8-numbits);
-    
-    /* remove the bits that are being returned from out buffer */
-    buffer <<= numbits;
+    const unsigned char *ptr = packet + field->offset;
+    bitbuffer_t value = 0;
+    int i;
 
-    /* and update our position inside this buffer */
-    bits -= numbits;
+    /* fields are read most significant bit first, as if the packet were
+     * one big-endian number */
+    for (i = 0; i < field->nbytes; i++)
+	value = (value << 8) | ptr[i];
 
-    return ret;
+    return (value >> field->shift) & field->mask;
 }
 
 int yyparse(void);
@@ -141,143 +111,185 @@ static bitbuffer_t fix_byteorder(bitbuffer_t value,
 
 
 
-void decode_protocol_file(uint16_t link_type UNUSED,const char *packet,int len,element_t *el)
+/*
+ * Works out where each field of a parsed protocol file lies in the header,
+ * so decoding a packet only needs to read each field from its place rather
+ * than feeding the packet through a bit buffer.
+ *
+ * Returns NULL if a field can't be read in one go (more than 64 bits once
+ * it is lined up on a byte boundary), which the bit buffer couldn't cope
+ * with either.
+ */
+protocol_t *compile_protocol(element_t *list)
+{
+    protocol_t *proto;
+    protocol_field_t *pf;
+    element_t *el;
+    uint32_t bit = 0;
+    int count = 0;
+
+    for (el = list; el != NULL; el = el->next) {
+	if (el->type == FIELD)
+	    count++;
+    }
+
+    proto = (protocol_t *)malloc(sizeof(protocol_t) +
+	    count * sizeof(protocol_field_t));
+    if (!proto)
+	return NULL;
+    proto->count = 0;
+    proto->next_field = -1;
+    proto->next_layer = -1;
+
+    for (el = list; el != NULL; el = el->next) {
+	if (el->type == NEXTHEADER) {
+	    int i;
+
+	    proto->next_layer = el->data->nextheader->layer;
+	    for (i = 0; i < proto->count; i++) {
+		if (proto->fields[i].field == el->data->nextheader->target)
+		    proto->next_field = i;
+	    }
+	    /* anything after the next header line is never decoded */
+	    break;
+	}
+
+	pf = &proto->fields[proto->count];
+	pf->field = el->data->field;
+	pf->offset = bit / 8;
+	pf->end = bit + pf->field->size;
+	pf->nbytes = (pf->end + 7) / 8 - pf->offset;
+	pf->shift = pf->nbytes * 8 - (bit % 8) - pf->field->size;
+	if (pf->field->size == 0 || pf->nbytes > sizeof(bitbuffer_t)) {
+	    fprintf(stderr, "XXX Field '%s' is too large to decode\n",
+		    pf->field->identifier);
+	    free(proto);
+	    return NULL;
+	}
+	pf->mask = pf->field->size == sizeof(bitbuffer_t) * 8 ?
+		~(bitbuffer_t)0 : ((bitbuffer_t)1 << pf->field->size) - 1;
+	bit = pf->end;
+	proto->count++;
+    }
+
+    /* the next header starts at the first byte not used by any field */
+    proto->next_offset = (bit + 7) / 8;
+    return proto;
+}
+
+void decode_protocol_file(uint16_t link_type UNUSED,const char *packet,int len,protocol_t *proto)
 {
+    const protocol_field_t *pf;
     bitbuffer_t result;
+    bitbuffer_t next_value = 0;
+    int i;
 
-    while(el != NULL)
+    for (i = 0; i < proto->count; i++)
     {
-	switch(el->type)
+	pf = &proto->fields[i];
+	if ((uint64_t)len * 8 < pf->end) {
+		trace_dump_printf(" [Truncated]\n");
+		return;
+	}
+	result = read_field((const unsigned char *)packet, pf);
+
+	switch(pf->field->display)
 	{
-	    case FIELD:
-	    	if (len*8+bits<el->data->field->size) {
-			printf(" [Truncated]\n");
-			return;
-		}
-		result = getbit((void*)&packet, &len, el->data->field->size); 
-
-		switch(el->data->field->display)
-		{
-		    /* integers get byteswapped if needed and displayed */
-		    case DISPLAY_INT: 
-		    {
-			result = fix_byteorder(result, 
-				el->data->field->order, 
-				el->data->field->size);
-				
-			el->data->field->value = result;
-			printf(" %s %" PRIi64 "\n", 
-				el->data->field->identifier,
-				result);
-		    }
-		    break;
-
-		    /* 
-		     * hex numbers get byteswapped if needed and displayed 
-		     * without being padded with zeroes
-		     */
-		    case DISPLAY_HEX: 
-		    { 
-			result = fix_byteorder(result, 
-				el->data->field->order, 
-				el->data->field->size);
+	    /* integers get byteswapped if needed and displayed */
+	    case DISPLAY_INT: 
+	    {
+		result = fix_byteorder(result, 
+			pf->field->order, 
+			pf->field->size);
 			
-			el->data->field->value = result;
-			printf(" %s 0x%" PRIx64 "\n", 
-				el->data->field->identifier,
-				result);
-		    }
-		    break;
-		    
-		    /* 
-		     * ipv4 addresses stay in network byte order and are
-		     * given to inet_ntoa() to deal with
-		     */
-		    case DISPLAY_IPV4: 
-		    {
-			/* assumes all ipv4 addresses are 32bit fields */
-			struct in_addr address;
-			address.s_addr = (uint32_t)result;
-			el->data->field->value = result;
-		    
-			printf(" %s %s\n", 
-				el->data->field->identifier,
-				inet_ntoa(address));
-		    }
-		    break;
-
-		    /* 
-		     * mac addresses stay in network byte order and are
-		     * displayed byte by byte with zero padding
-		     */
-		    case DISPLAY_MAC: 
-		    {
-			/* assumes all mac addresses are 48bit fields */
-			uint8_t *ptr = (uint8_t*)&result;
-			el->data->field->value = result;
-			printf(" %s %02x:%02x:%02x:%02x:%02x:%02x\n",
-				el->data->field->identifier,
-				ptr[0], ptr[1], ptr[2], 
-				ptr[3], ptr[4], ptr[5]);
-		    }
-		    break;
-		    
-		    /*
-		     * Flag values are only displayed if their value is true
-		     * otherwise they are ignored
-		     */
-		    case DISPLAY_FLAG: 
-		    {
-			el->data->field->value = result;
-			if(result)
-			    printf(" %s\n", el->data->field->identifier);
-		    }
-		    break;
-
-		    /*
-		     * Hidden values are not displayed at all. This is useful
-		     * for reserved fields or information that you don't care
-		     * about but need to read in order to get to the rest of
-		     * the header
-		     */
-		    case DISPLAY_NONE: 
-		    {
-			result = fix_byteorder(result, 
-				el->data->field->order, 
-				el->data->field->size);
-			el->data->field->value = result;
-		    }
-		    break;
-		};
-
-		break;
-
-	    case NEXTHEADER:
-		/* 
-		 * Before we move on to the next header, make sure our packet
-		 * pointer is pointing to the first unused bytes. This may
-		 * mean we have to backtrack to some that were put into the
-		 * buffer but weren't used.
-		 * - This wouldn't be a problem if all future output came
-		 * from this buffer, but there is a good chance we will use
-		 * some code from a shared library to output packet info
-		 * instead, and this doesn't have access to the buffer.
-		 */
-		packet = packet - (bits / 8);
-		len = len + (bits / 8);
-		bits = 0;
-		buffer = 0;
-
-		decode_next(packet, len, el->data->nextheader->prefix, 
-			ntohs(el->data->nextheader->target->value));
-		break;
+		trace_dump_printf(" %s %" PRIi64 "\n", 
+			pf->field->identifier,
+			result);
+	    }
+	    break;
+
+	    /* 
+	     * hex numbers get byteswapped if needed and displayed 
+	     * without being padded with zeroes
+	     */
+	    case DISPLAY_HEX: 
+	    { 
+		result = fix_byteorder(result, 
+			pf->field->order, 
+			pf->field->size);
+		
+		trace_dump_printf(" %s 0x%" PRIx64 "\n", 
+			pf->field->identifier,
+			result);
+	    }
+	    break;
+	    
+	    /* 
+	     * ipv4 addresses stay in network byte order and are
+	     * given to inet_ntoa() to deal with
+	     */
+	    case DISPLAY_IPV4: 
+	    {
+		/* assumes all ipv4 addresses are 32bit fields */
+		struct in_addr address;
+		address.s_addr = (uint32_t)result;
+	    
+		trace_dump_printf(" %s %s\n", 
+			pf->field->identifier,
+			inet_ntoa(address));
+	    }
+	    break;
+
+	    /* 
+	     * mac addresses stay in network byte order and are
+	     * displayed byte by byte with zero padding
+	     */
+	    case DISPLAY_MAC: 
+	    {
+		/* assumes all mac addresses are 48bit fields */
+		uint8_t *ptr = (uint8_t*)&result;
+		trace_dump_printf(" %s %02x:%02x:%02x:%02x:%02x:%02x\n",
+			pf->field->identifier,
+			ptr[0], ptr[1], ptr[2], 
+			ptr[3], ptr[4], ptr[5]);
+	    }
+	    break;
+	    
+	    /*
+	     * Flag values are only displayed if their value is true
+	     * otherwise they are ignored
+	     */
+	    case DISPLAY_FLAG: 
+	    {
+		if(result)
+		    trace_dump_printf(" %s\n", pf->field->identifier);
+	    }
+	    break;
+
+	    /*
+	     * Hidden values are not displayed at all. This is useful
+	     * for reserved fields or information that you don't care
+	     * about but need to read in order to get to the rest of
+	     * the header
+	     */
+	    case DISPLAY_NONE: 
+	    {
+		result = fix_byteorder(result, 
+			pf->field->order, 
+			pf->field->size);
+	    }
+	    break;
 	};
-	
-	el = el->next;
+
+	if (i == proto->next_field)
+	    next_value = result;
     }
-    buffer = 0;
-    bits = 0;
 
+    if (proto->next_layer >= 0) {
+	decode_next_layer(packet + proto->next_offset,
+		len - proto->next_offset, proto->next_layer,
+		ntohs(next_value));
+    }
 }
 
 
@@ -363,10 +375,14 @@ void print_list(element_t *list)
 int main(void)
 {
 	unsigned char mybuffer[] = { 0x01, 0x82, 0x03, 0x04, 0x05, 0x06 };
-	void *buf = mybuffer;
-	int len=sizeof(buffer);
-	printf("8bits=%"PRIx64"\n",getbit(&buf,&len,8));
-	printf("2bits=%"PRIx64"\n",getbit(&buf,&len,2));
+	field_t f8 = { BIGENDIAN, 8, DISPLAY_HEX, "8bits" };
+	field_t f2 = { BIGENDIAN, 2, DISPLAY_HEX, "2bits" };
+	node_t n8 = { &f8 }, n2 = { &f2 };
+	element_t e2 = { FIELD, NULL, &n2 };
+	element_t e8 = { FIELD, &e2, &n8 };
+	protocol_t *proto = compile_protocol(&e8);
+	printf("8bits=%"PRIx64"\n",read_field(mybuffer,&proto->fields[0]));
+	printf("2bits=%"PRIx64"\n",read_field(mybuffer,&proto->fields[1]));
 	return 0;
 }
 #endif
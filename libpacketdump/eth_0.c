@@ -39,33 +39,33 @@
 DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 {
 	unsigned int i=0;
-	printf(" Ubiquity:");
+	trace_dump_printf(" Ubiquity:");
 	for(i=0;i<132; /* Nothing */ ) {
 		unsigned int j;
-		printf("\n ");
+		trace_dump_printf("\n ");
 		for(j=0;j<WIDTH;j++) {
 			if (i+j<len)
-				printf(" %02x",(unsigned char)packet[i+j]);
+				trace_dump_printf(" %02x",(unsigned char)packet[i+j]);
 			else
-				printf("   ");
+				trace_dump_printf("   ");
 		}
-		printf("    ");
+		trace_dump_printf("    ");
 		for(j=0;j<WIDTH;j++) {
 			if (i+j<len)
 				if (isprint((unsigned char)packet[i+j]))
-					printf("%c",(unsigned char)packet[i+j]);
+					trace_dump_printf("%c",(unsigned char)packet[i+j]);
 				else
-					printf(".");
+					trace_dump_printf(".");
 			else
-				printf("   ");
+				trace_dump_printf("   ");
 		}
 		if (i+WIDTH>len)
 			break;
 		else
 			i+=WIDTH;
 	}
-	printf("\n");
+	trace_dump_printf("\n");
 	if (len>132)
-		decode_next(packet+132,len-132,"link",4);
+		decode_next_layer(packet+132,len-132,DECODE_LAYER_LINK,4);
 	return;
 }
@@ -45,7 +45,7 @@
  * attempt to decode.
  */
 static char *format_hrd(const struct arphdr *arp, const char *hrd) {
-	static char buffer[1024] = {0,};
+	static __thread char buffer[1024] = {0,};
 	int i, ret;
         size_t bufused;
 
@@ -85,7 +85,7 @@ static char *format_hrd(const struct arphdr *arp, const char *hrd) {
  * attempt to decode.
  */
 static char *format_pro(const struct arphdr *arp, const char *pro) {
-	static char buffer[1024] = {0,};
+	static __thread char buffer[1024] = {0,};
 	int i, ret;
         size_t bufused;
 	
@@ -134,7 +134,7 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 	const char *dest_pro = NULL;
 
 	if (len < sizeof(struct arphdr)) {
-		printf(" ARP: (Truncated)\n");
+		trace_dump_printf(" ARP: (Truncated)\n");
 		return;
 	}
 
@@ -149,16 +149,16 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 
 	switch(ntohs(arp->ar_op)) {
 		case ARPOP_REQUEST:
-			printf(" ARP: who-has %s", format_pro(arp, dest_pro));
-			printf(" tell %s (%s)\n", format_pro(arp, source_pro),
+			trace_dump_printf(" ARP: who-has %s", format_pro(arp, dest_pro));
+			trace_dump_printf(" tell %s (%s)\n", format_pro(arp, source_pro),
 					format_hrd(arp, source_hrd));
 			break;
 		case ARPOP_REPLY:
-			printf(" ARP: reply %s", format_pro(arp, source_pro));
-			printf(" is-at %s\n", format_hrd(arp, source_hrd));
+			trace_dump_printf(" ARP: reply %s", format_pro(arp, source_pro));
+			trace_dump_printf(" is-at %s\n", format_hrd(arp, source_hrd));
 			break;
 		default:
-			printf(" ARP: Unknown opcode (%i) from %s to %s\n",
+			trace_dump_printf(" ARP: Unknown opcode (%i) from %s to %s\n",
 					ntohs(arp->ar_op),
 					format_pro(arp, source_pro),
 					format_pro(arp, dest_pro));
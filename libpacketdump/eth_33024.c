@@ -52,13 +52,13 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
         int value;
         uint16_t ethertype;
 
-        LE(value, 3);   printf(" VLAN: User Priority: %d\n", value);
-        LE(value, 1);   printf(" VLAN: Format Indicator: %d\n", value);
-        LE(value, 12);  printf(" VLAN: ID: %d\n", value);
-        LE(value, 16);  printf(" VLAN: EtherType: 0x%04x\n", (uint16_t)value);
+        LE(value, 3);   trace_dump_printf(" VLAN: User Priority: %d\n", value);
+        LE(value, 1);   trace_dump_printf(" VLAN: Format Indicator: %d\n", value);
+        LE(value, 12);  trace_dump_printf(" VLAN: ID: %d\n", value);
+        LE(value, 16);  trace_dump_printf(" VLAN: EtherType: 0x%04x\n", (uint16_t)value);
         ethertype = (uint16_t) value;
 
-        decode_next(packet + 4, len - 4, "eth", ethertype);
+        decode_next_layer(packet + 4, len - 4, DECODE_LAYER_ETH, ethertype);
 
         return;
 }
@@ -48,26 +48,26 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
                         break;
                 }
 
-        	printf(" IPv6: Version %u\n", (tmp >> 28) & 0x000000f);
-        	printf(" IPv6: Class %u\n", (tmp >> 20) & 0x000000ff);
-	        printf(" IPv6: Flow Label %u\n", tmp & 0x000fffff);
+        	trace_dump_printf(" IPv6: Version %u\n", (tmp >> 28) & 0x000000f);
+        	trace_dump_printf(" IPv6: Class %u\n", (tmp >> 20) & 0x000000ff);
+	        trace_dump_printf(" IPv6: Flow Label %u\n", tmp & 0x000fffff);
 
                 if (len < 6) {
                         truncated = 1;
                         break;
                 }
-        	printf(" IPv6: Payload Length %u\n", ntohs(ip->plen));
+        	trace_dump_printf(" IPv6: Payload Length %u\n", ntohs(ip->plen));
 
                 if (len < 7) {
                         truncated = 1;
                         break;
                 }
-        	printf(" IPv6: Next Header %u\n", ip->nxt);
+        	trace_dump_printf(" IPv6: Next Header %u\n", ip->nxt);
                 if (len < 8) {
                         truncated = 1;
                         break;
                 }
-	        printf(" IPv6: Hop Limit %u\n", ip->hlim);
+	        trace_dump_printf(" IPv6: Hop Limit %u\n", ip->hlim);
 
                 if (len < 24) {
                         truncated = 1;
@@ -75,7 +75,7 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
                 }
 
 	        inet_ntop(AF_INET6, &(ip->ip_src), ipstr, INET6_ADDRSTRLEN);
-        	printf(" IPv6: Source IP %s\n", ipstr);
+        	trace_dump_printf(" IPv6: Source IP %s\n", ipstr);
 
                 if (len < 40) {
                         truncated = 1;
@@ -83,14 +83,14 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
                 }
 
                 inet_ntop(AF_INET6, &(ip->ip_dst), ipstr, INET6_ADDRSTRLEN);
-        	printf(" IPv6: Destination IP %s\n", ipstr);
+        	trace_dump_printf(" IPv6: Destination IP %s\n", ipstr);
         } while (0);
 
         if (truncated) {
-                printf(" IPv6: [Truncated]\n");
+                trace_dump_printf(" IPv6: [Truncated]\n");
                 return;
         }
 
-	decode_next(packet+sizeof(libtrace_ip6_t),len-sizeof(libtrace_ip6_t),"ip",ip->nxt);
+	decode_next_layer(packet+sizeof(libtrace_ip6_t),len-sizeof(libtrace_ip6_t),DECODE_LAYER_IP,ip->nxt);
 	return;
 }
@@ -51,23 +51,23 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 	unsigned int offset=0;
 	int value;
 	int more = 0;
-	LE(value,20); 	printf(" MPLS: Label: %d\n",value);
-	LE(value,3); 	printf(" MPLS: Class of service: %d\n",value);
-	LE(value,1);	printf(" MPLS: Stack: %s\n",value?"Last" :"More");
+	LE(value,20); 	trace_dump_printf(" MPLS: Label: %d\n",value);
+	LE(value,3); 	trace_dump_printf(" MPLS: Class of service: %d\n",value);
+	LE(value,1);	trace_dump_printf(" MPLS: Stack: %s\n",value?"Last" :"More");
 	if (value == 0) more = 1;
-	LE(value,8);	printf(" MPLS: TTL: %d\n",value);
+	LE(value,8);	trace_dump_printf(" MPLS: TTL: %d\n",value);
 	
 	/* MPLS doesn't say what it's encapsulating, so we make an educated
 	 * guess and pray.
 	 */
 	if (more)
-		decode_next(packet+offset/8,len-4,"eth",0x8847);
+		decode_next_layer(packet+offset/8,len-4,DECODE_LAYER_ETH,0x8847);
 	else if ((*(packet+4)&0xF0) == 0x40)
-		decode_next(packet+offset/8,len-4,"eth",0x0800);
+		decode_next_layer(packet+offset/8,len-4,DECODE_LAYER_ETH,0x0800);
 	else if ((*(packet+4)&0xF0) == 0x60)
-		decode_next(packet+offset/8,len-4,"eth",0x86DD);
+		decode_next_layer(packet+offset/8,len-4,DECODE_LAYER_ETH,0x86DD);
 	else
-		decode_next(packet+offset/8,len-4,"link",2);
+		decode_next_layer(packet+offset/8,len-4,DECODE_LAYER_LINK,2);
 
 	return;
 }
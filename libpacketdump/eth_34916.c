@@ -44,18 +44,18 @@ DLLEXPORT void decode(int link_type UNUSED,const char *pkt,unsigned len)
 	pppoe_t *pppoe = (pppoe_t *) pkt;
 	
 	if (len < sizeof(*pppoe)) {
-		printf(" PPPoE: Truncated (len = %u)\n", len);
+		trace_dump_printf(" PPPoE: Truncated (len = %u)\n", len);
 		return;
 	}
 
-	printf(" PPPoE: Version: %d\n",pppoe->ver);
-	printf(" PPPoE: Type: %d\n",pppoe->type);
-	printf(" PPPoE: Code: %d\n",pppoe->code);
-	printf(" PPPoE: Session: %d\n",ntohs(pppoe->session));
-	printf(" PPPoE: Length: %d\n",ntohs(pppoe->length));
+	trace_dump_printf(" PPPoE: Version: %d\n",pppoe->ver);
+	trace_dump_printf(" PPPoE: Type: %d\n",pppoe->type);
+	trace_dump_printf(" PPPoE: Code: %d\n",pppoe->code);
+	trace_dump_printf(" PPPoE: Session: %d\n",ntohs(pppoe->session));
+	trace_dump_printf(" PPPoE: Length: %d\n",ntohs(pppoe->length));
 
 	/* Meh.. pass it off to eth decoder */
-	decode_next(pkt + sizeof(*pppoe), len - sizeof(*pppoe), "link", 5);
+	decode_next_layer(pkt + sizeof(*pppoe), len - sizeof(*pppoe), DECODE_LAYER_LINK, 5);
 
 }
 
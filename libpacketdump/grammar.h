@@ -28,6 +28,8 @@
 
 #include <inttypes.h>
 
+typedef uint64_t bitbuffer_t;
+
 enum node_type_t {
     NEXTHEADER,
     FIELD
@@ -51,6 +53,7 @@ enum display_t {
 
 typedef struct next {
     char *prefix;		    /* search prefix for nextheader file */
+    int layer;			    /* decoder layer number for prefix */
     char *fieldname;		    /* name of the field whose value we use */
     struct field *target;	    /* link to the field whose value we use */
 } next_t;
@@ -60,7 +63,6 @@ typedef struct field {
     uint16_t size;		    /* size of the field in bits */
     enum display_t display;	    /* how the data should be displayed */
     char *identifier;		    /* display prefix + field identifier */
-    uint64_t value;		    /* calculated value for this field */
 } field_t; 
 
 typedef union node {
@@ -74,8 +76,26 @@ typedef struct element {
     node_t *data;
 } element_t;
     
-element_t *parse_protocol_file(char *filename);
-void decode_protocol_file(uint16_t link_type,const char *packet,int len, element_t* el);
+/* A field compiled down to where it sits in the header */
+typedef struct protocol_field {
+    uint32_t offset;		    /* first byte holding the field */
+    uint32_t end;		    /* bit just past the end of the field */
+    uint8_t nbytes;		    /* number of bytes holding the field */
+    uint8_t shift;		    /* bits after the field in its last byte */
+    bitbuffer_t mask;		    /* mask of the field once shifted down */
+    field_t *field;
+} protocol_field_t;
 
-typedef uint64_t bitbuffer_t;
+/* A protocol file compiled into the fields to decode, in order */
+typedef struct protocol {
+    int count;			    /* number of fields */
+    int next_field;		    /* field giving the next header, or -1 */
+    int next_layer;		    /* layer of the next header, or -1 */
+    uint32_t next_offset;	    /* byte the next header starts at */
+    protocol_field_t fields[];
+} protocol_t;
+    
+element_t *parse_protocol_file(char *filename);
+protocol_t *compile_protocol(element_t *list);
+void decode_protocol_file(uint16_t link_type,const char *packet,int len, protocol_t *proto);
 #endif
@@ -37,19 +37,19 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len) {
          * print it, but it's probably not that big of a deal?
          */
         if (len < sizeof(libtrace_ip6_ext_t)) {
-                printf(" IPv6 Hop-by-Hop: [truncated]\n");
+                trace_dump_printf(" IPv6 Hop-by-Hop: [truncated]\n");
                 return;
         }
 
         hbh_len = (hdr->len + 1) * 8;
 
-        printf(" IPv6 Hop-by-Hop: Next Header %u Header Ext Len %u", hdr->nxt,
+        trace_dump_printf(" IPv6 Hop-by-Hop: Next Header %u Header Ext Len %u", hdr->nxt,
                hdr->len);
 
         /* TODO: decode actual header contents one day? */
-        printf("\n");
+        trace_dump_printf("\n");
 
         if (hbh_len < len) {
-                decode_next(packet + hbh_len, len - hbh_len, "ip", hdr->nxt);
+                decode_next_layer(packet + hbh_len, len - hbh_len, DECODE_LAYER_IP, hdr->nxt);
         }
 }
@@ -53,53 +53,53 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
         int ippresent = 0;
 	if (len<1)
 		return;
-	printf(" ICMP:");
+	trace_dump_printf(" ICMP:");
 	switch(icmp->type) {
 		case 0:
-			printf(" Type: 0 (ICMP Echo Reply) Sequence: ");
+			trace_dump_printf(" Type: 0 (ICMP Echo Reply) Sequence: ");
 			if (len < 4)
-				printf("(Truncated)\n");
+				trace_dump_printf("(Truncated)\n");
 			else
-				printf("%u\n", ntohs(icmp->un.echo.sequence));
+				trace_dump_printf("%u\n", ntohs(icmp->un.echo.sequence));
 			break;
 		case 3:
-			printf(" Type: 3 (ICMP Destination Unreachable)\n");
+			trace_dump_printf(" Type: 3 (ICMP Destination Unreachable)\n");
 			if (len<2)
 				return;
 			if (icmp->code<sizeof(unreach_types)) {
-				printf(" ICMP: Code: %i (%s)\n",icmp->code,
+				trace_dump_printf(" ICMP: Code: %i (%s)\n",icmp->code,
 						unreach_types[icmp->code]);
 			}
 			else {
-				printf(" ICMP: Code: %i (Unknown)\n",icmp->code);
+				trace_dump_printf(" ICMP: Code: %i (Unknown)\n",icmp->code);
 			}
                         ippresent = 1;
 			break;
 		case 8:
-			printf(" Type: 8 (ICMP Echo Request) Sequence: ");
+			trace_dump_printf(" Type: 8 (ICMP Echo Request) Sequence: ");
 			if (len < 4)
-				printf("(Truncated)\n");
+				trace_dump_printf("(Truncated)\n");
 			else
-				printf("%u\n", ntohs(icmp->un.echo.sequence));
+				trace_dump_printf("%u\n", ntohs(icmp->un.echo.sequence));
 			break;
 		case 11:
-			printf(" Type: 11 (ICMP TTL Exceeded)\n");
+			trace_dump_printf(" Type: 11 (ICMP TTL Exceeded)\n");
                         ippresent = 1;
 			break;
 		default:
-			printf(" Type: %i (Unknown)\n",icmp->type);
+			trace_dump_printf(" Type: %i (Unknown)\n",icmp->type);
 			break;
 
 	}
-	printf(" ICMP: Checksum: ");
+	trace_dump_printf(" ICMP: Checksum: ");
 	if (len < 8)
-		printf("(Truncated)\n");
+		trace_dump_printf("(Truncated)\n");
 	else
-		printf("%u\n", ntohs(icmp->checksum));
+		trace_dump_printf("%u\n", ntohs(icmp->checksum));
 
         if (ippresent) {
-                decode_next(packet+8,len-8,
-                                "eth",0x0800);
+                decode_next_layer(packet+8,len-8,
+                                DECODE_LAYER_ETH,0x0800);
         }
 
 
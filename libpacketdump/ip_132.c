@@ -122,31 +122,31 @@ static void parse_options(char *offset, int vlen)
             case 5:
             {
                 struct in_addr *ia = (struct in_addr *)data;
-                printf(" SCTP: Option IP address %s\n", inet_ntoa(*ia));
+                trace_dump_printf(" SCTP: Option IP address %s\n", inet_ntoa(*ia));
             }
             break;
             case 6:
             {
-                printf(" SCTP: Option IPv6 address (TODO)\n");
+                trace_dump_printf(" SCTP: Option IPv6 address (TODO)\n");
             }
             break;
             case 7:
             {
-                printf(" SCTP: Option State cookie\n");
+                trace_dump_printf(" SCTP: Option State cookie\n");
                 /* // Prolly don't want to print this out :)
                 for(int i = 0; i < ntohs(ph->length) - 8; i++)
-                    printf("%02x", data[i]);
-                printf("'\n");*/
+                    trace_dump_printf("%02x", data[i]);
+                trace_dump_printf("'\n");*/
             }
             break;
             case 9:
             {
-                printf(" SCTP: Option Cookie preservative (TODO)\n");
+                trace_dump_printf(" SCTP: Option Cookie preservative (TODO)\n");
             }
             break;
             case 11:
             {
-                printf(" SCTP: Option Host name %s\n", data);
+                trace_dump_printf(" SCTP: Option Host name %s\n", data);
             }
             break;
             case 12:
@@ -155,23 +155,23 @@ static void parse_options(char *offset, int vlen)
                 int len = ntohs(ph->length) - 
                     sizeof(struct sctp_var_param_hdr);
 
-                printf(" SCTP: Option Supported address types ");
+                trace_dump_printf(" SCTP: Option Supported address types ");
 
                 while(len) {
-                    printf("%hu ", ntohs(*p));
+                    trace_dump_printf("%hu ", ntohs(*p));
                     p++;
                     len -= sizeof(*p);
                 }
-                printf("\n");
+                trace_dump_printf("\n");
             }
             break;
             default:
-                printf(" SCTP: Option Unknown type=%hu len=%hu\n", 
+                trace_dump_printf(" SCTP: Option Unknown type=%hu len=%hu\n", 
                         ntohs(ph->type), ntohs(ph->length));
         }
 
         if (ntohs(ph->length) == 0) {
-                printf("Invalid length in SCTP option -- halting decode\n");
+                trace_dump_printf("Invalid length in SCTP option -- halting decode\n");
                 return;
         }
 
@@ -189,13 +189,13 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
     uint16_t chunklen = 0;
 
     if(len < (signed)sizeof(struct sctp_common_hdr)) {
-        printf(" SCTP: packet too short!\n");
+        trace_dump_printf(" SCTP: packet too short!\n");
         return;
     }
 
     hdr = (struct sctp_common_hdr *)packet;
 
-    printf(" SCTP: Header Src port %hu Dst port %hu Tag %u Csum %u\n",
+    trace_dump_printf(" SCTP: Header Src port %hu Dst port %hu Tag %u Csum %u\n",
             ntohs(hdr->src_port), ntohs(hdr->dst_port),
             ntohl(hdr->verification_tag), ntohl(hdr->checksum));
 
@@ -204,7 +204,7 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 
     while(len > 0) {
         if (len < sizeof(struct sctp_chunk_hdr)) {
-                printf(" SCTP: [Truncated]\n\n");
+                trace_dump_printf(" SCTP: [Truncated]\n\n");
                 break;
         }
 
@@ -212,12 +212,12 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 
         chunklen = ntohs(chunk->length);
 
-        printf(" SCTP: Chunk %d Type %s Flags %u Len %u\n",
+        trace_dump_printf(" SCTP: Chunk %d Type %s Flags %u Len %u\n",
             chunk_num++,
             sctp_type_to_str(chunk->type), chunk->flags, chunklen);
 
         if(chunklen == 0) {
-            printf(" SCTP: Invalid chunk length, aborting.\n\n");
+            trace_dump_printf(" SCTP: Invalid chunk length, aborting.\n\n");
             break;
         }
 
@@ -239,7 +239,7 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
             {
                 struct sctp_data *data = (struct sctp_data *)(chunk + 1);
 
-                printf(" SCTP: TSN %u Stream ID %hu Stream Seqno %hu "
+                trace_dump_printf(" SCTP: TSN %u Stream ID %hu Stream Seqno %hu "
                         "Payload ID %u\n",
                         ntohl(data->tsn), ntohs(data->stream_id),
                         ntohs(data->stream_seqno),
@@ -253,7 +253,7 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
                 struct sctp_init_ack *ack = (struct sctp_init_ack *)
                     (chunk + 1);
 
-                printf(" SCTP: Tag %u Credit %u Outbound %hu Inbound %hu "
+                trace_dump_printf(" SCTP: Tag %u Credit %u Outbound %hu Inbound %hu "
                         "TSN %u\n",
                         ntohl(ack->init_tag),
                         ntohl(ack->rcv_wnd_credit),
@@ -274,21 +274,21 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
                 struct sctp_sack *sack = (struct sctp_sack *)(chunk + 1);
                 int i;
 
-                printf(" SCTP: Ack %u Wnd %u\n", ntohl(sack->tsn_ack),
+                trace_dump_printf(" SCTP: Ack %u Wnd %u\n", ntohl(sack->tsn_ack),
                         ntohl(sack->a_wnd));
 
                 for(i = 0; i < ntohs(sack->num_gap_blocks); i++) {
                     uint16_t *p = (uint16_t *)(sack + 1);
                     p += i * 2;
 
-                    printf(" SCTP: Gap ACK Start %hu End %hu\n",
+                    trace_dump_printf(" SCTP: Gap ACK Start %hu End %hu\n",
                             ntohs(*p), ntohs(*(p + 1)));
                 }
                 for(i = 0; i < ntohs(sack->num_dup_tsns); i++) {
                     uint32_t *p = (uint32_t *)(sack + 1);
                     p += ntohs(sack->num_gap_blocks) + i;
 
-                    printf(" SCTP: Duplicatate TSN %u\n", ntohl(*p));
+                    trace_dump_printf(" SCTP: Duplicatate TSN %u\n", ntohl(*p));
                 }
             }
             break;
@@ -297,5 +297,5 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
         packet += chunklen;
         len -= chunklen;
     }
-    printf("\n");
+    trace_dump_printf("\n");
 }
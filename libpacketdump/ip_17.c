@@ -36,38 +36,40 @@
 DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 {
 	struct libtrace_udp *udp = (struct libtrace_udp*)packet;
-	printf(" UDP:");
+	trace_dump_printf(" UDP:");
 	if (SAFE(udp, source)) {
-		struct servent *ent=getservbyport(udp->source,"udp");
-		if(ent) {
-			printf(" Source %i (%s)",htons(udp->source),ent->s_name);
+		char name[64];
+		if (trace_dump_service_name(udp->source,"udp",name,
+					sizeof(name))) {
+			trace_dump_printf(" Source %i (%s)",htons(udp->source),name);
 		} else {
-			printf(" Source %i",htons(udp->source));
+			trace_dump_printf(" Source %i",htons(udp->source));
 		}
 	}
 	else {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
 	if (SAFE(udp, dest)) {
-		struct servent *ent=getservbyport(udp->dest,"udp");
-		if(ent) {
-			printf(" Dest %i (%s)",htons(udp->dest),ent->s_name);
+		char name[64];
+		if (trace_dump_service_name(udp->dest,"udp",name,
+					sizeof(name))) {
+			trace_dump_printf(" Dest %i (%s)",htons(udp->dest),name);
 		} else {
-			printf(" Dest %i",htons(udp->dest));
+			trace_dump_printf(" Dest %i",htons(udp->dest));
 		}
 	}
 	else {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
-	printf("\n UDP:");
+	trace_dump_printf("\n UDP:");
 	DISPLAYS(udp, len," Len %u");
 	DISPLAYS(udp, check," Checksum %u");
-	printf("\n");
+	trace_dump_printf("\n");
 	if (htons(udp->source) < htons(udp->dest)) 
-		decode_next(packet+sizeof(*udp),len-sizeof(*udp),"udp",htons(udp->source));
+		decode_next_layer(packet+sizeof(*udp),len-sizeof(*udp),DECODE_LAYER_UDP,htons(udp->source));
 	else
-		decode_next(packet+sizeof(*udp),len-sizeof(*udp),"udp",htons(udp->dest));
+		decode_next_layer(packet+sizeof(*udp),len-sizeof(*udp),DECODE_LAYER_UDP,htons(udp->dest));
 	return;
 }
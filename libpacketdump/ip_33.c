@@ -55,24 +55,24 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len)
         DISPLAYS(dccp, source, " DCCP: Source %i");
         DISPLAYS(dccp, dest, " Dest %i");
         if (len > 4) {
-                printf("\n DCCP: Type %i", dccp->type);
+                trace_dump_printf("\n DCCP: Type %i", dccp->type);
                 if (dccp->type < (sizeof(dccp_types) / sizeof(char *))) {
-                        printf(" (%s)\n", dccp_types[dccp->type]);
+                        trace_dump_printf(" (%s)\n", dccp_types[dccp->type]);
                 } else {
-                        printf(" (Unknown)\n");
+                        trace_dump_printf(" (Unknown)\n");
                 }
-                printf(" DCCP: CcVal %i\n", dccp->ccval);
+                trace_dump_printf(" DCCP: CcVal %i\n", dccp->ccval);
         } else {
-                printf("\n");
+                trace_dump_printf("\n");
                 return;
         }
         if (len > 7)
-                printf(" DCCP: Seq %u\n", dccp->seq); // htonwhat?
+                trace_dump_printf(" DCCP: Seq %u\n", dccp->seq); // htonwhat?
         else
                 return;
         DISPLAY(dccp, doff, " DCCP: Dataoff: %i\n");
         if (len > 9)
-                printf(" DCCP: NDP %i CsLen: %i\n", dccp->ndp, dccp->cslen);
+                trace_dump_printf(" DCCP: NDP %i CsLen: %i\n", dccp->ndp, dccp->cslen);
         else {
                 return;
         }
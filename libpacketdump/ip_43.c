@@ -35,13 +35,13 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len) {
 
 	hbh_len = (hdr->len + 1) * 8;
 
-	printf(" IPv6 Routing Header: Next Header %u Header Ext Len %u",
+	trace_dump_printf(" IPv6 Routing Header: Next Header %u Header Ext Len %u",
 			hdr->nxt, hdr->len);
-	printf("\n IPv6 Routing Header: Routing Type %u Segments Left %u",
+	trace_dump_printf("\n IPv6 Routing Header: Routing Type %u Segments Left %u",
 			*packet, *(packet + 1));		
-	printf("\n");
+	trace_dump_printf("\n");
 
-	decode_next(packet + hbh_len, len - hbh_len, "ip", hdr->nxt);
+	decode_next_layer(packet + hbh_len, len - hbh_len, DECODE_LAYER_IP, hdr->nxt);
 
 
 }
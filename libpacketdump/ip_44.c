@@ -36,27 +36,27 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len)
 
 	// IPv6 Fragment Header
 	if (len == 0) {
-		printf(" IPv6 Frag: [Truncated]\n");
+		trace_dump_printf(" IPv6 Frag: [Truncated]\n");
 		return;
 	}
 
 	
 
-	printf(" IPv6 Frag: Next Header: %u\n", frag->nxt);
+	trace_dump_printf(" IPv6 Frag: Next Header: %u\n", frag->nxt);
 	
 	offset = ntohs(frag->frag_off);
-	printf(" IPv6 Frag: Offset: %u", offset & 0xFFF8);
-	if ((offset & 0x1)) printf(" MORE_FRAG");
+	trace_dump_printf(" IPv6 Frag: Offset: %u", offset & 0xFFF8);
+	if ((offset & 0x1)) trace_dump_printf(" MORE_FRAG");
 	
-	printf("\n"); 
-	printf(" IPv6 Frag: Identification: %u\n", ntohl(frag->ident));
+	trace_dump_printf("\n"); 
+	trace_dump_printf(" IPv6 Frag: Identification: %u\n", ntohl(frag->ident));
 
 	/* Only dump the next header if this is the first fragment */
 	if ((offset & 0xFFF8) != 0)
 		return;
 
-	decode_next(packet + sizeof(libtrace_ip6_frag_t), 
-			len - sizeof(libtrace_ip6_frag_t), "ip", frag->nxt);
+	decode_next_layer(packet + sizeof(libtrace_ip6_frag_t), 
+			len - sizeof(libtrace_ip6_frag_t), DECODE_LAYER_IP, frag->nxt);
 	return;	
 
 }
@@ -39,22 +39,22 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 {
 	// GRE
 	if (len<2) {
-		printf(" GRE: [Truncated]\n");
+		trace_dump_printf(" GRE: [Truncated]\n");
 		return;
 	}
-	printf(" GRE: %s\n",
+	trace_dump_printf(" GRE: %s\n",
 		ntohs(((gre_t*)packet)->flags) & 0x8000 
 			? "Checksum present"
 			: "Checksum absent");
-	printf(" GRE: Version: %d\n", ntohs(((gre_t*)packet)->flags) & 0x0007);
-	printf(" GRE: Protocol: %04x\n", ntohs(((gre_t*)packet)->ethertype));
+	trace_dump_printf(" GRE: Version: %d\n", ntohs(((gre_t*)packet)->flags) & 0x0007);
+	trace_dump_printf(" GRE: Protocol: %04x\n", ntohs(((gre_t*)packet)->ethertype));
 
 	if (ntohs(((gre_t*)packet)->flags) & 0x8000) {
-		decode_next(packet+4,len-4,"link",
+		decode_next_layer(packet+4,len-4,DECODE_LAYER_LINK,
 				ntohs(((gre_t*)packet)->ethertype));
 	}
 	else {
-		decode_next(packet+8,len-8,"link",
+		decode_next_layer(packet+8,len-8,DECODE_LAYER_LINK,
 				ntohs(((gre_t*)packet)->ethertype));
 	}
 	return;
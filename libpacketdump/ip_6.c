@@ -36,99 +36,101 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 	unsigned char type,optlen,*data;
 	int plen, i;
 	libtrace_tcp_t *tcp = (libtrace_tcp_t *)packet;
-	printf(" TCP:");
+	trace_dump_printf(" TCP:");
 	if (SAFE(tcp, source)) {
-		struct servent *ent=getservbyport(tcp->source,"tcp");
-		if(ent) {
-			printf(" Source %i (%s)",htons(tcp->source),ent->s_name);
+		char name[64];
+		if (trace_dump_service_name(tcp->source,"tcp",name,
+					sizeof(name))) {
+			trace_dump_printf(" Source %i (%s)",htons(tcp->source),name);
 		} else {
-			printf(" Source %i",htons(tcp->source));
+			trace_dump_printf(" Source %i",htons(tcp->source));
 		}
 	}
 	else {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
 	if (SAFE(tcp, dest)) {
-		struct servent *ent=getservbyport(tcp->dest,"tcp");
-		if(ent) {
-			printf(" Dest %i (%s)",htons(tcp->dest),ent->s_name);
+		char name[64];
+		if (trace_dump_service_name(tcp->dest,"tcp",name,
+					sizeof(name))) {
+			trace_dump_printf(" Dest %i (%s)",htons(tcp->dest),name);
 		} else {
-			printf(" Dest %i",htons(tcp->dest));
+			trace_dump_printf(" Dest %i",htons(tcp->dest));
 		}
 	}
 	else {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
-	printf("\n TCP:");
+	trace_dump_printf("\n TCP:");
 	DISPLAYL(tcp, seq," Seq %u");
-	printf("\n TCP:");
+	trace_dump_printf("\n TCP:");
 	DISPLAYL(tcp, ack_seq," Ack %u");
 	if ((char*)&tcp->window-(char *)tcp>len) {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
-	printf("\n TCP:");
-	printf(" DOFF %i",tcp->doff);
-	printf(" Flags:");
-	if (tcp->ecn_ns) printf(" ECN_NS");
-	if (tcp->cwr) printf(" CWR");
-	if (tcp->ece) printf(" ECE");
-	if (tcp->fin) printf(" FIN");
-	if (tcp->syn) printf(" SYN");
-	if (tcp->rst) printf(" RST");
-	if (tcp->psh) printf(" PSH");
-	if (tcp->ack) printf(" ACK");
-	if (tcp->urg) printf(" URG");
+	trace_dump_printf("\n TCP:");
+	trace_dump_printf(" DOFF %i",tcp->doff);
+	trace_dump_printf(" Flags:");
+	if (tcp->ecn_ns) trace_dump_printf(" ECN_NS");
+	if (tcp->cwr) trace_dump_printf(" CWR");
+	if (tcp->ece) trace_dump_printf(" ECE");
+	if (tcp->fin) trace_dump_printf(" FIN");
+	if (tcp->syn) trace_dump_printf(" SYN");
+	if (tcp->rst) trace_dump_printf(" RST");
+	if (tcp->psh) trace_dump_printf(" PSH");
+	if (tcp->ack) trace_dump_printf(" ACK");
+	if (tcp->urg) trace_dump_printf(" URG");
 	DISPLAYS(tcp, window," Window %i");
-	printf("\n TCP:");
+	trace_dump_printf("\n TCP:");
 	DISPLAYS(tcp, check," Checksum %i");
 	DISPLAYS(tcp, urg_ptr," Urgent %i");
 	pkt = (unsigned char*)packet+sizeof(*tcp);
 	plen = (len-sizeof *tcp) < (tcp->doff*4-sizeof(*tcp))?(len-sizeof(*tcp)):(tcp->doff*4-sizeof *tcp);
 	while(trace_get_next_option(&pkt,&plen,&type,&optlen,&data)) {
-		printf("\n TCP: ");
+		trace_dump_printf("\n TCP: ");
 		switch(type) {
 			case 0:
-				printf("End of options");
+				trace_dump_printf("End of options");
 				break;
 			case 1:
-				printf("NOP");
+				trace_dump_printf("NOP");
 				break;
 			case 2:
-				printf("MSS %i",htons(*(uint32_t *)(data)));
+				trace_dump_printf("MSS %i",htons(*(uint32_t *)(data)));
 				break;
 			case 3:
-				printf("Winscale %i",data[0]);
+				trace_dump_printf("Winscale %i",data[0]);
 				break;
 			case 4:
-				printf("SACK");
+				trace_dump_printf("SACK");
 				break;
 			case 5:
-				printf("SACK Information");
+				trace_dump_printf("SACK Information");
 				i=0;
 				while(i+8<optlen) {
-					printf("\n TCP:  %u-%u",
+					trace_dump_printf("\n TCP:  %u-%u",
 						htonl(*(uint32_t*)&data[i]),
 						htonl(*(uint32_t*)&data[i+4]));
 					i+=8;
 				}
 				break;
 			case 8:
-				printf("Timestamp %u %u",
+				trace_dump_printf("Timestamp %u %u",
 						htonl(*(uint32_t *)&data[0]),
 						htonl(*(uint32_t *)&data[4])
 				      );
 				break;
 			default:
-				printf("Unknown option %i",type);
+				trace_dump_printf("Unknown option %i",type);
 		}
 	}
-	printf("\n");
+	trace_dump_printf("\n");
 	if (htons(tcp->source) < htons(tcp->dest)) 
-		decode_next(packet+tcp->doff*4,len-tcp->doff*4,"tcp",htons(tcp->source));
+		decode_next_layer(packet+tcp->doff*4,len-tcp->doff*4,DECODE_LAYER_TCP,htons(tcp->source));
 	else
-		decode_next(packet+tcp->doff*4,len-tcp->doff*4,"tcp",htons(tcp->dest));
+		decode_next_layer(packet+tcp->doff*4,len-tcp->doff*4,DECODE_LAYER_TCP,htons(tcp->dest));
 	return;
 }
@@ -35,12 +35,12 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len) {
 
 	hbh_len = (hdr->len + 1) * 8;
 
-	printf(" IPv6 Destination Options: Next Header %u Header Ext Len %u",
+	trace_dump_printf(" IPv6 Destination Options: Next Header %u Header Ext Len %u",
 			hdr->nxt, hdr->len);
 
-	printf("\n");
+	trace_dump_printf("\n");
 
-	decode_next(packet + hbh_len, len - hbh_len, "ip", hdr->nxt);
+	decode_next_layer(packet + hbh_len, len - hbh_len, DECODE_LAYER_IP, hdr->nxt);
 
 
 }
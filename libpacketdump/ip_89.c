@@ -38,22 +38,22 @@ static void dump_ospf_v2_header(libtrace_ospf_v2_t *hdr, unsigned len) {
         DISPLAY(hdr, type, " Type %u ");
 	switch(hdr->type) {
 		case TRACE_OSPF_HELLO:
-			printf("(Hello)");
+			trace_dump_printf("(Hello)");
 			break;
 		case TRACE_OSPF_DATADESC:
-			printf("(Database Desc)");
+			trace_dump_printf("(Database Desc)");
 			break;
 		case TRACE_OSPF_LSREQ:
-			printf("(Link State Request)");
+			trace_dump_printf("(Link State Request)");
 			break;
 		case TRACE_OSPF_LSUPDATE:
-			printf("(Link State Update)");
+			trace_dump_printf("(Link State Update)");
 			break;
 		case TRACE_OSPF_LSACK:
-			printf("(Link State Ack.)");
+			trace_dump_printf("(Link State Ack.)");
 			break;
 	}
-        printf("\n");
+        trace_dump_printf("\n");
 
 	DISPLAYS(hdr, ospf_len, "OSPF Header: Length %u \n");
         DISPLAYIP(hdr, router, " OSPF Header: Router Id %s ");
@@ -72,8 +72,8 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len) {
 
 	if (hdr->ospf_v == 2) {
 		dump_ospf_v2_header(hdr, len);
-		decode_next(packet + sizeof(libtrace_ospf_v2_t), 
-			len - sizeof(libtrace_ospf_v2_t), "ospf2", 
+		decode_next_layer(packet + sizeof(libtrace_ospf_v2_t), 
+			len - sizeof(libtrace_ospf_v2_t), DECODE_LAYER_OSPF2, 
 			hdr->type);
 	}
 
@@ -41,9 +41,11 @@
 #ifdef HAVE_NETINET_IF_ETHER_H
 #  include <netinet/if_ether.h>
 #endif
+#include <dirent.h>
 #include <dlfcn.h>
-#include <map>
-#include <string>
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
 #include <ctype.h>
 #include "libpacketdump.h"
 extern "C"{
@@ -51,30 +53,64 @@ extern "C"{
 }
 
 enum decode_style_t {
+    DECODE_NONE = 0,
     DECODE_NORMAL,
+    DECODE_META,
     DECODE_PARSER
 };
 
-typedef void (*decode_norm_t)(uint16_t type,const char *packet,int len);
-typedef void (*decode_norm_meta)(uint16_t type,const char *packet,int len,libtrace_packet_t *p);
-typedef void (*decode_parser_t)(uint16_t type,const char *packet,int len, element_t* el);
+typedef void (*decode_norm_meta)(int type,const char *packet,unsigned len,libtrace_packet_t *p);
+typedef void (*decode_parser_t)(uint16_t type,const char *packet,int len, protocol_t *proto);
 
-libtrace_packet_t *p;
+/* The packet being decoded and the buffer its text is going to (NULL for
+ * stdout), which decoders find through decode_next() and
+ * trace_dump_printf() rather than having them passed along */
+static __thread libtrace_packet_t *current_packet = NULL;
+static __thread libtrace_dump_buffer_t *current_buffer = NULL;
+static __thread bool buffer_failed = false;
 
 typedef union decode_funcs {
-    decode_norm_t decode_n;
+    libpacketdump_decode_t decode_n;
     decode_norm_meta decode_meta;
     decode_parser_t decode_p;
 } decode_funcs_t;
 
 typedef struct decoder {
     enum decode_style_t style;
-    decode_funcs_t *func;
-    element_t *el; // make a union of structs with all args in it for all funcs?
+    decode_funcs_t func;
+    protocol_t *proto; // make a union of structs with all args in it for all funcs?
 } decode_t;
 
+/* Each layer has a table of decoders indexed by type, split into pages so
+ * that the few ethertypes and ports with decoders don't need a table with
+ * an entry for every possible value */
+#define DECODER_PAGE_BITS 8
+#define DECODER_PAGE_SIZE (1 << DECODER_PAGE_BITS)
+#define DECODER_PAGES (65536 / DECODER_PAGE_SIZE)
+#define MAX_DECODE_LAYERS 64
+
+typedef struct decode_layer {
+    char name[32];
+    decode_t *pages[DECODER_PAGES];
+} decode_layer_t;
+
+/* In the same order as the DECODE_LAYER_ enum */
+static decode_layer_t layers[MAX_DECODE_LAYERS] = {
+    {"link", {NULL}}, {"eth", {NULL}}, {"ip", {NULL}}, {"tcp", {NULL}},
+    {"udp", {NULL}}, {"ppp", {NULL}}, {"ospf2", {NULL}}, {"icmp6", {NULL}},
+    {"eapol", {NULL}}, {"unknown", {NULL}}
+};
+static int nb_layers = DECODE_LAYER_BUILTIN_COUNT;
+/* Only held while adding layers or registering decoders, neither of which
+ * are ever removed */
+static pthread_mutex_t layers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Every decoder is loaded the first time a packet is decoded, after which
+ * only trace_dump_register_decoder() changes the tables */
+static pthread_once_t decoders_loaded = PTHREAD_ONCE_INIT;
 
-static std::map<std::string,std::map<uint16_t,decode_t> > decoders;
+/* getservbyport() and getprotobynumber() return static data */
+static pthread_mutex_t netdb_lock = PTHREAD_MUTEX_INITIALIZER;
 
 #define WIDTH 16
 
@@ -83,200 +119,443 @@ static std::map<std::string,std::map<uint16_t,decode_t> > decoders;
 #warning "No DIRNAME set!"
 #endif
 
+void trace_dump_buffer_init(libtrace_dump_buffer_t *buffer) {
+	buffer->data = NULL;
+	buffer->len = 0;
+	buffer->size = 0;
+}
+
+void trace_dump_buffer_reset(libtrace_dump_buffer_t *buffer) {
+	buffer->len = 0;
+	if (buffer->data)
+		buffer->data[0] = '\0';
+}
+
+void trace_dump_buffer_free(libtrace_dump_buffer_t *buffer) {
+	free(buffer->data);
+	trace_dump_buffer_init(buffer);
+}
+
+/* Makes room for at least 'needed' more bytes (including the nul) */
+static int grow_buffer(libtrace_dump_buffer_t *buffer, size_t needed) {
+	size_t size = buffer->size ? buffer->size : 1024;
+	char *data;
+
+	while (size - buffer->len < needed)
+		size *= 2;
+	if (size == buffer->size)
+		return 0;
+	data = (char *)realloc(buffer->data, size);
+	if (!data)
+		return -1;
+	buffer->data = data;
+	buffer->size = size;
+	return 0;
+}
+
+int trace_dump_printf(const char *fmt, ...) {
+	libtrace_dump_buffer_t *buffer = current_buffer;
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	if (!buffer) {
+		ret = vprintf(fmt, ap);
+		va_end(ap);
+		return ret;
+	}
+	if (buffer_failed || grow_buffer(buffer, 128) < 0) {
+		va_end(ap);
+		buffer_failed = true;
+		return -1;
+	}
+	ret = vsnprintf(buffer->data + buffer->len, buffer->size - buffer->len,
+			fmt, ap);
+	va_end(ap);
+
+	/* Didn't fit, so grow to the size it told us and go again */
+	if (ret > 0 && (size_t)ret >= buffer->size - buffer->len) {
+		if (grow_buffer(buffer, (size_t)ret + 1) < 0) {
+			buffer->data[buffer->len] = '\0';
+			buffer_failed = true;
+			return -1;
+		}
+		va_start(ap, fmt);
+		ret = vsnprintf(buffer->data + buffer->len,
+				buffer->size - buffer->len, fmt, ap);
+		va_end(ap);
+	}
+	if (ret > 0)
+		buffer->len += ret;
+	return ret;
+}
+
+char *trace_dump_service_name(uint16_t port, const char *proto, char *buf,
+		size_t len) {
+	struct servent *ent;
+	char *name = NULL;
+
+	pthread_mutex_lock(&netdb_lock);
+	ent = getservbyport(port, proto);
+	if (ent) {
+		snprintf(buf, len, "%s", ent->s_name);
+		name = buf;
+	}
+	pthread_mutex_unlock(&netdb_lock);
+	return name;
+}
+
+char *trace_dump_protocol_name(uint8_t proto, char *buf, size_t len) {
+	struct protoent *ent;
+	char *name = NULL;
+
+	pthread_mutex_lock(&netdb_lock);
+	ent = getprotobynumber(proto);
+	if (ent) {
+		snprintf(buf, len, "%s", ent->p_name);
+		name = buf;
+	}
+	pthread_mutex_unlock(&netdb_lock);
+	return name;
+}
+
 static void formatted_hexdump(const char *packet, int len) {
 	int i;
 
 	for(i=0;i<len; /* Nothing */ ) {
 		int j;
-		printf("\n ");
+		trace_dump_printf("\n ");
 		for(j=0;j<WIDTH;j++) {
 			if (i+j<len)
-				printf(" %02x",(unsigned char)packet[i+j]);
+				trace_dump_printf(" %02x",(unsigned char)packet[i+j]);
 			else
-				printf("   ");
+				trace_dump_printf("   ");
 		}
-		printf("    ");
+		trace_dump_printf("    ");
 		for(j=0;j<WIDTH;j++) {
 			if (i+j<len)
 				if (isprint((unsigned char)packet[i+j]))
-					printf("%c",(unsigned char)packet[i+j]);
+					trace_dump_printf("%c",(unsigned char)packet[i+j]);
 				else
-					printf(".");
+					trace_dump_printf(".");
 			else
-				printf("   ");
+				trace_dump_printf("   ");
 		}
 		if (i+WIDTH>len)
 			break;
 		else
 			i+=WIDTH;
 	}
-	printf("\n");
+	trace_dump_printf("\n");
 }
 
-void trace_hexdump_packet(struct libtrace_packet_t *packet) {
+static void dump_capture_header(libtrace_packet_t *packet, uint32_t length) {
+	time_t sec = (time_t)trace_get_seconds(packet);
+	char timestr[64];
+
+	if (!ctime_r(&sec, timestr))
+		timestr[0] = '\0';
+	trace_dump_printf("\n%s",timestr);
+	trace_dump_printf(" Capture: Packet Length: %i/%i Direction Value: %i\n",
+			(int)length,
+			(int)trace_get_wire_length(packet),
+			(int)trace_get_direction(packet));
+}
+
+static void hexdump_packet(struct libtrace_packet_t *packet) {
 
 	libtrace_linktype_t linktype;
 	uint32_t length;
 	const char *pkt_ptr = (char *)trace_get_packet_buffer(packet, &linktype, NULL);
 
-	time_t sec = (time_t)trace_get_seconds(packet);
-	
 	length = trace_get_capture_length(packet);
 
 	if (pkt_ptr == NULL || length == 0) {
-		printf(" [No packet payload]\n");
+		trace_dump_printf(" [No packet payload]\n");
 		return;
 	}
 
-	printf("\n%s",ctime(&sec));
-	printf(" Capture: Packet Length: %i/%i Direction Value: %i\n",
-			(int)length,
-			(int)trace_get_wire_length(packet),
-			(int)trace_get_direction(packet));
-
+	dump_capture_header(packet, length);
 	formatted_hexdump(pkt_ptr, (int)length);
 	return;
 }
 
-void trace_dump_packet(struct libtrace_packet_t *packet)
+static void dump_packet(struct libtrace_packet_t *packet)
 {
-	p = packet;
-
-	time_t sec = (time_t)trace_get_seconds(packet);
 	libtrace_linktype_t linktype;
 	uint32_t length;
 	const char *link=(char *)trace_get_packet_buffer(packet,&linktype,NULL);
 
 	length = trace_get_capture_length(packet);
-	printf("\n%s",ctime(&sec));
-	printf(" Capture: Packet Length: %i/%i Direction Value: %i\n",
-			(int)length,
-			(int)trace_get_wire_length(packet),
-			(int)trace_get_direction(packet));
+	dump_capture_header(packet, length);
 
 	if (!link) 
-		printf(" [No link layer available]\n");
+		trace_dump_printf(" [No link layer available]\n");
 	else
 		decode_next(link,length, "link", linktype);
 }
 
+/* Runs a dump with the current thread's output going to 'buffer' (or
+ * stdout if NULL), putting back whatever was there before so that a
+ * decoder can dump another packet of its own */
+static int dump_to(libtrace_packet_t *packet, libtrace_dump_buffer_t *buffer,
+		void (*dump)(libtrace_packet_t *)) {
+	libtrace_packet_t *saved_packet = current_packet;
+	libtrace_dump_buffer_t *saved_buffer = current_buffer;
+	bool saved_failed = buffer_failed;
+	int ret;
+
+	current_packet = packet;
+	current_buffer = buffer;
+	buffer_failed = false;
+	dump(packet);
+	ret = buffer_failed ? -1 : 0;
+
+	current_packet = saved_packet;
+	current_buffer = saved_buffer;
+	buffer_failed = saved_failed;
+	return ret;
+}
+
+void trace_hexdump_packet(struct libtrace_packet_t *packet) {
+	dump_to(packet, NULL, hexdump_packet);
+}
+
+void trace_dump_packet(struct libtrace_packet_t *packet) {
+	dump_to(packet, NULL, dump_packet);
+}
+
+int trace_hexdump_packet_buffer(libtrace_packet_t *packet,
+		libtrace_dump_buffer_t *buffer) {
+	return dump_to(packet, buffer, hexdump_packet);
+}
+
+int trace_dump_packet_buffer(libtrace_packet_t *packet,
+		libtrace_dump_buffer_t *buffer) {
+	return dump_to(packet, buffer, dump_packet);
+}
+
 static void generic_decode(uint16_t type,const char *packet, int len) {
-	printf(" Unknown Protocol: %i",type);
+	trace_dump_printf(" Unknown Protocol: %i",type);
 
 	formatted_hexdump(packet, len);
 }
 
-static void *open_so_decoder(const char *name,int type)
+static int find_layer(const char *name)
 {
-	char path[1024];
-	void *hdl;
-	/* Only check LIBPKTDUMPDIR if we're not setuid.  Not bulletproof, but hopefully anyone who
-	 * sets uid == euid will also clear the environment (eg sudo).
-	 */
-	if (getuid() == geteuid() && getenv("LIBPKTDUMPDIR")) {
-		snprintf(path,sizeof(path),"%s/%s_%i.so",getenv("LIBPKTDUMPDIR"),name,type);
-		hdl = dlopen(path,RTLD_LAZY);
-		if (hdl)
-			return hdl;
+	int i, count = __atomic_load_n(&nb_layers, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i < count; i++) {
+		if (strcmp(layers[i].name, name) == 0)
+			return i;
 	}
-	/* If the variable isn't set, *or* if we don't find anything, try the system location. */
-	snprintf(path,sizeof(path),DIRNAME "/%s_%i.so",name,type);
-	hdl = dlopen(path,RTLD_LAZY);
-	if (hdl)
-		return hdl;
+	return -1;
+}
 
-	return hdl;
+int decode_layer_id(const char *name)
+{
+	int layer = find_layer(name);
+
+	if (layer >= 0)
+		return layer;
+
+	pthread_mutex_lock(&layers_lock);
+	layer = find_layer(name);
+	if (layer < 0 && nb_layers < MAX_DECODE_LAYERS &&
+			strlen(name) < sizeof(layers[0].name)) {
+		layer = nb_layers;
+		strcpy(layers[layer].name, name);
+		__atomic_store_n(&nb_layers, layer + 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&layers_lock);
+	return layer;
 }
 
-static void *open_protocol_decoder(const char *name, int type)
+static const decode_t *find_decoder(int layer, uint16_t type)
 {
-	char path[1024];
-	void *hdl;
-	/* Only check LIBPKTDUMPDIR if we're not setuid.  Not bulletproof, but hopefully anyone who
-	 * sets uid == euid will also clear the environment (eg sudo).
-	 */
-	if (getuid() == geteuid() && getenv("LIBPKTDUMPDIR")) {
-		snprintf(path,sizeof(path),"%s/%s_%i.protocol",getenv("LIBPKTDUMPDIR"),name,type);
-		hdl = parse_protocol_file(path);
-		if (hdl)
-			return hdl;
+	decode_t *page = __atomic_load_n(
+			&layers[layer].pages[type >> DECODER_PAGE_BITS],
+			__ATOMIC_ACQUIRE);
+
+	if (!page || page[type & (DECODER_PAGE_SIZE - 1)].style == DECODE_NONE)
+		return NULL;
+	return &page[type & (DECODER_PAGE_SIZE - 1)];
+}
+
+/* Sets the decoder for a type. Once other threads may be decoding, pages
+ * are never changed in place. A copy holding the new decoder replaces the
+ * page instead, and the old one is left for any decode still using it. */
+static int set_decoder(int layer, uint16_t type, const decode_t *dec,
+		bool published)
+{
+	decode_t **slot = &layers[layer].pages[type >> DECODER_PAGE_BITS];
+	decode_t *page = *slot;
+
+	if (!page || published) {
+		page = (decode_t *)calloc(DECODER_PAGE_SIZE, sizeof(decode_t));
+		if (!page)
+			return -1;
+		if (*slot)
+			memcpy(page, *slot, DECODER_PAGE_SIZE *
+					sizeof(decode_t));
 	}
-	/* Try the system directory */
-	snprintf(path,sizeof(path),DIRNAME "/%s_%i.protocol",
-		name,type);
-	hdl = parse_protocol_file(path);
+	page[type & (DECODER_PAGE_SIZE - 1)] = *dec;
+	__atomic_store_n(slot, page, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void load_so_decoder(const char *path, int layer, int type)
+{
+	void *hdl = dlopen(path,RTLD_LAZY);
+	void *s;
+	decode_t dec;
 
 	if (!hdl)
-		return hdl;
+		return;
+
+	/* PCAPNG format requires the libtrace_packet_t structure in order
+	 * to determine the byte ordering */
+	if (layer == DECODE_LAYER_LINK && (type == TRACE_TYPE_PCAPNG_META ||
+			type == TRACE_TYPE_ERF_META)) {
+		s=dlsym(hdl,"decode_meta");
+		dec.style = DECODE_META;
+		dec.func.decode_meta = (decode_norm_meta)s;
+	} else {
+		s=dlsym(hdl,"decode");
+		dec.style = DECODE_NORMAL;
+		dec.func.decode_n = (libpacketdump_decode_t)s;
+	}
+	dec.proto = NULL;
 
-	return hdl;
+	if (!s || set_decoder(layer, type, &dec, false) < 0)
+		dlclose(hdl);
 }
 
-void decode_next(const char *packet,int len,const char *proto_name,int type)
+static void load_protocol_decoder(const char *path, int layer, int type)
 {
-	std::string sname(proto_name);
-
-	// if we haven't worked out how to decode this type yet, load the
-	// appropriate files to do so
-	if (decoders[sname].find(type)==decoders[sname].end()) {
-		void *hdl;
-		decode_funcs_t *func = new decode_funcs_t;
-		decode_t dec;
-
-		/* Try and find a .so to handle this protocol */
-		hdl = open_so_decoder(sname.c_str(),type);
-		if (hdl) {
-
-			/* PCAPNG format requires the libtrace_packet_t structure in order
-			 * to determine the byte ordering */
-			void *s;
-			if (type == TRACE_TYPE_PCAPNG_META || type == TRACE_TYPE_ERF_META) {
-				s=dlsym(hdl,"decode_meta");
-				if (s) { func->decode_meta = (decode_norm_meta)s; }
-			} else {
-				s=dlsym(hdl,"decode");
-				if (s) { func->decode_n = (decode_norm_t)s; }
-			}
+	decode_t dec;
+	element_t *el;
 
-			if (s) {
-				dec.style = DECODE_NORMAL;
-				dec.el = NULL; 
-			}
-			else {
-				dlclose(hdl);
-				hdl = NULL;
-			}
-		}
+	/* Protocol files are compiled once here, rather than walking the
+	 * parsed file for every packet */
+	el = parse_protocol_file((char *)path);
+	if (!el || !(dec.proto = compile_protocol(el)))
+		return;
+	dec.style = DECODE_PARSER;
+	dec.func.decode_p = decode_protocol_file;
+	set_decoder(layer, type, &dec, false);
+}
 
-		/* We didn't successfully open the .so, try finding a .protocol that we can use */
-		if (!hdl) {
-			hdl = open_protocol_decoder(sname.c_str(),type);
-			if (hdl) {
-				// use the protocol file
-				func->decode_p = decode_protocol_file;
-				dec.style = DECODE_PARSER;
-				dec.el = (element_t*)hdl;
-			}
-		}
+/* Loads every decoder in a directory named <layer>_<type><suffix> */
+static void load_decoder_dir(const char *dir, const char *suffix)
+{
+	char path[1024], name[32];
+	struct dirent *ent;
+	size_t len, suffixlen = strlen(suffix);
+	const char *sep;
+	char *end;
+	long type;
+	int layer;
+	DIR *d;
+
+	if (!(d = opendir(dir)))
+		return;
 
-		/* No matches found, fall back to the generic decoder. */
-		/* TODO: We should have a variety of fallback decoders based on the protocol. */
-		if(!hdl)
-		{
-			// no protocol file either, use a generic one
-			func->decode_n = generic_decode;
-			dec.style = DECODE_NORMAL;
-			dec.el = NULL;
-		} 
-
-		dec.func = func;
-		decoders[sname][type] = dec;
+	while ((ent = readdir(d)) != NULL) {
+		len = strlen(ent->d_name);
+		if (len <= suffixlen ||
+				strcmp(ent->d_name + len - suffixlen, suffix))
+			continue;
+		sep = strrchr(ent->d_name, '_');
+		if (!sep || sep == ent->d_name ||
+				(size_t)(sep - ent->d_name) >= sizeof(name))
+			continue;
+		type = strtol(sep + 1, &end, 10);
+		if (end == sep + 1 || end != ent->d_name + len - suffixlen ||
+				type < 0 || type > 65535)
+			continue;
+
+		memcpy(name, ent->d_name, sep - ent->d_name);
+		name[sep - ent->d_name] = '\0';
+		if ((layer = decode_layer_id(name)) < 0)
+			continue;
+
+		snprintf(path,sizeof(path),"%s/%s",dir,ent->d_name);
+		if (strcmp(suffix, ".so") == 0)
+			load_so_decoder(path, layer, (int)type);
+		else
+			load_protocol_decoder(path, layer, (int)type);
+	}
+	closedir(d);
+}
+
+static void load_decoders(void)
+{
+	const char *envdir = NULL;
+
+	/* Only check LIBPKTDUMPDIR if we're not setuid.  Not bulletproof, but hopefully anyone who
+	 * sets uid == euid will also clear the environment (eg sudo).
+	 */
+	if (getuid() == geteuid())
+		envdir = getenv("LIBPKTDUMPDIR");
+
+	/* Later decoders replace earlier ones, so a .so is preferred over a
+	 * .protocol file wherever it is, and LIBPKTDUMPDIR is preferred over
+	 * the system directory */
+	load_decoder_dir(DIRNAME, ".protocol");
+	if (envdir)
+		load_decoder_dir(envdir, ".protocol");
+	load_decoder_dir(DIRNAME, ".so");
+	if (envdir)
+		load_decoder_dir(envdir, ".so");
+}
+
+int trace_dump_register_decoder(const char *name, int type,
+		libpacketdump_decode_t decode)
+{
+	int layer, ret;
+	decode_t dec;
+
+	pthread_once(&decoders_loaded, load_decoders);
+	if ((layer = decode_layer_id(name)) < 0)
+		return -1;
+
+	dec.style = DECODE_NORMAL;
+	dec.func.decode_n = decode;
+	dec.proto = NULL;
+
+	/* Other threads may already be decoding with these pages */
+	pthread_mutex_lock(&layers_lock);
+	ret = set_decoder(layer, (uint16_t)type, &dec, true);
+	pthread_mutex_unlock(&layers_lock);
+	return ret;
+}
+
+void decode_next(const char *packet,int len,const char *proto_name,int type)
+{
+	int layer = find_layer(proto_name);
+
+	if (layer < 0) {
+		/* Nothing has been loaded for this layer */
+		trace_dump_printf("unknown protocol %s/%i\n",proto_name,type);
+		generic_decode(type, packet, len);
+		return;
 	}
+	decode_next_layer(packet, len, layer, type);
+}
+
+void decode_next_layer(const char *packet,int len,int layer,int type)
+{
+	const decode_t *dec = NULL;
+
+	pthread_once(&decoders_loaded, load_decoders);
+	if (layer >= 0 && layer < __atomic_load_n(&nb_layers, __ATOMIC_ACQUIRE))
+		dec = find_decoder(layer, (uint16_t)type);
 
 	/* TODO: Instead of haxing this here, we should provide a series of generic_decode's
 	 * and let the code above deal with it.
 	 */
-	if (decoders[sname][type].func->decode_n == generic_decode) {
+	if (!dec) {
 		/* We can't decode a link, so lets skip that and see if libtrace
 		 * knows how to find us the ip header
 		 */
@@ -284,42 +563,46 @@ void decode_next(const char *packet,int len,const char *proto_name,int type)
 		/* Also, don't try to skip if the linktype is not valid, 
 		 * because libtrace will just assert fail and that's never
 		 * good */
-		if (sname=="link" && type != -1) {
+		if (layer == DECODE_LAYER_LINK && type != -1) {
 			uint16_t newtype;
 			uint32_t newlen=len;
 			const char *network=(const char*)trace_get_payload_from_link((void*)packet,
 					(libtrace_linktype_t)type,
 					&newtype,&newlen);
 			if (network) {
-				printf("skipping unknown link header of type %i to network type %i\n",type,newtype);
+				trace_dump_printf("skipping unknown link header of type %i to network type %i\n",type,newtype);
 				/* Should hex dump this too. */
-				decode_next(network,newlen,"eth",newtype);
+				decode_next_layer(network,newlen,DECODE_LAYER_ETH,newtype);
 				return;
 			}
 		}
 		else {
-			printf("unknown protocol %s/%i\n",sname.c_str(),type);
+			trace_dump_printf("unknown protocol %s/%i\n",
+				layer >= 0 && layer < MAX_DECODE_LAYERS ?
+				layers[layer].name : "?",type);
 		}
+		generic_decode(type, packet, len);
+		return;
 	}
 
 	// decode using the appropriate function
-	switch(decoders[sname][type].style)
+	switch(dec->style)
 	{
 		case DECODE_NORMAL:
-			/* If this is a pcapng packet call the correct function and pass the
-			 * libtrace_packet_t structure. We need this to determine the byte ordering */
-			if (type == TRACE_TYPE_PCAPNG_META || type == TRACE_TYPE_ERF_META) {
-				decoders[sname][type].func->decode_meta(type,packet,len,p);
-			} else {
-				decoders[sname][type].func->decode_n(type,packet,len);
-			}
+			dec->func.decode_n(type,packet,len);
+			break;
+
+		case DECODE_META:
+			/* pcapng and ERF meta packets need the libtrace_packet_t
+			 * structure to determine the byte ordering */
+			dec->func.decode_meta(type,packet,len,current_packet);
 			break;
 
 		case DECODE_PARSER:
-			decoders[sname][type].func->decode_p(type,packet,len,
-				decoders[sname][type].el);
+			dec->func.decode_p(type,packet,len,dec->proto);
 			break;
 
+		case DECODE_NONE:
+			break;
 	};
 }
-
@@ -36,9 +36,9 @@ extern "C" {
 
 #define DISPLAY_EXP(hdr,x,fmt,exp) \
         if (SAFE(hdr, x)) \
-                printf(fmt,exp); \
+                trace_dump_printf(fmt,exp); \
         else {\
-                printf("(Truncated)\n"); \
+                trace_dump_printf("(Truncated)\n"); \
                 return; \
         }
 
@@ -48,9 +48,107 @@ extern "C" {
 #define DISPLAYL(hdr,x,fmt) DISPLAY_EXP(hdr,x,fmt,htonl(hdr->x))
 #define DISPLAYIP(hdr,x,fmt) DISPLAY_EXP(hdr,x,fmt,inet_ntoa(*(struct in_addr*)(void *)(&hdr->x)))
 
+/** A growable buffer that decoded packets are written into, so that
+ * packets can be decoded by several threads at once and printed later.
+ *
+ * Initialise it with trace_dump_buffer_init() (or zero it), and release
+ * the memory with trace_dump_buffer_free().
+ */
+typedef struct libtrace_dump_buffer {
+        /** The decoded text, which is always nul terminated once anything
+         * has been written */
+        char *data;
+        /** The length of the decoded text, not including the nul */
+        size_t len;
+        /** The number of bytes allocated for data */
+        size_t size;
+} libtrace_dump_buffer_t;
 
+void trace_dump_buffer_init(libtrace_dump_buffer_t *buffer);
+/** Empties a buffer, keeping its memory to be written into again */
+void trace_dump_buffer_reset(libtrace_dump_buffer_t *buffer);
+void trace_dump_buffer_free(libtrace_dump_buffer_t *buffer);
+
+/** Prints a packet to stdout.
+ *
+ * These write straight to stdout, so output from several threads calling
+ * them at the same time will be interleaved. Use the _buffer variants
+ * below from per packet threads instead.
+ */
 void trace_hexdump_packet(libtrace_packet_t *packet);
 void trace_dump_packet(libtrace_packet_t *packet);
+
+/** Decodes a packet, appending the text to a buffer rather than printing
+ * it. These are safe to call from several threads at once, as long as
+ * each thread has its own buffer.
+ *
+ * @return 0 if successful, -1 if the buffer could not be grown, in which
+ * case the output is truncated
+ */
+int trace_hexdump_packet_buffer(libtrace_packet_t *packet,
+                libtrace_dump_buffer_t *buffer);
+int trace_dump_packet_buffer(libtrace_packet_t *packet,
+                libtrace_dump_buffer_t *buffer);
+
+/** Writes decoder output, either to the buffer the current thread is
+ * decoding into or to stdout. Decoders must use this instead of printf().
+ */
+int trace_dump_printf(const char *fmt, ...) PRINTF(1,2);
+
+/** Looks up the name of a service or IP protocol like getservbyport() and
+ * getprotobynumber() do, but copies it into 'buf' so that it can't be
+ * changed by another thread doing a lookup.
+ *
+ * @param port		The port number, in network byte order
+ * @return buf, or NULL if the service or protocol is unknown
+ */
+char *trace_dump_service_name(uint16_t port, const char *proto, char *buf,
+                size_t len);
+char *trace_dump_protocol_name(uint8_t proto, char *buf, size_t len);
+
+/** The layers that decoders are registered against. A decoder for "type"
+ * at a layer is loaded from <layer>_<type>.so or <layer>_<type>.protocol,
+ * and layers other than these are added as decoders for them are found.
+ */
+enum {
+        DECODE_LAYER_LINK,
+        DECODE_LAYER_ETH,
+        DECODE_LAYER_IP,
+        DECODE_LAYER_TCP,
+        DECODE_LAYER_UDP,
+        DECODE_LAYER_PPP,
+        DECODE_LAYER_OSPF2,
+        DECODE_LAYER_ICMP6,
+        DECODE_LAYER_EAPOL,
+        DECODE_LAYER_UNKNOWN,
+        DECODE_LAYER_BUILTIN_COUNT
+};
+
+typedef void (*libpacketdump_decode_t)(int type, const char *packet,
+                unsigned len);
+
+/** Finds the number of a layer, adding it if it hasn't been seen before.
+ *
+ * @return the layer number, or -1 if there are too many layers
+ */
+int decode_layer_id(const char *name);
+
+/** Registers a decoder that is linked into the program, replacing any
+ * decoder for the same layer and type loaded from the plugin directory.
+ *
+ * Decoders may be registered while other threads are decoding packets,
+ * which see either the old decoder or the new one.
+ *
+ * @return 0 if successful, -1 if the layer could not be added
+ */
+int trace_dump_register_decoder(const char *layer, int type,
+                libpacketdump_decode_t decode);
+
+/** Passes the rest of the packet on to the decoder for the next header.
+ * Decoders should use decode_next_layer() with a DECODE_LAYER_ number,
+ * as looking up the layer by name is slower.
+ */
+void decode_next_layer(const char *packet,int len,int layer,int type);
 void decode_next(const char *packet,int len,const char *proto_name,int type);
 
 void decode(int link_type, const char *pkt, unsigned len);
@@ -32,18 +32,18 @@
 
 DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 {
-	printf(" Legacy PoS:");
+	trace_dump_printf(" Legacy PoS:");
 	if (len>=4)
-		printf(" %08x\n",*(uint32_t *)packet);
+		trace_dump_printf(" %08x\n",*(uint32_t *)packet);
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	if (len>4) {
-		decode_next(packet+4,len-4,"eth",2048);
+		decode_next_layer(packet+4,len-4,DECODE_LAYER_ETH,2048);
 	}
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	return;
@@ -44,28 +44,28 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 {
 	libtrace_chdlc_t *frame = (libtrace_chdlc_t *)packet;
 
-	printf(" CHDLC:");
+	trace_dump_printf(" CHDLC:");
 	if (len >= 1)
-		printf(" Address: 0x%02x", frame->address);
+		trace_dump_printf(" Address: 0x%02x", frame->address);
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	
 	if (len >= 2)
-		printf(" Control: 0x%02x", frame->control);
+		trace_dump_printf(" Control: 0x%02x", frame->control);
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	
 	if (len >= 4) {
-		printf(" Ethertype: 0x%04x\n", ntohs(frame->ethertype));
-		decode_next(packet + 4, len - 4, "eth", 
+		trace_dump_printf(" Ethertype: 0x%04x\n", ntohs(frame->ethertype));
+		decode_next_layer(packet + 4, len - 4, DECODE_LAYER_ETH, 
 				ntohs(frame->ethertype));
 	}
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	
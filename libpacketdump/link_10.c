@@ -32,16 +32,16 @@
 DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 {
 	// ATM
-	printf(" Legacy Framing:");
+	trace_dump_printf(" Legacy Framing:");
 	if (len>=12) {
 		uint16_t type = htons(*(uint16_t*)(packet+sizeof(libtrace_atm_cell_t)+4));
-		printf(" %04x\n",type);
-		decode_next(packet+sizeof(libtrace_atm_cell_t) + 4,
+		trace_dump_printf(" %04x\n",type);
+		decode_next_layer(packet+sizeof(libtrace_atm_cell_t) + 4,
 				len-sizeof(libtrace_atm_cell_t) -4, 
-				"eth",type);
+				DECODE_LAYER_ETH,type);
 	}
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	return;
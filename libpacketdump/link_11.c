@@ -31,12 +31,12 @@
 DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 {
 	// Ethernet - just raw ethernet frames
-	printf(" Legacy: ");
+	trace_dump_printf(" Legacy: ");
 	if (len>=10) {
-		decode_next(packet,len,"link",2);
+		decode_next_layer(packet,len,DECODE_LAYER_LINK,2);
 	}
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	return;
@@ -53,10 +53,10 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 	uint16_t rtap_real_len; /* to make sure length in header matches fields present */
 	rtap = (libtrace_radiotap_t *)packet;
 	
-	printf(" Radiotap:");
+	trace_dump_printf(" Radiotap:");
 
 	if (len < 8) {
-		printf(" [|Truncated (%u bytes)]\n", len);
+		trace_dump_printf(" [|Truncated (%u bytes)]\n", len);
 		return;
 	}
 	
@@ -64,23 +64,23 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 	rtap_len = bswap_le_to_host16(rtap->it_len);
 	rtap_pres = bswap_le_to_host32(rtap->it_present);
 
-	printf(" version: %u, length: %u, fields: %#08x\n", rtap->it_version,
+	trace_dump_printf(" version: %u, length: %u, fields: %#08x\n", rtap->it_version,
 			rtap_len, rtap_pres);
 	
 	/* Check for extended bitmasks */
 	ptr = (uint32_t *) (char *)(&(rtap->it_present));
 	
 	if ( (rtap_pres) & (1 << TRACE_RADIOTAP_EXT) ) 
-		printf("  extended fields:");
+		trace_dump_printf("  extended fields:");
 	
 	while( (bswap_le_to_host32(*ptr)) & (1 << TRACE_RADIOTAP_EXT) ) {
 		rtap_real_len += sizeof (uint32_t);
 		ptr++;
-		printf(" %#08x", bswap_le_to_host32(*ptr));	
+		trace_dump_printf(" %#08x", bswap_le_to_host32(*ptr));	
 	}
 
         if ( (rtap_pres) & (1 << TRACE_RADIOTAP_EXT) )
-                printf("\n");
+                trace_dump_printf("\n");
 
 	/* make p point to the first data field */
 	s = (uint8_t *) rtap;
@@ -88,27 +88,27 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_TSFT)) {
 		ALIGN_NATURAL_64(p,s,rtap_real_len);
-		printf(" Radiotap: TSFT = %" PRIu64 " microseconds\n", bswap_le_to_host64(*((uint64_t *)p)));
+		trace_dump_printf(" Radiotap: TSFT = %" PRIu64 " microseconds\n", bswap_le_to_host64(*((uint64_t *)p)));
 		p += sizeof (uint64_t);
 		rtap_real_len += sizeof (uint64_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_FLAGS)) {
-		printf(" Radiotap: Flags = 0x%02x\n", *p);
+		trace_dump_printf(" Radiotap: Flags = 0x%02x\n", *p);
 		p += sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
 
 	
 	if (rtap_pres & (1 << TRACE_RADIOTAP_RATE)) {
-		printf(" Radiotap: Rate = %u kbps\n", (*p) * 500);
+		trace_dump_printf(" Radiotap: Rate = %u kbps\n", (*p) * 500);
 		p +=  sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
 	
 	if (rtap_pres & (1 << TRACE_RADIOTAP_CHANNEL)) {
 		ALIGN_NATURAL_16(p,s,rtap_real_len);
-		printf(" Radiotap: Freq = %u MHz, ChanFlags: 0x%04x\n", bswap_le_to_host16(*((uint16_t *)p)), 
+		trace_dump_printf(" Radiotap: Freq = %u MHz, ChanFlags: 0x%04x\n", bswap_le_to_host16(*((uint16_t *)p)), 
 				*(((uint16_t *)p) + 1));
 		p += sizeof (uint32_t);
 		rtap_real_len += sizeof(uint32_t);
@@ -116,21 +116,21 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 											
 	if (rtap_pres & (1 << TRACE_RADIOTAP_FHSS)) {
 		ALIGN_NATURAL_16(p,s, rtap_real_len);
-		printf(" Radiotap: FHSS HopSet = %u , HopPattern: %u\n", *p, *(p+1)); 
+		trace_dump_printf(" Radiotap: FHSS HopSet = %u , HopPattern: %u\n", *p, *(p+1)); 
 		p += sizeof (uint16_t);
 		rtap_real_len += sizeof(uint16_t);
 	}
 
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_DBM_ANTSIGNAL)) {
-		printf(" Radiotap: Signal = %i dBm\n", (int8_t) *p) ;
+		trace_dump_printf(" Radiotap: Signal = %i dBm\n", (int8_t) *p) ;
 		p += sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
 
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_DBM_ANTNOISE)) {
-		printf(" Radiotap: Noise = %i dBm\n", (int8_t) *p); 
+		trace_dump_printf(" Radiotap: Noise = %i dBm\n", (int8_t) *p); 
 		p += sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
@@ -138,7 +138,7 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_LOCK_QUALITY)) {
 		ALIGN_NATURAL_16(p,s, rtap_real_len);
-		printf(" Radiotap: Barker Code Lock Quality = %u\n", bswap_le_to_host16(*((uint16_t *)p))); 
+		trace_dump_printf(" Radiotap: Barker Code Lock Quality = %u\n", bswap_le_to_host16(*((uint16_t *)p))); 
 		p += sizeof (uint16_t);
 		rtap_real_len += sizeof(uint16_t);
 	}
@@ -146,73 +146,73 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_TX_ATTENUATION)) {
 		ALIGN_NATURAL_16(p,s, rtap_real_len);
-		printf(" Radiotap: TX Attenuation = %u\n", bswap_le_to_host16(*((uint16_t *)p))); 
+		trace_dump_printf(" Radiotap: TX Attenuation = %u\n", bswap_le_to_host16(*((uint16_t *)p))); 
 		p += sizeof (uint16_t);
 		rtap_real_len += sizeof(uint16_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_DB_TX_ATTENUATION)) {
 		ALIGN_NATURAL_16(p,s,rtap_real_len);
-		printf(" Radiotap: TX Attenuation = %u dB\n", bswap_le_to_host16(*((uint16_t *)p))); 
+		trace_dump_printf(" Radiotap: TX Attenuation = %u dB\n", bswap_le_to_host16(*((uint16_t *)p))); 
 		p += sizeof (uint16_t);
 		rtap_real_len += sizeof(uint16_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_DBM_TX_POWER)) {
-		printf(" Radiotap: TX Power = %i dBm\n", *p); 
+		trace_dump_printf(" Radiotap: TX Power = %i dBm\n", *p); 
 		p += sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_ANTENNA)) {
-		printf(" Radiotap: Antenna = %u\n", *p); 
+		trace_dump_printf(" Radiotap: Antenna = %u\n", *p); 
 		p += sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_DB_ANTSIGNAL)) {
-		printf(" Radiotap: Signal = %u dB\n", *p); 
+		trace_dump_printf(" Radiotap: Signal = %u dB\n", *p); 
 		p += sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_DB_ANTNOISE)) {
-		printf(" Radiotap: Noise = %u dB\n", *p); 
+		trace_dump_printf(" Radiotap: Noise = %u dB\n", *p); 
 		p += sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_RX_FLAGS)) {
 		ALIGN_NATURAL_16(p,s,rtap_real_len);
-		printf(" Radiotap: RX Flags = 0x%04x\n", *((uint16_t *)p));
+		trace_dump_printf(" Radiotap: RX Flags = 0x%04x\n", *((uint16_t *)p));
 		p += sizeof (uint16_t);
 		rtap_real_len += sizeof(uint16_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_TX_FLAGS)) {
 		ALIGN_NATURAL_16(p,s,rtap_real_len);
-		printf(" Radiotap: TX Flags = 0x%04x\n", *((uint16_t *)p));
+		trace_dump_printf(" Radiotap: TX Flags = 0x%04x\n", *((uint16_t *)p));
 		p += sizeof (uint16_t);
 		rtap_real_len += sizeof(uint16_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_RTS_RETRIES)) {
-		printf(" Radiotap: RTS Retries = %u\n", *p);
+		trace_dump_printf(" Radiotap: RTS Retries = %u\n", *p);
 		p += sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
 
 	if (rtap_pres & (1 << TRACE_RADIOTAP_DATA_RETRIES)) {
-		printf(" Radiotap: Data Retries = %u\n", *p);
+		trace_dump_printf(" Radiotap: Data Retries = %u\n", *p);
 		p += sizeof (uint8_t);
 		rtap_real_len += sizeof(uint8_t);
 	}
 
 	if (rtap_real_len != rtap_len) 
-		printf(" Radiotap: WARNING: Header contains un-decoded fields.\n");
+		trace_dump_printf(" Radiotap: WARNING: Header contains un-decoded fields.\n");
 
 	if (len > rtap_len) 
-		decode_next(packet + rtap_len, len - rtap_len, "link", TRACE_TYPE_80211);
+		decode_next_layer(packet + rtap_len, len - rtap_len, DECODE_LAYER_LINK, TRACE_TYPE_80211);
 		
 	return;
 
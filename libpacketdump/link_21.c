@@ -17,19 +17,19 @@ static void print_meta_contents(libtrace_meta_t *meta) {
                 if (meta->items[i].section != last_sec) {
                         switch(meta->items[i].section) {
                                 case ERF_PROV_SECTION_CAPTURE:
-                                        printf("  Capture section:\n");
+                                        trace_dump_printf("  Capture section:\n");
                                         break;
                                 case ERF_PROV_SECTION_HOST:
-                                        printf("  Host section:\n");
+                                        trace_dump_printf("  Host section:\n");
                                         break;
                                 case ERF_PROV_SECTION_MODULE:
-                                        printf("  Module section:\n");
+                                        trace_dump_printf("  Module section:\n");
                                         break;
                                 case ERF_PROV_SECTION_INTERFACE:
-                                        printf("  Interface section:\n");
+                                        trace_dump_printf("  Interface section:\n");
                                         break;
                                 case ERF_PROV_SECTION_STREAM:
-                                        printf("  Stream section:\n");
+                                        trace_dump_printf("  Stream section:\n");
                                         break;
                         }
                         last_sec = meta->items[i].section;
@@ -40,44 +40,44 @@ static void print_meta_contents(libtrace_meta_t *meta) {
                 }
 
 		if (meta->items[i].datatype == TRACE_META_STRING) {
-			printf("   %s: %s\n",
+			trace_dump_printf("   %s: %s\n",
 				meta->items[i].option_name,
 				(char *)meta->items[i].data);
 		} else if (meta->items[i].datatype == TRACE_META_UINT8) {
-			printf("   %s: %" PRIu8 "\n",
+			trace_dump_printf("   %s: %" PRIu8 "\n",
                                 meta->items[i].option_name,
 				*(uint8_t *)meta->items[i].data);
 		} else if (meta->items[i].datatype == TRACE_META_UINT32) {
-			printf("   %s: %" PRIu32 "\n",
+			trace_dump_printf("   %s: %" PRIu32 "\n",
                                 meta->items[i].option_name,
 				*(uint32_t *)meta->items[i].data);
 		} else if (meta->items[i].datatype == TRACE_META_UINT64) {
-			printf("   %s: %" PRIu64 "\n",
+			trace_dump_printf("   %s: %" PRIu64 "\n",
                                 meta->items[i].option_name,
 				*(uint64_t *)meta->items[i].data);
 		} else if (meta->items[i].datatype == TRACE_META_IPV4) {
 			struct in_addr ip;
 			ip.s_addr = *(uint32_t *)meta->items[i].data;
-			printf("   %s: %s\n",
+			trace_dump_printf("   %s: %s\n",
 				meta->items[i].option_name,
 				inet_ntoa(ip));
 		} else if (meta->items[i].datatype == TRACE_META_IPV6) {
-			printf("   %s: %s\n",
+			trace_dump_printf("   %s: %s\n",
                                 meta->items[i].option_name,
 				(char *)meta->items[i].data);
 		} else if (meta->items[i].datatype == TRACE_META_MAC) {
 			unsigned char *mac = meta->items[i].data;
-			printf("   %s: %02x:%02x:%02x:%02x:%02x:%02x\n",
+			trace_dump_printf("   %s: %02x:%02x:%02x:%02x:%02x:%02x\n",
 				meta->items[i].option_name,
 				mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
 		} else {
-			printf("   Unknown Option ID %" PRIu16 " (output RAW): ", meta->items[i].option);
+			trace_dump_printf("   Unknown Option ID %" PRIu16 " (output RAW): ", meta->items[i].option);
 			int k;
 			unsigned char *curr = (unsigned char *)meta->items[i].data;
 			for (k=0; k<meta->items[i].len; k++) {
-				printf("%02x ", curr[k]);
+				trace_dump_printf("%02x ", curr[k]);
 			}
-			printf("\n");
+			trace_dump_printf("\n");
 		}
 	}
 }
@@ -85,7 +85,7 @@ static void print_meta_contents(libtrace_meta_t *meta) {
 DLLEXPORT void decode_meta(int link_type UNUSED, const char *packet UNUSED, unsigned len UNUSED,
 	libtrace_packet_t *p) {
 
-	printf(" ERF Provenance Packet\n");
+	trace_dump_printf(" ERF Provenance Packet\n");
 	libtrace_meta_t *sec_all = trace_get_all_metadata(p);
 
 	if (sec_all != NULL) {
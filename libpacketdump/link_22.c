@@ -22,25 +22,25 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len) {
 
         basedec = wandder_get_etsili_base_decoder(dec);
         while (wandder_etsili_get_next_fieldstr(dec, linespace, 4096)) {
-                printf(" ETSILI: ");
+                trace_dump_printf(" ETSILI: ");
                 for (i = 0; i < wandder_get_level(basedec); i++) {
-                        printf("  ");
+                        trace_dump_printf("  ");
                         lastlevel = i + 1;
                 }
-                printf("%s\n", linespace);
+                trace_dump_printf("%s\n", linespace);
         }
 
         cchdr = wandder_etsili_get_cc_contents(dec, &rem, namesp, 1024);
 
         if (cchdr) {
-                printf(" ETSILI: ");
+                trace_dump_printf(" ETSILI: ");
                 for (i = 0; i < lastlevel + 1; i++) {
-                        printf("  ");
+                        trace_dump_printf("  ");
                 }
-                printf("%s: ...\n", namesp);
+                trace_dump_printf("%s: ...\n", namesp);
                 wandder_free_etsili_decoder(dec);
                 /* XXX What if there is an IPv7?? */
-                decode_next((const char *)cchdr, rem, "eth",
+                decode_next_layer((const char *)cchdr, rem, DECODE_LAYER_ETH,
                                 ((*cchdr) & 0xf0) == 0x40 ? TRACE_ETHERTYPE_IP :
                                 TRACE_ETHERTYPE_IPV6);
                 return;
@@ -49,22 +49,22 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len) {
         iricontents = wandder_etsili_get_iri_contents(dec, &rem, &ident,
                         namesp, 1024);
         if (iricontents) {
-                printf(" ETSILI: ");
+                trace_dump_printf(" ETSILI: ");
                 /* hard-coded indentation, but easier than introducing
                  * yet another parameter to get_iri_contents()
                  */
                 for (i = 0; i < 7; i++) {
-                        printf("  ");
+                        trace_dump_printf("  ");
                 }
-                printf("%s: ...\n", namesp);
+                trace_dump_printf("%s: ...\n", namesp);
                 wandder_free_etsili_decoder(dec);
                 if (ident == WANDDER_IRI_CONTENT_IP) {
-                        decode_next((const char *)iricontents, rem, "eth",
+                        decode_next_layer((const char *)iricontents, rem, DECODE_LAYER_ETH,
                                         ((*iricontents) & 0xf0) == 0x40 ?
                                         TRACE_ETHERTYPE_IP :
                                         TRACE_ETHERTYPE_IPV6);
                 } else if (ident == WANDDER_IRI_CONTENT_SIP) {
-                        decode_next((const char *)iricontents, rem, "udp",
+                        decode_next_layer((const char *)iricontents, rem, DECODE_LAYER_UDP,
                                         5060);
                 }
         }
@@ -16,22 +16,22 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet UNUSED,unsigned le
 
 static void print_section_type(libtrace_meta_t *r) {
 	int i;
-	printf(" PCAPNG Section Header Block\n");
+	trace_dump_printf(" PCAPNG Section Header Block\n");
 
 	if (r == NULL) { return; }
 
         for (i=0; i<r->num; i++) {
         	switch(r->items[i].option) {
                 	case(PCAPNG_META_SHB_HARDWARE):
-                        	printf("  shb_hardware: %s\n",
+                        	trace_dump_printf("  shb_hardware: %s\n",
                                 	(char *)r->items[i].data);
                                 break;
                         case(PCAPNG_META_SHB_OS):
-                                printf("  shb_os: %s\n",
+                                trace_dump_printf("  shb_os: %s\n",
                                         (char *)r->items[i].data);
                                 break;
                         case(PCAPNG_META_SHB_USERAPPL):
-                                printf("  shb_userappl: %s\n",
+                                trace_dump_printf("  shb_userappl: %s\n",
                                         (char *)r->items[i].data);
                                 break;
         	}
@@ -42,73 +42,73 @@ static void print_interface_type(libtrace_meta_t *r, libtrace_packet_t *packet)
 	struct in_addr ip;
 	unsigned char *tmp;
 	char *ip6, *ptr UNUSED;
-	printf(" PCAPNG Interface Description Block\n");
+	trace_dump_printf(" PCAPNG Interface Description Block\n");
 
 	if (r == NULL) { return; }
 
 	for (i=0; i<r->num; i++) {
 		switch(r->items[i].option) {
 			case(PCAPNG_META_IF_NAME):
-				printf("  if_name: %s\n",
+				trace_dump_printf("  if_name: %s\n",
 					(char *)r->items[i].data);
 				break;
 			case(PCAPNG_META_IF_DESCR):
-				printf("  if_description: %s\n",
+				trace_dump_printf("  if_description: %s\n",
 					(char *)r->items[i].data);
 				break;
 			case(PCAPNG_META_IF_IP4):
 				ip.s_addr = *(uint32_t *)r->items[i].data;
-				printf("  if_IPv4addr: %s", inet_ntoa(ip));
+				trace_dump_printf("  if_IPv4addr: %s", inet_ntoa(ip));
 				break;
 			case(PCAPNG_META_IF_IP6):
 				ip6 = calloc(1, INET6_ADDRSTRLEN);
 				ptr = trace_get_interface_ipv6_string(packet, ip6,
 					INET6_ADDRSTRLEN, 0);
-				printf("  if_IPv6addr: %s\n", ip6);
+				trace_dump_printf("  if_IPv6addr: %s\n", ip6);
 				free(ip6);
 				break;
 			case(PCAPNG_META_IF_MAC):
 				tmp = r->items[i].data;
-				printf("  if_MACaddr: %02x:%02x:%02x:%02x:%02x:%02x\n",
+				trace_dump_printf("  if_MACaddr: %02x:%02x:%02x:%02x:%02x:%02x\n",
 					tmp[0], tmp[1], tmp[2], tmp[3], tmp[4], tmp[5]);
 				break;
 			case(PCAPNG_META_IF_EUI):
 				tmp = r->items[i].data;
-				printf("  if_EUIaddr: %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x\n",
+				trace_dump_printf("  if_EUIaddr: %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x\n",
 					tmp[0], tmp[1], tmp[2], tmp[3],
 					tmp[4], tmp[5], tmp[6], tmp[7]);
 				break;
 			case(PCAPNG_META_IF_SPEED):
-				printf("  if_speed: %" PRIu64 "\n",
+				trace_dump_printf("  if_speed: %" PRIu64 "\n",
 					*(uint64_t *)r->items[i].data);
 				break;
 			case(PCAPNG_META_IF_TSRESOL):
-				printf("  if_tsresol: %" PRIu8 "\n",
+				trace_dump_printf("  if_tsresol: %" PRIu8 "\n",
 					*(uint8_t *)r->items[i].data);
 				break;
 			case(PCAPNG_META_IF_TZONE):
 				/* Waiting for specification to specify */
 				break;
 			case(PCAPNG_META_IF_FILTER):
-				printf("  if_filter: %" PRIu8 "",
+				trace_dump_printf("  if_filter: %" PRIu8 "",
 					*(uint8_t *)r->items[i].data);
-				printf(" %s\n",
+				trace_dump_printf(" %s\n",
 					(char *)r->items[i].data+sizeof(uint8_t));
 				break;
 			case(PCAPNG_META_IF_OS):
-				printf("  if_os: %s\n",
+				trace_dump_printf("  if_os: %s\n",
 					(char *)r->items[i].data);
 				break;
 			case(PCAPNG_META_IF_FCSLEN):
-				printf("  if_fcslen: %" PRIu8 "\n",
+				trace_dump_printf("  if_fcslen: %" PRIu8 "\n",
 					*(uint8_t *)r->items[i].data);
 				break;
 			case(PCAPNG_META_IF_TSOFFSET):
-				printf("  if_tsoffset: %" PRIu64 "\n",
+				trace_dump_printf("  if_tsoffset: %" PRIu64 "\n",
 					*(uint64_t *)r->items[i].data);
 				break;
 			case(PCAPNG_META_IF_HARDWARE):
-				printf("  if_hardware: %s\n",
+				trace_dump_printf("  if_hardware: %s\n",
 					(char *)r->items[i].data);
 				break;
 			default:
@@ -120,14 +120,14 @@ static void print_interface_type(libtrace_meta_t *r, libtrace_packet_t *packet)
 static void print_name_resolution_type(libtrace_meta_t *r) {
 	int i;
 	struct in_addr ip;
-	printf(" PCAPNG Name Resolution\n");
+	trace_dump_printf(" PCAPNG Name Resolution\n");
 	if (r == NULL) { return; }
 
 	for (i=0; i<r->num; i++) {
 		switch(r->items[i].option) {
 			case(PCAPNG_META_NRB_RECORD_IP4):
 				ip.s_addr = *(uint32_t *)r->items[i].data;
-				printf("  nrb_record_ipv4: %s dns_name: %s\n",
+				trace_dump_printf("  nrb_record_ipv4: %s dns_name: %s\n",
 					inet_ntoa(ip),
 					(char *)(r->items[i].data+sizeof(uint32_t)));
 				break;
@@ -156,7 +156,7 @@ static void print_name_resolution_type(libtrace_meta_t *r) {
 
 static void print_interface_statistics_type(libtrace_meta_t *r) {
 	int i;
-        printf(" PCAPNG Interface Statistics\n");
+        trace_dump_printf(" PCAPNG Interface Statistics\n");
 
 	if (r == NULL) { return; }
 
@@ -164,31 +164,31 @@ static void print_interface_statistics_type(libtrace_meta_t *r) {
                 switch(r->items[i].option) {
 			case(PCAPNG_META_ISB_STARTTIME):
 				/* Need to split into 4 octets */
-				printf("  isb_starttime: %" PRIu64 "\n",
+				trace_dump_printf("  isb_starttime: %" PRIu64 "\n",
                                         *(uint64_t *)r->items[i].data);
                                 break;
 			case(PCAPNG_META_ISB_ENDTIME):
-				printf("  isb_endtime: %" PRIu64 "\n",
+				trace_dump_printf("  isb_endtime: %" PRIu64 "\n",
 					*(uint64_t *)r->items[i].data);
 				break;
 			case(PCAPNG_META_ISB_IFRECV):
-				printf("  isb_ifrecv: %" PRIu64 "\n",
+				trace_dump_printf("  isb_ifrecv: %" PRIu64 "\n",
                                         *(uint64_t *)r->items[i].data);
                                 break;
 			case(PCAPNG_META_ISB_IFDROP):
-				printf("  isb_ifdrop: %" PRIu64 "\n",
+				trace_dump_printf("  isb_ifdrop: %" PRIu64 "\n",
                                         *(uint64_t *)r->items[i].data);
                                 break;
 			case(PCAPNG_META_ISB_FILTERACCEPT):
-				printf("  isb_filteraccept: %" PRIu64 "\n",
+				trace_dump_printf("  isb_filteraccept: %" PRIu64 "\n",
                                         *(uint64_t *)r->items[i].data);
                                 break;
 			case(PCAPNG_META_ISB_OSDROP):
-				printf("  isb_osdrop: %" PRIu64 "\n",
+				trace_dump_printf("  isb_osdrop: %" PRIu64 "\n",
                                         *(uint64_t *)r->items[i].data);
                                 break;
 			case(PCAPNG_META_ISB_USRDELIV):
-				printf("  isb_usrdeliv: %" PRIu64 "\n",
+				trace_dump_printf("  isb_usrdeliv: %" PRIu64 "\n",
                                         *(uint64_t *)r->items[i].data);
                                 break;
 			default:
@@ -199,19 +199,19 @@ static void print_interface_statistics_type(libtrace_meta_t *r) {
 
 static void print_custom_type(libtrace_meta_t *r) {
 	int i, k;
-	printf(" PCAPNG Custom Block\n");
+	trace_dump_printf(" PCAPNG Custom Block\n");
 
 	if (r == NULL) { return; }
 
 	/* print the custom data */
 	for (i=0; i<r->num; i++) {
-		printf("  Private Enterprise Number (PEN): %" PRIu32 "\n",
+		trace_dump_printf("  Private Enterprise Number (PEN): %" PRIu32 "\n",
 			*(uint32_t *)r->items[i].data);
-		printf("   Data: ");
+		trace_dump_printf("   Data: ");
 		char *ptr = r->items[i].data+sizeof(uint32_t);
 		uint16_t length = r->items[i].len-sizeof(uint32_t);
 		for (k=0; k<length; k++) {
-			printf("%02x ", ptr[k]);
+			trace_dump_printf("%02x ", ptr[k]);
 		}
 	}
 }
@@ -271,7 +271,7 @@ DLLEXPORT void decode_meta(int link_type UNUSED,const char *packet UNUSED,unsign
 			print_secrets_type(r);
 			break;
 		default:
-			printf("Unknown Type/Block\n");
+			trace_dump_printf("Unknown Type/Block\n");
 
 	}
 
@@ -15,12 +15,12 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len) {
 	prov_used = ntohl(tags->providers_used);
         filterbits = bswap_be_to_host64(tags->filterbits);
 
-	printf(" CorsaroTags: Protocol: %u  Source Port: %u  Dest Port: %u\n",
+	trace_dump_printf(" CorsaroTags: Protocol: %u  Source Port: %u  Dest Port: %u\n",
 			tags->protocol, ntohs(tags->src_port),
 			ntohs(tags->dest_port));
-	printf(" CorsaroTags: Flowtuple hash: %u\n", ntohl(tags->ft_hash));
+	trace_dump_printf(" CorsaroTags: Flowtuple hash: %u\n", ntohl(tags->ft_hash));
 	if (prov_used & (1 << NDAG_IPMETA_PROVIDER_MAXMIND)) {
-		printf(" CorsaroTags: Maxmind Continent: %c%c   Country: %c%c\n",
+		trace_dump_printf(" CorsaroTags: Maxmind Continent: %c%c   Country: %c%c\n",
 				(unsigned char)(tags->maxmind_continent & 0xff),
 				(unsigned char)(tags->maxmind_continent >> 8),
 				(unsigned char)(tags->maxmind_country & 0xff),
@@ -28,40 +28,40 @@ DLLEXPORT void decode(int link_type UNUSED, const char *packet, unsigned len) {
 		);
 	}
 	if (prov_used & (1 << NDAG_IPMETA_PROVIDER_NETACQ_EDGE)) {
-		printf(" CorsaroTags: Netacq-Edge Continent: %c%c   Country: %c%c\n",
+		trace_dump_printf(" CorsaroTags: Netacq-Edge Continent: %c%c   Country: %c%c\n",
 				(unsigned char)(tags->netacq_continent & 0xff),
 				(unsigned char)(tags->netacq_continent >> 8),
 				(unsigned char)(tags->netacq_country & 0xff),
 				(unsigned char)(tags->netacq_country >> 8)
 		);
-                printf(" CorsaroTags: Netacq-Edge Region Code: %u\n",
+                trace_dump_printf(" CorsaroTags: Netacq-Edge Region Code: %u\n",
                                 ntohs(tags->netacq_region));
-                printf(" CorsaroTags: Netacq-Edge Polygon Ids: ");
+                trace_dump_printf(" CorsaroTags: Netacq-Edge Polygon Ids: ");
                 for (i = 0; i < MAX_NETACQ_POLYGONS; i++) {
                         uint32_t pgon = ntohl(tags->netacq_polygon[i]);
                         if ((pgon & 0x00ffffff) == 0) {
                                 break;
                         }
-                        printf("%u:%u ", (pgon >> 24), (pgon & 0x00ffffff));
+                        trace_dump_printf("%u:%u ", (pgon >> 24), (pgon & 0x00ffffff));
                 }
-                printf("\n");
+                trace_dump_printf("\n");
 
 	}
         if (prov_used & (1 << NDAG_IPMETA_PROVIDER_PFX2AS)) {
-                printf(" CorsaroTags: Source ASN: %u\n",
+                trace_dump_printf(" CorsaroTags: Source ASN: %u\n",
                                 ntohl(tags->prefixasn));
         }
 
-        printf(" CorsaroTags: Filters: ");
+        trace_dump_printf(" CorsaroTags: Filters: ");
         /* Let's just cover the high-level filters here */
-        printf("%s%s%s%s\n",
+        trace_dump_printf("%s%s%s%s\n",
                         (filterbits & 0x01) ? "Spoofed " : "Not-Spoofed ",
                         (filterbits & 0x02) ? "Erratic " : "Not-Erratic ",
                         (filterbits & 0x04) ? "Not-Routable " : "Routable ",
                         (filterbits & 0x08) ? "LSScan ": "");
 
         if (len > sizeof(corsaro_packet_tags_t)) {
-                decode_next(packet + sizeof(corsaro_packet_tags_t),
-                        len - sizeof(corsaro_packet_tags_t), "link", 2);
+                decode_next_layer(packet + sizeof(corsaro_packet_tags_t),
+                        len - sizeof(corsaro_packet_tags_t), DECODE_LAYER_LINK, 2);
         }
 }
@@ -141,7 +141,7 @@ typedef struct ieee80211_payload {
 } __attribute__ ((__packed__)) ieee80211_payload;
 
 static char *macaddr(uint8_t mac[]) {
-	static char ether_buf[18] = {0, };
+	static __thread char ether_buf[18] = {0, };
 	trace_ether_ntoa(mac, ether_buf);
 	return ether_buf;
 }
@@ -232,18 +232,18 @@ typedef struct ieee80211_ie {
 static void decode_80211_vendor_ie(ieee80211_ie *ie) {
 	uint8_t *data = (uint8_t *) ((char *)ie + sizeof(ieee80211_ie));
 	uint32_t ie_oui;	
-	printf("  Vendor Private Information Element\n");
+	trace_dump_printf("  Vendor Private Information Element\n");
 	if (ie->length <= 3) return;
 	ie_oui = (data[0] << 16) | (data[1] << 8) | data[2];
 	switch(ie_oui) {
 		case 0x0050f2:
-			printf("   Atheros 802.11i/WPA IE\n");
+			trace_dump_printf("   Atheros 802.11i/WPA IE\n");
 			break;
 		case 0x00037f:
-			printf("   Atheros Advanced Capability IE\n");
+			trace_dump_printf("   Atheros Advanced Capability IE\n");
 			break;
 		default:
-			printf("   Unknown Vendor OUI (0x%06x)\n", ie_oui);
+			trace_dump_printf("   Unknown Vendor OUI (0x%06x)\n", ie_oui);
 			break;
 	}
 
@@ -262,7 +262,7 @@ static void decode_80211_information_elements(const char *pkt, unsigned len) {
 		ie = (ieee80211_ie *) pkt;
 		
 		if ( len < ( sizeof(ieee80211_ie) + ie->length)) {
-			printf("  [Truncated]\n");
+			trace_dump_printf("  [Truncated]\n");
 			return;
 		}
 		
@@ -270,160 +270,160 @@ static void decode_80211_information_elements(const char *pkt, unsigned len) {
 		
 		switch (ie->id) {
 			case 0:
-				printf("  SSID = ");
+				trace_dump_printf("  SSID = ");
 				for (i = 0; i < ie->length; i++) 
-					printf("%c", data[i]);
-				printf("\n");
+					trace_dump_printf("%c", data[i]);
+				trace_dump_printf("\n");
 				break;
 			case 1:
-				printf("  Supported Rates (Kbit/s):\n   ");
+				trace_dump_printf("  Supported Rates (Kbit/s):\n   ");
 				/* NB: the MSB of each field will be set
 				 * if the rate it describes is part of the
 				 * basic rate set, hence the AND */
 				for (i = 0; i < ie->length; i++) {
-					printf("%u, ", 
+					trace_dump_printf("%u, ", 
 						( (data[i]&0x7F) * 500));
 
 				}
-				printf("%c%c\n", 0x8, 0x8);
+				trace_dump_printf("%c%c\n", 0x8, 0x8);
 				break;
 			case 3:
-				printf("  DSSS Channel = ");
-				printf("%u\n", *data);
+				trace_dump_printf("  DSSS Channel = ");
+				trace_dump_printf("%u\n", *data);
 				break;
 			case 5:
-				printf("  Traffic Indication Message:\n");
-				printf("   DTIM Count = %u, ", *data);
+				trace_dump_printf("  Traffic Indication Message:\n");
+				trace_dump_printf("   DTIM Count = %u, ", *data);
 				data++;
-				printf("DTIM Period = %u\n", *data);
+				trace_dump_printf("DTIM Period = %u\n", *data);
 				data++;
-				printf("   Broadcast/Multicast waiting = %s\n", 
+				trace_dump_printf("   Broadcast/Multicast waiting = %s\n", 
 					(*data) & 0x01 ? "Yes\0" : "No\0");
 				bmap_offset = ((*data) & 0xFE) >> 1;
 				data++;
 				if ((ie->length == 4) && ( *data == 0)) {
-					printf("   No traffic waiting for stations\n");
+					trace_dump_printf("   No traffic waiting for stations\n");
 					break;
 				}
 				
-				printf("   Traffic waiting for AssocIDs: ");
+				trace_dump_printf("   Traffic waiting for AssocIDs: ");
 				for (i = 0; i < (ie->length - 3); i++) {
 					int j;
 					for (j = 0; j < 8; j++) {
 						if (data[i] & (1 << j)) {
-							printf("%u ", (bmap_offset + i + 1) * 8 + j);
+							trace_dump_printf("%u ", (bmap_offset + i + 1) * 8 + j);
 						}
 					}
 				}		
-				printf("\n");
+				trace_dump_printf("\n");
 						
 				break;
 			case 7:
-				printf("  802.11d Country Information:\n");
-				printf("   ISO 3166 Country Code: %c%c\n", data[0], data[1]);
-				printf("   Regulatory Operating Environment: ");
-				if (data[2] == ' ') printf("Indoor/Outdoor\n");
-				else if (data[2] == 'O') printf("Outdoor only\n");
-				else if (data[2] == 'I') printf("Indoor only\n");
-				else printf("Unknown, code = %c\n", data[2]);
+				trace_dump_printf("  802.11d Country Information:\n");
+				trace_dump_printf("   ISO 3166 Country Code: %c%c\n", data[0], data[1]);
+				trace_dump_printf("   Regulatory Operating Environment: ");
+				if (data[2] == ' ') trace_dump_printf("Indoor/Outdoor\n");
+				else if (data[2] == 'O') trace_dump_printf("Outdoor only\n");
+				else if (data[2] == 'I') trace_dump_printf("Indoor only\n");
+				else trace_dump_printf("Unknown, code = %c\n", data[2]);
 				data += sizeof(uint8_t) * 3;
 				for (i = 0; i < ((ie->length - 3) / 3); i++) {
-					printf("   First Channel: %u, Num Channels: %u, Max Tx Power %idBm\n",
+					trace_dump_printf("   First Channel: %u, Num Channels: %u, Max Tx Power %idBm\n",
 							data[0], data[1], (int8_t) data[2]);
 					data += sizeof(uint8_t) * 3;
 				}
 				
 				break;
 			case 11:
-				printf("  802.11e QBSS Load\n");
+				trace_dump_printf("  802.11e QBSS Load\n");
 				break;
 			case 12:
-				printf("  802.11e EDCA Parameter\n");
+				trace_dump_printf("  802.11e EDCA Parameter\n");
 				break;
 			case 13:
-				printf("  802.11e TSPEC\n");
+				trace_dump_printf("  802.11e TSPEC\n");
 				break;
 			case 14:
-				printf("  802.11e TCLAS\n");
+				trace_dump_printf("  802.11e TCLAS\n");
 				break;
 			case 15:
-				printf("  802.11e Schedule\n");
+				trace_dump_printf("  802.11e Schedule\n");
 				break;
 			case 16:
-				printf("  Authentication Challenge Text\n");
+				trace_dump_printf("  Authentication Challenge Text\n");
 				break;
 			case 32:
-				printf("  802.11h Power Contraint\n");
-				printf("   Local Power Contraint = %udB\n", data[0]);
+				trace_dump_printf("  802.11h Power Contraint\n");
+				trace_dump_printf("   Local Power Contraint = %udB\n", data[0]);
 				break;
 			case 33:
-				printf("  802.11h Power Capability\n");
-				printf("   Minimum Transmit Power Capability = %idBm\n", (int8_t)data[0]);
-				printf("   Maximum Transmit Power Capability = %idBm\n", (int8_t)data[1]);
+				trace_dump_printf("  802.11h Power Capability\n");
+				trace_dump_printf("   Minimum Transmit Power Capability = %idBm\n", (int8_t)data[0]);
+				trace_dump_printf("   Maximum Transmit Power Capability = %idBm\n", (int8_t)data[1]);
 				break;
 			case 34:
-				printf("  802.11h Transmit Power Control Request\n");
+				trace_dump_printf("  802.11h Transmit Power Control Request\n");
 				break;
 			case 35:
-				printf("  802.11h Transmit Power Control Report\n");
-				printf("   Transmit Power = %idBm\n", (int8_t)data[0]);
-				printf("   Link Margin = %idB\n", (int8_t)data[1]);
+				trace_dump_printf("  802.11h Transmit Power Control Report\n");
+				trace_dump_printf("   Transmit Power = %idBm\n", (int8_t)data[0]);
+				trace_dump_printf("   Link Margin = %idB\n", (int8_t)data[1]);
 				break;
 			case 36:
-				printf("  802.11h Supported Channels\n");
+				trace_dump_printf("  802.11h Supported Channels\n");
 				for(i = 0; i < (ie->length / 2); i++) {
-					printf("   First Channel = %u, Num Channels = %u\n", data[0], data[1]);
+					trace_dump_printf("   First Channel = %u, Num Channels = %u\n", data[0], data[1]);
 					data += 2;
 				}
 				break;
 			case 37:
-				printf("  802.11h Channel Switch Announcement\n");
-				printf("   New Channel Number = %u\n", data[1]);
-				printf("   Target Beacon Transmission Times untill switch = %u\n", data[2]);
-				if (data[0]) printf("   Don't transmit more frames until switch occurs\n");
+				trace_dump_printf("  802.11h Channel Switch Announcement\n");
+				trace_dump_printf("   New Channel Number = %u\n", data[1]);
+				trace_dump_printf("   Target Beacon Transmission Times untill switch = %u\n", data[2]);
+				if (data[0]) trace_dump_printf("   Don't transmit more frames until switch occurs\n");
 				break;
 			case 38:
-				printf("  802.11h Measurement Request\n");
+				trace_dump_printf("  802.11h Measurement Request\n");
 				break;
 			case 39:
-				printf("  802.11h Measurement Report\n");
+				trace_dump_printf("  802.11h Measurement Report\n");
 				break;
 			case 40:
-				printf("  802.11h Quiet\n");
+				trace_dump_printf("  802.11h Quiet\n");
 				break;
 			case 41:
-				printf("  802.11h IBSS DFS\n");
+				trace_dump_printf("  802.11h IBSS DFS\n");
 				break;
 			case 42:
-				printf("  802.11g ERP Information\n");
-				if(data[0] & 0x80) printf("   NonERP STAs are present in this BSS\n");
-				if(data[0] & 0x40) printf("   Use Protection Mechanism\n");
-				if(data[0] & 0x20) printf("   Do not use short preamble\n");
+				trace_dump_printf("  802.11g ERP Information\n");
+				if(data[0] & 0x80) trace_dump_printf("   NonERP STAs are present in this BSS\n");
+				if(data[0] & 0x40) trace_dump_printf("   Use Protection Mechanism\n");
+				if(data[0] & 0x20) trace_dump_printf("   Do not use short preamble\n");
 				break;
 			case 43:
-				printf("  802.11e TS Delay\n");
+				trace_dump_printf("  802.11e TS Delay\n");
 				break;
 			case 44:
-				printf("  802.11e TCLAS Processing\n");
+				trace_dump_printf("  802.11e TCLAS Processing\n");
 				break;
 			case 46:
-				printf("  802.11e QoS Capability\n");
+				trace_dump_printf("  802.11e QoS Capability\n");
 				break;
 			case 48:
-				printf("  802.11i RSN:\n");
+				trace_dump_printf("  802.11i RSN:\n");
 				break;
 			case 50:
-				printf("  802.11g Extended Supported Rates (Kbit/s)\n   ");
+				trace_dump_printf("  802.11g Extended Supported Rates (Kbit/s)\n   ");
 				for(i = 0; i < ie->length; i++) 
-					printf("%u, ", data[i] * 500);
-				printf("%c%c\n", (char) 8, (char) 8);		
+					trace_dump_printf("%u, ", data[i] * 500);
+				trace_dump_printf("%c%c\n", (char) 8, (char) 8);		
 				break;
 				
 			case 221:
 				decode_80211_vendor_ie(ie);
 				break;
 			default:
-				printf("  Unknown IE Element ID, 0x%02x\n", ie->id);
+				trace_dump_printf("  Unknown IE Element ID, 0x%02x\n", ie->id);
 		}
 		len -= sizeof(ieee80211_ie) + ie->length;
 		pkt = ((char *)pkt + sizeof(ieee80211_ie) + ie->length);
@@ -433,71 +433,71 @@ static void decode_80211_information_elements(const char *pkt, unsigned len) {
 static
 void ieee80211_print_reason_code(uint16_t code) {
 	switch (code) {
-		case 0: printf("Reserved"); break;
-		case 1: printf("Unspecified Reason"); break;
-		case 2: printf("Previous authentication no longer valid"); break;
-		case 3: printf("Deauthenticated because sending station is leaving or has left IBSS or BSS"); break;
-		case 4: printf("Disassociated due to inactivity"); break;
-		case 5: printf("Disassociated because AP is unable to handle all currently associated stations"); break;
-		case 6: printf("Class 2 frame received from nonauthenticated station"); break;
-		case 7: printf("Class 3 frame received from nonassociated station"); break;
-		case 8: printf("Disassociated because AP is leaving (or has left) BSS"); break;
-		case 9: printf("Station requesting (re)association is not authenticated with responding station"); break;
-		default: printf("Unknown reason code: %u\n", code);
+		case 0: trace_dump_printf("Reserved"); break;
+		case 1: trace_dump_printf("Unspecified Reason"); break;
+		case 2: trace_dump_printf("Previous authentication no longer valid"); break;
+		case 3: trace_dump_printf("Deauthenticated because sending station is leaving or has left IBSS or BSS"); break;
+		case 4: trace_dump_printf("Disassociated due to inactivity"); break;
+		case 5: trace_dump_printf("Disassociated because AP is unable to handle all currently associated stations"); break;
+		case 6: trace_dump_printf("Class 2 frame received from nonauthenticated station"); break;
+		case 7: trace_dump_printf("Class 3 frame received from nonassociated station"); break;
+		case 8: trace_dump_printf("Disassociated because AP is leaving (or has left) BSS"); break;
+		case 9: trace_dump_printf("Station requesting (re)association is not authenticated with responding station"); break;
+		default: trace_dump_printf("Unknown reason code: %u\n", code);
 	}
 }
 
 static 
 void ieee80211_print_status_code(uint16_t code) {
 	switch (code) {
-		case 0: printf("Successful"); break;
-		case 1: printf("Unspecified failure"); break;
-		case 10: printf("Cannot support all requested capabilities in the Capability Information field"); break;
-		case 11: printf("Reassociation denied due to inablity to confirm that association exists"); break;
-		case 12: printf("Association denied due to reason outside the scope of this standard"); break;
-		case 13: printf("Responding station does not support the specified authentication algorithm"); break;
-		case 14: printf("Received an Authentication frame with authentication transaction sequence number outside of expected sequence"); break;
-		case 15: printf("Authentication rejected because of channege failure"); break;
-		case 16: printf("Authentication rejected due to timeout waiting for next frame in sequence"); break;
-		case 17: printf("Association denied because AP is unable to handle additional associated stations"); break;
-		case 18: printf("Association denied due to requesting station not supporting all of the data rates in the BSSBasicRates parameter"); break;
-		default: printf("Unknown status code: %u", code);
+		case 0: trace_dump_printf("Successful"); break;
+		case 1: trace_dump_printf("Unspecified failure"); break;
+		case 10: trace_dump_printf("Cannot support all requested capabilities in the Capability Information field"); break;
+		case 11: trace_dump_printf("Reassociation denied due to inablity to confirm that association exists"); break;
+		case 12: trace_dump_printf("Association denied due to reason outside the scope of this standard"); break;
+		case 13: trace_dump_printf("Responding station does not support the specified authentication algorithm"); break;
+		case 14: trace_dump_printf("Received an Authentication frame with authentication transaction sequence number outside of expected sequence"); break;
+		case 15: trace_dump_printf("Authentication rejected because of channege failure"); break;
+		case 16: trace_dump_printf("Authentication rejected due to timeout waiting for next frame in sequence"); break;
+		case 17: trace_dump_printf("Association denied because AP is unable to handle additional associated stations"); break;
+		case 18: trace_dump_printf("Association denied due to requesting station not supporting all of the data rates in the BSSBasicRates parameter"); break;
+		default: trace_dump_printf("Unknown status code: %u", code);
 	}
 }
 
 /* Decodes a capability info field */
 static void decode_80211_capinfo(ieee80211_capinfo *c) {
-	printf(" 802.11MAC: Capability Info:");
-	if (c->ess) printf(" ESS");
-	if (c->ibss) printf(" IBSS");
-	if (c->cf_pollable) printf(" CF-POLLABLE");
-	if (c->cf_poll_req) printf(" CF-POLL-REQ");
-	if (c->privacy) printf(" PRIVACY");
-	if (c->short_preamble) printf(" SHORT-PREAMBLE");
-	if (c->pbcc) printf (" PBCC");
-	if (c->channel_agility) printf (" CHANNEL-AGILITY");
-	if (c->spectrum_mgmt) printf( " SPECTRUM-MGMT");
-	if (c->qos) printf(" QoS");
-	if (c->short_slot_time) printf (" SHORT-SLOT-TIME");
-	if (c->apsd) printf(" APSD");
-	if (c->dsss_ofdm) printf (" DSSS-OFDM");
-	if (c->delayed_block_ack) printf(" DELAYED-BLK-ACK");
-	if (c->immediate_block_ack) printf(" IMMEDIATE-BLK-ACK");
-	printf("\n");
+	trace_dump_printf(" 802.11MAC: Capability Info:");
+	if (c->ess) trace_dump_printf(" ESS");
+	if (c->ibss) trace_dump_printf(" IBSS");
+	if (c->cf_pollable) trace_dump_printf(" CF-POLLABLE");
+	if (c->cf_poll_req) trace_dump_printf(" CF-POLL-REQ");
+	if (c->privacy) trace_dump_printf(" PRIVACY");
+	if (c->short_preamble) trace_dump_printf(" SHORT-PREAMBLE");
+	if (c->pbcc) trace_dump_printf (" PBCC");
+	if (c->channel_agility) trace_dump_printf (" CHANNEL-AGILITY");
+	if (c->spectrum_mgmt) trace_dump_printf( " SPECTRUM-MGMT");
+	if (c->qos) trace_dump_printf(" QoS");
+	if (c->short_slot_time) trace_dump_printf (" SHORT-SLOT-TIME");
+	if (c->apsd) trace_dump_printf(" APSD");
+	if (c->dsss_ofdm) trace_dump_printf (" DSSS-OFDM");
+	if (c->delayed_block_ack) trace_dump_printf(" DELAYED-BLK-ACK");
+	if (c->immediate_block_ack) trace_dump_printf(" IMMEDIATE-BLK-ACK");
+	trace_dump_printf("\n");
 }
 	
 /* Decodes a beacon (or a probe response) */
 static void decode_80211_beacon(const char *pkt, unsigned len) {
 	ieee80211_beacon *b = (ieee80211_beacon *)pkt;
 	if (len < sizeof(ieee80211_beacon)) {
-		printf(" 802.11MAC: [Truncated]\n");
+		trace_dump_printf(" 802.11MAC: [Truncated]\n");
 		return;
 	}
 	
-	printf(" 802.11MAC: Timestamp = %" PRIu64 "\n", b->ts);
-	printf(" 802.11MAC: Beacon Interval = %u\n", b->interval);
+	trace_dump_printf(" 802.11MAC: Timestamp = %" PRIu64 "\n", b->ts);
+	trace_dump_printf(" 802.11MAC: Beacon Interval = %u\n", b->interval);
 	decode_80211_capinfo(&b->capinfo);
-	printf(" 802.11MAC: Information Elements:\n");
+	trace_dump_printf(" 802.11MAC: Information Elements:\n");
 	decode_80211_information_elements((char *) pkt + sizeof(ieee80211_beacon), len - sizeof(ieee80211_beacon));		
 }
 
@@ -505,13 +505,13 @@ static void decode_80211_assoc_request(const char *pkt, unsigned len) {
 	ieee80211_assoc_req *a = (ieee80211_assoc_req *) pkt;
 	
 	if (len < sizeof(ieee80211_assoc_req)) {
-		printf(" [Truncated association request]\n");
+		trace_dump_printf(" [Truncated association request]\n");
 		return;
 	}
 
 	decode_80211_capinfo(&a->capinfo);
-	printf(" 802.11MAC: Listen Interval = %u beacon intervals\n", a->listen_interval);
-	printf(" 802.11MAC: Information Elements:\n");
+	trace_dump_printf(" 802.11MAC: Listen Interval = %u beacon intervals\n", a->listen_interval);
+	trace_dump_printf(" 802.11MAC: Information Elements:\n");
 	decode_80211_information_elements((char *)pkt + sizeof(ieee80211_assoc_req), len - sizeof(ieee80211_assoc_req));
 }
 
@@ -519,14 +519,14 @@ static void decode_80211_assoc_response(const char *pkt, unsigned len) {
 	ieee80211_assoc_resp *r = (ieee80211_assoc_resp *) pkt;
 
 	if (len < sizeof(ieee80211_assoc_resp)) {
-		printf(" [Truncated association response]\n");
+		trace_dump_printf(" [Truncated association response]\n");
 		return;
 	}
 	decode_80211_capinfo(&r->capinfo);
-	printf(" 802.11MAC: Status Code = ");
+	trace_dump_printf(" 802.11MAC: Status Code = ");
 	ieee80211_print_status_code(r->status_code);
 	/* AID has two most significant bits set to 1 */
-	printf("\n 802.11MAC: Association ID = %u\n", r->assoc_id & 0x3FFF);
+	trace_dump_printf("\n 802.11MAC: Association ID = %u\n", r->assoc_id & 0x3FFF);
 	decode_80211_information_elements((char *)pkt + sizeof(ieee80211_assoc_resp), len-sizeof(ieee80211_assoc_resp));
 }
 	
@@ -534,27 +534,27 @@ static void decode_80211_reassoc_request(const char *pkt, unsigned len) {
 	ieee80211_reassoc_req *r = (ieee80211_reassoc_req *) pkt;
 
 	if (len < sizeof(ieee80211_reassoc_req)) {
-		printf(" [Truncated reassociation request]\n");
+		trace_dump_printf(" [Truncated reassociation request]\n");
 		return;
 	}
 	decode_80211_capinfo(&r->capinfo);
-	printf(" 802.11MAC: Listen Interval = %u beacon intervals\n", r->listen_interval);
-	printf(" 802.11MAC: Current AP address = %s\n", macaddr(r->current_address));
-	printf(" 802.11MAC: Information Elements:\n");
+	trace_dump_printf(" 802.11MAC: Listen Interval = %u beacon intervals\n", r->listen_interval);
+	trace_dump_printf(" 802.11MAC: Current AP address = %s\n", macaddr(r->current_address));
+	trace_dump_printf(" 802.11MAC: Information Elements:\n");
 	decode_80211_information_elements((char *)pkt + sizeof(ieee80211_reassoc_req), len - sizeof(ieee80211_reassoc_req));
 }
 
 static void decode_80211_authentication_frame(const char *pkt, unsigned len) {
 	ieee80211_auth *auth = (ieee80211_auth *)pkt;
 	if(len < sizeof(ieee80211_auth)) {
-		printf(" [Truncated authentication frame]\n");
+		trace_dump_printf(" [Truncated authentication frame]\n");
 		return;
 	}
-	printf(" 802.11MAC: Authentication algorithm number = %u\n", auth->auth_algo_num);
-	printf(" 802.11MAC: Authentication transaction sequence number = %u\n", auth->auth_trans_seq_num);
-	printf(" 802.11MAC: Status Code = ");
+	trace_dump_printf(" 802.11MAC: Authentication algorithm number = %u\n", auth->auth_algo_num);
+	trace_dump_printf(" 802.11MAC: Authentication transaction sequence number = %u\n", auth->auth_trans_seq_num);
+	trace_dump_printf(" 802.11MAC: Status Code = ");
 	ieee80211_print_status_code(auth->status_code);
-	printf("\n 802.11MAC: Information Elements:\n");
+	trace_dump_printf("\n 802.11MAC: Information Elements:\n");
 	decode_80211_information_elements((char *)pkt + sizeof(ieee80211_auth), len - sizeof(ieee80211_auth));
 
 }
@@ -563,34 +563,34 @@ static void decode_80211_mgmt(const char *pkt, unsigned len) {
 	ieee80211_mgmt_frame *mgmt = (ieee80211_mgmt_frame *)pkt;
 	const char *data;
 	
-	printf(" 802.11MAC: Management frame: ");
+	trace_dump_printf(" 802.11MAC: Management frame: ");
 	
 	if (len < sizeof(ieee80211_mgmt_frame)) {
-		printf("[Truncated]\n");
+		trace_dump_printf("[Truncated]\n");
 		return;
 	}
 
 	switch (mgmt->ctl.subtype) {
-		case 0: printf("association request"); break;
-		case 1: printf("association response"); break;
-		case 2: printf("reassociation request"); break;
-		case 3: printf("reassociation response"); break;
-		case 4: printf("probe request"); break;
-		case 5: printf("probe response"); break;
-		case 8: printf("beacon"); break;
-		case 9: printf("ATIM"); break;
-		case 10: printf("disassociation"); break;
-		case 11: printf("authentication"); break;
-		case 12: printf("deauthentication"); break;
-		case 13: printf("action"); break;
-		default: printf("RESERVED"); break;
+		case 0: trace_dump_printf("association request"); break;
+		case 1: trace_dump_printf("association response"); break;
+		case 2: trace_dump_printf("reassociation request"); break;
+		case 3: trace_dump_printf("reassociation response"); break;
+		case 4: trace_dump_printf("probe request"); break;
+		case 5: trace_dump_printf("probe response"); break;
+		case 8: trace_dump_printf("beacon"); break;
+		case 9: trace_dump_printf("ATIM"); break;
+		case 10: trace_dump_printf("disassociation"); break;
+		case 11: trace_dump_printf("authentication"); break;
+		case 12: trace_dump_printf("deauthentication"); break;
+		case 13: trace_dump_printf("action"); break;
+		default: trace_dump_printf("RESERVED"); break;
 	}
 	
-	printf("\n 802.11MAC: Duration = %u us\n", mgmt->duration);
-	printf(" 802.11MAC: DA       = %s\n", macaddr(mgmt->addr1));
-	printf(" 802.11MAC: SA       = %s\n", macaddr(mgmt->addr2));
-	printf(" 802.11MAC: BSSID    = %s\n", macaddr(mgmt->addr3));
-	printf(" 802.11MAC: fragment no. = %u, sequence no. = %u\n",
+	trace_dump_printf("\n 802.11MAC: Duration = %u us\n", mgmt->duration);
+	trace_dump_printf(" 802.11MAC: DA       = %s\n", macaddr(mgmt->addr1));
+	trace_dump_printf(" 802.11MAC: SA       = %s\n", macaddr(mgmt->addr2));
+	trace_dump_printf(" 802.11MAC: BSSID    = %s\n", macaddr(mgmt->addr3));
+	trace_dump_printf(" 802.11MAC: fragment no. = %u, sequence no. = %u\n",
 			(mgmt->seq_ctrl & 0x000F) ,
 			(mgmt->seq_ctrl & 0xFFF0) >> 4);
 
@@ -620,9 +620,9 @@ static void decode_80211_mgmt(const char *pkt, unsigned len) {
 			break;
 		case 10:
 			data = (pkt + sizeof(ieee80211_mgmt_frame));
-			printf(" 802.11MAC: Reason Code = ");
+			trace_dump_printf(" 802.11MAC: Reason Code = ");
 			ieee80211_print_reason_code((uint16_t) ((data[0] << 8) | (data[1])));
-			printf("\n");
+			trace_dump_printf("\n");
 			break;
 						    
 		case 11:
@@ -630,83 +630,83 @@ static void decode_80211_mgmt(const char *pkt, unsigned len) {
 			break;
 		case 12:
 			data = (pkt + sizeof(ieee80211_mgmt_frame));
-			printf(" 802.11MAC: Reason Code = ");
+			trace_dump_printf(" 802.11MAC: Reason Code = ");
 			ieee80211_print_reason_code((uint16_t) ((data[0] << 8) | (data[1])));
-			printf("\n");
+			trace_dump_printf("\n");
 			break;
 		default:
-			printf(" 802.11MAC: Subtype %u decoder not implemented\n", mgmt->ctl.subtype);
+			trace_dump_printf(" 802.11MAC: Subtype %u decoder not implemented\n", mgmt->ctl.subtype);
 	}
 
-	printf("\n");
+	trace_dump_printf("\n");
 
 }
 
 static void decode_80211_ctrl(const char *pkt, unsigned len) {
 	ieee80211_ctrl_frame_1addr *ctrl1 = (ieee80211_ctrl_frame_1addr *) pkt;
 	ieee80211_ctrl_frame_2addr *ctrl2 = (ieee80211_ctrl_frame_2addr *) pkt;
-	printf(" 802.11MAC: Control frame: ");
+	trace_dump_printf(" 802.11MAC: Control frame: ");
 	
 	if (len < sizeof(ieee80211_ctrl_frame_1addr)) {
-		printf("[Truncated]\n");
+		trace_dump_printf("[Truncated]\n");
 		return;
 	}
 	
 	switch (ctrl1->ctl.subtype) {
 		case 8: 
-			printf("BlockAckReq\n"); 
+			trace_dump_printf("BlockAckReq\n"); 
 			break;
 		case 9: 
-			printf("BlockAck\n"); 
+			trace_dump_printf("BlockAck\n"); 
 			break;
 		case 10: 
-			printf("PS-Poll\n"); 
-			printf(" 802.11MAC: AID = 0x%04x\n", ntohs(ctrl1->duration));
-			printf(" 802.11MAC: BSSID = %s\n", macaddr(ctrl1->addr1));
+			trace_dump_printf("PS-Poll\n"); 
+			trace_dump_printf(" 802.11MAC: AID = 0x%04x\n", ntohs(ctrl1->duration));
+			trace_dump_printf(" 802.11MAC: BSSID = %s\n", macaddr(ctrl1->addr1));
 			break;
 		case 11:
-			printf("RTS\n");
+			trace_dump_printf("RTS\n");
  
 			if (len < sizeof(ieee80211_ctrl_frame_2addr)) {
-				printf("[Truncated]\n");
+				trace_dump_printf("[Truncated]\n");
 				return;
 			}
 
-			printf(" 802.11MAC: RA = %s\n", macaddr(ctrl2->addr1));
-			printf(" 802.11MAC: TA = %s\n", macaddr(ctrl2->addr2));
+			trace_dump_printf(" 802.11MAC: RA = %s\n", macaddr(ctrl2->addr1));
+			trace_dump_printf(" 802.11MAC: TA = %s\n", macaddr(ctrl2->addr2));
 			break;
 		case 12: 
-			printf("CTS\n"); 
-			printf(" 802.11MAC: RA = %s\n", macaddr(ctrl1->addr1));
+			trace_dump_printf("CTS\n"); 
+			trace_dump_printf(" 802.11MAC: RA = %s\n", macaddr(ctrl1->addr1));
 			break;
 		case 13:
-			printf("ACK\n"); 
-			printf(" 802.11MAC: RA = %s\n", macaddr(ctrl1->addr1));
+			trace_dump_printf("ACK\n"); 
+			trace_dump_printf(" 802.11MAC: RA = %s\n", macaddr(ctrl1->addr1));
 			break;
 		case 14:
-			printf("CF-End\n"); 
+			trace_dump_printf("CF-End\n"); 
 
 			if (len < sizeof(ieee80211_ctrl_frame_2addr)) {
-				printf("[Truncated]\n");
+				trace_dump_printf("[Truncated]\n");
 				return;
 			}
 
-			printf(" 802.11MAC: RA = %s\n", macaddr(ctrl2->addr1));
-			printf(" 802.11MAC: BSSID = %s\n", macaddr(ctrl2->addr2));
+			trace_dump_printf(" 802.11MAC: RA = %s\n", macaddr(ctrl2->addr1));
+			trace_dump_printf(" 802.11MAC: BSSID = %s\n", macaddr(ctrl2->addr2));
 			break;
 		case 15:
-			printf("CF-End + CF-Ack\n"); 
+			trace_dump_printf("CF-End + CF-Ack\n"); 
 
 			if (len < sizeof(ieee80211_ctrl_frame_2addr)) {
-				printf("[Truncated]\n");
+				trace_dump_printf("[Truncated]\n");
 				return;
 			}
 
-			printf(" 802.11MAC: RA = %s\n", macaddr(ctrl2->addr1));
-			printf(" 802.11MAC: BSSID = %s\n", macaddr(ctrl2->addr2));
+			trace_dump_printf(" 802.11MAC: RA = %s\n", macaddr(ctrl2->addr1));
+			trace_dump_printf(" 802.11MAC: BSSID = %s\n", macaddr(ctrl2->addr2));
 			break;
 		default:
-			printf("RESERVED"); 
+			trace_dump_printf("RESERVED"); 
 			break;
 	}
 
@@ -718,69 +718,69 @@ static void decode_80211_data(const char *pkt, unsigned len) {
 	ieee80211_payload *pld; 
 	uint32_t hdrlen = 0;
 	
-	printf(" 802.11MAC: Data frame: ");
+	trace_dump_printf(" 802.11MAC: Data frame: ");
 	
 	if (len < sizeof(ieee80211_data_frame_3)) {
-		printf("[Truncated]\n");
+		trace_dump_printf("[Truncated]\n");
 		return;
 	}
 
 	switch (data->ctl.subtype) {
-		case 0: printf("Data"); break;
-		case 1: printf("Data + CF-Ack"); break;
-		case 2: printf("Data + CF-Poll"); break;
-		case 3: printf("Data + CF-Ack + CF-Poll"); break;
-		case 4: printf("Null (no data)"); break;
-		case 5: printf("CF-Ack (no data)"); break;
-		case 6: printf("CF-Poll (no data)"); break;
-		case 7: printf("CF-Ack + CF-Poll (no data)"); break;
-		case 8: printf("QoS Data"); break;
-		case 9: printf("QoS Data + CF-Ack"); break;
-		case 10: printf("QoS Data + CF-Poll"); break;
-		case 11: printf("QoS Data + CF-Ack + CF-Poll"); break;
-		case 12: printf("QoS Null (no data)"); break;
+		case 0: trace_dump_printf("Data"); break;
+		case 1: trace_dump_printf("Data + CF-Ack"); break;
+		case 2: trace_dump_printf("Data + CF-Poll"); break;
+		case 3: trace_dump_printf("Data + CF-Ack + CF-Poll"); break;
+		case 4: trace_dump_printf("Null (no data)"); break;
+		case 5: trace_dump_printf("CF-Ack (no data)"); break;
+		case 6: trace_dump_printf("CF-Poll (no data)"); break;
+		case 7: trace_dump_printf("CF-Ack + CF-Poll (no data)"); break;
+		case 8: trace_dump_printf("QoS Data"); break;
+		case 9: trace_dump_printf("QoS Data + CF-Ack"); break;
+		case 10: trace_dump_printf("QoS Data + CF-Poll"); break;
+		case 11: trace_dump_printf("QoS Data + CF-Ack + CF-Poll"); break;
+		case 12: trace_dump_printf("QoS Null (no data)"); break;
 			 /* subtype 13 is reserved */
-		case 14: printf("QoS CF-Poll (no data)"); break;
-		case 15: printf("Qos CF-Ack + CF-Poll (no data)"); break;
+		case 14: trace_dump_printf("QoS CF-Poll (no data)"); break;
+		case 15: trace_dump_printf("Qos CF-Ack + CF-Poll (no data)"); break;
 
-		default: printf("RESERVED"); break;
+		default: trace_dump_printf("RESERVED"); break;
 	}
 
-	printf("\n 802.11MAC: duration = %u us\n", data->duration);
-	printf(" 802.11MAC: fragment no. = %u, sequence no. = %u\n",
+	trace_dump_printf("\n 802.11MAC: duration = %u us\n", data->duration);
+	trace_dump_printf(" 802.11MAC: fragment no. = %u, sequence no. = %u\n",
 			(data->seq_ctrl & 0x000F) ,
 			(data->seq_ctrl & 0xFFF0) >> 4);
 
 	hdrlen = sizeof(ieee80211_data_frame_3);
 	
 	if (! data->ctl.from_ds && ! data->ctl.to_ds) {
-		printf(" 802.11MAC: DA      = %s\n", macaddr(data->addr1));
-		printf(" 802.11MAC: SA      = %s\n", macaddr(data->addr2));
-		printf(" 802.11MAC: BSSID   = %s\n", macaddr(data->addr3));
+		trace_dump_printf(" 802.11MAC: DA      = %s\n", macaddr(data->addr1));
+		trace_dump_printf(" 802.11MAC: SA      = %s\n", macaddr(data->addr2));
+		trace_dump_printf(" 802.11MAC: BSSID   = %s\n", macaddr(data->addr3));
 	} else if ( ! data->ctl.from_ds && data->ctl.to_ds) {
-		printf(" 802.11MAC: DA      = %s\n", macaddr(data->addr3));
-		printf(" 802.11MAC: SA      = %s\n", macaddr(data->addr2));
-		printf(" 802.11MAC: BSSID   = %s\n", macaddr(data->addr1));
+		trace_dump_printf(" 802.11MAC: DA      = %s\n", macaddr(data->addr3));
+		trace_dump_printf(" 802.11MAC: SA      = %s\n", macaddr(data->addr2));
+		trace_dump_printf(" 802.11MAC: BSSID   = %s\n", macaddr(data->addr1));
 	} else if ( data->ctl.from_ds && ! data->ctl.to_ds) {
-		printf(" 802.11MAC: DA      = %s\n", macaddr(data->addr1));
-		printf(" 802.11MAC: SA      = %s\n", macaddr(data->addr3));
-		printf(" 802.11MAC: BSSID   = %s\n", macaddr(data->addr2));
+		trace_dump_printf(" 802.11MAC: DA      = %s\n", macaddr(data->addr1));
+		trace_dump_printf(" 802.11MAC: SA      = %s\n", macaddr(data->addr3));
+		trace_dump_printf(" 802.11MAC: BSSID   = %s\n", macaddr(data->addr2));
 	} else {
 		/* Check to make sure we have a four-address frame first */
 		if (len < sizeof(ieee80211_data_frame)) {
-			printf(" 802.11MAC: [Truncated]\n");
+			trace_dump_printf(" 802.11MAC: [Truncated]\n");
 			return;
 		}
-		printf(" 802.11MAC: DA      = %s\n", macaddr(data->addr3));
-		printf(" 802.11MAC: SA      = %s\n", macaddr(data->addr4));
-		printf(" 802.11MAC: TA      = %s\n", macaddr(data->addr2));
-		printf(" 802.11MAC: RA      = %s\n", macaddr(data->addr1));
+		trace_dump_printf(" 802.11MAC: DA      = %s\n", macaddr(data->addr3));
+		trace_dump_printf(" 802.11MAC: SA      = %s\n", macaddr(data->addr4));
+		trace_dump_printf(" 802.11MAC: TA      = %s\n", macaddr(data->addr2));
+		trace_dump_printf(" 802.11MAC: RA      = %s\n", macaddr(data->addr1));
 		hdrlen = sizeof(ieee80211_data_frame); /* 4 addr header */
 	}
 
 
 	if (data->ctl.subtype >= 8) { 
-		printf(" 802.11e: QoS = 0x%04x\n", qos->qos);
+		trace_dump_printf(" 802.11e: QoS = 0x%04x\n", qos->qos);
 		if (len > sizeof(ieee80211_qos_data_frame)) 
 			hdrlen = sizeof(ieee80211_qos_data_frame);
 	}
@@ -792,18 +792,18 @@ static void decode_80211_data(const char *pkt, unsigned len) {
 		if (ntohs(pld->ethertype) == 0xaaaa) {
 			/* 802.11 payload contains an 802.2 LLC/SNAP header */
 			libtrace_llcsnap_t *llcsnap = (libtrace_llcsnap_t *) pld;
-			printf(" 802.2: DSAP = 0x%x, SSAP = 0x%x, OUI = 0x%x, Type = 0x%x\n", 
+			trace_dump_printf(" 802.2: DSAP = 0x%x, SSAP = 0x%x, OUI = 0x%x, Type = 0x%x\n", 
 					llcsnap->dsap, llcsnap->ssap, llcsnap->oui, ntohs(llcsnap->type));
 			payload_offset = sizeof(libtrace_llcsnap_t);
 			ethertype = ntohs(llcsnap->type);
 		} else {
 			/* 802.11 payload contains an Ethernet II frame */
-			printf(" 802.11MAC: Payload ethertype = 0x%04x\n", ntohs(pld->ethertype));
+			trace_dump_printf(" 802.11MAC: Payload ethertype = 0x%04x\n", ntohs(pld->ethertype));
 			payload_offset = sizeof(pld->ethertype);
 			ethertype = ntohs(pld->ethertype);
 		}
-		decode_next((char *) pkt + hdrlen + payload_offset, 
-				len - hdrlen - payload_offset, "eth", ethertype);
+		decode_next_layer((char *) pkt + hdrlen + payload_offset, 
+				len - hdrlen - payload_offset, DECODE_LAYER_ETH, ethertype);
 	}
 
 	
@@ -814,27 +814,27 @@ DLLEXPORT void decode(int link_type UNUSED, const char *pkt, unsigned len)
 	ieee80211_frame_control *fc;
 	
 	if (len < sizeof(ieee80211_frame_control)) {
-		printf(" 802.11MAC: Truncated at frame control field\n");
+		trace_dump_printf(" 802.11MAC: Truncated at frame control field\n");
 		return;
 	}
 
 	fc = (ieee80211_frame_control *) pkt;	
 
-	printf(" 802.11MAC: ");
+	trace_dump_printf(" 802.11MAC: ");
 
-	printf("proto = %d, type = %d, subtype = %d, ", fc->version, fc->type, fc->subtype);
+	trace_dump_printf("proto = %d, type = %d, subtype = %d, ", fc->version, fc->type, fc->subtype);
 
-	printf("flags =");
-	if (fc->to_ds) printf(" toDS");
-	if (fc->from_ds) printf(" fromDS");
-	if (fc->more_frag) printf(" moreFrag");
-	if (fc->retry) printf(" retry");
-	if (fc->power) printf(" pwrMgmt");
-	if (fc->more_data) printf(" moreData");
-	if (fc->wep) printf(" WEP");
-	if (fc->order) printf(" order");
+	trace_dump_printf("flags =");
+	if (fc->to_ds) trace_dump_printf(" toDS");
+	if (fc->from_ds) trace_dump_printf(" fromDS");
+	if (fc->more_frag) trace_dump_printf(" moreFrag");
+	if (fc->retry) trace_dump_printf(" retry");
+	if (fc->power) trace_dump_printf(" pwrMgmt");
+	if (fc->more_data) trace_dump_printf(" moreData");
+	if (fc->wep) trace_dump_printf(" WEP");
+	if (fc->order) trace_dump_printf(" order");
 
-	printf("\n");
+	trace_dump_printf("\n");
 	switch (fc->type) {
 		case 0:
 			decode_80211_mgmt(pkt, len);
@@ -846,8 +846,8 @@ DLLEXPORT void decode(int link_type UNUSED, const char *pkt, unsigned len)
 			decode_80211_data(pkt, len);
 			break;
 		case 3:
-			printf(" Unable to decode frame type %u, dumping rest of packet\n", fc->type);
-			decode_next(pkt + sizeof(ieee80211_frame_control), len - sizeof(ieee80211_frame_control), "unknown", 0);
+			trace_dump_printf(" Unable to decode frame type %u, dumping rest of packet\n", fc->type);
+			decode_next_layer(pkt + sizeof(ieee80211_frame_control), len - sizeof(ieee80211_frame_control), DECODE_LAYER_UNKNOWN, 0);
 			
 			break;
 	}
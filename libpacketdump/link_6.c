@@ -50,7 +50,7 @@ static libtrace_linktype_t arphrd_type_to_libtrace(unsigned int arphrd) {
                 case LIBTRACE_ARPHRD_LOOPBACK: return TRACE_TYPE_NONE;
                 case LIBTRACE_ARPHRD_NONE: return TRACE_TYPE_NONE;
         }
-	printf("Unknown ARPHRD: %u\n", arphrd);
+	trace_dump_printf("Unknown ARPHRD: %u\n", arphrd);
 	return ~0U;
 }
 
@@ -58,28 +58,29 @@ DLLEXPORT void decode(int link_type ,const char *pkt,unsigned len)
 {
 	libtrace_sll_header_t *sll = (libtrace_sll_header_t *) pkt;
 	libtrace_linktype_t linktype = link_type;
+	char ether_buf[18] = {0, };
 	void *ret;	
 
 	if (len < sizeof(*sll)) {
-		printf(" Linux SLL: Truncated (len = %u)\n", len);
+		trace_dump_printf(" Linux SLL: Truncated (len = %u)\n", len);
 		return;
 	}
 
-	printf(" Linux SLL: Packet Type = ");
+	trace_dump_printf(" Linux SLL: Packet Type = ");
 	switch(ntohs(sll->pkttype)) {
-		case TRACE_SLL_HOST: printf("HOST\n"); break;
-		case TRACE_SLL_BROADCAST: printf("BROADCAST\n"); break;
-		case TRACE_SLL_MULTICAST: printf("MULTICAST\n"); break;
-		case TRACE_SLL_OTHERHOST: printf("OTHERHOST\n"); break;
-		case TRACE_SLL_OUTGOING: printf("OUTGOING\n"); break;
-		default: printf("Unknown (0x%04x)\n", ntohs(sll->pkttype));
+		case TRACE_SLL_HOST: trace_dump_printf("HOST\n"); break;
+		case TRACE_SLL_BROADCAST: trace_dump_printf("BROADCAST\n"); break;
+		case TRACE_SLL_MULTICAST: trace_dump_printf("MULTICAST\n"); break;
+		case TRACE_SLL_OTHERHOST: trace_dump_printf("OTHERHOST\n"); break;
+		case TRACE_SLL_OUTGOING: trace_dump_printf("OUTGOING\n"); break;
+		default: trace_dump_printf("Unknown (0x%04x)\n", ntohs(sll->pkttype));
 	}
 	
-	printf(" Linux SLL: Hardware Address Type = 0x%04x\n", ntohs(sll->hatype));
-	printf(" Linux SLL: Hardware Address Length = %u\n", ntohs(sll->halen));
-	printf(" Linux SLL: Hardware Address = %s\n", trace_ether_ntoa( (sll->addr), NULL));
+	trace_dump_printf(" Linux SLL: Hardware Address Type = 0x%04x\n", ntohs(sll->hatype));
+	trace_dump_printf(" Linux SLL: Hardware Address Length = %u\n", ntohs(sll->halen));
+	trace_dump_printf(" Linux SLL: Hardware Address = %s\n", trace_ether_ntoa( (sll->addr), ether_buf));
 
-	printf(" Linux SLL: Protocol = 0x%04x\n", ntohs(sll->protocol));
+	trace_dump_printf(" Linux SLL: Protocol = 0x%04x\n", ntohs(sll->protocol));
 
 	/* Decide how to continue processing... */
 	
@@ -90,15 +91,15 @@ DLLEXPORT void decode(int link_type ,const char *pkt,unsigned len)
 				ntohs(sll->hatype) == LIBTRACE_ARPHRD_LOOPBACK) { 
 		
 		if (ntohs(sll->protocol) == 0x0060) {
-			decode_next(ret, len, "link", 
+			decode_next_layer(ret, len, DECODE_LAYER_LINK, 
 				arphrd_type_to_libtrace(ntohs(sll->hatype)));
 		}
 		else if (ret) {
-			decode_next(ret, len, "eth", ntohs(sll->protocol));
+			decode_next_layer(ret, len, DECODE_LAYER_ETH, ntohs(sll->protocol));
                 }
 	}
 	else {
-		decode_next(ret, len, "link", 
+		decode_next_layer(ret, len, DECODE_LAYER_LINK, 
 				arphrd_type_to_libtrace(ntohs(sll->hatype)));
 	}
 	return;
@@ -44,23 +44,23 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 {
 	libtrace_hdlc_t *frame = (libtrace_hdlc_t *)packet;
 
-	printf(" PPP:");
+	trace_dump_printf(" PPP:");
 	if (len >= 1)
-		printf(" Address: 0x%02x", frame->address);
+		trace_dump_printf(" Address: 0x%02x", frame->address);
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	
 	if (len >= 2)
-		printf(" Control: 0x%02x", frame->control);
+		trace_dump_printf(" Control: 0x%02x", frame->control);
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	
 	if (len >= 4) {
-		printf(" Protocol: 0x%04x\n", ntohs(frame->protocol));
+		trace_dump_printf(" Protocol: 0x%04x\n", ntohs(frame->protocol));
 		
 		/* PPP protocols do not match ethertypes, so we have to
 		 * convert
@@ -69,11 +69,11 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len)
 		 * done generically 
 		 */
 		if (ntohs(frame->protocol) == 0x0021) {
-			decode_next(packet + 4, len - 4, "eth", 0x0800);
+			decode_next_layer(packet + 4, len - 4, DECODE_LAYER_ETH, 0x0800);
 		} 
 	}
 	else {
-		printf("[|Truncated]\n");
+		trace_dump_printf("[|Truncated]\n");
 		return;
 	}
 	
@@ -38,57 +38,57 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len) {
 
 	if (len < 4) 
 		return;
-	printf(" OSPF Hello: Network Mask %s\n", inet_ntoa(hello->mask));
+	trace_dump_printf(" OSPF Hello: Network Mask %s\n", inet_ntoa(hello->mask));
 	if (len < 6)
 		return;
 
-	printf(" OSPF Hello: Interval %u ", ntohs(hello->interval));
+	trace_dump_printf(" OSPF Hello: Interval %u ", ntohs(hello->interval));
 
 	if (len < 7) {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
 
-	printf("Options ");
+	trace_dump_printf("Options ");
 
 	if (hello->hello_options.e_bit)
-		printf("E ");
+		trace_dump_printf("E ");
 	if (hello->hello_options.mc_bit)
-		printf("MC ");
+		trace_dump_printf("MC ");
 	if (hello->hello_options.np_bit)
-		printf("N/P ");
+		trace_dump_printf("N/P ");
 	if (hello->hello_options.ea_bit)
-		printf("EA ");
+		trace_dump_printf("EA ");
 	if (hello->hello_options.dc_bit)
-		printf("DC ");
-	printf("\n");
+		trace_dump_printf("DC ");
+	trace_dump_printf("\n");
 
 	if (len < 8) 
 		return;
 
-	printf(" OSPF Hello: Priority %u ", hello->priority);
+	trace_dump_printf(" OSPF Hello: Priority %u ", hello->priority);
 	
 	if (len < 12) {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
 
-	printf("Dead Interval %u\n", ntohl(hello->deadint));
+	trace_dump_printf("Dead Interval %u\n", ntohl(hello->deadint));
 	
 	if (len < 16) 
 		return;
 
-	printf(" OSPF Hello: Designated Router %s\n", inet_ntoa(hello->designated));
+	trace_dump_printf(" OSPF Hello: Designated Router %s\n", inet_ntoa(hello->designated));
 
 	if (len < 20)
 		return;
 
-	printf(" OSPF Hello: Backup Designated Router %s\n", inet_ntoa(hello->backup));
+	trace_dump_printf(" OSPF Hello: Backup Designated Router %s\n", inet_ntoa(hello->backup));
 
 	neigh = (struct in_addr *)(packet + sizeof(libtrace_ospf_hello_v2_t));
 	len -= sizeof(libtrace_ospf_hello_v2_t);
 	while (len >= 4) {
-		printf(" OSPF Hello: Neighbour %s\n", inet_ntoa(*neigh));
+		trace_dump_printf(" OSPF Hello: Neighbour %s\n", inet_ntoa(*neigh));
 		neigh++;
 		len -= sizeof(struct in_addr);
 	}
@@ -38,75 +38,75 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len) {
 
 	if (len < 2)
 		return;
-	printf(" OSPF LSA: Age %u ", ntohs(lsa->age));	
+	trace_dump_printf(" OSPF LSA: Age %u ", ntohs(lsa->age));	
 
 	if (len < 3)
 		return;
-	printf("Options ");
+	trace_dump_printf("Options ");
 
 	if (lsa->lsa_options.e_bit)
-		printf("E ");
+		trace_dump_printf("E ");
 	if (lsa->lsa_options.mc_bit)
-		printf("MC ");
+		trace_dump_printf("MC ");
 	if (lsa->lsa_options.np_bit)
-		printf("N/P ");
+		trace_dump_printf("N/P ");
 	if (lsa->lsa_options.ea_bit)
-		printf("EA ");
+		trace_dump_printf("EA ");
 	if (lsa->lsa_options.dc_bit)
-		printf("DC ");
-	printf("\n");
+		trace_dump_printf("DC ");
+	trace_dump_printf("\n");
 
 	if (len < 4)
 		return;
-	printf(" OSPF LSA: LS Type %u ", lsa->lsa_type);
+	trace_dump_printf(" OSPF LSA: LS Type %u ", lsa->lsa_type);
 	switch(lsa->lsa_type) {
 		case 1:
-			printf("(Router LSA)\n");
+			trace_dump_printf("(Router LSA)\n");
 			break;
 		case 2:
-			printf("(Network LSA)\n");
+			trace_dump_printf("(Network LSA)\n");
 			break;
 		case 3:
-			printf("(Summary LSA - IP)\n");
+			trace_dump_printf("(Summary LSA - IP)\n");
 			break;
 		case 4:
-			printf("(Summary LSA - ASBR)\n");
+			trace_dump_printf("(Summary LSA - ASBR)\n");
 			break;
 		case 5:
-			printf("(AS External LSA)\n");
+			trace_dump_printf("(AS External LSA)\n");
 			break;
 		default:
-			printf("(Unknown)\n");
+			trace_dump_printf("(Unknown)\n");
 	}
 	
 	if (len < 8)
 		return;
 	
-	printf(" OSPF LSA: Link State ID %s ", inet_ntoa(lsa->ls_id));
+	trace_dump_printf(" OSPF LSA: Link State ID %s ", inet_ntoa(lsa->ls_id));
 
 	if (len < 12) {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
 
-	printf("Advertising Router %s\n", inet_ntoa(lsa->adv_router));
+	trace_dump_printf("Advertising Router %s\n", inet_ntoa(lsa->adv_router));
 
 	if (len < 16)
 		return;
 
-	printf(" OSPF LSA: Seq %u ", ntohl(lsa->seq));
+	trace_dump_printf(" OSPF LSA: Seq %u ", ntohl(lsa->seq));
 
 	if (len < 18) {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
 
-	printf("Checksum %u ", ntohs(lsa->checksum));
+	trace_dump_printf("Checksum %u ", ntohs(lsa->checksum));
 
 	if (len < 20) {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
 
-	printf("Length %u \n", ntohs(lsa->length));
+	trace_dump_printf("Length %u \n", ntohs(lsa->length));
 }
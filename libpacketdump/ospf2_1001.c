@@ -43,14 +43,14 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len) {
 	if (len < 4)
 		return;
 	
-	printf(" OSPF Router LSA: Links %u ", ntohs(hdr->num_links));
+	trace_dump_printf(" OSPF Router LSA: Links %u ", ntohs(hdr->num_links));
 	if (hdr->v)
-		printf("V ");
+		trace_dump_printf("V ");
 	if (hdr->e) 
-		printf("E ");
+		trace_dump_printf("E ");
 	if (hdr->b)
-		printf("B ");
-	printf("\n");
+		trace_dump_printf("B ");
+	trace_dump_printf("\n");
 
 	link_ptr = trace_get_first_ospf_link_from_router_lsa_v2(hdr, &len);
 
@@ -60,9 +60,9 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len) {
 		if (!link) {
 			break;
 		}
-		printf(" OSPF Router Link: Id %s ", inet_ntoa(link->link_id));
-		printf("Data %s\n", inet_ntoa(link->link_data));
-		printf(" OSPF Router Link: Type %u TOS %u Metric %u\n",
+		trace_dump_printf(" OSPF Router Link: Id %s ", inet_ntoa(link->link_id));
+		trace_dump_printf("Data %s\n", inet_ntoa(link->link_data));
+		trace_dump_printf(" OSPF Router Link: Type %u TOS %u Metric %u\n",
 				link->type, link->num_tos,
 				ntohs(link->tos_metric));
 		i++;
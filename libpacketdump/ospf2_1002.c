@@ -38,14 +38,14 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len) {
 
 	if (len < 4)
 		return;
-	printf(" OSPF Network LSA: Netmask %s\n", inet_ntoa(net->netmask));
+	trace_dump_printf(" OSPF Network LSA: Netmask %s\n", inet_ntoa(net->netmask));
 
 	router = (struct in_addr *)(packet + sizeof(libtrace_ospf_network_lsa_v2_t));
 	len -= sizeof(libtrace_ospf_network_lsa_v2_t);
 
 	while (len >= sizeof(struct in_addr)) {
 
-		printf("OSPF Network LSA: Attached Router %s\n", 
+		trace_dump_printf("OSPF Network LSA: Attached Router %s\n", 
 				inet_ntoa(*router));
 		router ++;
 		len -= sizeof(struct in_addr);
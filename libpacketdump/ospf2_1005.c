@@ -37,26 +37,26 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len) {
 	if (len < 4)
 		return;
 	
-	printf (" OSPF AS External LSA: Netmask %s ", inet_ntoa(as->netmask));
+	trace_dump_printf (" OSPF AS External LSA: Netmask %s ", inet_ntoa(as->netmask));
 
 	if (len < 8) {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
 	
-	printf( "Metric %u\n", trace_get_ospf_metric_from_as_external_lsa_v2(as));
+	trace_dump_printf( "Metric %u\n", trace_get_ospf_metric_from_as_external_lsa_v2(as));
 
 	if (len < 12)
 		return;
 	
-	printf(" OSPF AS External LSA: Forwarding %s ", inet_ntoa(as->forwarding));
+	trace_dump_printf(" OSPF AS External LSA: Forwarding %s ", inet_ntoa(as->forwarding));
 
 	if (len < 16) {
-		printf("\n");
+		trace_dump_printf("\n");
 		return;
 	}
 	
-	printf("External Tag %u\n", ntohl(as->external_tag));
+	trace_dump_printf("External Tag %u\n", ntohl(as->external_tag));
 
 }
 
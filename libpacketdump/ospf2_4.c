@@ -46,7 +46,7 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len) {
 	if (len < 4)
 		return;
 	max_lsas = ntohl(update->ls_num_adv);
-	printf(" OSPF LS Update: LSAs %u\n", max_lsas);
+	trace_dump_printf(" OSPF LS Update: LSAs %u\n", max_lsas);
 	
 
 	lsa_ptr = trace_get_first_ospf_lsa_from_update_v2(update, &rem);
@@ -60,13 +60,13 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len) {
 		i ++;
 		if (lsa_hdr) {
 
-			decode_next((char *)lsa_hdr, lsa_length, "ospf2", 1000);
+			decode_next_layer((char *)lsa_hdr, lsa_length, DECODE_LAYER_OSPF2, 1000);
 		}	
 
 		if (lsa_body) {
-			decode_next((char *)lsa_body, lsa_length - 
+			decode_next_layer((char *)lsa_body, lsa_length - 
 					sizeof(libtrace_ospf_lsa_v2_t),
-					"ospf2",
+					DECODE_LAYER_OSPF2,
 					1000 + lsa_type);
 		}
 
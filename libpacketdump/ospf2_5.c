@@ -44,7 +44,7 @@ DLLEXPORT void decode(int link_type UNUSED,const char *packet,unsigned len) {
                        	&rem, &lsa_type, &lsa_length) > 0) {
 
 		if (lsa_hdr) {
-			decode_next((char *)lsa_hdr, lsa_length, "ospf2", 1000);
+			decode_next_layer((char *)lsa_hdr, lsa_length, DECODE_LAYER_OSPF2, 1000);
 		}
 
 		/* These packets contain LSA headers only so don't try to
@@ -96,6 +96,7 @@ nextfile:   TOK_NEXT identifier identifier {
 		element_t *el;
 	        next_t *nextheader = (next_t *)malloc(sizeof(next_t)); 
 		nextheader->prefix = $2;
+		nextheader->layer = decode_layer_id($2);
 		nextheader->fieldname = $3;
 		nextheader->target = NULL;
 		
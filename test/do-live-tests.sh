@@ -112,12 +112,21 @@ do
 	do
 		do_test ./test-live "$w" "$r"
 		do_test ./test-live-snaplen "$w" "$r"
+		do_test ./test-ring-blocks "$w" "$r"
 	done
 done
 for w in "${dag_formats[@]}"
 do
 	do_test_dag ./test-live-dag "$w" "$w"
 done
+# Forwards between two pcap file vdevs, so it doesn't need veth0/veth1
+for w in "${write_formats[@]}"
+do
+	if [[ $w == dpdkvdev:* ]]; then
+		do_test ./test-dpdk-vdev
+		break
+	fi
+done
 
 echo
 echo "Single threaded API tests passed: $OK"
@@ -44,12 +44,18 @@ do_test ./test-format-parallel -r legacypos
 echo \* Read tsh
 do_test ./test-format-parallel -r tsh
 
+echo \* Read merge
+do_test ./test-format-parallel -r merge -c 200
+
 echo \* Read rawerf
 do_test ./test-format-parallel -r rawerf
 
 echo \* Read pcapng
 do_test ./test-format-parallel -r pcapng
 
+echo \* Read pcapngfile
+do_test ./test-format-parallel -m -r pcapngfile
+
 echo \* Read etsilive
 if command -v socat > /dev/null
 then
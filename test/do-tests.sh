@@ -356,6 +356,45 @@ do_test ./test-qinq
 echo " * Test structures"
 do_test ./test-structures
 
+echo " * Merge several traces"
+do_test ./test-merge
+
+echo " * Write packets in batches"
+do_test ./test-write-packets
+
+echo " * Packet and flow sampling"
+do_test ./test-sampling
+
+echo " * Seeking with time indexes"
+do_test ./test-time-index
+
+echo " * Copying packets"
+do_test ./test-copy
+
+echo " * Huge page packet buffers"
+do_test ./test-hugepages
+
+echo " * Decoding packets into buffers"
+do_test ./test-dump-buffer
+
+echo " * XDP classic BPF filter interpreter"
+do_test ./test-xdp-filter
+
+# Stopping part way through a trace that is being read in parallel must not
+# leave tracesplit waiting on the threads that are still reading
+tracesplit_max_files() {
+	dir=$(mktemp -d)
+	timeout 60 ../tools/tracesplit/tracesplit -t 4 -w 2 -c 30 -m 50 \
+		erf:traces/fragtest.erf.gz erf:$dir/split
+	ret=$?
+	files=$(ls $dir | wc -l)
+	rm -rf $dir
+	[ $ret -eq 0 ] && [ $files -eq 50 ]
+}
+
+echo " * Splitting a trace into a limited number of files"
+do_test tracesplit_max_files
+
 echo
 echo "Tests passed: $OK"
 echo "Tests failed: $FAIL"
@@ -0,0 +1,148 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/* Copies every packet of a trace and checks the copies match, that they
+ * can be reused to read more packets into and that the copies are counted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "libtrace.h"
+
+#define MAX_PACKETS 1024
+
+static const char *uris[] = {
+	"pcapfile:traces/radius.pcap",
+	"erf:traces/100_packets.erf",
+	"pcapng:traces/complex.pcapng",
+	NULL
+};
+
+static void iferr(libtrace_t *trace,const char *msg)
+{
+	libtrace_err_t err = trace_get_err(trace);
+	if (err.err_num==0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+static int same_packet(libtrace_packet_t *a, libtrace_packet_t *b)
+{
+	libtrace_linktype_t la, lb;
+	uint32_t ra, rb;
+	void *pa = trace_get_packet_buffer(a, &la, &ra);
+	void *pb = trace_get_packet_buffer(b, &lb, &rb);
+
+	if (!pa || !pb)
+		return pa == pb;
+	return la == lb && ra == rb && memcmp(pa, pb, ra) == 0 &&
+		trace_get_erf_timestamp(a) == trace_get_erf_timestamp(b) &&
+		trace_get_wire_length(a) == trace_get_wire_length(b);
+}
+
+static int check_trace(const char *uri)
+{
+	libtrace_t *trace;
+	libtrace_packet_t *packet;
+	libtrace_packet_t *copies[MAX_PACKETS];
+	libtrace_stat_t *stat;
+	uint64_t bytes = 0;
+	int count = 0, reused = 0, i, error = 0;
+
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+
+	packet = trace_create_packet();
+	while (count < MAX_PACKETS && trace_read_packet(trace, packet) > 0) {
+		copies[count] = trace_copy_packet(packet);
+		if (!copies[count] || !same_packet(packet, copies[count])) {
+			printf("failure: %s: copy of packet %d differs\n",
+				uri, count);
+			error = 1;
+		}
+		bytes += trace_get_framing_length(packet) +
+			trace_get_capture_length(packet);
+		count++;
+	}
+	iferr(trace, uri);
+
+	stat = trace_get_statistics(trace, NULL);
+	if (!stat->copied_valid || stat->copied != (uint64_t)count ||
+			!stat->copied_bytes_valid ||
+			stat->copied_bytes != bytes) {
+		printf("failure: %s: %" PRIu64 " copies of %" PRIu64
+			" bytes counted, expected %d of %" PRIu64 "\n", uri,
+			stat->copied, stat->copied_bytes, count, bytes);
+		error = 1;
+	}
+	for (i = 0; i < count; i++)
+		trace_destroy_packet(copies[i]);
+	trace_destroy(trace);
+
+	/* A copy only has a buffer big enough for its own packet, so reading
+	 * the next packet into it must not overflow it */
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+	while (trace_read_packet(trace, packet) > 0) {
+		libtrace_packet_t *copy = trace_copy_packet(packet);
+
+		reused++;
+		if (trace_read_packet(trace, copy) > 0)
+			reused++;
+		trace_destroy_packet(copy);
+	}
+	iferr(trace, uri);
+	if (reused != count) {
+		printf("failure: %s: read %d packets into copies, expected %d\n",
+			uri, reused, count);
+		error = 1;
+	}
+	trace_destroy(trace);
+	trace_destroy_packet(packet);
+
+	return error;
+}
+
+int main(int argc UNUSED, char *argv[] UNUSED) {
+	int i, error = 0;
+
+	for (i = 0; uris[i] != NULL; i++)
+		error |= check_trace(uris[i]);
+
+	if (!error)
+		printf("success: copied packets match their originals\n");
+	return error;
+}
@@ -0,0 +1,177 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ *
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/* Forwards a pcap file between two DPDK pcap vdevs, so no NIC is needed.
+ * Packets read from a dpdk: input are sent from their own mbufs, and with
+ * a TX queue larger than a read burst they are only sent when the next
+ * burst is read or the output is destroyed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "libtrace.h"
+
+#define PACKETS 100
+#define TX_QUEUE 32
+
+static const char *pcap_uri = "pcapfile:traces/100_packets.pcap";
+static const char *in_uri =
+	"dpdkvdev:net_pcap1,rx_pcap=traces/100_packets.pcap,tx_pcap=/dev/null";
+static const char *out_uri =
+	"dpdkvdev:net_pcap0,rx_pcap=traces/100_packets.pcap,"
+	"tx_pcap=traces/100_packets.dpdk.pcap";
+static const char *sent_uri = "pcapfile:traces/100_packets.dpdk.pcap";
+
+static void signal_handler(int signal)
+{
+	if (signal == SIGALRM) {
+		fprintf(stderr, "!!!Failed due to Timeout!!!\n");
+		exit(-1);
+	}
+}
+
+static void iferr(libtrace_t *trace, const char *msg)
+{
+	libtrace_err_t err = trace_get_err(trace);
+	if (err.err_num == 0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+static void iferrout(libtrace_out_t *trace, const char *msg)
+{
+	libtrace_err_t err = trace_get_err_output(trace);
+	if (err.err_num == 0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+int main(int argc UNUSED, char *argv[] UNUSED)
+{
+	libtrace_t *trace, *orig;
+	libtrace_out_t *out;
+	libtrace_packet_t *packet, *expected;
+	size_t queue = TX_QUEUE;
+	uint32_t len;
+	int i, seen = 0, error = 0, ret;
+
+	trace = trace_create(in_uri);
+	if (trace_is_err(trace) &&
+			trace_get_err(trace).err_num == TRACE_ERR_BAD_FORMAT) {
+		printf("Skipping: libtrace was built without DPDK\n");
+		trace_destroy(trace);
+		return 0;
+	}
+	iferr(trace, in_uri);
+
+	signal(SIGALRM, signal_handler);
+	alarm(60);
+
+	out = trace_create_output(out_uri);
+	iferrout(out, out_uri);
+	trace_config_output(out, TRACE_OPTION_TX_MAX_QUEUE, &queue);
+	iferrout(out, out_uri);
+	trace_start(trace);
+	iferr(trace, in_uri);
+	trace_start_output(out);
+	iferrout(out, out_uri);
+
+	packet = trace_create_packet();
+	for (i = 0; i < PACKETS; i++) {
+		if (trace_read_packet(trace, packet) <= 0) {
+			iferr(trace, in_uri);
+			printf("failure: only read %d packets\n", i);
+			return 1;
+		}
+		/* Queued packets are sent later, a successful write
+		 * returns 0 */
+		ret = trace_write_packet(out, packet);
+		iferrout(out, out_uri);
+		if (ret != 0) {
+			printf("failure: writing packet %d returned %d\n",
+					i, ret);
+			error = 1;
+		}
+	}
+	trace_destroy_packet(packet);
+
+	/* Sends whatever is still queued */
+	trace_destroy_output(out);
+	trace_destroy(trace);
+
+	/* Everything must have been sent, in order */
+	orig = trace_create(pcap_uri);
+	iferr(orig, pcap_uri);
+	trace = trace_create(sent_uri);
+	iferr(trace, sent_uri);
+	trace_start(orig);
+	iferr(orig, pcap_uri);
+	trace_start(trace);
+	iferr(trace, sent_uri);
+
+	packet = trace_create_packet();
+	expected = trace_create_packet();
+	while (trace_read_packet(trace, packet) > 0) {
+		if (trace_read_packet(orig, expected) <= 0) {
+			printf("failure: extra packet %d\n", seen);
+			error = 1;
+			break;
+		}
+		/* The output may strip a trailing checksum */
+		len = trace_get_capture_length(packet);
+		if (len > trace_get_capture_length(expected) ||
+				memcmp(trace_get_packet_buffer(packet, NULL, NULL),
+				trace_get_packet_buffer(expected, NULL, NULL),
+				len) != 0) {
+			printf("failure: packet %d differs\n", seen);
+			error = 1;
+		}
+		seen++;
+	}
+	iferr(trace, sent_uri);
+
+	if (seen != PACKETS) {
+		printf("failure: %d packets written, %d sent\n", PACKETS, seen);
+		error = 1;
+	} else if (!error) {
+		printf("success: %d packets forwarded\n", seen);
+	}
+
+	trace_destroy_packet(packet);
+	trace_destroy_packet(expected);
+	trace_destroy(trace);
+	trace_destroy(orig);
+
+	return error;
+}
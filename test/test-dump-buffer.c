@@ -0,0 +1,258 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+
+/* Decodes packets into libpacketdump buffers, checking the text matches
+ * what trace_dump_packet() prints and that decoding the same trace in
+ * several threads at once gives the same result. Also checks decoders
+ * registered by the program replace the ones loaded from plugins.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libtrace_parallel.h"
+#include "libpacketdump.h"
+
+static const char *uris[] = {
+	"pcapfile:traces/100_packets.pcap",
+	"erf:traces/100_packets.erf",
+	"pcapfile:traces/vlan.pcap",
+	"pcapng:traces/complex.pcapng",
+	NULL
+};
+
+static libtrace_dump_buffer_t parallel_text;
+
+static void iferr(libtrace_t *trace,const char *msg)
+{
+	libtrace_err_t err = trace_get_err(trace);
+	if (err.err_num==0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+/* Decodes every packet of a trace into one buffer, or to stdout if
+ * buffer is NULL */
+static void dump_trace(const char *uri, libtrace_dump_buffer_t *buffer)
+{
+	libtrace_t *trace;
+	libtrace_packet_t *packet;
+
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+
+	packet = trace_create_packet();
+	while (trace_read_packet(trace, packet) > 0) {
+		if (buffer)
+			assert(trace_dump_packet_buffer(packet, buffer) == 0);
+		else
+			trace_dump_packet(packet);
+	}
+	iferr(trace, uri);
+	trace_destroy_packet(packet);
+	trace_destroy(trace);
+}
+
+/* Reads back what trace_dump_packet() printed for a trace */
+static char *dump_trace_stdout(const char *uri)
+{
+	FILE *tmp = tmpfile();
+	char *text;
+	long len;
+	int saved;
+
+	assert(tmp);
+	fflush(stdout);
+	saved = dup(fileno(stdout));
+	dup2(fileno(tmp), fileno(stdout));
+	dump_trace(uri, NULL);
+	fflush(stdout);
+	dup2(saved, fileno(stdout));
+	close(saved);
+
+	len = ftell(tmp);
+	text = malloc(len + 1);
+	rewind(tmp);
+	assert(fread(text, 1, len, tmp) == (size_t)len);
+	text[len] = '\0';
+	fclose(tmp);
+	return text;
+}
+
+static void *start_decode(libtrace_t *trace UNUSED,
+		libtrace_thread_t *t UNUSED, void *global UNUSED)
+{
+	libtrace_dump_buffer_t *buffer = malloc(sizeof(*buffer));
+
+	trace_dump_buffer_init(buffer);
+	return buffer;
+}
+
+static libtrace_packet_t *per_packet(libtrace_t *trace, libtrace_thread_t *t,
+		void *global UNUSED, void *tls, libtrace_packet_t *packet)
+{
+	libtrace_dump_buffer_t *buffer = tls;
+	libtrace_generic_t result;
+
+	trace_dump_buffer_reset(buffer);
+	assert(trace_dump_packet_buffer(packet, buffer) == 0);
+	result.ptr = strdup(buffer->data);
+	trace_publish_result(trace, t, trace_packet_get_order(packet), result,
+			RESULT_USER);
+	return packet;
+}
+
+static void stop_decode(libtrace_t *trace UNUSED, libtrace_thread_t *t UNUSED,
+		void *global UNUSED, void *tls)
+{
+	trace_dump_buffer_free(tls);
+	free(tls);
+}
+
+static void append_result(libtrace_t *trace UNUSED,
+		libtrace_thread_t *sender UNUSED, void *global UNUSED,
+		void *tls UNUSED, libtrace_result_t *result)
+{
+	char *text = result->value.ptr;
+
+	if (result->type != RESULT_USER)
+		return;
+	/* Appending to a buffer outside of a dump just prints to stdout, so
+	 * build up the text by hand */
+	if (parallel_text.len + strlen(text) + 1 > parallel_text.size) {
+		parallel_text.size = (parallel_text.len + strlen(text)) * 2 + 1;
+		parallel_text.data = realloc(parallel_text.data,
+				parallel_text.size);
+	}
+	strcpy(parallel_text.data + parallel_text.len, text);
+	parallel_text.len += strlen(text);
+	free(text);
+}
+
+static void decode_ipv4(int type UNUSED, const char *packet UNUSED,
+		unsigned len)
+{
+	trace_dump_printf(" Registered IPv4: %u\n", len);
+}
+
+static void dump_trace_parallel(const char *uri)
+{
+	libtrace_t *trace;
+	libtrace_callback_set_t *processing, *reporter;
+
+	trace_dump_buffer_free(&parallel_text);
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_set_perpkt_threads(trace, 4);
+	trace_set_combiner(trace, &combiner_ordered, (libtrace_generic_t){0});
+
+	processing = trace_create_callback_set();
+	trace_set_starting_cb(processing, start_decode);
+	trace_set_packet_cb(processing, per_packet);
+	trace_set_stopping_cb(processing, stop_decode);
+	reporter = trace_create_callback_set();
+	trace_set_result_cb(reporter, append_result);
+
+	trace_pstart(trace, NULL, processing, reporter);
+	iferr(trace, uri);
+	trace_join(trace);
+	iferr(trace, uri);
+
+	trace_destroy(trace);
+	trace_destroy_callback_set(processing);
+	trace_destroy_callback_set(reporter);
+}
+
+int main(int argc UNUSED, char *argv[] UNUSED) {
+	libtrace_dump_buffer_t buffer;
+	char *printed;
+	int i, error = 0;
+
+	for (i = 0; uris[i] != NULL; i++) {
+		trace_dump_buffer_init(&buffer);
+		dump_trace(uris[i], &buffer);
+		if (buffer.len == 0 || strlen(buffer.data) != buffer.len) {
+			printf("failure: %s decoded to %zu bytes\n", uris[i],
+				buffer.len);
+			error = 1;
+		}
+
+		printed = dump_trace_stdout(uris[i]);
+		if (strcmp(printed, buffer.data) != 0) {
+			printf("failure: %s decodes differently into a "
+				"buffer than to stdout\n", uris[i]);
+			error = 1;
+		}
+		free(printed);
+
+		dump_trace_parallel(uris[i]);
+		if (parallel_text.len != buffer.len ||
+				strcmp(parallel_text.data, buffer.data) != 0) {
+			printf("failure: %s decodes differently in parallel\n",
+				uris[i]);
+			error = 1;
+		}
+
+		/* Reset buffers are written from the start again */
+		trace_dump_buffer_reset(&buffer);
+		if (buffer.len != 0 || buffer.data[0] != '\0') {
+			printf("failure: buffer was not emptied\n");
+			error = 1;
+		}
+		trace_dump_buffer_free(&buffer);
+	}
+	trace_dump_buffer_free(&parallel_text);
+
+	/* Layers keep their numbers, whether built in or added later */
+	if (decode_layer_id("ip") != DECODE_LAYER_IP ||
+			decode_layer_id("test") < DECODE_LAYER_BUILTIN_COUNT ||
+			decode_layer_id("test") != decode_layer_id("test")) {
+		printf("failure: layer numbers are not stable\n");
+		error = 1;
+	}
+
+	assert(trace_dump_register_decoder("eth", 0x0800, decode_ipv4) == 0);
+	trace_dump_buffer_init(&buffer);
+	dump_trace(uris[0], &buffer);
+	if (!strstr(buffer.data, " Registered IPv4: ") ||
+			strstr(buffer.data, " IP: Source ")) {
+		printf("failure: registered decoder was not used\n");
+		error = 1;
+	}
+	trace_dump_buffer_free(&buffer);
+
+	if (!error)
+		printf("success: packets decoded the same into buffers\n");
+	return error;
+}
@@ -76,6 +76,8 @@ const char *lookup_uri(const char *type) {
                 return "pcap:traces/100_packets.pcap";
         if (!strcmp(type, "pcapng"))
                 return "pcap:traces/100_packets.pcapng";
+        if (!strcmp(type, "pcapngfile"))
+                return "pcapng:traces/100_packets.pcapng";
         if (!strcmp(type, "wtf"))
                 return "wtf:traces/wed.wtf";
         if (!strcmp(type, "rtclient"))
@@ -92,6 +94,9 @@ const char *lookup_uri(const char *type) {
                 return "legacypos:traces/legacypos.gz";
         if (!strcmp(type, "legacyeth"))
                 return "legacyeth:traces/legacyeth.gz";
+        if (!strcmp(type, "merge"))
+                return "merge:erf:traces/100_packets.erf,"
+                       "pcapfile:traces/100_packets.pcap";
         if (!strcmp(type, "tsh"))
                 return "tsh:traces/10_packets.tsh.gz";
         return type;
@@ -181,7 +186,7 @@ static libtrace_packet_t *per_packet(libtrace_t *trace UNUSED,
 
         assert(count == storage->count);
 
-        if (count > 100) {
+        if (count > expected) {
                 fprintf(stderr,
                         "Too many packets -- someone should stop me!\n");
                 kill(getpid(), SIGTERM);
@@ -322,14 +327,18 @@ int main(int argc, char *argv[]) {
         uint32_t global = 0xabcdef;
         struct sigaction sigact;
         bool pause = 1;
+        int discard_meta = 0;
         int opt;
         char *read = NULL;
 
-        while ((opt = getopt(argc, argv, "pr:c:t:")) != -1) {
+        while ((opt = getopt(argc, argv, "pmr:c:t:")) != -1) {
                 switch (opt) {
                 case 'p':
                         pause = 0;
                         break;
+                case 'm':
+                        discard_meta = 1;
+                        break;
                 case 'r':
                         read = optarg;
                         break;
@@ -355,6 +364,11 @@ int main(int argc, char *argv[]) {
         trace = trace_create(tracename);
         iferr(trace, tracename);
 
+        if (discard_meta) {
+                trace_config(trace, TRACE_OPTION_DISCARD_META, &discard_meta);
+                iferr(trace, tracename);
+        }
+
         processing = trace_create_callback_set();
         trace_set_starting_cb(processing, start_processing);
         trace_set_stopping_cb(processing, stop_processing);
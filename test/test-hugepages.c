@@ -0,0 +1,261 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+
+/* Reads traces in parallel with packet buffers and queues in huge pages,
+ * then reuses a packet across formats to check the buffers go back to
+ * where they came from. Without huge pages reserved this exercises the
+ * transparent huge page fallback instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "libtrace_parallel.h"
+
+static const char *uris[] = {
+	"pcapfile:traces/100_packets.pcap",
+	"erf:traces/100_packets.erf",
+	"pcapng:traces/100_packets.pcapng",
+	NULL
+};
+
+static int parallel_count = 0;
+static int copy_errors = 0;
+
+static void iferr(libtrace_t *trace,const char *msg)
+{
+	libtrace_err_t err = trace_get_err(trace);
+	if (err.err_num==0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+static int count_packets(const char *uri, libtrace_packet_t *packet)
+{
+	libtrace_t *trace;
+	int count = 0;
+
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+	while (trace_read_packet(trace, packet) > 0)
+		count++;
+	iferr(trace, uri);
+	trace_destroy(trace);
+	return count;
+}
+
+static libtrace_packet_t *per_packet(libtrace_t *trace UNUSED,
+		libtrace_thread_t *t UNUSED, void *global UNUSED,
+		void *tls UNUSED, libtrace_packet_t *packet)
+{
+	libtrace_packet_t *copy = trace_copy_packet(packet);
+
+	if (trace_get_capture_length(copy) != trace_get_capture_length(packet)
+			|| memcmp(trace_get_packet_buffer(copy, NULL, NULL),
+				trace_get_packet_buffer(packet, NULL, NULL),
+				trace_get_capture_length(packet)) != 0)
+		__sync_fetch_and_add(&copy_errors, 1);
+	trace_destroy_packet(copy);
+	__sync_fetch_and_add(&parallel_count, 1);
+	return packet;
+}
+
+static int read_parallel(const char *uri, const char *config)
+{
+	libtrace_t *trace;
+	libtrace_callback_set_t *processing;
+
+	parallel_count = 0;
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	if (trace_set_configuration(trace, config) == -1)
+		iferr(trace, config);
+
+	processing = trace_create_callback_set();
+	trace_set_packet_cb(processing, per_packet);
+	trace_pstart(trace, NULL, processing, NULL);
+	iferr(trace, uri);
+	trace_join(trace);
+	iferr(trace, uri);
+
+	trace_destroy(trace);
+	trace_destroy_callback_set(processing);
+	return parallel_count;
+}
+
+/* Copies every packet in a trace, checking each copy came out the same */
+static int copy_packets(const char *uri)
+{
+	libtrace_t *trace;
+	libtrace_packet_t *packet, *copy;
+	int error = 0;
+
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+	packet = trace_create_packet();
+	while (trace_read_packet(trace, packet) > 0) {
+		copy = trace_copy_packet(packet);
+		if (trace_get_capture_length(copy) !=
+				trace_get_capture_length(packet) ||
+				memcmp(trace_get_packet_buffer(copy, NULL, NULL),
+				trace_get_packet_buffer(packet, NULL, NULL),
+				trace_get_capture_length(packet)) != 0)
+			error = 1;
+		trace_destroy_packet(copy);
+	}
+	iferr(trace, uri);
+	trace_destroy_packet(packet);
+	trace_destroy(trace);
+	if (error)
+		printf("failure: copies from %s did not match\n", uri);
+	return error;
+}
+
+/* Passes one packet through formats that give it a pool buffer, swap its
+ * buffer or drop it, then prepares it again once its buffer has gone. None
+ * of this may return a missing buffer to the pool, which would hand it out
+ * to a later copy.
+ */
+static int reprepare_dropped(void)
+{
+	libtrace_t *trace, *dead;
+	libtrace_packet_t *packet;
+	libtrace_rt_types_t type;
+	char record[2048];
+	size_t len;
+	void *buffer;
+	int i, error = 0;
+
+	packet = trace_create_packet();
+	trace = trace_create(uris[0]);
+	iferr(trace, uris[0]);
+	trace_start(trace);
+	iferr(trace, uris[0]);
+	if (trace_read_packet(trace, packet) <= 0) {
+		printf("failure: unable to read a packet from %s\n", uris[0]);
+		exit(1);
+	}
+	len = trace_get_framing_length(packet) +
+		trace_get_capture_length(packet);
+	assert(len <= sizeof(record));
+	memcpy(record, packet->header, len);
+	type = packet->type;
+	trace_destroy(trace);
+
+	count_packets("merge:erf:traces/100_packets.erf", packet);
+	/* Leaves the packet without a buffer of its own */
+	count_packets(uris[1], packet);
+
+	dead = trace_create_dead(uris[0]);
+	for (i = 0; i < 2; i++) {
+		buffer = malloc(LIBTRACE_PACKET_BUFSIZE);
+		memcpy(buffer, record, len);
+		if (trace_prepare_packet(dead, packet, buffer, type,
+				TRACE_PREP_OWN_BUFFER) == -1)
+			iferr(dead, "prepare");
+		if (trace_get_framing_length(packet) +
+				trace_get_capture_length(packet) != len) {
+			printf("failure: prepared packet has the wrong "
+				"length\n");
+			error = 1;
+		}
+	}
+	trace_destroy_packet(packet);
+	trace_destroy(dead);
+
+	/* Copies take their buffers from the pool */
+	for (i = 0; uris[i] != NULL; i++)
+		error |= copy_packets(uris[i]);
+	return error;
+}
+
+int main(int argc UNUSED, char *argv[] UNUSED) {
+	libtrace_packet_t *packet;
+	int expected[3];
+	int i, count, round;
+	int error = 0;
+
+	/* Count the packets before huge pages are turned on */
+	packet = trace_create_packet();
+	for (i = 0; uris[i] != NULL; i++)
+		expected[i] = count_packets(uris[i], packet);
+	trace_destroy_packet(packet);
+
+	/* The first trace turns the arena on for the whole process */
+	for (i = 0; uris[i] != NULL; i++) {
+		count = read_parallel(uris[i],
+			"hugepage_size=2M,perpkt_threads=2");
+		if (count != expected[i]) {
+			printf("failure: %s read %d packets with huge pages, "
+				"expected %d\n", uris[i], count, expected[i]);
+			error = 1;
+		}
+	}
+	if (copy_errors) {
+		printf("failure: %d copies did not match their packet\n",
+			copy_errors);
+		error = 1;
+	}
+
+	/* An unsupported size only warns */
+	count = read_parallel(uris[0], "hugepage_size=3M");
+	if (count != expected[0]) {
+		printf("failure: %s read %d packets with a bad huge page "
+			"size, expected %d\n", uris[0], count, expected[0]);
+		error = 1;
+	}
+
+	/* Each format must hand back a buffer another gave the packet */
+	packet = trace_create_packet();
+	for (round = 0; round < 2; round++) {
+		for (i = 0; uris[i] != NULL; i++) {
+			count = count_packets(uris[i], packet);
+			if (count != expected[i]) {
+				printf("failure: %s read %d packets after "
+					"another format, expected %d\n",
+					uris[i], count, expected[i]);
+				error = 1;
+			}
+		}
+	}
+	trace_destroy_packet(packet);
+
+	error |= reprepare_dropped();
+
+	if (!error)
+		printf("success: traces read the same with huge pages\n");
+	return error;
+}
@@ -0,0 +1,187 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/* Reads several traces through the merge: format and checks that every
+ * packet comes back exactly once, in timestamp order. Sampling applies to
+ * the merged stream, rather than to each source on its own.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "libtrace.h"
+
+static const char *small_sources[] = {
+	"erf:traces/100_packets.erf",
+	"pcapfile:traces/100_packets.pcap",
+	"erf:traces/5_packets.erf.gz",
+	"pcapfile:traces/100_seconds.pcap",
+	NULL
+};
+
+/* Small meta records mixed with packets bigger than the smallest copy pool
+ * buffers, which have to keep their own size as they are passed between the
+ * readers and the caller */
+static const char *large_sources[] = {
+	"pcapfile:traces/radius.pcap",
+	"erf:traces/provenance.erf",
+	"pcapfile:traces/8021x.pcap",
+	"erf:traces/fragtest.erf.gz",
+	NULL
+};
+
+void iferr(libtrace_t *trace,const char *msg)
+{
+	libtrace_err_t err = trace_get_err(trace);
+	if (err.err_num==0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+static int compare_ts(const void *a, const void *b)
+{
+	uint64_t ta = *(const uint64_t *)a;
+	uint64_t tb = *(const uint64_t *)b;
+
+	if (ta < tb)
+		return -1;
+	return ta > tb;
+}
+
+/* Appends the timestamps of every packet in a trace to 'ts' */
+static int read_timestamps(const char *uri, uint64_t **ts, int *count,
+		int *size)
+{
+	libtrace_t *trace;
+	libtrace_packet_t *packet;
+
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+
+	packet = trace_create_packet();
+	while (trace_read_packet(trace, packet) > 0) {
+		if (*count == *size) {
+			*size *= 2;
+			*ts = realloc(*ts, *size * sizeof(uint64_t));
+		}
+		(*ts)[(*count)++] = trace_get_erf_timestamp(packet);
+	}
+	iferr(trace, uri);
+	trace_destroy_packet(packet);
+	trace_destroy(trace);
+	return 0;
+}
+
+/* Merges the sources and checks the result against their timestamps,
+ * keeping one in every 'rate' merged packets */
+static int check_merge(const char **sources, int rate)
+{
+	char uri[1024] = "merge:";
+	uint64_t *expected;
+	uint64_t last = 0;
+	int size = 256, count = 0, seen = 0;
+	int i, error = 0;
+	libtrace_t *trace;
+	libtrace_packet_t *packet;
+
+	expected = malloc(size * sizeof(uint64_t));
+	for (i = 0; sources[i] != NULL; i++) {
+		read_timestamps(sources[i], &expected, &count, &size);
+		if (i > 0)
+			strcat(uri, ",");
+		strcat(uri, sources[i]);
+	}
+	qsort(expected, count, sizeof(uint64_t), compare_ts);
+	for (i = 0, seen = 0; i < count; i += rate)
+		expected[seen++] = expected[i];
+	count = seen;
+	seen = 0;
+
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	if (rate > 1)
+		trace_set_sample_rate(trace, rate);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+
+	packet = trace_create_packet();
+	while (trace_read_packet(trace, packet) > 0) {
+		uint64_t ts = trace_get_erf_timestamp(packet);
+
+		if (seen >= count) {
+			seen++;
+			continue;
+		}
+		if (ts < last) {
+			printf("failure: packet %d is out of order\n", seen);
+			error = 1;
+		}
+		if (ts != expected[seen]) {
+			printf("failure: packet %d has timestamp %" PRIu64
+				", expected %" PRIu64 "\n", seen, ts,
+				expected[seen]);
+			error = 1;
+		}
+		if (trace_get_link_type(packet) == (libtrace_linktype_t)~0U) {
+			printf("failure: packet %d has no link type\n", seen);
+			error = 1;
+		}
+		last = ts;
+		seen++;
+	}
+	iferr(trace, uri);
+
+	if (seen != count) {
+		printf("failure: %d packets expected, %d seen\n", count, seen);
+		error = 1;
+	} else if (!error) {
+		printf("success: %d packets read in order\n", seen);
+	}
+
+	/* The last packet must survive the trace going away first */
+	trace_destroy(trace);
+	trace_destroy_packet(packet);
+	free(expected);
+
+	return error;
+}
+
+int main(int argc UNUSED, char *argv[] UNUSED) {
+	int error = 0;
+
+	error |= check_merge(small_sources, 1);
+	error |= check_merge(large_sources, 1);
+	error |= check_merge(small_sources, 3);
+	return error;
+}
@@ -0,0 +1,231 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ *
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/* Checks the block reference counting used by block mode (TPACKET_V3)
+ * ring: input. A block must stay with us for as long as any packet read from
+ * it is alive, even if packets read before a pause and resume are released
+ * afterwards into a ring mapped at the same address.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "libtrace.h"
+
+/* Packets held across the pause, they are all read from the first block */
+#define HELD_PACKETS 4
+/* Enough packets to wrap around every block in the ring several times */
+#define FLOOD_PACKETS 20000
+
+static unsigned char frame[] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, /* Dest Mac */
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x06, /* Src Mac */
+	0x01, 0x01, /* Ethertype = Experimental */
+	0x00, 0x00, 0x00, 0x00, /* Sequence number */
+	0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, /* payload */
+	0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, /* payload */
+	0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, /* payload */
+	0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, /* payload */
+	0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, /* payload */
+	0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, /* payload */
+	0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, /* payload */
+};
+
+#define SEQ_OFFSET 14
+
+static void signal_handler(int signal)
+{
+	if (signal == SIGALRM) {
+		fprintf(stderr, "!!!Failed due to Timeout!!!\n");
+		exit(-1);
+	}
+}
+
+static void iferr_out(libtrace_out_t *trace)
+{
+	libtrace_err_t err = trace_get_err_output(trace);
+	if (err.err_num == 0)
+		return;
+	printf("Error: %s\n", err.problem);
+	exit(-err.err_num);
+}
+
+static void iferr(libtrace_t *trace)
+{
+	libtrace_err_t err = trace_get_err(trace);
+	if (err.err_num == 0)
+		return;
+	printf("Error: %s\n", err.problem);
+	exit(-err.err_num);
+}
+
+static void send_packets(libtrace_out_t *out, uint32_t first, int count)
+{
+	libtrace_packet_t *packet = trace_create_packet();
+	int i;
+
+	for (i = 0; i < count; i++) {
+		uint32_t seq = first + i;
+
+		memcpy(frame + SEQ_OFFSET, &seq, sizeof(seq));
+		trace_construct_packet(packet, TRACE_TYPE_ETH, frame,
+				sizeof(frame));
+		if (trace_write_packet(out, packet) == -1)
+			iferr_out(out);
+	}
+	trace_destroy_packet(packet);
+	trace_flush_output(out);
+}
+
+/* Reads the next packet we sent, skipping any other traffic */
+static void read_sent_packet(libtrace_t *trace, libtrace_packet_t *packet)
+{
+	libtrace_linktype_t linktype;
+	uint32_t remaining;
+	unsigned char *l2;
+
+	do {
+		if (trace_read_packet(trace, packet) <= 0) {
+			iferr(trace);
+			fprintf(stderr, "Error: looks like we lost some packets!\n");
+			exit(1);
+		}
+		l2 = trace_get_layer2(packet, &linktype, &remaining);
+	} while (l2 == NULL || remaining < sizeof(frame) ||
+			memcmp(l2 + 12, frame + 12, 2) != 0);
+}
+
+static uint32_t get_seq(libtrace_packet_t *packet)
+{
+	libtrace_linktype_t linktype;
+	uint32_t remaining, seq;
+	unsigned char *l2 = trace_get_layer2(packet, &linktype, &remaining);
+
+	memcpy(&seq, l2 + SEQ_OFFSET, sizeof(seq));
+	return seq;
+}
+
+int main(int argc, char *argv[])
+{
+	libtrace_out_t *trace_write;
+	libtrace_t *trace_read;
+	libtrace_packet_t *held[HELD_PACKETS];
+	libtrace_packet_t *current;
+	int blockmode = 1;
+	int err = 0;
+	int i;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s type(write) type(read)\n", argv[0]);
+		return 1;
+	}
+
+	/* Only block mode ring: input keeps per block reference counts */
+	if (strncmp(argv[2], "ring:", 5) != 0) {
+		printf("Skipping: %s is not a ring: input\n", argv[2]);
+		return 0;
+	}
+
+	signal(SIGALRM, signal_handler);
+	alarm(20);
+
+	trace_write = trace_create_output(argv[1]);
+	iferr_out(trace_write);
+	trace_read = trace_create(argv[2]);
+	iferr(trace_read);
+	if (trace_config(trace_read, TRACE_OPTION_RING_BLOCK_MODE,
+				&blockmode) != 0)
+		iferr(trace_read);
+
+	trace_start_output(trace_write);
+	iferr_out(trace_write);
+	trace_start(trace_read);
+	iferr(trace_read);
+
+	/* Hold a few packets from the first ring */
+	send_packets(trace_write, 0, HELD_PACKETS);
+	for (i = 0; i < HELD_PACKETS; i++) {
+		held[i] = trace_create_packet();
+		read_sent_packet(trace_read, held[i]);
+	}
+
+	/* Replace the ring, and hold a packet from the new one */
+	if (trace_pause(trace_read) != 0)
+		iferr(trace_read);
+	if (trace_start(trace_read) != 0)
+		iferr(trace_read);
+
+	send_packets(trace_write, 100, 1);
+	current = trace_create_packet();
+	read_sent_packet(trace_read, current);
+	if (get_seq(current) != 100) {
+		fprintf(stderr, "Error: expected packet 100, read %u\n",
+				get_seq(current));
+		err = 1;
+	}
+
+	/* Fill the rest of the new ring. The kernel now waits for us to give
+	 * back the block current is in */
+	send_packets(trace_write, 1000, FLOOD_PACKETS);
+
+	/* Reading into a packet from the old ring releases it, which must not
+	 * give the new ring's first block back to the kernel while current
+	 * still uses it */
+	read_sent_packet(trace_read, held[0]);
+
+	send_packets(trace_write, 100000, FLOOD_PACKETS);
+	usleep(100000);
+
+	if (get_seq(current) != 100) {
+		fprintf(stderr, "Error: a held packet was overwritten by the "
+				"kernel, it now has sequence %u\n",
+				get_seq(current));
+		err = 1;
+	}
+
+	/* Once current is released, we can keep reading */
+	read_sent_packet(trace_read, current);
+	if (get_seq(current) < 1000) {
+		fprintf(stderr, "Error: expected a flood packet, read %u\n",
+				get_seq(current));
+		err = 1;
+	}
+
+	for (i = 0; i < HELD_PACKETS; i++)
+		trace_destroy_packet(held[i]);
+	trace_destroy_packet(current);
+
+	trace_destroy_output(trace_write);
+	trace_destroy(trace_read);
+
+	if (err == 0)
+		printf("Success\n");
+	return err;
+}
@@ -0,0 +1,227 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/* Checks the packet and flow sampling stages, both when reading a trace
+ * with trace_read_packet() and when reading it in parallel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "libtrace_parallel.h"
+
+#define TRACE_URI "pcapfile:traces/100_packets.pcap"
+#define MAX_PACKETS 1024
+
+/* Direction independent flow key for every packet of the trace */
+static char keys[MAX_PACKETS][128];
+static int kept[MAX_PACKETS];
+static int parallel_count = 0;
+
+static void iferr(libtrace_t *trace,const char *msg)
+{
+	libtrace_err_t err = trace_get_err(trace);
+	if (err.err_num==0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+static void flow_key(libtrace_packet_t *packet, char *key)
+{
+	char a[64], b[64];
+	char *src = trace_get_source_address_string(packet, a, sizeof(a));
+	char *dst = trace_get_destination_address_string(packet, b, sizeof(b));
+	uint16_t sport = trace_get_source_port(packet);
+	uint16_t dport = trace_get_destination_port(packet);
+
+	if (!src || !dst) {
+		strcpy(key, "none");
+		return;
+	}
+	if (strcmp(src, dst) < 0 || (strcmp(src, dst) == 0 && sport < dport))
+		snprintf(key, 128, "%s:%u-%s:%u", src, sport, dst, dport);
+	else
+		snprintf(key, 128, "%s:%u-%s:%u", dst, dport, src, sport);
+}
+
+/* Reads the trace, recording which packets made it through sampling by
+ * matching their timestamps against the unsampled trace */
+static int read_sampled(int rate, int flow_rate, uint64_t *ts, int total,
+		uint64_t *filtered)
+{
+	libtrace_t *trace;
+	libtrace_packet_t *packet;
+	libtrace_stat_t *stat;
+	int count = 0, i = 0;
+
+	trace = trace_create(TRACE_URI);
+	iferr(trace, "create");
+	if (trace_set_sample_rate(trace, rate) == -1)
+		iferr(trace, "sample rate");
+	if (trace_set_flow_sample_rate(trace, flow_rate) == -1)
+		iferr(trace, "flow sample rate");
+	trace_start(trace);
+	iferr(trace, "start");
+
+	memset(kept, 0, sizeof(kept));
+	packet = trace_create_packet();
+	while (trace_read_packet(trace, packet) > 0) {
+		uint64_t now = trace_get_erf_timestamp(packet);
+		while (i < total && ts[i] != now)
+			i++;
+		if (i < total)
+			kept[i++] = 1;
+		count++;
+	}
+	iferr(trace, "read");
+
+	stat = trace_get_statistics(trace, NULL);
+	*filtered = stat->filtered;
+	trace_destroy_packet(packet);
+	trace_destroy(trace);
+	return count;
+}
+
+static libtrace_packet_t *per_packet(libtrace_t *trace UNUSED,
+		libtrace_thread_t *t UNUSED, void *global UNUSED,
+		void *tls UNUSED, libtrace_packet_t *packet)
+{
+	__sync_fetch_and_add(&parallel_count, 1);
+	return packet;
+}
+
+static int read_parallel(int rate, int flow_rate)
+{
+	libtrace_t *trace;
+	libtrace_callback_set_t *processing;
+
+	parallel_count = 0;
+	trace = trace_create(TRACE_URI);
+	iferr(trace, "create");
+	trace_set_perpkt_threads(trace, 2);
+	trace_set_burst_size(trace, 10);
+	trace_set_sample_rate(trace, rate);
+	trace_set_flow_sample_rate(trace, flow_rate);
+
+	processing = trace_create_callback_set();
+	trace_set_packet_cb(processing, per_packet);
+	trace_pstart(trace, NULL, processing, NULL);
+	iferr(trace, "pstart");
+	trace_join(trace);
+	iferr(trace, "join");
+
+	trace_destroy(trace);
+	trace_destroy_callback_set(processing);
+	return parallel_count;
+}
+
+int main(int argc UNUSED, char *argv[] UNUSED) {
+	libtrace_t *trace;
+	libtrace_packet_t *packet;
+	uint64_t ts[MAX_PACKETS];
+	uint64_t filtered;
+	int total = 0, count, flows, i, j;
+	int error = 0;
+
+	/* Read the whole trace to know what sampling should produce */
+	trace = trace_create(TRACE_URI);
+	iferr(trace, "create");
+	trace_start(trace);
+	iferr(trace, "start");
+	packet = trace_create_packet();
+	while (trace_read_packet(trace, packet) > 0 && total < MAX_PACKETS) {
+		ts[total] = trace_get_erf_timestamp(packet);
+		flow_key(packet, keys[total]);
+		total++;
+	}
+	trace_destroy_packet(packet);
+	trace_destroy(trace);
+
+	/* 1-in-N packet sampling keeps the first packet of each interval */
+	count = read_sampled(10, 0, ts, total, &filtered);
+	if (count != (total + 9) / 10 || filtered != (uint64_t)(total - count)) {
+		printf("failure: 1-in-10 sampling kept %d of %d packets, "
+			"%" PRIu64 " filtered\n", count, total, filtered);
+		error = 1;
+	}
+	for (i = 0; i < total; i++) {
+		if (kept[i] != (i % 10 == 0)) {
+			printf("failure: packet %d wrongly %s\n", i,
+				kept[i] ? "kept" : "discarded");
+			error = 1;
+			break;
+		}
+	}
+
+	/* Flow sampling must keep whole flows, in both directions */
+	flows = read_sampled(0, 4, ts, total, &filtered);
+	if (flows == 0 || flows == total) {
+		printf("failure: flow sampling kept %d of %d packets\n",
+			flows, total);
+		error = 1;
+	}
+	for (i = 0; i < total; i++) {
+		for (j = 0; j < total; j++) {
+			if (strcmp(keys[i], keys[j]) == 0 &&
+					kept[i] != kept[j]) {
+				printf("failure: flow %s was only partially "
+					"sampled\n", keys[i]);
+				error = 1;
+				i = j = total;
+			}
+		}
+	}
+
+	/* Sampling must be deterministic between runs */
+	if (read_sampled(0, 4, ts, total, &filtered) != flows) {
+		printf("failure: flow sampling is not deterministic\n");
+		error = 1;
+	}
+
+	/* The parallel pipeline must choose the same flows */
+	count = read_parallel(0, 4);
+	if (count != flows) {
+		printf("failure: parallel flow sampling kept %d packets, "
+			"expected %d\n", count, flows);
+		error = 1;
+	}
+	count = read_parallel(1, 1);
+	if (count != total) {
+		printf("failure: parallel read without sampling kept %d "
+			"packets, expected %d\n", count, total);
+		error = 1;
+	}
+
+	if (!error)
+		printf("success: %d packets, %d kept by flow sampling\n",
+			total, flows);
+	return error;
+}
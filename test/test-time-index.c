@@ -0,0 +1,224 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/* Seeks within pcap and pcapng traces, both by reading forward when there
+ * is no saved time index and by using one built ahead of time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "libtrace.h"
+
+#define MAX_PACKETS 1024
+
+static const char *uris[] = {
+	"pcapfile:traces/100_seconds.pcap",
+	"pcapfile:traces/100_packets.pcap",
+	"pcapng:traces/100_packets.pcapng",
+	NULL
+};
+
+static void iferr(libtrace_t *trace,const char *msg)
+{
+	libtrace_err_t err = trace_get_err(trace);
+	if (err.err_num==0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+static void index_name(const char *uri, char *buffer, size_t len)
+{
+	snprintf(buffer, len, "%s.tidx", strchr(uri, ':') + 1);
+}
+
+/* Reads every packet from the current position of a trace */
+static int read_timestamps(libtrace_t *trace, uint64_t *ts)
+{
+	libtrace_packet_t *packet = trace_create_packet();
+	int count = 0;
+
+	while (trace_read_packet(trace, packet) > 0) {
+		if (IS_LIBTRACE_META_PACKET(packet))
+			continue;
+		if (count < MAX_PACKETS)
+			ts[count] = trace_get_erf_timestamp(packet);
+		count++;
+	}
+	iferr(trace, "read");
+	trace_destroy_packet(packet);
+	return count;
+}
+
+/* Seeks to 'target' and checks that exactly the packets at or after it
+ * are read back */
+static int check_seek(const char *uri, uint64_t *ts, int total,
+		uint64_t target)
+{
+	libtrace_t *trace;
+	uint64_t seen[MAX_PACKETS];
+	int first = 0, count, i;
+
+	while (first < total && ts[first] < target)
+		first++;
+
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+	if (trace_seek_erf_timestamp(trace, target) == -1)
+		iferr(trace, "seek");
+
+	count = read_timestamps(trace, seen);
+	trace_destroy(trace);
+
+	if (count != total - first) {
+		printf("failure: %s: seeking to %" PRIu64 " read %d packets, "
+			"expected %d\n", uri, target, count, total - first);
+		return 1;
+	}
+	for (i = 0; i < count; i++) {
+		if (seen[i] != ts[first + i]) {
+			printf("failure: %s: seeking to %" PRIu64 " read the "
+				"wrong packets\n", uri, target);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Seeks back and forth within the one trace, reading a few packets after
+ * each seek */
+static int check_reseek(const char *uri, uint64_t *ts, int total)
+{
+	libtrace_t *trace;
+	libtrace_packet_t *packet;
+	int targets[] = { 37, 10, total - 5, 0, 20 };
+	int i, j, error = 0;
+
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+	packet = trace_create_packet();
+
+	for (i = 0; i < (int)(sizeof(targets) / sizeof(targets[0])); i++) {
+		if (trace_seek_erf_timestamp(trace, ts[targets[i]]) == -1)
+			iferr(trace, "seek");
+		for (j = targets[i]; j < targets[i] + 5 && j < total; ) {
+			if (trace_read_packet(trace, packet) <= 0) {
+				iferr(trace, "read");
+				printf("failure: %s: ran out of packets after "
+					"seeking to packet %d\n", uri,
+					targets[i]);
+				error = 1;
+				break;
+			}
+			if (IS_LIBTRACE_META_PACKET(packet))
+				continue;
+			if (trace_get_erf_timestamp(packet) != ts[j]) {
+				printf("failure: %s: seeking to packet %d "
+					"read the wrong packets\n", uri,
+					targets[i]);
+				error = 1;
+				break;
+			}
+			j++;
+		}
+	}
+
+	trace_destroy_packet(packet);
+	trace_destroy(trace);
+	return error;
+}
+
+static int check_trace(const char *uri)
+{
+	libtrace_t *trace;
+	uint64_t ts[MAX_PACKETS];
+	char index[1024];
+	int total, error = 0;
+
+	index_name(uri, index, sizeof(index));
+	unlink(index);
+
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	trace_start(trace);
+	iferr(trace, uri);
+	total = read_timestamps(trace, ts);
+	trace_destroy(trace);
+	assert(total > 40 && total <= MAX_PACKETS);
+
+	/* Without an index seeking reads forward, and never writes one */
+	error |= check_seek(uri, ts, total, ts[37]);
+	if (access(index, F_OK) == 0) {
+		printf("failure: %s: seeking wrote an index\n", uri);
+		error = 1;
+	}
+	error |= check_seek(uri, ts, total, ts[0]);
+	error |= check_seek(uri, ts, total, ts[0] - 1);
+	error |= check_seek(uri, ts, total, ts[total - 1]);
+	error |= check_seek(uri, ts, total, ts[total - 1] + 1);
+	error |= check_seek(uri, ts, total, ts[20] + 1);
+	error |= check_reseek(uri, ts, total);
+
+	/* A denser index built ahead of time gives the same results */
+	trace = trace_create(uri);
+	iferr(trace, uri);
+	if (trace_build_time_index(trace, 7) == -1)
+		iferr(trace, "build index");
+	trace_destroy(trace);
+	if (access(index, R_OK) != 0) {
+		printf("failure: %s: no index was written\n", uri);
+		error = 1;
+	}
+
+	error |= check_seek(uri, ts, total, ts[37]);
+	error |= check_seek(uri, ts, total, ts[40] + 1);
+	error |= check_seek(uri, ts, total, ts[total - 1]);
+	error |= check_reseek(uri, ts, total);
+
+	unlink(index);
+	return error;
+}
+
+int main(int argc UNUSED, char *argv[] UNUSED) {
+	int i, error = 0;
+
+	for (i = 0; uris[i] != NULL; i++)
+		error |= check_trace(uris[i]);
+
+	if (!error)
+		printf("success: seeking with time indexes\n");
+	return error;
+}
@@ -0,0 +1,204 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/* Writes a trace out in batches with trace_write_packets() and checks that
+ * reading it back gives the same packets as the original, and that packets
+ * the output can't write aren't counted as written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "libtrace.h"
+
+#define BATCH 16
+
+static const char *in_uri = "pcapfile:traces/100_packets.pcap";
+static const char *out_uri = "pcapfile:traces/100_packets.batch.pcap";
+static const char *meta_uri = "pcapng:traces/100_packets.pcapng";
+static const char *meta_out_uri = "pcapfile:traces/100_packets.batchng.pcap";
+
+void iferr(libtrace_t *trace,const char *msg)
+{
+	libtrace_err_t err = trace_get_err(trace);
+	if (err.err_num==0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+void iferrout(libtrace_out_t *trace,const char *msg)
+{
+	libtrace_err_t err = trace_get_err_output(trace);
+	if (err.err_num==0)
+		return;
+	printf("Error: %s: %s\n", msg, err.problem);
+	exit(1);
+}
+
+/* Writes a batch that starts with pcapng meta-packets to a pcap file, which
+ * has to skip them */
+static int check_skipped(void)
+{
+	libtrace_t *trace;
+	libtrace_out_t *out;
+	libtrace_packet_t *packets[BATCH];
+	int i, meta = 0, ret, error = 0;
+
+	trace = trace_create(meta_uri);
+	iferr(trace, meta_uri);
+	out = trace_create_output(meta_out_uri);
+	iferrout(out, meta_out_uri);
+	trace_start(trace);
+	iferr(trace, meta_uri);
+	trace_start_output(out);
+	iferrout(out, meta_out_uri);
+
+	for (i = 0; i < BATCH; i++) {
+		packets[i] = trace_create_packet();
+		if (trace_read_packet(trace, packets[i]) <= 0) {
+			iferr(trace, meta_uri);
+			printf("failure: %s is too short\n", meta_uri);
+			exit(1);
+		}
+		if (IS_LIBTRACE_META_PACKET(packets[i]))
+			meta++;
+	}
+	assert(meta > 0);
+
+	ret = trace_write_packets(out, packets, BATCH);
+	iferrout(out, meta_out_uri);
+	if (ret != BATCH - meta) {
+		printf("failure: wrote %d packets, expected %d as %d were "
+				"meta-packets\n", ret, BATCH - meta, meta);
+		error = 1;
+	}
+
+	for (i = 0; i < BATCH; i++)
+		trace_destroy_packet(packets[i]);
+	trace_destroy_output(out);
+	trace_destroy(trace);
+	return error;
+}
+
+int main(int argc UNUSED, char *argv[] UNUSED) {
+	libtrace_t *trace, *orig;
+	libtrace_out_t *out;
+	libtrace_packet_t *packets[BATCH];
+	libtrace_packet_t *packet;
+	int i, count = 0, batches = 0, seen = 0, error = 0, ret;
+
+	trace = trace_create(in_uri);
+	iferr(trace, in_uri);
+	out = trace_create_output(out_uri);
+	iferrout(out, out_uri);
+	trace_start(trace);
+	iferr(trace, in_uri);
+	trace_start_output(out);
+	iferrout(out, out_uri);
+
+	for (i = 0; i < BATCH; i++)
+		packets[i] = trace_create_packet();
+
+	/* Write the trace out a batch at a time, the last batch is short */
+	for (;;) {
+		for (i = 0; i < BATCH; i++) {
+			if (trace_read_packet(trace, packets[i]) <= 0)
+				break;
+		}
+		iferr(trace, in_uri);
+		if (i == 0)
+			break;
+		ret = trace_write_packets(out, packets, i);
+		iferrout(out, out_uri);
+		if (ret != i) {
+			printf("failure: wrote %d of %d packets\n", ret, i);
+			error = 1;
+		}
+		count += i;
+		batches++;
+		if (i < BATCH)
+			break;
+	}
+
+	for (i = 0; i < BATCH; i++)
+		trace_destroy_packet(packets[i]);
+	trace_destroy_output(out);
+	trace_destroy(trace);
+
+	/* Read both traces back and compare them packet by packet */
+	orig = trace_create(in_uri);
+	iferr(orig, in_uri);
+	trace = trace_create(out_uri);
+	iferr(trace, out_uri);
+	trace_start(orig);
+	iferr(orig, in_uri);
+	trace_start(trace);
+	iferr(trace, out_uri);
+
+	packet = trace_create_packet();
+	packets[0] = trace_create_packet();
+	while (trace_read_packet(trace, packet) > 0) {
+		if (trace_read_packet(orig, packets[0]) <= 0) {
+			printf("failure: extra packet %d\n", seen);
+			error = 1;
+			break;
+		}
+		if (trace_get_erf_timestamp(packet) !=
+				trace_get_erf_timestamp(packets[0]) ||
+				trace_get_capture_length(packet) !=
+				trace_get_capture_length(packets[0]) ||
+				memcmp(trace_get_packet_buffer(packet, NULL, NULL),
+				trace_get_packet_buffer(packets[0], NULL, NULL),
+				trace_get_capture_length(packet)) != 0) {
+			printf("failure: packet %d differs\n", seen);
+			error = 1;
+		}
+		seen++;
+	}
+	iferr(trace, out_uri);
+
+	if (seen != count) {
+		printf("failure: %d packets written, %d read back\n",
+				count, seen);
+		error = 1;
+	} else if (!error) {
+		printf("success: %d packets written in %d batches\n",
+				count, batches);
+	}
+
+	trace_destroy_packet(packet);
+	trace_destroy_packet(packets[0]);
+	trace_destroy(trace);
+	trace_destroy(orig);
+
+	error |= check_skipped();
+	return error;
+}
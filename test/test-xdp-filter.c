@@ -0,0 +1,256 @@
+/*
+ * This file is part of libtrace
+ *
+ * Copyright (c) 2007 The University of Waikato, Hamilton, New Zealand.
+ *
+ * All rights reserved.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtrace; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ *
+ */
+
+/* Runs the classic BPF interpreter used by the XDP program in userspace,
+ * over filters laid out the way pcap compiles them. Also checks that the
+ * prebuilt XDP object was rebuilt after the last control map change.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include <linux/types.h>
+#include <linux/bpf_common.h>
+
+#include "format_linux_xdp.h"
+#include "format_linux_xdp_filter.h"
+
+#define INSN(c, t, f, kk) { .code = (c), .jt = (t), .jf = (f), .k = (kk) }
+
+/* ip */
+static const libtrace_xdp_insn_t filter_ip[] = {
+	INSN(BPF_LD|BPF_H|BPF_ABS, 0, 0, 12),
+	INSN(BPF_JMP|BPF_JEQ|BPF_K, 0, 1, 0x0800),
+	INSN(BPF_RET|BPF_K, 0, 0, 262144),
+	INSN(BPF_RET|BPF_K, 0, 0, 0),
+};
+
+/* ip and tcp dst port 80 */
+static const libtrace_xdp_insn_t filter_http[] = {
+	INSN(BPF_LD|BPF_H|BPF_ABS, 0, 0, 12),
+	INSN(BPF_JMP|BPF_JEQ|BPF_K, 0, 8, 0x0800),
+	INSN(BPF_LD|BPF_B|BPF_ABS, 0, 0, 23),
+	INSN(BPF_JMP|BPF_JEQ|BPF_K, 0, 6, 6),
+	INSN(BPF_LD|BPF_H|BPF_ABS, 0, 0, 20),
+	INSN(BPF_JMP|BPF_JSET|BPF_K, 4, 0, 0x1fff),
+	INSN(BPF_LDX|BPF_B|BPF_MSH, 0, 0, 14),
+	INSN(BPF_LD|BPF_H|BPF_IND, 0, 0, 16),
+	INSN(BPF_JMP|BPF_JEQ|BPF_K, 0, 1, 80),
+	INSN(BPF_RET|BPF_K, 0, 0, 262144),
+	INSN(BPF_RET|BPF_K, 0, 0, 0),
+};
+
+/* len >= 100, using the X register and the ALU */
+static const libtrace_xdp_insn_t filter_len[] = {
+	INSN(BPF_LDX|BPF_W|BPF_LEN, 0, 0, 0),
+	INSN(BPF_MISC|BPF_TXA, 0, 0, 0),
+	INSN(BPF_ALU|BPF_ADD|BPF_K, 0, 0, 1),
+	INSN(BPF_ALU|BPF_SUB|BPF_K, 0, 0, 1),
+	INSN(BPF_JMP|BPF_JGE|BPF_K, 0, 1, 100),
+	INSN(BPF_RET|BPF_A, 0, 0, 0),
+	INSN(BPF_RET|BPF_K, 0, 0, 0),
+};
+
+/* ld [1000], reads beyond the end of our packets */
+static const libtrace_xdp_insn_t filter_oob[] = {
+	INSN(BPF_LD|BPF_W|BPF_ABS, 0, 0, 1000),
+	INSN(BPF_RET|BPF_K, 0, 0, 262144),
+};
+
+/* a division, which the interpreter doesn't handle */
+static const libtrace_xdp_insn_t filter_div[] = {
+	INSN(BPF_LD|BPF_W|BPF_LEN, 0, 0, 0),
+	INSN(BPF_ALU|BPF_DIV|BPF_K, 0, 0, 2),
+	INSN(BPF_RET|BPF_A, 0, 0, 0),
+};
+
+/* Ethernet, IPv4 and the start of a TCP header to port 80 */
+static unsigned char tcp_packet[128] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, /* Dest Mac */
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x06, /* Src Mac */
+	0x08, 0x00, /* Ethertype = IPv4 */
+	0x45, 0x00, 0x00, 0x72, /* IPv4, 20 byte header */
+	0x00, 0x00, 0x00, 0x00, /* Not fragmented */
+	0x40, 0x06, 0x00, 0x00, /* TCP */
+	0x0a, 0x00, 0x00, 0x01,
+	0x0a, 0x00, 0x00, 0x02,
+	0x30, 0x39, 0x00, 0x50, /* Ports 12345 -> 80 */
+};
+
+/* Ethernet and IPv6 */
+static unsigned char ipv6_packet[64] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, /* Dest Mac */
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x06, /* Src Mac */
+	0x86, 0xdd, /* Ethertype = IPv6 */
+	0x60, 0x00, 0x00, 0x00,
+};
+
+static int failures = 0;
+
+static void check(const char *name, const libtrace_xdp_insn_t *insns,
+		unsigned int len, unsigned char *pkt, size_t pktlen,
+		bool expected) {
+
+	libtrace_ctrl_map_t ctrl;
+	bool result;
+
+	memset(&ctrl, 0, sizeof(ctrl));
+	memcpy(ctrl.filter, insns, len * sizeof(libtrace_xdp_insn_t));
+	ctrl.filter_len = len;
+
+	result = xdp_run_filter(pkt, pkt + pktlen, &ctrl);
+	if (result != expected) {
+		fprintf(stderr, "%s: expected %s, got %s\n", name,
+				expected ? "match" : "no match",
+				result ? "match" : "no match");
+		failures++;
+	}
+}
+
+/* Reads the control map definition out of the prebuilt XDP object. The
+ * kernel refuses a map update of the wrong size, so a stale object would
+ * run without the newer control fields, e.g. the flow hash */
+static void check_object(const char *path) {
+
+	FILE *f;
+	long size;
+	unsigned char *buf;
+	Elf64_Ehdr *ehdr;
+	Elf64_Shdr *shdrs, *symtab = NULL;
+	Elf64_Sym *sym;
+	const char *strtab;
+	struct bpf_map_def {
+		__u32 type, key_size, value_size, max_entries, map_flags;
+	} def;
+	unsigned int i;
+	int found = 0;
+
+	if ((f = fopen(path, "rb")) == NULL) {
+		perror(path);
+		failures++;
+		return;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	buf = malloc(size);
+	if (buf == NULL || fread(buf, 1, size, f) != (size_t)size) {
+		fprintf(stderr, "%s: unable to read the object\n", path);
+		fclose(f);
+		free(buf);
+		failures++;
+		return;
+	}
+	fclose(f);
+
+	ehdr = (Elf64_Ehdr *)buf;
+	shdrs = (Elf64_Shdr *)(buf + ehdr->e_shoff);
+	for (i = 0; i < ehdr->e_shnum; i++) {
+		if (shdrs[i].sh_type == SHT_SYMTAB)
+			symtab = &shdrs[i];
+	}
+	if (symtab == NULL) {
+		fprintf(stderr, "%s: no symbol table\n", path);
+		free(buf);
+		failures++;
+		return;
+	}
+
+	strtab = (const char *)buf + shdrs[symtab->sh_link].sh_offset;
+	for (i = 0; i < symtab->sh_size / sizeof(Elf64_Sym); i++) {
+		sym = (Elf64_Sym *)(buf + symtab->sh_offset) + i;
+		if (strcmp(strtab + sym->st_name, "libtrace_ctrl_map") != 0)
+			continue;
+		memcpy(&def, buf + shdrs[sym->st_shndx].sh_offset +
+				sym->st_value, sizeof(def));
+		found = 1;
+	}
+	free(buf);
+
+	if (!found) {
+		fprintf(stderr, "%s: no libtrace_ctrl_map\n", path);
+		failures++;
+	} else if (def.value_size != sizeof(libtrace_ctrl_map_t)) {
+		fprintf(stderr, "%s: control map holds %u bytes, expected %zu, "
+				"the object needs rebuilding\n", path,
+				def.value_size, sizeof(libtrace_ctrl_map_t));
+		failures++;
+	}
+}
+
+#define CHECK(filter, pkt, len, expected) \
+	check(#filter " on " #pkt, filter, \
+			sizeof(filter) / sizeof(filter[0]), pkt, len, expected)
+
+int main(void) {
+
+	unsigned char fragment[sizeof(tcp_packet)];
+
+	CHECK(filter_ip, tcp_packet, sizeof(tcp_packet), true);
+	CHECK(filter_ip, ipv6_packet, sizeof(ipv6_packet), false);
+
+	CHECK(filter_http, tcp_packet, sizeof(tcp_packet), true);
+	CHECK(filter_http, ipv6_packet, sizeof(ipv6_packet), false);
+	/* the ports live past the end of a truncated packet */
+	CHECK(filter_http, tcp_packet, 36, false);
+
+	/* later fragments don't carry the ports */
+	memcpy(fragment, tcp_packet, sizeof(fragment));
+	fragment[21] = 0x10;
+	CHECK(filter_http, fragment, sizeof(fragment), false);
+
+	CHECK(filter_len, tcp_packet, sizeof(tcp_packet), true);
+	CHECK(filter_len, ipv6_packet, sizeof(ipv6_packet), false);
+
+	CHECK(filter_oob, tcp_packet, sizeof(tcp_packet), false);
+
+	/* only supported filters are pushed into the XDP program */
+	if (!xdp_filter_supported(filter_http,
+				sizeof(filter_http) / sizeof(filter_http[0]))) {
+		fprintf(stderr, "filter_http should be supported\n");
+		failures++;
+	}
+	if (xdp_filter_supported(filter_div,
+				sizeof(filter_div) / sizeof(filter_div[0]))) {
+		fprintf(stderr, "filter_div should not be supported\n");
+		failures++;
+	}
+	/* an unsupported instruction that does reach the interpreter
+	 * accepts the packet, leaving it for libtrace to filter */
+	CHECK(filter_div, ipv6_packet, sizeof(ipv6_packet), true);
+
+	check_object("../lib/format_linux_xdp_kern.bpf");
+
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("Success\n");
+	return 0;
+}
@@ -166,8 +166,238 @@ void PrefixSub::anonIPv6(uint8_t *orig, uint8_t *result) {
 #ifdef HAVE_LIBCRYPTO
 #include <openssl/evp.h>
 
-CryptoAnon::CryptoAnon(uint8_t *key, uint8_t len, uint8_t cachebits, uint8_t *salt) :
-        Anonymiser(salt) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AESNI_ENGINE 1
+#include <cpuid.h>
+#include <wmmintrin.h>
+#endif
+
+/* Maximum number of slots to search for a prefix before giving up */
+#define PREFIX_CACHE_MAX_PROBE 16
+
+static inline uint64_t hashPrefix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+SharedPrefixCache::SharedPrefixCache(uint32_t slotbits) {
+
+    /* Each shard needs room for at least one full probe sequence */
+    if (slotbits < PREFIX_CACHE_SHARD_BITS + 4) {
+        slotbits = PREFIX_CACHE_SHARD_BITS + 4;
+    }
+    this->shardbits = slotbits - PREFIX_CACHE_SHARD_BITS;
+    this->slots = (struct slot *)calloc(1ULL << slotbits, sizeof(struct slot));
+    assert(this->slots);
+
+    for (int i = 0; i < PREFIX_CACHE_SHARDS; i++) {
+        pthread_mutex_init(&this->locks[i], NULL);
+    }
+    this->hits = 0;
+    this->misses = 0;
+}
+
+SharedPrefixCache::~SharedPrefixCache() {
+    for (int i = 0; i < PREFIX_CACHE_SHARDS; i++) {
+        pthread_mutex_destroy(&this->locks[i]);
+    }
+    free(this->slots);
+}
+
+/* Probe sequences never leave the shard that a prefix hashes to, so every
+ * slot is only ever written while holding the lock for its own shard.
+ */
+inline struct SharedPrefixCache::slot *SharedPrefixCache::probe(
+        uint64_t hash, int i) {
+    uint64_t shard = hash & (PREFIX_CACHE_SHARDS - 1);
+    uint64_t shardmask = (1ULL << this->shardbits) - 1;
+    uint64_t pos = ((hash >> PREFIX_CACHE_SHARD_BITS) + i) & shardmask;
+
+    return &this->slots[(shard << this->shardbits) + pos];
+}
+
+bool SharedPrefixCache::lookup(uint64_t prefix, uint64_t *result) {
+    uint64_t hash = hashPrefix(prefix);
+
+    for (int i = 0; i < PREFIX_CACHE_MAX_PROBE; i++) {
+        struct slot *s = probe(hash, i);
+
+        /* Slots are filled in probe order and never emptied, so an
+         * unready slot means the prefix is not (yet) in the cache */
+        if (__atomic_load_n(&s->ready, __ATOMIC_ACQUIRE) == 0) {
+            return false;
+        }
+        if (s->key == prefix) {
+            *result = s->value;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SharedPrefixCache::insert(uint64_t prefix, uint64_t result) {
+    uint64_t hash = hashPrefix(prefix);
+    pthread_mutex_t *lock = &this->locks[hash & (PREFIX_CACHE_SHARDS - 1)];
+
+    pthread_mutex_lock(lock);
+    for (int i = 0; i < PREFIX_CACHE_MAX_PROBE; i++) {
+        struct slot *s = probe(hash, i);
+
+        if (s->ready == 0) {
+            s->key = prefix;
+            s->value = result;
+            __atomic_store_n(&s->ready, 1, __ATOMIC_RELEASE);
+            break;
+        }
+        if (s->key == prefix) {
+            /* Another thread got here first */
+            break;
+        }
+    }
+    pthread_mutex_unlock(lock);
+}
+
+void SharedPrefixCache::addStats(uint64_t hits, uint64_t misses) {
+    __atomic_add_fetch(&this->hits, hits, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&this->misses, misses, __ATOMIC_RELAXED);
+}
+
+uint64_t SharedPrefixCache::getHits() {
+    return __atomic_load_n(&this->hits, __ATOMIC_RELAXED);
+}
+
+uint64_t SharedPrefixCache::getMisses() {
+    return __atomic_load_n(&this->misses, __ATOMIC_RELAXED);
+}
+
+#ifdef HAVE_AESNI_ENGINE
+/* AES-NI implementation of AES-128 encryption, compiled for the aes target
+ * so that the rest of traceanon does not need -maes. None of this may be
+ * called unless aesniAvailable() has returned true.
+ */
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+
+/* Each aesenc has a latency of several cycles but a throughput of one (or
+ * more) per cycle, so we push eight independent blocks through the rounds
+ * together to keep the AES unit busy.
+ */
+AESNI_TARGET static inline __m128i aesniExpandStep(__m128i key,
+        __m128i keygened) {
+    keygened = _mm_shuffle_epi32(keygened, _MM_SHUFFLE(3, 3, 3, 3));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, keygened);
+}
+
+#define AESNI_EXPAND(k, rcon) \
+        aesniExpandStep(k, _mm_aeskeygenassist_si128(k, rcon))
+
+AESNI_TARGET static void aesniExpandKey(const uint8_t *key,
+        uint8_t *roundkeys) {
+    __m128i rk[AESNI_ROUND_KEYS];
+
+    rk[0] = _mm_loadu_si128((const __m128i *)key);
+    rk[1] = AESNI_EXPAND(rk[0], 0x01);
+    rk[2] = AESNI_EXPAND(rk[1], 0x02);
+    rk[3] = AESNI_EXPAND(rk[2], 0x04);
+    rk[4] = AESNI_EXPAND(rk[3], 0x08);
+    rk[5] = AESNI_EXPAND(rk[4], 0x10);
+    rk[6] = AESNI_EXPAND(rk[5], 0x20);
+    rk[7] = AESNI_EXPAND(rk[6], 0x40);
+    rk[8] = AESNI_EXPAND(rk[7], 0x80);
+    rk[9] = AESNI_EXPAND(rk[8], 0x1b);
+    rk[10] = AESNI_EXPAND(rk[9], 0x36);
+
+    for (int i = 0; i < AESNI_ROUND_KEYS; i++) {
+        _mm_store_si128((__m128i *)(roundkeys + i * 16), rk[i]);
+    }
+}
+
+/* Encrypts eight independent blocks in place, one round at a time across
+ * all eight so that consecutive aesenc instructions never depend on each
+ * other.
+ */
+AESNI_TARGET static inline void aesniEncrypt8(const __m128i *rk,
+        uint8_t blocks[][16]) {
+    __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+    int r;
+
+#define AESNI_LOAD(j) \
+    b##j = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blocks[j]), rk[0])
+    AESNI_LOAD(0); AESNI_LOAD(1); AESNI_LOAD(2); AESNI_LOAD(3);
+    AESNI_LOAD(4); AESNI_LOAD(5); AESNI_LOAD(6); AESNI_LOAD(7);
+#undef AESNI_LOAD
+
+    for (r = 1; r < AESNI_ROUND_KEYS - 1; r++) {
+        b0 = _mm_aesenc_si128(b0, rk[r]);
+        b1 = _mm_aesenc_si128(b1, rk[r]);
+        b2 = _mm_aesenc_si128(b2, rk[r]);
+        b3 = _mm_aesenc_si128(b3, rk[r]);
+        b4 = _mm_aesenc_si128(b4, rk[r]);
+        b5 = _mm_aesenc_si128(b5, rk[r]);
+        b6 = _mm_aesenc_si128(b6, rk[r]);
+        b7 = _mm_aesenc_si128(b7, rk[r]);
+    }
+
+#define AESNI_STORE(j) \
+    _mm_storeu_si128((__m128i *)blocks[j], \
+            _mm_aesenclast_si128(b##j, rk[AESNI_ROUND_KEYS - 1]))
+    AESNI_STORE(0); AESNI_STORE(1); AESNI_STORE(2); AESNI_STORE(3);
+    AESNI_STORE(4); AESNI_STORE(5); AESNI_STORE(6); AESNI_STORE(7);
+#undef AESNI_STORE
+}
+
+AESNI_TARGET static inline void aesniEncrypt1(const __m128i *rk,
+        uint8_t *block) {
+    __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)block), rk[0]);
+
+    for (int r = 1; r < AESNI_ROUND_KEYS - 1; r++) {
+        b = _mm_aesenc_si128(b, rk[r]);
+    }
+    _mm_storeu_si128((__m128i *)block,
+            _mm_aesenclast_si128(b, rk[AESNI_ROUND_KEYS - 1]));
+}
+
+/* Encrypts 'count' independent blocks in place (i.e. ECB mode) */
+AESNI_TARGET static void aesniEncryptBlocks(const uint8_t *roundkeys,
+        uint8_t blocks[][16], int count) {
+    __m128i rk[AESNI_ROUND_KEYS];
+    int i, r;
+
+    for (r = 0; r < AESNI_ROUND_KEYS; r++) {
+        rk[r] = _mm_load_si128((const __m128i *)(roundkeys + r * 16));
+    }
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        aesniEncrypt8(rk, blocks + i);
+    }
+    for (; i < count; i++) {
+        aesniEncrypt1(rk, blocks[i]);
+    }
+}
+#endif
+
+bool CryptoAnon::aesniAvailable() {
+#ifdef HAVE_AESNI_ENGINE
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return (ecx & bit_AES) != 0;
+#else
+    return false;
+#endif
+}
+
+CryptoAnon::CryptoAnon(uint8_t *key, uint8_t len, uint8_t cachebits,
+        uint8_t *salt, SharedPrefixCache *v4cache,
+        SharedPrefixCache *v6cache, bool use_aesni) : Anonymiser(salt) {
 
     assert(len >= 32);
     memcpy(this->key, key, 16);
@@ -179,20 +409,43 @@ CryptoAnon::CryptoAnon(uint8_t *key, uint8_t len, uint8_t cachebits, uint8_t *sa
 
     EVP_EncryptInit_ex(this->ctx, this->cipher, NULL, this->key, NULL);
 
+    this->aesni = use_aesni && aesniAvailable();
+#ifdef HAVE_AESNI_ENGINE
+    if (this->aesni) {
+        aesniExpandKey(this->key, this->roundkeys);
+    }
+#endif
+
     this->cachebits = cachebits;
 
-    this->ipv4_cache = new IPv4AnonCache();
-    this->ipv6_cache = new IPv6AnonCache();
+    if (v4cache && v6cache) {
+        this->ipv4_cache = v4cache;
+        this->ipv6_cache = v6cache;
+        this->owns_caches = false;
+    } else {
+        this->ipv4_cache = new SharedPrefixCache(cachebits + 1);
+        this->ipv6_cache = new SharedPrefixCache(20);
+        this->owns_caches = true;
+    }
+    this->cache_hits = 0;
+    this->cache_misses = 0;
+
     this->recent_ipv4_cache[0][0] = 0;
     this->recent_ipv4_cache[0][1] = 0;
     this->recent_ipv4_cache[1][0] = 0;
-    this->recent_ipv4_cache[0][1] = 0;
+    this->recent_ipv4_cache[1][1] = 0;
 
 }
 
 
 CryptoAnon::~CryptoAnon() {
-    delete(this->ipv4_cache);
+    /* Both caches are always shared (or owned) together, so keep the
+     * statistics on the IPv4 one */
+    this->ipv4_cache->addStats(this->cache_hits, this->cache_misses);
+    if (this->owns_caches) {
+        delete(this->ipv4_cache);
+        delete(this->ipv6_cache);
+    }
     EVP_CIPHER_CTX_cleanup(this->ctx);
     EVP_CIPHER_CTX_free(this->ctx);
 }
@@ -269,40 +522,65 @@ void CryptoAnon::anonIPv6(uint8_t *orig, uint8_t *result) {
 }
 
 uint32_t CryptoAnon::lookupv4Cache(uint32_t prefix) {
+    uint64_t prefmask;
 
-    IPv4AnonCache::iterator it = this->ipv4_cache->find(prefix);
-
-    if (it == this->ipv4_cache->end()) {
-        uint32_t prefmask = this->encrypt32Bits(prefix, 0, this->cachebits, 0);
-        (*this->ipv4_cache)[prefix] = prefmask;
-        return prefmask;
+    if (this->ipv4_cache->lookup(prefix, &prefmask)) {
+        this->cache_hits ++;
+        return (uint32_t)prefmask;
     }
-    return it->second;
+
+    this->cache_misses ++;
+    prefmask = this->encrypt32Bits(prefix, 0, this->cachebits, 0);
+    this->ipv4_cache->insert(prefix, prefmask);
+    return (uint32_t)prefmask;
 
 }
 
 uint64_t CryptoAnon::lookupv6Cache(uint64_t prefix) {
-    IPv6AnonCache::iterator it = this->ipv6_cache->find(prefix);
+    uint64_t prefmask;
 
-    if (it == this->ipv6_cache->end()) {
-        uint64_t prefmask = this->encrypt64Bits(prefix);
-        (*this->ipv6_cache)[prefix] = prefmask;
+    if (this->ipv6_cache->lookup(prefix, &prefmask)) {
+        this->cache_hits ++;
         return prefmask;
     }
-    return it->second;
+
+    this->cache_misses ++;
+    prefmask = this->encrypt64Bits(prefix);
+    this->ipv6_cache->insert(prefix, prefmask);
+    return prefmask;
+}
+
+/* Encrypts 'count' blocks in place. Each block is encrypted independently,
+ * so all of the blocks for an address can be in flight at once.
+ */
+void CryptoAnon::encryptBlocks(uint8_t blocks[][16], int count) {
+    int outl = count * 16;
+
+#ifdef HAVE_AESNI_ENGINE
+    if (this->aesni) {
+        aesniEncryptBlocks(this->roundkeys, blocks, count);
+        return;
+    }
+#endif
+    /* ECB mode, so OpenSSL can also pipeline these if it wants to */
+    EVP_EncryptUpdate(this->ctx, (unsigned char *)blocks, &outl,
+            (unsigned char *)blocks, count * 16);
 }
 
 uint32_t CryptoAnon::encrypt32Bits(uint32_t orig, uint8_t start, uint8_t stop, 
         uint32_t res) {
-    uint8_t rin_output[32];
-    uint8_t rin_input[16];
+    uint8_t rin_blocks[32][16];
     uint32_t first4pad;
-    int outl = 32;
+    int count = stop - start;
+
+    if (count <= 0) {
+        return res;
+    }
 
-    memcpy(rin_input, this->padding, 16);
     first4pad = generateFirstPad(this->padding);
 
     for (int pos = start; pos < stop; pos ++) {
+        uint8_t *rin_input = rin_blocks[pos - start];
         uint32_t input;
 
         /* The MS bits are taken from the original address. The remaining
@@ -316,20 +594,22 @@ uint32_t CryptoAnon::encrypt32Bits(uint32_t orig, uint8_t start, uint8_t stop,
                     ((first4pad << pos) >> pos);
         }
 
+        memcpy(rin_input, this->padding, 16);
         rin_input[0] = (uint8_t) (input >> 24);
         rin_input[1] = (uint8_t) ((input << 8) >> 24);
         rin_input[2] = (uint8_t) ((input << 16) >> 24);
         rin_input[3] = (uint8_t) ((input << 24) >> 24);
+    }
 
-        /* Encryption: we're using AES as a pseudorandom function. For each
-         * bit in the original address, we use the first bit of the resulting
-         * encrypted output as part of an XOR mask */
-        EVP_EncryptUpdate(this->ctx, (unsigned char *)rin_output, &outl, 
-                (unsigned char *)rin_input, 16);
+    /* Encryption: we're using AES as a pseudorandom function. For each
+     * bit in the original address, we use the first bit of the resulting
+     * encrypted output as part of an XOR mask. None of the inputs depend
+     * on an earlier output, so we can encrypt them all in one go. */
+    this->encryptBlocks(rin_blocks, count);
 
+    for (int pos = start; pos < stop; pos ++) {
         /* Put the first bit of the output into the right slot of our mask */
-        res |= (((uint32_t)rin_output[0]) >> 7) << (31 - pos);
-
+        res |= (((uint32_t)rin_blocks[pos - start][0]) >> 7) << (31 - pos);
     }
     return res;
 
@@ -338,13 +618,10 @@ uint32_t CryptoAnon::encrypt32Bits(uint32_t orig, uint8_t start, uint8_t stop,
 uint64_t CryptoAnon::encrypt64Bits(uint64_t orig) {
 
     /* See encrypt32Bits for more explanation of how this works */
-    uint8_t rin_output[32];
-    uint8_t rin_input[16];
+    uint8_t rin_blocks[64][16];
     uint64_t first8pad;
-    int outl = 32;
     uint64_t result = 0;
 
-    memcpy(rin_input, this->padding, 16);
     memcpy(&first8pad, this->padding, 8);
 
     for (int pos = 0; pos < 64; pos ++) {
@@ -357,12 +634,14 @@ uint64_t CryptoAnon::encrypt64Bits(uint64_t orig) {
                     ((first8pad << pos) >> pos);
         }
 
-        memcpy(rin_input, &input, 8);
+        memcpy(rin_blocks[pos], this->padding, 16);
+        memcpy(rin_blocks[pos], &input, 8);
+    }
 
-        EVP_EncryptUpdate(this->ctx, (unsigned char *)rin_output, &outl,
-                (unsigned char *)rin_input, 16);
+    this->encryptBlocks(rin_blocks, 64);
 
-        result |= ((((uint64_t)rin_output[0]) >> 7) << (63 - pos));
+    for (int pos = 0; pos < 64; pos ++) {
+        result |= ((((uint64_t)rin_blocks[pos][0]) >> 7) << (63 - pos));
     }
 
     return result;
@@ -82,31 +82,90 @@ private:
 
 #ifdef HAVE_LIBCRYPTO
 #include <openssl/evp.h>
-#include <map>
+#include <pthread.h>
+#include <stddef.h>
 
-typedef std::map<uint32_t, uint32_t> IPv4AnonCache;
-typedef std::map<uint64_t, uint64_t> IPv6AnonCache;
+#define PREFIX_CACHE_SHARD_BITS 6
+#define PREFIX_CACHE_SHARDS (1 << PREFIX_CACHE_SHARD_BITS)
+
+/* Cache of anonymised prefixes that can be shared between the CryptoAnon
+ * instances belonging to each processing thread, so that each prefix only
+ * needs to be encrypted once no matter how many threads see it.
+ *
+ * Lookups do not take any locks -- a slot is only ever written once, and
+ * is not visible to readers until its 'ready' flag has been set. Inserts
+ * lock just the shard that the prefix hashes to. The table never grows;
+ * if a prefix cannot be placed within a few slots of its home position it
+ * is simply not cached.
+ */
+class SharedPrefixCache {
+public:
+    SharedPrefixCache(uint32_t slotbits);
+    ~SharedPrefixCache();
+
+    bool lookup(uint64_t prefix, uint64_t *result);
+    void insert(uint64_t prefix, uint64_t result);
+
+    void addStats(uint64_t hits, uint64_t misses);
+    uint64_t getHits();
+    uint64_t getMisses();
+
+private:
+    struct slot {
+        uint64_t key;
+        uint64_t value;
+        uint32_t ready;
+    };
+
+    struct slot *slots;
+    uint32_t shardbits;
+    pthread_mutex_t locks[PREFIX_CACHE_SHARDS];
+
+    uint64_t hits;
+    uint64_t misses;
+
+    struct slot *probe(uint64_t hash, int i);
+};
+
+/* Round keys for AES-128 (initial key plus 10 rounds) */
+#define AESNI_ROUND_KEYS 11
 
 class CryptoAnon : public Anonymiser {
 public:
-    CryptoAnon(uint8_t *key, uint8_t len, uint8_t cachebits, uint8_t *salt);
+    /* If use_aesni is true and the CPU supports the AES-NI instructions,
+     * blocks are encrypted using our own interleaved AES-NI code rather
+     * than via OpenSSL. Both produce exactly the same output.
+     */
+    CryptoAnon(uint8_t *key, uint8_t len, uint8_t cachebits, uint8_t *salt,
+            SharedPrefixCache *v4cache = NULL,
+            SharedPrefixCache *v6cache = NULL, bool use_aesni = true);
     ~CryptoAnon();
 
     uint32_t anonIPv4(uint32_t orig);
     void anonIPv6(uint8_t *orig, uint8_t *result);
 
+    static bool aesniAvailable();
+
 private:
     uint8_t padding[16];
     uint8_t key[16];
     uint8_t cachebits;
 
-    IPv4AnonCache *ipv4_cache;
-    IPv6AnonCache *ipv6_cache;
+    bool aesni;
+    uint8_t roundkeys[AESNI_ROUND_KEYS * 16] __attribute__((aligned(16)));
+
+    SharedPrefixCache *ipv4_cache;
+    SharedPrefixCache *ipv6_cache;
+    bool owns_caches;
+
+    uint64_t cache_hits;
+    uint64_t cache_misses;
 
     uint32_t recent_ipv4_cache[2][2];
     const EVP_CIPHER *cipher;
     EVP_CIPHER_CTX *ctx;
 
+    void encryptBlocks(uint8_t blocks[][16], int count);
     uint32_t encrypt32Bits(uint32_t orig, uint8_t start, uint8_t stop,
             uint32_t res);
     uint64_t encrypt64Bits(uint64_t orig); 
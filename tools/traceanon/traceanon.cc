@@ -50,6 +50,15 @@
 struct libtrace_t *inptrace = NULL;
 traceanon_opts_t globalopts;
 
+#ifdef HAVE_LIBCRYPTO
+/* Number of most-significant IPv4 address bits that are cached */
+#define CRYPTOPAN_CACHE_BITS 20
+
+/* Anonymised prefixes, shared by the CryptoAnon in every processing thread */
+static SharedPrefixCache *ipv4_prefixes = NULL;
+static SharedPrefixCache *ipv6_prefixes = NULL;
+#endif
+
 static void cleanup_signal(int signal)
 {
 	(void)signal;
@@ -391,7 +400,9 @@ static void *start_anon(libtrace_t *trace, libtrace_thread_t *t, void *global)
 		}
 #ifdef HAVE_LIBCRYPTO
                 CryptoAnon *anon = new CryptoAnon((uint8_t *)opts->enc_key,
-                        (uint8_t)strlen(opts->enc_key), 20, opts->salt);
+                        (uint8_t)strlen(opts->enc_key), CRYPTOPAN_CACHE_BITS,
+                        opts->salt, ipv4_prefixes, ipv6_prefixes,
+                        opts->cryptopan_engine != CRYPTOPAN_ENGINE_OPENSSL);
                 return anon;
 #else
                 /* TODO nicer way of exiting? */
@@ -483,6 +494,8 @@ static void init_global_opts(traceanon_opts_t *glob) {
         glob->enc_dest_opt = false;
         glob->enc_type = ENC_NONE;
         glob->enc_key = NULL;
+        glob->cryptopan_engine = CRYPTOPAN_ENGINE_AUTO;
+        glob->cryptopan_cache_stats = false;
 
         glob->enc_radius_packet = false;
         glob->radius_force_anon = false;
@@ -693,6 +706,22 @@ int main(int argc, char *argv[])
 
         trace_set_perpkt_threads(inptrace, globalopts.threads);
 
+#ifdef HAVE_LIBCRYPTO
+        if (globalopts.enc_type == ENC_CRYPTOPAN &&
+                        globalopts.cryptopan_engine == CRYPTOPAN_ENGINE_AESNI &&
+                        !CryptoAnon::aesniAvailable()) {
+                fprintf(stderr, "Error: requested the AES-NI CryptoPan engine "
+                        "but this CPU does not support AES-NI\n");
+                exitcode = 1;
+                goto exitanon;
+        }
+
+        if (globalopts.enc_type == ENC_CRYPTOPAN) {
+                ipv4_prefixes = new SharedPrefixCache(CRYPTOPAN_CACHE_BITS + 1);
+                ipv6_prefixes = new SharedPrefixCache(20);
+        }
+#endif
+
         if (globalopts.filterstring) {
                 filter = trace_create_filter(globalopts.filterstring);
         }
@@ -720,6 +749,17 @@ int main(int argc, char *argv[])
 	// Wait for the trace to finish
 	trace_join(inptrace);
 
+#ifdef HAVE_LIBCRYPTO
+        if (ipv4_prefixes && globalopts.cryptopan_cache_stats) {
+                uint64_t hits = ipv4_prefixes->getHits();
+                uint64_t lookups = hits + ipv4_prefixes->getMisses();
+
+                fprintf(stderr, "CryptoPAn prefix cache: %" PRIu64
+                                " lookups, %.2f%% hit rate\n", lookups,
+                                lookups ? (100.0 * hits) / lookups : 0.0);
+        }
+#endif
+
 exitanon:
         if (pktcbs)
                 trace_destroy_callback_set(pktcbs);
@@ -727,6 +767,10 @@ exitanon:
                 trace_destroy_callback_set(repcbs);
         if (inptrace)
         	trace_destroy(inptrace);
+#ifdef HAVE_LIBCRYPTO
+        delete(ipv4_prefixes);
+        delete(ipv6_prefixes);
+#endif
 
         free_global_opts(&globalopts);
 
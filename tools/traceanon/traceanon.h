@@ -35,6 +35,12 @@ enum enc_type_t {
         ENC_PREFIX_SUBSTITUTION
 };
 
+enum cryptopan_engine_t {
+        CRYPTOPAN_ENGINE_AUTO,
+        CRYPTOPAN_ENGINE_AESNI,
+        CRYPTOPAN_ENGINE_OPENSSL
+};
+
 #define SALT_LENGTH 32
 #define SHA256_SIZE 32
 
@@ -69,6 +75,8 @@ typedef struct traceanon_options {
     bool enc_dest_opt;
     enum enc_type_t enc_type;
     char *enc_key;
+    enum cryptopan_engine_t cryptopan_engine;
+    bool cryptopan_cache_stats;
 
     bool enc_radius_packet;
     bool radius_force_anon;
@@ -174,6 +174,34 @@ static int parse_anonip_section(traceanon_opts_t *opts, yaml_document_t *doc,
             opts->enc_type = ENC_CRYPTOPAN;
             opts->enc_key = strdup((char *)value->data.scalar.value);
         }
+
+        if (key->type == YAML_SCALAR_NODE && value->type == YAML_SCALAR_NODE
+                && strcmp((char *)key->data.scalar.value, "cryptopan_engine")
+                        == 0) {
+            char *valstr = (char *)value->data.scalar.value;
+
+            if (strcmp(valstr, "auto") == 0) {
+                opts->cryptopan_engine = CRYPTOPAN_ENGINE_AUTO;
+            } else if (strcmp(valstr, "aesni") == 0) {
+                opts->cryptopan_engine = CRYPTOPAN_ENGINE_AESNI;
+            } else if (strcmp(valstr, "openssl") == 0) {
+                opts->cryptopan_engine = CRYPTOPAN_ENGINE_OPENSSL;
+            } else {
+                fprintf(stderr, "Unexpected value for 'cryptopan_engine' option: %s\n", valstr);
+                fprintf(stderr, "Should be one of ('auto', 'aesni', 'openssl')\n");
+                return -1;
+            }
+        }
+
+        if (key->type == YAML_SCALAR_NODE && value->type == YAML_SCALAR_NODE
+                && strcmp((char *)key->data.scalar.value, "cache_stats")
+                        == 0) {
+            if (yaml_parse_onoff((char *)value->data.scalar.value) == 1) {
+                opts->cryptopan_cache_stats = true;
+            } else {
+                opts->cryptopan_cache_stats = false;
+            }
+        }
     }
     return 0;
 
@@ -37,8 +37,14 @@
 #include <getopt.h>
 #include <string.h>
 #include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
 
 #include "libpacketdump.h"
+#include "data-struct/ring_buffer.h"
+
+/* Number of packets each trace is allowed to be read ahead of the window */
+#define READ_AHEAD 64
 
 uint32_t max_diff = 0;
 uint32_t dumped_diff = 0;
@@ -51,29 +57,80 @@ struct packet_window {
     int status;
     uint32_t hash;
     libtrace_packet_t *packet;
+    /* next slot in the same hash bucket, or -1 */
+    int next;
+    bool indexed;
+};
+
+/* Each trace is read and hashed by its own thread, which fills packets from
+ * a fixed pool and passes them over through the 'full' ring. The window
+ * swaps each one for the packet it has finished with, and hands that back
+ * through the 'empty' ring. The rings carry pool slot numbers starting at
+ * 1, so that NULL can be used to signal the end of the trace (on 'full') or
+ * to tell the reader to stop (on 'empty').
+ *
+ * Packets in the window are indexed by hash, so finding a match anywhere in
+ * the window only compares the packets that share its hash.
+ */
+struct diff_input {
+    libtrace_t *trace;
+    libtrace_packet_t *pool[READ_AHEAD];
+    int pool_status[READ_AHEAD];
+    uint32_t pool_hash[READ_AHEAD];
+    libtrace_ringbuffer_t full;
+    libtrace_ringbuffer_t empty;
+    pthread_t thread;
+    bool running;
+    bool finished;
+    /* result of the read that ended the trace */
+    int status;
+
+    /* first slot in each hash bucket, or -1 */
+    int *buckets;
+    uint32_t bucket_mask;
 };
 
-void fill_packet_windows(libtrace_t *trace_a, libtrace_t *trace_b,
+void fill_packet_windows(struct diff_input *input_a, struct diff_input *input_b,
                          struct packet_window *a, int a_pos,
                          struct packet_window *b, int b_pos,
                          int window_size);
 
+static inline uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* Hashes the packet from the start of the link layer header to the end of
+ * the capture, eight bytes at a time */
 static uint32_t hash_packet(libtrace_packet_t *packet) {
 
     libtrace_linktype_t ltype;
-    uint32_t rem, i;
+    uint32_t rem;
+    uint64_t hash, word;
 
     const char *str = (const char *)trace_get_packet_buffer(packet, &ltype, &rem);
     if (!str)
         return 0;
 
-    /* djb hashing algorithm */
-    unsigned long hash = 5381;
-    for (i = 0; i < rem; str++, i++) {
-        hash = ((hash << 5) + hash) + (*str);
+    hash = 0x9e3779b97f4a7c15ULL ^ rem;
+    while (rem >= sizeof(word)) {
+        memcpy(&word, str, sizeof(word));
+        hash = (hash ^ hash_mix(word)) * 0x87c37b91114253d5ULL;
+        str += sizeof(word);
+        rem -= sizeof(word);
+    }
+    if (rem > 0) {
+        word = 0;
+        memcpy(&word, str, rem);
+        hash = (hash ^ hash_mix(word)) * 0x87c37b91114253d5ULL;
     }
 
-    return hash;
+    hash = hash_mix(hash);
+    return (uint32_t)(hash ^ (hash >> 32));
 }
 
 /* Compares the two provided packets. If the packets differ in any fashion,
@@ -148,14 +205,183 @@ static void usage(char *prog) {
 	printf("\t%s [options] traceA traceB\n\n", prog);
 	printf("Supported options:\n");
 	printf("\t-m <max>   Stop after <max> differences have been reported\n");
-	printf("\t-w <window> The size of the window to match packets with\n");
+	printf("\t-w <window> The size of the window to match packets with, i.e. how\n");
+	printf("\t            far out of order a packet can be (default 20)\n");
         printf("\t-a <traceA-diff.pcap> Write traceA differences to file\n");
         printf("\t-b <traceB-diff.pcap> Write traceB differences to file\n");
 	return;
 
 }
 
-void fill_packet_windows(libtrace_t *trace_a, libtrace_t *trace_b,
+static void *read_input(void *arg) {
+
+    struct diff_input *in = (struct diff_input *)arg;
+    libtrace_packet_t *packet;
+    uintptr_t slot;
+    int ret;
+
+    while ((slot = (uintptr_t)libtrace_ringbuffer_read(&in->empty)) != 0) {
+
+        packet = in->pool[slot - 1];
+        ret = trace_read_packet(in->trace, packet);
+        if (ret <= 0) {
+            in->status = ret;
+            break;
+        }
+
+        /* The format may reuse this buffer on the next read, which
+         * would be too soon when we are reading ahead */
+        if (packet->buf_control == TRACE_CTRL_EXTERNAL) {
+            libtrace_packet_t *copy = trace_copy_packet(packet);
+            trace_destroy_packet(packet);
+            in->pool[slot - 1] = packet = copy;
+        }
+
+        in->pool_status[slot - 1] = ret;
+        in->pool_hash[slot - 1] = hash_packet(packet);
+        libtrace_ringbuffer_write(&in->full, (void *)slot);
+    }
+
+    /* The full ring always has room for every slot plus this */
+    libtrace_ringbuffer_write(&in->full, NULL);
+    return NULL;
+}
+
+static int start_input(struct diff_input *in, char *uri, int window_size) {
+
+    uint32_t buckets = 1;
+    int i;
+
+    in->trace = trace_create(uri);
+    if (trace_is_err(in->trace)) {
+        trace_perror(in->trace, "Opening trace file");
+        return -1;
+    }
+    if (trace_start(in->trace)) {
+        trace_perror(in->trace, "Starting trace");
+        trace_destroy(in->trace);
+        return -1;
+    }
+
+    /* Keep the buckets at most half full */
+    while (buckets < (uint32_t)window_size * 2)
+        buckets <<= 1;
+    in->buckets = malloc(sizeof(int) * buckets);
+    if (in->buckets == NULL) {
+        fprintf(stderr, "Unable to allocate memory, try reducing window size\n");
+        trace_destroy(in->trace);
+        return -1;
+    }
+    memset(in->buckets, -1, sizeof(int) * buckets);
+    in->bucket_mask = buckets - 1;
+
+    libtrace_ringbuffer_init(&in->full, READ_AHEAD + 1,
+                             LIBTRACE_RINGBUFFER_BLOCKING);
+    libtrace_ringbuffer_init(&in->empty, READ_AHEAD + 1,
+                             LIBTRACE_RINGBUFFER_BLOCKING);
+    for (i = 0; i < READ_AHEAD; i++) {
+        in->pool[i] = trace_create_packet();
+        libtrace_ringbuffer_write(&in->empty, (void *)(uintptr_t)(i + 1));
+    }
+
+    if (pthread_create(&in->thread, NULL, read_input, in) != 0) {
+        perror("pthread_create");
+        for (i = 0; i < READ_AHEAD; i++)
+            trace_destroy_packet(in->pool[i]);
+        libtrace_ringbuffer_destroy(&in->full);
+        libtrace_ringbuffer_destroy(&in->empty);
+        free(in->buckets);
+        trace_destroy(in->trace);
+        return -1;
+    }
+    in->running = true;
+    return 0;
+}
+
+/* Stops the reader for a trace, leaving the trace itself to be checked for
+ * errors and destroyed by the caller */
+static void stop_input(struct diff_input *in) {
+
+    int i;
+
+    if (!in->running)
+        return;
+
+    if (!in->finished) {
+        /* Wake the reader if it is waiting for an empty packet, then
+         * discard anything it still manages to read until it stops */
+        libtrace_ringbuffer_write(&in->empty, NULL);
+        while (libtrace_ringbuffer_read(&in->full) != NULL)
+            ;
+        in->finished = true;
+    }
+    pthread_join(in->thread, NULL);
+    in->running = false;
+
+    for (i = 0; i < READ_AHEAD; i++)
+        trace_destroy_packet(in->pool[i]);
+    libtrace_ringbuffer_destroy(&in->full);
+    libtrace_ringbuffer_destroy(&in->empty);
+    free(in->buckets);
+}
+
+static void index_remove(struct diff_input *in, struct packet_window *window,
+                         int pos) {
+
+    int *link = &in->buckets[window[pos].hash & in->bucket_mask];
+
+    while (*link != pos)
+        link = &window[*link].next;
+    *link = window[pos].next;
+    window[pos].indexed = false;
+}
+
+static void index_insert(struct diff_input *in, struct packet_window *window,
+                         int pos) {
+
+    int *bucket = &in->buckets[window[pos].hash & in->bucket_mask];
+
+    window[pos].next = *bucket;
+    *bucket = pos;
+    window[pos].indexed = true;
+}
+
+/* Replaces the packet in a window slot with the next one from the trace */
+static void read_window_packet(struct diff_input *in,
+                               struct packet_window *window, int pos) {
+
+    libtrace_packet_t *packet;
+    uintptr_t slot;
+
+    if (window[pos].indexed)
+        index_remove(in, window, pos);
+
+    if (in->finished) {
+        window[pos].status = in->status;
+        window[pos].hash = 0;
+        return;
+    }
+
+    slot = (uintptr_t)libtrace_ringbuffer_read(&in->full);
+    if (slot == 0) {
+        in->finished = true;
+        window[pos].status = in->status;
+        window[pos].hash = 0;
+        return;
+    }
+
+    /* Give the reader the packet we are finished with in exchange */
+    packet = window[pos].packet;
+    window[pos].packet = in->pool[slot - 1];
+    window[pos].status = in->pool_status[slot - 1];
+    window[pos].hash = in->pool_hash[slot - 1];
+    in->pool[slot - 1] = packet;
+    libtrace_ringbuffer_write(&in->empty, (void *)slot);
+
+    index_insert(in, window, pos);
+}
+
+void fill_packet_windows(struct diff_input *input_a, struct diff_input *input_b,
                          struct packet_window *a, int a_pos,
                          struct packet_window *b, int b_pos,
                          int window_size) {
@@ -167,13 +393,7 @@ void fill_packet_windows(libtrace_t *trace_a, libtrace_t *trace_b,
         pos = i % window_size;
 
         if (a[pos].status == INT_MAX) {
-            a[pos].status =
-                trace_read_packet(trace_a, a[pos].packet);
-            if (a[pos].status > 0) {
-                a[pos].hash = hash_packet(a[pos].packet);
-            } else {
-                a[pos].hash = 0;
-            }
+            read_window_packet(input_a, a, pos);
         }
     }
 
@@ -183,22 +403,53 @@ void fill_packet_windows(libtrace_t *trace_a, libtrace_t *trace_b,
         pos = i % window_size;
 
         if (b[pos].status == INT_MAX) {
-            b[pos].status =
-                trace_read_packet(trace_b, b[pos].packet);
-            if (b[pos].status > 0) {
-                b[pos].hash = hash_packet(b[i % window_size].packet);
-            } else {
-                b[pos].hash = 0;
-            }
+            read_window_packet(input_b, b, pos);
         }
     }
 
 }
 
+/* Looks for the first packet in the window that matches 'target', out of
+ * the window_size - 1 packets after position 'from'. Only the packets that
+ * share the hash of 'target' are compared.
+ *
+ * Returns true and sets 'found' to the position of the match if there is
+ * one.
+ */
+static bool find_match(struct diff_input *in, struct packet_window *window,
+                       uint64_t from, int window_size,
+                       struct packet_window *target, uint64_t *found) {
+
+    int start = from % window_size;
+    int best = window_size;
+    int pos, dist;
+
+    for (pos = in->buckets[target->hash & in->bucket_mask]; pos != -1;
+         pos = window[pos].next) {
+
+        if (window[pos].hash != target->hash)
+            continue;
+
+        dist = (pos - start + window_size) % window_size;
+        if (dist == 0 || dist >= best)
+            continue;
+
+        if (compare_packets(target, &window[pos]))
+            best = dist;
+    }
+
+    if (best == window_size)
+        return false;
+
+    *found = from + best;
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
 
         struct packet_window *packet_window[2];
+        struct diff_input input[2];
         int window_size = 20, i;
         uint64_t w_pos[2], j;
         uint64_t b_pos[2];
@@ -238,6 +489,10 @@ int main(int argc, char *argv[])
 				break;
 			case 'w':
                                 window_size=atoi(optarg);
+                                if (window_size < 1) {
+                                        fprintf(stderr, "-w option must be at least 1\n");
+                                        return 1;
+                                }
                                 break;
                         case 'a':
                                 output_file[0] = optarg;
@@ -279,31 +534,18 @@ int main(int argc, char *argv[])
             }
             packet_window[0][i].status = INT_MAX;
             packet_window[1][i].status = INT_MAX;
+            packet_window[0][i].indexed = false;
+            packet_window[1][i].indexed = false;
         }
 
-        /* create and start trace A */
-	trace[0] = trace_create(argv[optind++]);
-	if (trace_is_err(trace[0])) {
-		trace_perror(trace[0],"Opening trace file");
-		return -1;
-	}
-	if (trace_start(trace[0])) {
-		trace_perror(trace[0],"Starting trace");
-		trace_destroy(trace[0]);
-		return -1;
-	}
-
-        /* create and start trace B */
-	trace[1] = trace_create(argv[optind++]);
-	if (trace_is_err(trace[1])) {
-		trace_perror(trace[1],"Opening trace file");
-		return -1;
-	}
-	if (trace_start(trace[1])) {
-		trace_perror(trace[1],"Starting trace");
-		trace_destroy(trace[1]);
-		return -1;
-	}
+        /* create and start trace A and B, each with its own reader */
+        memset(input, 0, sizeof(input));
+        if (start_input(&input[0], argv[optind++], window_size) < 0)
+                return -1;
+        if (start_input(&input[1], argv[optind++], window_size) < 0)
+                return -1;
+        trace[0] = input[0].trace;
+        trace[1] = input[1].trace;
 
         /* if we are outputting to file create output trace */
         if (output_file[0] != NULL) {
@@ -332,7 +574,7 @@ int main(int argc, char *argv[])
         }
 
         /* prime the packet window */
-        fill_packet_windows(trace[0], trace[1],
+        fill_packet_windows(&input[0], &input[1],
                             packet_window[0], w_pos[0],
                             packet_window[1], w_pos[1],
                             window_size);
@@ -346,16 +588,10 @@ int main(int argc, char *argv[])
 
                /* record position of window B */
                b_pos[1] = w_pos[1];
-               /* advance window B */
-               w_pos[1] += 1;
 
-               /* advance window B until a packet match is found or we reach the end of the window */
-               while (!(match = compare_packets(&packet_window[0][w_pos[0] % window_size],
-                                                &packet_window[1][w_pos[1] % window_size]))
-                      && w_pos[1] < b_pos[1] + window_size) {
-
-                   w_pos[1] += 1;
-               }
+               /* look for a match in the rest of window B */
+               match = find_match(&input[1], packet_window[1], b_pos[1], window_size,
+                                  &packet_window[0][w_pos[0] % window_size], &w_pos[1]);
 
                /* if a match was found */
                if (match) {
@@ -370,23 +606,17 @@ int main(int argc, char *argv[])
                    }
 
                    /* refil the packet windows */
-                   fill_packet_windows(trace[0], trace[1], packet_window[0], w_pos[0],
+                   fill_packet_windows(&input[0], &input[1], packet_window[0], w_pos[0],
                                        packet_window[1], w_pos[1], window_size);
 
                /* if a match was not found */
                } else {
 
-                   w_pos[1] = b_pos[1];
                    b_pos[0] = w_pos[0];
-                   w_pos[0] += 1;
-
-                   /* advance window A until a packet match is found or we reach the end of window A */
-                   while (!(match = compare_packets(&packet_window[0][w_pos[0] % window_size],
-                                                    &packet_window[1][w_pos[1] % window_size]))
-                          && w_pos[0] < b_pos[0] + window_size) {
 
-                       w_pos[0] += 1;
-                   }
+                   /* look for a match in the rest of window A */
+                   match = find_match(&input[0], packet_window[0], b_pos[0], window_size,
+                                      &packet_window[1][w_pos[1] % window_size], &w_pos[0]);
 
                    /* if a match was found */
                    if (match) {
@@ -401,7 +631,7 @@ int main(int argc, char *argv[])
                        }
 
                        /* refil the packet window */
-                       fill_packet_windows(trace[0], trace[1], packet_window[0], w_pos[0],
+                       fill_packet_windows(&input[0], &input[1], packet_window[0], w_pos[0],
                                            packet_window[1], w_pos[1], window_size);
 
                    /* if a match was not found */
@@ -415,7 +645,7 @@ int main(int argc, char *argv[])
                        packet_window[1][b_pos[1] % window_size].status = INT_MAX;
 
                        /* refil the packet window */
-                       fill_packet_windows(trace[0], trace[1], packet_window[0], w_pos[0],
+                       fill_packet_windows(&input[0], &input[1], packet_window[0], w_pos[0],
                                            packet_window[1], w_pos[1], window_size);
 
                        /* check max diff */
@@ -436,7 +666,7 @@ int main(int argc, char *argv[])
                 packet_window[0][w_pos[0] % window_size].status = INT_MAX;
                 packet_window[1][w_pos[1] % window_size].status = INT_MAX;
                 /* refill packet windows */
-                fill_packet_windows(trace[0], trace[1],
+                fill_packet_windows(&input[0], &input[1],
                             packet_window[0], w_pos[0],
                             packet_window[1], w_pos[1],
                             window_size);
@@ -452,7 +682,7 @@ int main(int argc, char *argv[])
 
             dump_packet(output[0], packet_window[0][w_pos[0] % window_size].packet);
             packet_window[0][w_pos[0] % window_size].status = INT_MAX;
-            fill_packet_windows(trace[0], trace[1],
+            fill_packet_windows(&input[0], &input[1],
                                 packet_window[0], w_pos[0],
                                 packet_window[1], w_pos[1],
                                 window_size);
@@ -469,7 +699,7 @@ int main(int argc, char *argv[])
 
             dump_packet(output[1], packet_window[1][w_pos[1] % window_size].packet);
             packet_window[1][w_pos[1] % window_size].status = INT_MAX;
-            fill_packet_windows(trace[0], trace[1],
+            fill_packet_windows(&input[0], &input[1],
                                 packet_window[0], w_pos[0],
                                 packet_window[1], w_pos[1],
                                 window_size);
@@ -483,6 +713,10 @@ int main(int argc, char *argv[])
         }
 end:
 
+        /* stop reading before looking at the traces */
+        stop_input(&input[0]);
+        stop_input(&input[1]);
+
         /* check for errors */
 	if (trace_is_err(trace[0])) {
 		trace_perror(trace[0],"Reading packets");
@@ -33,6 +33,40 @@
 #include <getopt.h>
 #include <signal.h>
 #include <string.h>
+#include <pthread.h>
+#include "data-struct/ring_buffer.h"
+
+/* Number of packets each input is allowed to read ahead of the merge */
+#define READ_AHEAD 64
+
+/* Each input is read by its own thread, which fills packets from a fixed
+ * pool and passes them to the merge through the 'full' ring. The merge hands
+ * them back through the 'empty' ring once they have been written. The rings
+ * carry pool slot numbers starting at 1, so that NULL can be used to signal
+ * the end of the input (on 'full') or to tell the reader to stop (on
+ * 'empty').
+ *
+ * Reading a packet can change trace state that the accessors of packets
+ * already read rely on, such as the pcapng interface table. The reader looks
+ * up the timestamp of each packet itself and passes it along with the
+ * packet, and holds 'lock' while reading so that the merge can take it
+ * before writing a packet out.
+ */
+struct merge_input {
+	char *uri;
+	libtrace_t *trace;
+	libtrace_packet_t *pool[READ_AHEAD];
+	uint64_t pool_ts[READ_AHEAD];
+	libtrace_ringbuffer_t full;
+	libtrace_ringbuffer_t empty;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	bool running;
+
+	/* Packet currently waiting to be merged, and its timestamp */
+	uintptr_t slot;
+	uint64_t ts;
+};
 
 static void usage(char *argv0)
 {
@@ -59,13 +93,186 @@ static void cleanup_signal(int sig UNUSED)
 	trace_interrupt();
 }
 
+static void *read_input(void *arg)
+{
+	struct merge_input *in = (struct merge_input *)arg;
+
+	while (!done) {
+		uintptr_t slot = (uintptr_t)libtrace_ringbuffer_read(&in->empty);
+		libtrace_packet_t *packet;
+		int ret;
+
+		if (slot == 0)
+			break;
+
+		packet = in->pool[slot - 1];
+		pthread_mutex_lock(&in->lock);
+		ret = trace_read_packet(in->trace, packet);
+		pthread_mutex_unlock(&in->lock);
+		if (ret < 0) {
+			trace_perror(in->trace, "%s", in->uri);
+			break;
+		}
+		if (ret == 0)
+			break;
+
+		/* The format may reuse this buffer on the next read, which
+		 * would be too soon when we are reading ahead */
+		if (packet->buf_control == TRACE_CTRL_EXTERNAL) {
+			libtrace_packet_t *copy = trace_copy_packet(packet);
+			if (!copy) {
+				fprintf(stderr, "%s: unable to copy packet\n",
+						in->uri);
+				break;
+			}
+			trace_destroy_packet(packet);
+			in->pool[slot - 1] = copy;
+			packet = copy;
+		}
+		in->pool_ts[slot - 1] = trace_get_erf_timestamp(packet);
+		libtrace_ringbuffer_write(&in->full, (void *)slot);
+	}
+
+	/* The full ring always has room for every slot plus this */
+	libtrace_ringbuffer_write(&in->full, NULL);
+	return NULL;
+}
+
+static int start_input(struct merge_input *in, char *uri)
+{
+	int i;
+
+	in->uri = uri;
+	in->trace = trace_create(uri);
+	if (trace_is_err(in->trace)) {
+		trace_perror(in->trace,"trace_create");
+		return -1;
+	}
+	if (trace_start(in->trace)==-1) {
+		trace_perror(in->trace,"trace_start");
+		return -1;
+	}
+
+	libtrace_ringbuffer_init(&in->full, READ_AHEAD + 1,
+			LIBTRACE_RINGBUFFER_BLOCKING);
+	libtrace_ringbuffer_init(&in->empty, READ_AHEAD + 1,
+			LIBTRACE_RINGBUFFER_BLOCKING);
+	for (i = 0; i < READ_AHEAD; i++) {
+		in->pool[i] = trace_create_packet();
+		libtrace_ringbuffer_write(&in->empty, (void *)(uintptr_t)(i + 1));
+	}
+
+	pthread_mutex_init(&in->lock, NULL);
+	if (pthread_create(&in->thread, NULL, read_input, in) != 0) {
+		perror("pthread_create");
+		return -1;
+	}
+	in->running = true;
+	return 0;
+}
+
+/* Stops the reader for an input and releases everything belonging to it.
+ * 'finished' is true if the reader has already signalled the end of the
+ * input.
+ */
+static void stop_input(struct merge_input *in, bool finished)
+{
+	int i;
+
+	if (!in->running)
+		return;
+
+	if (!finished) {
+		/* Wake the reader if it is waiting for an empty packet, then
+		 * discard anything it still manages to read until it stops */
+		libtrace_ringbuffer_write(&in->empty, NULL);
+		while (libtrace_ringbuffer_read(&in->full) != NULL)
+			;
+	}
+	pthread_join(in->thread, NULL);
+	in->running = false;
+
+	for (i = 0; i < READ_AHEAD; i++)
+		trace_destroy_packet(in->pool[i]);
+	libtrace_ringbuffer_destroy(&in->full);
+	libtrace_ringbuffer_destroy(&in->empty);
+	pthread_mutex_destroy(&in->lock);
+	trace_destroy(in->trace);
+	in->trace = NULL;
+}
+
+/* Fetches the next packet with a timestamp from an input. Meta packets
+ * without a timestamp are written out straight away.
+ *
+ * Returns false once the input has no packets left.
+ */
+static bool next_packet(struct merge_input *in, libtrace_out_t *output)
+{
+	while (1) {
+		libtrace_packet_t *packet;
+
+		in->slot = (uintptr_t)libtrace_ringbuffer_read(&in->full);
+		if (in->slot == 0) {
+			/* Reader has finished, so no packets are in use */
+			stop_input(in, true);
+			return false;
+		}
+
+		packet = in->pool[in->slot - 1];
+		in->ts = in->pool_ts[in->slot - 1];
+		if (in->ts != 0 || !IS_LIBTRACE_META_PACKET(packet))
+			return true;
+
+		pthread_mutex_lock(&in->lock);
+		trace_write_packet(output, packet);
+		pthread_mutex_unlock(&in->lock);
+		libtrace_ringbuffer_write(&in->empty, (void *)in->slot);
+	}
+}
+
+static inline bool merge_before(struct merge_input *inputs, int a, int b)
+{
+	/* Break ties in favour of the earlier input */
+	if (inputs[a].ts != inputs[b].ts)
+		return inputs[a].ts < inputs[b].ts;
+	return a < b;
+}
+
+/* Restores the heap property below position 'pos' of a min-heap of input
+ * indexes ordered by the timestamp of each input's current packet */
+static void heap_sift_down(int *heap, int count, struct merge_input *inputs,
+		int pos)
+{
+	while (1) {
+		int smallest = pos;
+		int left = pos * 2 + 1;
+		int right = left + 1;
+		int tmp;
+
+		if (left < count && merge_before(inputs, heap[left],
+					heap[smallest]))
+			smallest = left;
+		if (right < count && merge_before(inputs, heap[right],
+					heap[smallest]))
+			smallest = right;
+		if (smallest == pos)
+			break;
+
+		tmp = heap[pos];
+		heap[pos] = heap[smallest];
+		heap[smallest] = tmp;
+		pos = smallest;
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	
 	struct libtrace_out_t *output;
-	struct libtrace_t **input;
-	struct libtrace_packet_t **packet;
-	bool *live;
+	struct merge_input *inputs;
+	int *heap;
+	int heapsize = 0;
+	int ninputs;
 	int interfaces_per_input=0;
 	bool unique_packets=false;
 	int i=0;
@@ -74,7 +281,6 @@ int main(int argc, char *argv[])
 	int compression=-1;
 	char *compress_type_str = NULL;
 	trace_option_compresstype_t compress_type = TRACE_OPTION_COMPRESSTYPE_NONE;
-
 	while (1) {
 		int option_index;
 		struct option long_options[] = {
@@ -188,83 +394,40 @@ int main(int argc, char *argv[])
 	sigaction(SIGINT,&sigact,NULL);
 	sigaction(SIGTERM,&sigact,NULL);
 
-	input=calloc((size_t)(argc-optind),sizeof(struct libtrace_t *));
-	packet=calloc((size_t)(argc-optind),sizeof(struct libtrace_packet_t *));
-	live=calloc((size_t)(argc-optind),sizeof(bool));
-	for(i=0;i<argc-optind;++i) {
-		libtrace_t *f;
-		libtrace_packet_t *p;
-		f=trace_create(argv[i+optind]);
-		if (trace_is_err(f)) {
-			trace_perror(f,"trace_create");
-			return 1;
-		}
-		if (trace_start(f)==-1) {
-			trace_perror(f,"trace_start");
+	ninputs = argc - optind;
+	inputs = calloc((size_t)ninputs, sizeof(struct merge_input));
+	heap = calloc((size_t)ninputs, sizeof(int));
+	for(i=0;i<ninputs;++i) {
+		if (start_input(&inputs[i], argv[i+optind]) == -1)
 			return 1;
-		}
-		p=trace_create_packet();
-		input[i]=f;
-		packet[i]=p;
-		if (trace_read_packet(f,packet[i])>0){
-			live[i]=true;
-		}
 	}
 
-	while(1) {
-		uint64_t oldest_ts=0;
-                uint64_t this_ts = 0;
-		int oldest=-1;
+	/* Inputs are added in order, so the first packet of each one is
+	 * fetched (and any leading meta packets written) in that order too */
+	for(i=0;i<ninputs;++i) {
+		if (next_packet(&inputs[i], output))
+			heap[heapsize++] = i;
+	}
+	for (i = heapsize / 2 - 1; i >= 0; i--)
+		heap_sift_down(heap, heapsize, inputs, i);
+
+	while(heapsize > 0) {
+		struct merge_input *in;
+		libtrace_packet_t *packet;
+		int oldest = heap[0];
+		uint64_t oldest_ts;
 		int curr_dir;
-		if (done)
-			break;
-		for(i=0;i<argc-optind;++i) {
-			if (!live[i] && input[i]) {
-				int ret=trace_read_packet(input[i],packet[i]);
-				if (ret<0) {
-					/* Error */
-					trace_perror(input[i], "%s", argv[i+2]);
-					trace_destroy(input[i]);
-					input[i]=NULL;
-				}
-				else if (ret==0) {
-					/* EOF */
-					trace_destroy(input[i]);
-					input[i]=NULL;
-				}
-				else
-					live[i]=true;
-			}
-			if (live[i]) {
-                                this_ts = trace_get_erf_timestamp(packet[i]);
-
-				/* If the ts is 0 and its a meta packet just output it
-				 * and read new packets until we get one that has a ts */
-				while (this_ts == 0 && IS_LIBTRACE_META_PACKET(packet[i])) {
-					trace_write_packet(output,packet[i]);
-
-					/* read another packet, break if reached EOF */
-					if (trace_read_packet(input[i],packet[i])>0) {
-                                        	live[i] = true;
-                                	} else { break; }
-					this_ts = trace_get_erf_timestamp(packet[i]);
-				}
 
-				if (this_ts != 0 && (oldest==-1 ||
-				                oldest_ts>this_ts)) {
-        				oldest=i;
-	        			oldest_ts=this_ts;
-			        }
-                        }
-		}
-		/* We have run out of packets! */
-		if (oldest==-1) {
+		if (done)
 			break;
-		}
 
-		live[oldest]=false;
+		in = &inputs[oldest];
+		packet = in->pool[in->slot - 1];
+		oldest_ts = in->ts;
 
-		curr_dir = trace_get_direction(packet[oldest]);
+		/* Writing looks at the packet through its input trace */
+		pthread_mutex_lock(&in->lock);
+		curr_dir = trace_get_direction(packet);
 		if (curr_dir != -1 && interfaces_per_input) {
 			/* If there are more interfaces than
 			 * interfaces_per_input, then clamp at the 
@@ -275,22 +438,33 @@ int main(int argc, char *argv[])
 				? curr_dir
 				: interfaces_per_input-1;
 
-			trace_set_direction(packet[oldest],
+			trace_set_direction(packet,
 					oldest*interfaces_per_input
 					+curr_dir);
 		}
 
-		if (unique_packets && oldest_ts == last_ts)
-			continue;
-
-		if (trace_write_packet(output,packet[oldest]) < 0) {
-			trace_perror_output(output, "trace_write_packet");
-			break;
+		if (!unique_packets || oldest_ts != last_ts) {
+			if (trace_write_packet(output,packet) < 0) {
+				pthread_mutex_unlock(&in->lock);
+				trace_perror_output(output, "trace_write_packet");
+				break;
+			}
+			last_ts=oldest_ts;
 		}
-
-		last_ts=oldest_ts;
-		
+		pthread_mutex_unlock(&in->lock);
+
+		/* Replace this input's packet with its next one, or drop the
+		 * input from the heap if it has run out */
+		libtrace_ringbuffer_write(&in->empty, (void *)in->slot);
+		if (!next_packet(in, output))
+			heap[0] = heap[--heapsize];
+		heap_sift_down(heap, heapsize, inputs, 0);
 	}
+
+	for(i=0;i<ninputs;++i)
+		stop_input(&inputs[i], false);
+	free(inputs);
+	free(heap);
 	trace_destroy_output(output);
 
 	return 0;
@@ -25,32 +25,115 @@
  */
 
 
-#include <libtrace.h>
+#include "libtrace_parallel.h"
 #include <err.h>
 #include <time.h>
 #include "libpacketdump.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
 #include <getopt.h>
 
+static struct libtrace_t *trace = NULL;
+static uint64_t count = 0;
+static uint64_t numpackets = 0;
+
+static void cleanup_signal(int signal)
+{
+	(void)signal;
+	if (trace)
+		trace_pstop(trace);
+}
+
 void usage(char *argv0) 
 {
 	fprintf(stderr,"Usage:\n"
 	"%s flags inputfile\n"
 	"-f --filter=expr	BPF filter specification, quoted\n"
 	"-c --count=num		terminate after num packets\n"
+	"-t --threads=num	decode packets using num threads\n"
 	"-H --libtrace-help	Print libtrace runtime documentation\n"
 		,argv0);
 	exit(0);
 }
 
+static void *start_decode(libtrace_t *trace, libtrace_thread_t *t,
+		void *global)
+{
+	libtrace_dump_buffer_t *buffer = (libtrace_dump_buffer_t *)
+		malloc(sizeof(libtrace_dump_buffer_t));
+
+	trace_dump_buffer_init(buffer);
+	return buffer;
+}
+
+/* Decodes the packet in this thread, then hands the text to the reporter
+ * which prints it in the order the packets were read */
+static libtrace_packet_t *per_packet(libtrace_t *trace, libtrace_thread_t *t,
+		void *global, void *tls, libtrace_packet_t *packet)
+{
+	libtrace_dump_buffer_t *buffer = (libtrace_dump_buffer_t *)tls;
+	libtrace_generic_t result;
+	char *text;
+
+	if (packet->type < TRACE_RT_DATA_SIMPLE &&
+		packet->type != TRACE_RT_PCAPNG_META &&
+		packet->type != TRACE_RT_ERF_META)
+		/* Ignore RT messages */
+		return packet;
+
+	trace_dump_buffer_reset(buffer);
+	if (trace_dump_packet_buffer(packet, buffer) == -1)
+		fprintf(stderr, "Out of memory decoding packet\n");
+
+	text = (char *)malloc(buffer->len + 1);
+	if (!text) {
+		fprintf(stderr, "Out of memory decoding packet\n");
+		return packet;
+	}
+	memcpy(text, buffer->data ? buffer->data : "", buffer->len);
+	text[buffer->len] = '\0';
+	result.ptr = text;
+	trace_publish_result(trace, t, trace_packet_get_order(packet), result,
+			RESULT_USER);
+	return packet;
+}
+
+static void stop_decode(libtrace_t *trace, libtrace_thread_t *t,
+		void *global, void *tls)
+{
+	libtrace_dump_buffer_t *buffer = (libtrace_dump_buffer_t *)tls;
+
+	trace_dump_buffer_free(buffer);
+	free(buffer);
+}
+
+static void print_packet(libtrace_t *trace, libtrace_thread_t *sender,
+		void *global, void *tls, libtrace_result_t *result)
+{
+	char *text = (char *)result->value.ptr;
+
+	if (result->type != RESULT_USER)
+		return;
+
+	/* Packets already decoded when the count was reached are dropped */
+	if (!count || numpackets < count) {
+		fputs(text, stdout);
+		numpackets++;
+		/* Losing a race with the end of the trace isn't an error */
+		if (count && numpackets == count && trace_pstop(trace) == -1)
+			trace_get_err(trace);
+	}
+	free(text);
+}
+
 int main(int argc,char **argv)
 {
-	struct libtrace_t *trace = NULL;
-	struct libtrace_packet_t *packet = trace_create_packet();
 	struct libtrace_filter_t *filter=NULL;
-	uint64_t count=0;
-	uint64_t numpackets=0;
+	libtrace_callback_set_t *pktcbs, *repcbs;
+	struct sigaction sigact;
+	int threads = 0;
 	
 
 	if (argc<2)
@@ -61,11 +144,12 @@ int main(int argc,char **argv)
 		struct option long_options[] = {
 			{ "filter",	   1, 0, 'f' },
 			{ "count",	   1, 0, 'c' },
+			{ "threads",	   1, 0, 't' },
 			{ "libtrace-help", 0, 0, 'H' },
 			{ NULL,		   0, 0, 0   },
 		};
 
-		int c=getopt_long(argc,argv,"f:c:H",
+		int c=getopt_long(argc,argv,"f:c:t:H",
 				long_options, &option_index);
 		if (c == -1)
 			break;
@@ -78,6 +162,11 @@ int main(int argc,char **argv)
 				filter=trace_create_filter(optarg);
 				break;
 			case 'c': count=atol(optarg); break;
+			case 't':
+				  threads=atoi(optarg);
+				  if (threads <= 0)
+					  threads = 1;
+				  break;
 			case 'H': 
 				  trace_help(); 
 				  exit(1);
@@ -88,7 +177,17 @@ int main(int argc,char **argv)
 		}
 	}
 				
-	
+	pktcbs = trace_create_callback_set();
+	trace_set_starting_cb(pktcbs, start_decode);
+	trace_set_packet_cb(pktcbs, per_packet);
+	trace_set_stopping_cb(pktcbs, stop_decode);
+
+	repcbs = trace_create_callback_set();
+	trace_set_result_cb(repcbs, print_packet);
+
+	sigact.sa_handler = cleanup_signal;
+	sigemptyset(&sigact.sa_mask);
+	sigact.sa_flags = SA_RESTART;
 
 	while(optind <argc) {
 		trace = trace_create(argv[optind]);
@@ -100,37 +199,41 @@ int main(int argc,char **argv)
 			continue;
 		}
 
-		trace_start(trace);
-		if (trace_is_err(trace)) {
-			trace_perror(trace,"trace_start");
+		/* Print the packets in the order they were read, however
+		 * many threads decode them */
+		trace_set_combiner(trace, &combiner_ordered,
+				(libtrace_generic_t){0});
+		if (threads)
+			trace_set_perpkt_threads(trace, threads);
+		if (filter && trace_config(trace, TRACE_OPTION_FILTER,
+					filter) == -1) {
+			trace_perror(trace, "Configuring filter");
 			trace_destroy(trace);
 			continue;
 		}
-		while(trace_read_packet(trace,packet)> 0 ){
-			if (filter && !trace_apply_filter(filter,packet))
-				continue;
-			if (packet->type < TRACE_RT_DATA_SIMPLE &&
-				packet->type != TRACE_RT_PCAPNG_META &&
-				packet->type != TRACE_RT_ERF_META)
-				/* Ignore RT messages */
-				continue;
-                        if (trace_is_err(trace)) {
-                                break;
-                        }
-			trace_dump_packet(packet);
-
-			if(count) {
-				numpackets++;
-				if (numpackets == count)
-					break;
-			}
+
+		if (trace_pstart(trace, NULL, pktcbs, repcbs) == -1) {
+			trace_perror(trace,"trace_pstart");
+			trace_destroy(trace);
+			continue;
 		}
+
+		sigaction(SIGINT, &sigact, NULL);
+		sigaction(SIGTERM, &sigact, NULL);
+
+		trace_join(trace);
 		printf("\n");
 
 		if (trace_is_err(trace)) {
 			trace_perror(trace, "trace_read_packet");
 		}
 		trace_destroy(trace);
+		trace = NULL;
 	}
+
+	trace_destroy_callback_set(pktcbs);
+	trace_destroy_callback_set(repcbs);
+	if (filter)
+		trace_destroy_filter(filter);
 	return 0;
 }
@@ -32,47 +32,27 @@
 #include <stdlib.h>
 #include "libtrace.h"
 #include "tracereport.h"
-#include "contain.h"
+#include "flowset.h"
 #include "report.h"
 
-static uint64_t flow_count=0;
+static flowset_t *flowset = NULL;
+static int flow_sketch = 0;
 
-struct fivetuple_t {
-	uint32_t ipa;
-	uint32_t ipb;
-	uint16_t porta;
-	uint16_t portb;
-	uint8_t prot;
-};
-
-static int fivetuplecmp(struct fivetuple_t a, struct fivetuple_t b)
+void flow_set_sketch(int sketch)
 {
-	if (a.porta != b.porta) return a.porta-b.porta;
-	if (a.portb != b.portb) return a.portb-b.portb;
-	if (a.ipa != b.ipa) return a.ipa-b.ipa;
-	if (a.ipb != b.ipb) return a.ipb-b.ipb;
-	return a.prot - b.prot;
+	flow_sketch = sketch;
 }
 
-static int flowset_cmp(const splay *a, const splay *b);
-SET_CREATE(flowset,struct fivetuple_t,fivetuplecmp)
-
 void flow_per_packet(struct libtrace_packet_t *packet)
 {
-	struct libtrace_ip *ip = trace_get_ip(packet);
-	struct fivetuple_t ft;
-	if (!ip)
-		return;
-	ft.ipa=ip->ip_src.s_addr;
-	ft.ipb=ip->ip_dst.s_addr;
-	ft.porta=trace_get_source_port(packet);
-	ft.portb=trace_get_destination_port(packet);
-	ft.prot = 0;
-
-	if (!SET_CONTAINS(flowset,ft)) {
-		SET_INSERT(flowset,ft);
-		flow_count++;
+	if (!flowset) {
+		flowset = flowset_create(flow_sketch);
+		if (!flowset) {
+			fprintf(stderr, "Unable to allocate the flow set\n");
+			exit(1);
+		}
 	}
+	flowset_insert_packet(flowset, packet);
 }
 
 void flow_report(void)
@@ -82,6 +62,13 @@ void flow_report(void)
 		perror("fopen");
 		return;
 	}
-	fprintf(out, "Flows: %" PRIu64 "\n",flow_count);
+	if (flowset && flowset_is_sketch(flowset))
+		fprintf(out, "Flows: %" PRIu64 " (estimated)\n",
+				flowset_count(flowset));
+	else
+		fprintf(out, "Flows: %" PRIu64 "\n",
+				flowset ? flowset_count(flowset) : 0);
 	fclose(out);
+	flowset_destroy(flowset);
+	flowset = NULL;
 }
@@ -0,0 +1,346 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+
+
+
+#include <inttypes.h>
+#include <lt_inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libtrace.h"
+#include "flowset.h"
+
+#define FLOWTAB_INITIAL_SIZE 4096
+
+/* Number of sketch registers is 2^SKETCH_BITS */
+#define SKETCH_BITS 14
+#define SKETCH_REGISTERS (1 << SKETCH_BITS)
+
+/* Keys are padded to a multiple of 8 bytes and any padding is zeroed so
+ * that they can be hashed and compared as plain memory.
+ */
+struct flowkey_v4 {
+	uint32_t ipa;
+	uint32_t ipb;
+	uint16_t porta;
+	uint16_t portb;
+	uint8_t prot;
+	uint8_t pad[3];
+};
+
+struct flowkey_v6 {
+	uint8_t ipa[16];
+	uint8_t ipb[16];
+	uint16_t porta;
+	uint16_t portb;
+	uint8_t prot;
+	uint8_t pad[3];
+};
+
+/* An open-addressed table of fixed size keys. tags[i] holds the upper 32
+ * bits of the hash of the key stored in slot i (with the low bit forced on)
+ * or zero if the slot is empty, so most probes never look at the key.
+ */
+struct flowtab {
+	uint32_t *tags;
+	uint8_t *keys;
+	size_t keylen;
+	uint64_t size;
+	uint64_t used;
+};
+
+struct flowset {
+	int sketch;
+	struct flowtab v4;
+	struct flowtab v6;
+	uint8_t *registers;
+};
+
+static inline uint64_t fmix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t flowkey_hash(const void *key, size_t keylen)
+{
+	const uint8_t *p = (const uint8_t *)key;
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ keylen;
+	uint64_t w;
+	size_t i;
+
+	for (i = 0; i < keylen; i += sizeof(w)) {
+		memcpy(&w, p + i, sizeof(w));
+		h = (h ^ fmix64(w)) * 0x9e3779b97f4a7c15ULL;
+	}
+	return fmix64(h);
+}
+
+static inline uint32_t flowtab_tag(uint64_t hash)
+{
+	return (uint32_t)(hash >> 32) | 1;
+}
+
+static void flowtab_free(struct flowtab *tab)
+{
+	free(tab->tags);
+	free(tab->keys);
+	tab->tags = NULL;
+	tab->keys = NULL;
+}
+
+static int flowtab_init(struct flowtab *tab, size_t keylen)
+{
+	tab->keylen = keylen;
+	tab->size = FLOWTAB_INITIAL_SIZE;
+	tab->used = 0;
+	tab->tags = calloc(tab->size, sizeof(uint32_t));
+	tab->keys = malloc(tab->size * keylen);
+	if (!tab->tags || !tab->keys) {
+		flowtab_free(tab);
+		return -1;
+	}
+	return 0;
+}
+
+/* Places a key known not to be in the table into the first free slot */
+static void flowtab_place(struct flowtab *tab, const void *key,
+		uint64_t hash)
+{
+	uint64_t mask = tab->size - 1;
+	uint64_t i = hash & mask;
+
+	while (tab->tags[i] != 0)
+		i = (i + 1) & mask;
+	tab->tags[i] = flowtab_tag(hash);
+	memcpy(tab->keys + i * tab->keylen, key, tab->keylen);
+	tab->used ++;
+}
+
+/* Doubles the table. If the larger table can't be allocated the old one is
+ * kept, which still has free slots since it is only ever 3/4 full.
+ */
+static void flowtab_grow(struct flowtab *tab)
+{
+	struct flowtab old = *tab;
+	uint64_t i;
+
+	tab->size = old.size * 2;
+	tab->used = 0;
+	tab->tags = calloc(tab->size, sizeof(uint32_t));
+	tab->keys = malloc(tab->size * tab->keylen);
+	if (!tab->tags || !tab->keys) {
+		flowtab_free(tab);
+		*tab = old;
+		return;
+	}
+
+	for (i = 0; i < old.size; i++) {
+		const uint8_t *key = old.keys + i * old.keylen;
+		if (old.tags[i] == 0)
+			continue;
+		flowtab_place(tab, key, flowkey_hash(key, old.keylen));
+	}
+	flowtab_free(&old);
+}
+
+/* Returns 1 if the key was inserted, 0 if it was already present and -1 if
+ * the table is full because it could not be grown
+ */
+static int flowtab_insert(struct flowtab *tab, const void *key, uint64_t hash)
+{
+	uint64_t mask = tab->size - 1;
+	uint64_t i = hash & mask;
+	uint32_t tag = flowtab_tag(hash);
+
+	/* Always leave one empty slot so that probing terminates */
+	if (tab->used + 1 >= tab->size)
+		return -1;
+
+	while (tab->tags[i] != 0) {
+		if (tab->tags[i] == tag && memcmp(tab->keys + i * tab->keylen,
+					key, tab->keylen) == 0)
+			return 0;
+		i = (i + 1) & mask;
+	}
+
+	tab->tags[i] = tag;
+	memcpy(tab->keys + i * tab->keylen, key, tab->keylen);
+	tab->used ++;
+
+	/* Keep the load factor below 3/4 so probe sequences stay short */
+	if (tab->used * 4 >= tab->size * 3)
+		flowtab_grow(tab);
+	return 1;
+}
+
+static void sketch_add(uint8_t *registers, uint64_t hash)
+{
+	uint32_t idx = hash >> (64 - SKETCH_BITS);
+	uint64_t rest = hash << SKETCH_BITS;
+	uint8_t rank;
+
+	if (rest == 0)
+		rank = 64 - SKETCH_BITS + 1;
+	else
+		rank = __builtin_clzll(rest) + 1;
+
+	if (rank > registers[idx])
+		registers[idx] = rank;
+}
+
+static uint64_t sketch_estimate(const uint8_t *registers)
+{
+	double m = SKETCH_REGISTERS;
+	double alpha = 0.7213 / (1.0 + 1.079 / m);
+	double sum = 0.0;
+	double estimate;
+	int zeroes = 0;
+	int i;
+
+	for (i = 0; i < SKETCH_REGISTERS; i++) {
+		sum += ldexp(1.0, -registers[i]);
+		if (registers[i] == 0)
+			zeroes ++;
+	}
+
+	estimate = alpha * m * m / sum;
+
+	/* Small cardinalities are better estimated by linear counting */
+	if (estimate <= 2.5 * m && zeroes != 0)
+		estimate = m * log(m / zeroes);
+
+	return (uint64_t)(estimate + 0.5);
+}
+
+flowset_t *flowset_create(int sketch)
+{
+	flowset_t *set = calloc(1, sizeof(flowset_t));
+
+	if (!set)
+		return NULL;
+
+	set->sketch = sketch;
+	if (sketch) {
+		set->registers = calloc(SKETCH_REGISTERS, sizeof(uint8_t));
+		if (!set->registers) {
+			free(set);
+			return NULL;
+		}
+	} else if (flowtab_init(&set->v4, sizeof(struct flowkey_v4)) < 0
+			|| flowtab_init(&set->v6,
+				sizeof(struct flowkey_v6)) < 0) {
+		/* flowtab_free() copes with a table that was never set up */
+		flowtab_free(&set->v4);
+		flowtab_free(&set->v6);
+		free(set);
+		return NULL;
+	}
+	return set;
+}
+
+int flowset_insert_packet(flowset_t *set, libtrace_packet_t *packet)
+{
+	uint16_t ethertype;
+	uint32_t remaining;
+	uint64_t hash;
+	void *l3;
+	struct flowtab *tab;
+	union {
+		struct flowkey_v4 v4;
+		struct flowkey_v6 v6;
+	} key;
+	size_t keylen;
+
+	l3 = trace_get_layer3(packet, &ethertype, &remaining);
+	if (!l3)
+		return -1;
+
+	memset(&key, 0, sizeof(key));
+
+	if (ethertype == TRACE_ETHERTYPE_IP &&
+			remaining >= sizeof(libtrace_ip_t)) {
+		libtrace_ip_t *ip = (libtrace_ip_t *)l3;
+		key.v4.ipa = ip->ip_src.s_addr;
+		key.v4.ipb = ip->ip_dst.s_addr;
+		key.v4.prot = ip->ip_p;
+		key.v4.porta = trace_get_source_port(packet);
+		key.v4.portb = trace_get_destination_port(packet);
+		keylen = sizeof(key.v4);
+		tab = &set->v4;
+	} else if (ethertype == TRACE_ETHERTYPE_IPV6 &&
+			remaining >= sizeof(libtrace_ip6_t)) {
+		libtrace_ip6_t *ip6 = (libtrace_ip6_t *)l3;
+		memcpy(key.v6.ipa, &ip6->ip_src, sizeof(key.v6.ipa));
+		memcpy(key.v6.ipb, &ip6->ip_dst, sizeof(key.v6.ipb));
+		if (trace_get_transport(packet, &key.v6.prot, NULL) == NULL)
+			key.v6.prot = ip6->nxt;
+		key.v6.porta = trace_get_source_port(packet);
+		key.v6.portb = trace_get_destination_port(packet);
+		keylen = sizeof(key.v6);
+		tab = &set->v6;
+	} else {
+		return -1;
+	}
+
+	hash = flowkey_hash(&key, keylen);
+
+	if (set->sketch) {
+		sketch_add(set->registers, hash);
+		return 0;
+	}
+	return flowtab_insert(tab, &key, hash);
+}
+
+uint64_t flowset_count(const flowset_t *set)
+{
+	if (set->sketch)
+		return sketch_estimate(set->registers);
+	return set->v4.used + set->v6.used;
+}
+
+int flowset_is_sketch(const flowset_t *set)
+{
+	return set->sketch;
+}
+
+void flowset_destroy(flowset_t *set)
+{
+	if (!set)
+		return;
+	if (set->sketch) {
+		free(set->registers);
+	} else {
+		flowtab_free(&set->v4);
+		flowtab_free(&set->v6);
+	}
+	free(set);
+}
@@ -0,0 +1,72 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+
+
+
+#ifndef _FLOWSET_
+#define _FLOWSET_
+
+#include "libtrace.h"
+
+/* Set of unique unidirectional 5-tuples
+ *
+ * Flows are stored in open-addressed (linear probing) hash tables with
+ * fixed-size keys, one table for IPv4 flows (16 byte keys) and one for
+ * IPv6 flows (40 byte keys), so a lookup normally touches a single cache
+ * line rather than walking a tree.
+ *
+ * If the set is created in sketch mode no keys are stored at all. Instead
+ * each flow hash is fed into a HyperLogLog sketch, which gives an estimate
+ * of the number of distinct flows (typically within 1%) using a fixed
+ * 16 KiB of memory regardless of how many flows are seen.
+ */
+
+typedef struct flowset flowset_t;
+
+/* Creates an empty flow set. If sketch is non-zero, only an estimate of the
+ * flow count is maintained. Returns NULL if the set could not be allocated.
+ */
+flowset_t *flowset_create(int sketch);
+
+/* Adds the flow that a packet belongs to into the set.
+ *
+ * Returns 1 if the flow was not in the set already, 0 if it was (or the set
+ * is in sketch mode) and -1 if the packet has no IPv4 or IPv6 header or the
+ * set has run out of memory.
+ */
+int flowset_insert_packet(flowset_t *set, libtrace_packet_t *packet);
+
+/* Returns the number of distinct flows in the set. For sets created in
+ * sketch mode this is an estimate.
+ */
+uint64_t flowset_count(const flowset_t *set);
+
+/* Returns non-zero if the set is only estimating the flow count */
+int flowset_is_sketch(const flowset_t *set);
+
+void flowset_destroy(flowset_t *set);
+
+#endif /* _FLOWSET_ */
@@ -44,6 +44,8 @@ void tcpseg_per_packet(struct libtrace_packet_t *packet);
 
 void drops_per_trace(libtrace_t *trace);
 
+void flow_set_sketch(int sketch);
+
 void dir_report(void);
 void error_report(void);
 void flow_report(void);
@@ -138,6 +138,7 @@ static void usage(char *argv0)
 	"-c --count=N		Stop after reading N packets\n"
 	"-e --error		Report packet errors (e.g. checksum failures, rxerrors)\n"
 	"-F --flow		Report flows\n"
+	"-a --approxflows	Estimate the flow count using fixed memory\n"
 	"-m --misc		Report misc information (start/end times, duration, pps)\n"
 	"-P --protocol		Report transport protocols\n"
 	"-p --port		Report port numbers\n"
@@ -167,6 +168,7 @@ int main(int argc, char *argv[]) {
 	while (1) {
 		int option_index;
 		struct option long_options[] = {
+			{ "approxflows",	0, 0, 'a' },
 			{ "count", 		1, 0, 'c' },
 			{ "ecn",		0, 0, 'C' },
 			{ "direction", 		0, 0, 'd' },
@@ -186,12 +188,16 @@ int main(int argc, char *argv[]) {
 			{ "ttl", 		0, 0, 't' },
 			{ NULL, 		0, 0, 0 }
 		};
-		opt = getopt_long(argc, argv, "Df:HemFPpTtOondCsc:", 
+		opt = getopt_long(argc, argv, "aDf:HemFPpTtOondCsc:", 
 				long_options, &option_index);
 		if (opt == -1)
 			break;
 		
 		switch (opt) {
+			case 'a':
+				flow_set_sketch(1);
+				reports_required |= REPORT_TYPE_FLOW;
+				break;
 			case 'c':
 				count = atoi(optarg);
 				break;
@@ -25,7 +25,7 @@
  */
 
 
-#include <libtrace.h>
+#include <libtrace_parallel.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
@@ -36,6 +36,7 @@
 #include <assert.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
 
 /* Global variables */
 struct libtrace_out_t *output = NULL;
@@ -56,6 +57,47 @@ int verbose=0;
 int compress_level=-1;
 trace_option_compresstype_t compress_type = TRACE_OPTION_COMPRESSTYPE_NONE;
 char *output_base = NULL;
+int threads = 0;
+
+/* A packet read from the input, along with what deciding which file it
+ * goes in needs to know about it */
+typedef struct split_packet {
+	libtrace_packet_t *packet;	/* copy to be written, or NULL */
+	double seconds;
+	uint64_t caplen;
+	bool corrupt;
+} split_packet_t;
+
+/* Output files are compressed and written by a pool of writer threads, so
+ * reading and splitting aren't held up by compression. Each file is only
+ * written by one thread, so its packets are written in order */
+typedef struct write_job {
+	libtrace_out_t *output;
+	libtrace_packet_t *packet;	/* NULL to close the output */
+	struct write_job *next;
+} write_job_t;
+
+typedef struct writer {
+	pthread_t thread;
+	pthread_cond_t work;
+	write_job_t *head;
+	write_job_t *tail;
+} writer_t;
+
+/* Reading stops while this many jobs are waiting for the writers */
+#define MAX_QUEUED_JOBS 4096
+
+writer_t *writers = NULL;
+int nwriters = 4;
+int output_writer = 0;
+uint64_t queued_jobs = 0;
+bool writers_stopping = false;
+volatile int write_failed = 0;
+pthread_mutex_t writers_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t writers_drained = PTHREAD_COND_INITIALIZER;
+
+/* trace_construct_packet() sets up a dead trace the first time it is used */
+pthread_mutex_t jump_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 static char *strdupcat(char *str,char *app)
@@ -87,7 +129,9 @@ static int usage(char *argv0)
         "-j --jump=n            Jump to the nth IP header\n"
 	"-H --libtrace-help	Print libtrace runtime documentation\n"
 	"-S --snaplen		Snap packets at the specified length\n"
+	"-t --threads=n		Read packets using n threads\n"
 	"-v --verbose		Output statistics\n"
+	"-w --writers=n		Compress and write output using n threads\n"
 	"-z --compress-level	Set compression level\n"
 	"-Z --compress-type 	Set compression type\n"
 	,argv0);
@@ -96,6 +140,13 @@ static int usage(char *argv0)
 
 volatile int done=0;
 
+/* The reporter must keep taking results while a parallel input is being
+ * stopped, so it only tells the main thread to stop it. This is also
+ * signalled once the reporter has finished with the input */
+pthread_mutex_t reading_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t reading_cond = PTHREAD_COND_INITIALIZER;
+bool reading_finished = false;
+
 static void cleanup_signal(int sig)
 {
 	(void)sig;
@@ -103,6 +154,163 @@ static void cleanup_signal(int sig)
 	trace_interrupt();
 }
 
+static void wake_main(bool finished)
+{
+	pthread_mutex_lock(&reading_lock);
+	if (finished)
+		reading_finished = true;
+	pthread_cond_signal(&reading_cond);
+	pthread_mutex_unlock(&reading_lock);
+}
+
+/* Waits for the reporter to finish with a parallel input, stopping the input
+ * first if we are done with it. Signal handlers can only set 'done', so this
+ * wakes up regularly to check it */
+static void wait_for_input(libtrace_t *input)
+{
+	struct timespec ts;
+	bool stop;
+
+	pthread_mutex_lock(&reading_lock);
+	while (!done && !reading_finished) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 100000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&reading_cond, &reading_lock, &ts);
+	}
+	stop = !reading_finished;
+	pthread_mutex_unlock(&reading_lock);
+
+	/* Losing a race with the end of the trace isn't an error */
+	if (stop && trace_pstop(input) == -1)
+		trace_get_err(input);
+	trace_join(input);
+}
+
+static void *writer_thread(void *data)
+{
+	writer_t *w = (writer_t *)data;
+	write_job_t *jobs, *job;
+	uint64_t n;
+
+	pthread_mutex_lock(&writers_lock);
+	while (1) {
+		while (!w->head && !writers_stopping)
+			pthread_cond_wait(&w->work, &writers_lock);
+		if (!w->head)
+			break;
+
+		/* Take everything queued so far in one go */
+		jobs = w->head;
+		w->head = w->tail = NULL;
+		pthread_mutex_unlock(&writers_lock);
+
+		for (n = 0; jobs != NULL; n++) {
+			job = jobs;
+			jobs = job->next;
+			if (!job->packet) {
+				trace_destroy_output(job->output);
+			} else {
+				if (!write_failed && trace_write_packet(
+						job->output, job->packet)==-1) {
+					trace_perror_output(job->output,
+							"write_packet");
+					write_failed = 1;
+				}
+				trace_destroy_packet(job->packet);
+			}
+			free(job);
+		}
+
+		pthread_mutex_lock(&writers_lock);
+		queued_jobs -= n;
+		pthread_cond_broadcast(&writers_drained);
+	}
+	pthread_mutex_unlock(&writers_lock);
+	return NULL;
+}
+
+static int start_writers(void)
+{
+	int i;
+
+	writers = calloc(nwriters, sizeof(writer_t));
+	if (!writers)
+		return -1;
+	for (i = 0; i < nwriters; i++) {
+		pthread_cond_init(&writers[i].work, NULL);
+		if (pthread_create(&writers[i].thread, NULL, writer_thread,
+					&writers[i]) != 0) {
+			perror("pthread_create");
+			nwriters = i;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Finishes writing everything that is queued, then stops the writers */
+static void stop_writers(void)
+{
+	int i;
+
+	pthread_mutex_lock(&writers_lock);
+	writers_stopping = true;
+	for (i = 0; i < nwriters; i++)
+		pthread_cond_signal(&writers[i].work);
+	pthread_mutex_unlock(&writers_lock);
+
+	for (i = 0; i < nwriters; i++) {
+		pthread_join(writers[i].thread, NULL);
+		pthread_cond_destroy(&writers[i].work);
+	}
+	free(writers);
+}
+
+/* Hands a packet to the thread writing the current output, which then owns
+ * the packet. A NULL packet closes the output once it has been written */
+static void queue_write(libtrace_out_t *out, libtrace_packet_t *packet)
+{
+	writer_t *w = &writers[output_writer];
+	write_job_t *job = malloc(sizeof(write_job_t));
+
+	if (!job) {
+		fprintf(stderr, "Out of memory queueing packets to write\n");
+		exit(1);
+	}
+	job->output = out;
+	job->packet = packet;
+	job->next = NULL;
+
+	pthread_mutex_lock(&writers_lock);
+	if (w->tail)
+		w->tail->next = job;
+	else
+		w->head = job;
+	w->tail = job;
+	queued_jobs++;
+	pthread_cond_signal(&w->work);
+	pthread_mutex_unlock(&writers_lock);
+}
+
+/* Waits until no more than 'limit' jobs are waiting for the writers */
+static void wait_for_writers(uint64_t limit)
+{
+	pthread_mutex_lock(&writers_lock);
+	while (queued_jobs > limit)
+		pthread_cond_wait(&writers_drained, &writers_lock);
+	pthread_mutex_unlock(&writers_lock);
+}
+
+static void close_output(void)
+{
+	queue_write(output, NULL);
+	output = NULL;
+}
+
 
 static libtrace_packet_t *perform_jump(libtrace_packet_t *packet, int jump)
 {
@@ -184,35 +392,95 @@ static libtrace_packet_t *perform_jump(libtrace_packet_t *packet, int jump)
 }
 
 
-/* Return values:
- *  1 = continue reading packets
- *  0 = stop reading packets, cos we're done
- *  -1 = stop reading packets, we've got an error
+/* Does the work for a packet that doesn't depend on the packets before it,
+ * which is done by the threads reading the input. Returns NULL if the
+ * packet isn't going to be written.
  */
-static int per_packet(libtrace_packet_t **packet) {
-        if (IS_LIBTRACE_META_PACKET((*packet))) {
-                return 1;
+static split_packet_t *prepare_packet(libtrace_packet_t *packet)
+{
+	split_packet_t *sp;
+
+        if (IS_LIBTRACE_META_PACKET(packet)) {
+                return NULL;
         }
 
-	if (trace_get_link_type(*packet) == -1) {
-		fprintf(stderr, "Halted due to being unable to determine linktype - input trace may be corrupt.\n");
-		return -1;
+	sp = calloc(1, sizeof(split_packet_t));
+	if (!sp) {
+		fprintf(stderr, "Out of memory reading packets\n");
+		exit(1);
+	}
+
+	if (trace_get_link_type(packet) == -1) {
+		sp->corrupt = true;
+		return sp;
 	}
 
 	if (snaplen>0) {
-		trace_set_capture_length(*packet,snaplen);
+		trace_set_capture_length(packet,snaplen);
 	}
 
-	if (trace_get_seconds(*packet)<starttime) {
-		return 1;
+	sp->seconds = trace_get_seconds(packet);
+	if (sp->seconds<starttime) {
+		free(sp);
+		return NULL;
+	}
+	sp->caplen = trace_get_capture_length(packet);
+
+	/* Some traces we have are padded (usually with 0x00), so
+	 * lets sort that out now and truncate them properly
+	 */
+
+	if (trace_get_capture_length(packet)
+			> trace_get_wire_length(packet)) {
+		trace_set_capture_length(packet,
+                        trace_get_wire_length(packet));
 	}
 
-	if (trace_get_seconds(*packet)>endtime) {
+        /* Support "jump"ping to the nth IP header. */
+        if (jumpopt) {
+            /* Skip headers. If an IP header isn't found on the nth layer
+             * down the packet is skipped */
+            pthread_mutex_lock(&jump_lock);
+            sp->packet = perform_jump(packet, jumpopt);
+            pthread_mutex_unlock(&jump_lock);
+        } else {
+            /* The packet is kept until a writer gets to it */
+            sp->packet = trace_copy_packet(packet);
+        }
+
+	return sp;
+}
+
+static void discard_packet(split_packet_t *sp)
+{
+	if (sp->packet)
+		trace_destroy_packet(sp->packet);
+	free(sp);
+}
+
+/* Decides which file each packet goes in, in the order they were read.
+ *
+ * Return values:
+ *  1 = continue reading packets
+ *  0 = stop reading packets, cos we're done
+ *  -1 = stop reading packets, we've got an error
+ */
+static int split_packet(split_packet_t *sp) {
+	if (write_failed) {
+		return -1;
+	}
+
+	if (sp->corrupt) {
+		fprintf(stderr, "Halted due to being unable to determine linktype - input trace may be corrupt.\n");
+		return -1;
+	}
+
+	if (sp->seconds>endtime) {
 		return 0;
 	}
 
 	if (firsttime==0) {
-		time_t now = trace_get_seconds(*packet);
+		time_t now = sp->seconds;
 		if (now != 0 && starttime != 0) {
 			firsttime=now-((now - starttime)%interval);
 		}
@@ -221,22 +489,19 @@ static int per_packet(libtrace_packet_t **packet) {
 		}
 	}
 
-	if (output && trace_get_seconds(*packet)>firsttime+interval) {
-		trace_destroy_output(output);
-		output=NULL;
+	if (output && sp->seconds>firsttime+interval) {
+		close_output();
 		firsttime+=interval;
 	}
 
 	if (output && pktcount%count==0) {
-		trace_destroy_output(output);
-		output=NULL;
+		close_output();
 	}
 
 	pktcount++;
-	totbytes+=trace_get_capture_length(*packet);
+	totbytes+=sp->caplen;
 	if (output && totbytes-totbyteslast>=bytes) {
-		trace_destroy_output(output);
-		output=NULL;
+		close_output();
 		totbyteslast=totbytes;
 	}
 	if (!output) {
@@ -310,44 +575,70 @@ static int per_packet(libtrace_packet_t **packet) {
 		}
 		free(buffer);
 		filescreated ++;
+		/* Spread the files over the writers */
+		output_writer = (output_writer + 1) % nwriters;
 	}
 
-	/* Some traces we have are padded (usually with 0x00), so
-	 * lets sort that out now and truncate them properly
-	 */
-
-	if (trace_get_capture_length(*packet)
-			> trace_get_wire_length(*packet)) {
-		trace_set_capture_length(*packet,
-                        trace_get_wire_length(*packet));
+	if (sp->packet) {
+		queue_write(output, sp->packet);
+		sp->packet = NULL;
 	}
 
-        /* Support "jump"ping to the nth IP header. */
-        if (jumpopt) {
-            /* Skip headers */
-            struct libtrace_packet_t *newpacket = perform_jump(*packet, jumpopt);
-            if (newpacket) {
-		/* If an IP header was found on the nth layer down
-		 * write out the packet  */
-	        if (trace_write_packet(output, newpacket)==-1) {
-                    trace_perror_output(output,"write_packet");
-                    return -1;
-        	}
-		/* Then destroy the packet */
-		trace_destroy_packet(newpacket);
-            }
-            else /* Skip packet - Payload ran out before getting to nth layer */
-                return 1;
-        } else {
+	return 1;
 
-	    if (trace_write_packet(output, *packet)==-1) {
-		trace_perror_output(output,"write_packet");
-		return -1;
-	    }
+}
+
+static libtrace_packet_t *read_packet(libtrace_t *trace, libtrace_thread_t *t,
+		void *global, void *tls, libtrace_packet_t *packet)
+{
+	libtrace_generic_t result;
+	split_packet_t *sp;
+
+	(void)global;
+	(void)tls;
+	if (done)
+		return packet;
+
+	/* Don't read too far ahead of the writers */
+	wait_for_writers(MAX_QUEUED_JOBS);
+
+	sp = prepare_packet(packet);
+	if (sp) {
+		result.ptr = sp;
+		trace_publish_result(trace, t, trace_packet_get_order(packet),
+				result, RESULT_USER);
 	}
+	return packet;
+}
 
-	return 1;
+static void split_result(libtrace_t *trace, libtrace_thread_t *sender,
+		void *global, void *tls, libtrace_result_t *result)
+{
+	split_packet_t *sp = (split_packet_t *)result->value.ptr;
+
+	(void)trace;
+	(void)sender;
+	(void)global;
+	(void)tls;
+	if (result->type != RESULT_USER)
+		return;
+
+	/* Packets already read when we decided to stop are dropped */
+	if (!done && split_packet(sp) < 1) {
+		done = 1;
+		wake_main(false);
+	}
+	discard_packet(sp);
+}
 
+static void split_stopping(libtrace_t *trace, libtrace_thread_t *t,
+		void *global, void *tls)
+{
+	(void)trace;
+	(void)t;
+	(void)global;
+	(void)tls;
+	wake_main(true);
 }
 
 int main(int argc, char *argv[])
@@ -356,8 +647,10 @@ int main(int argc, char *argv[])
 	struct libtrace_filter_t *filter=NULL;
 	struct libtrace_t *input = NULL;
 	struct libtrace_packet_t *packet = trace_create_packet();
+	libtrace_callback_set_t *pktcbs, *repcbs;
 	struct sigaction sigact;
-	int i;
+	split_packet_t *sp;
+	int i, ret;
 
 	if (argc<2) {
 		usage(argv[0]);
@@ -378,13 +671,15 @@ int main(int argc, char *argv[])
 			{ "libtrace-help", 0, 0, 'H' },
 			{ "maxfiles", 	   1, 0, 'm' },
 			{ "snaplen",	   1, 0, 'S' },
+			{ "threads",	   1, 0, 't' },
 			{ "verbose",       0, 0, 'v' },
+			{ "writers",	   1, 0, 'w' },
 			{ "compress-level", 1, 0, 'z' },
 			{ "compress-type", 1, 0, 'Z' },
 			{ NULL, 	   0, 0, 0   },
 		};
 
-		int c=getopt_long(argc, argv, "j:f:c:b:s:e:i:m:S:Hvz:Z:",
+		int c=getopt_long(argc, argv, "j:f:c:b:s:e:i:m:S:t:Hvw:z:Z:",
 				long_options, &option_index);
 
 		if (c==-1)
@@ -409,6 +704,14 @@ int main(int argc, char *argv[])
 				  break;
 			case 'S': snaplen=atoi(optarg);
 				  break;
+			case 't': threads=atoi(optarg);
+				  if (threads <= 0)
+					  threads = 1;
+				  break;
+			case 'w': nwriters=atoi(optarg);
+				  if (nwriters <= 0)
+					  nwriters = 1;
+				  break;
 			case 'H':
 				  trace_help();
 				  exit(1);
@@ -482,6 +785,17 @@ int main(int argc, char *argv[])
 	signal(SIGINT,&cleanup_signal);
 	signal(SIGTERM,&cleanup_signal);
 
+	if (start_writers() == -1) {
+		fprintf(stderr, "Unable to start writer threads\n");
+		return 1;
+	}
+
+	pktcbs = trace_create_callback_set();
+	trace_set_packet_cb(pktcbs, read_packet);
+	repcbs = trace_create_callback_set();
+	trace_set_result_cb(repcbs, split_result);
+	trace_set_stopping_cb(repcbs, split_stopping);
+
 	for (i = optind; i < argc - 1; i++) {
 
 
@@ -498,18 +812,49 @@ int main(int argc, char *argv[])
 			return 1;
 		}
 
-		if (trace_start(input)==-1) {
-			trace_perror(input,"%s",argv[i]);
-			return 1;
-		}
+		if (starttime != 0) {
+			/* Seeking straight to the start time means reading the
+			 * trace in this thread. If the format can't seek,
+			 * prepare_packet() discards the earlier packets */
+			if (trace_start(input)==-1) {
+				trace_perror(input,"%s",argv[i]);
+				return 1;
+			}
+			if (trace_seek_seconds(input, starttime) == -1) {
+				trace_get_err(input);
+			}
 
-		while (trace_read_packet(input,packet)>0) {
-			if (per_packet(&packet) < 1)
-				done = 1;
-			if (done)
-				break;
+			while (trace_read_packet(input,packet)>0) {
+				wait_for_writers(MAX_QUEUED_JOBS);
+				sp = prepare_packet(packet);
+				if (sp) {
+					ret = split_packet(sp);
+					discard_packet(sp);
+					if (ret < 1)
+						done = 1;
+				}
+				if (done)
+					break;
+			}
+		} else {
+			/* Packets are read by several threads, but split
+			 * in the order they were read */
+			trace_set_combiner(input, &combiner_ordered,
+					(libtrace_generic_t){0});
+			if (threads)
+				trace_set_perpkt_threads(input, threads);
+			reading_finished = false;
+			if (trace_pstart(input, NULL, pktcbs, repcbs) == -1) {
+				trace_perror(input,"%s",argv[i]);
+				return 1;
+			}
+			wait_for_input(input);
 		}
 
+		/* The packets still waiting to be written refer to the input,
+		 * so they have to be written before it is destroyed */
+		wait_for_writers(0);
+
 		if (trace_is_err(input)) {
 			trace_perror(input,"Reading packets");
 			trace_destroy(input);
@@ -544,8 +889,11 @@ int main(int argc, char *argv[])
 
 	
 	if (output)
-		trace_destroy_output(output);
+		close_output();
+	stop_writers();
 
+	trace_destroy_callback_set(pktcbs);
+	trace_destroy_callback_set(repcbs);
 	trace_destroy_packet(packet);
 
 	return 0;
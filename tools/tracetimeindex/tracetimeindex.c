@@ -0,0 +1,107 @@
+/*
+ *
+ * Copyright (c) 2007-2016 The University of Waikato, Hamilton, New Zealand.
+ * All rights reserved.
+ *
+ * This file is part of libtrace.
+ *
+ * This code has been developed by the University of Waikato WAND
+ * research group. For further information please see http://www.wand.net.nz/
+ *
+ * libtrace is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtrace is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ */
+
+
+/*
+ * This program builds the time index used to seek within pcap and pcapng
+ * trace files, and saves it next to each trace it is given
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "libtrace.h"
+
+static void usage(char *argv0)
+{
+	fprintf(stderr,"Usage: %s [-h|--help] [--stride|-s packets] libtraceuri...\n",argv0);
+}
+
+static int index_trace(char *uri, uint32_t stride)
+{
+	libtrace_t *trace;
+	int ret = 0;
+
+	trace = trace_create(uri);
+	if (trace_is_err(trace)) {
+		trace_perror(trace, "%s", uri);
+		ret = -1;
+	} else if (trace_build_time_index(trace, stride) == -1) {
+		trace_perror(trace, "Indexing %s", uri);
+		ret = -1;
+	}
+	trace_destroy(trace);
+	return ret;
+}
+
+int main(int argc, char *argv[]) {
+
+	int i, ret = 0;
+	int stride = 0;
+
+	while(1) {
+		int option_index;
+		struct option long_options[] = {
+			{ "help",	0, 0, 'h' },
+			{ "stride",	1, 0, 's' },
+			{ NULL,		0, 0, 0   },
+		};
+
+		int c=getopt_long(argc, argv, "hs:",
+				long_options, &option_index);
+
+		if (c==-1)
+			break;
+
+		switch (c) {
+			case 'h':
+				usage(argv[0]);
+				return 1;
+			case 's':
+				stride = atoi(optarg);
+				if (stride < 0)
+					stride = 0;
+				break;
+			default:
+				fprintf(stderr,"Unknown option: %c\n",c);
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for(i=optind;i<argc;++i) {
+		if (index_trace(argv[i], (uint32_t)stride) == -1)
+			ret = 1;
+	}
+
+	return ret;
+}